@@ -35,6 +35,7 @@ public class CapsaCore : ModuleRules
 			{
 				"CoreUObject",
 				"Engine",
+				"NetCore",
 				"Slate",
 				"SlateCore",
 				"DeveloperSettings",
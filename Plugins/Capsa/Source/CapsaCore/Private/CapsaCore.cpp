@@ -2,18 +2,23 @@
 
 #include "CapsaCore.h"
 
+#include "Telemetry/CapsaTelemetry.h"
+
 
 #define LOCTEXT_NAMESPACE "FCapsaCoreModule"
 
 void FCapsaCoreModule::StartupModule()
 {
+	FCapsaTelemetry::Get().Start();
 }
 
 void FCapsaCoreModule::ShutdownModule()
 {
+	FCapsaTelemetry::Get().Stop();
 }
 
 #undef LOCTEXT_NAMESPACE
 
 IMPLEMENT_MODULE( FCapsaCoreModule, CapsaCore )
 DEFINE_LOG_CATEGORY( LogCapsaCore );
+DEFINE_LOG_CATEGORY( LogCapsaThrottle );
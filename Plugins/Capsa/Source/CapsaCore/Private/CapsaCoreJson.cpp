@@ -2,6 +2,9 @@
 
 #include "CapsaCoreJson.h"
 
+#include "Encoding/CapsaJsonReader.h"
+#include "Encoding/CapsaJsonWriter.h"
+
 #include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaCoreJson)
 
 TSharedPtr<FJsonObject> UCapsaCoreJsonHelpers::TMapToJsonObject( const TMap<FString, FString>& Map )
@@ -16,14 +19,65 @@ TSharedPtr<FJsonObject> UCapsaCoreJsonHelpers::TMapToJsonObject( const TMap<FStr
 	return JsonObject;
 }
 
-TSharedPtr<FJsonObject> UCapsaCoreJsonHelpers::TMapToJsonObject( const TMap<FString, TSharedPtr<FJsonValue>>& Map )
+void UCapsaCoreJsonHelpers::WriteAuthenticationRequest( const FCapsaAuthenticationRequest& Request, TArray<uint8>& OutJson )
 {
-	TSharedPtr<FJsonObject> JsonObject = MakeShareable( new FJsonObject );
+	OutJson.Reset();
+
+	FCapsaJsonWriter Writer( OutJson );
+	Writer.BeginObject();
+	Writer.WriteString( TEXT( "key" ), Request.Key );
+	Writer.WriteString( TEXT( "platform" ), Request.Platform );
+	Writer.WriteString( TEXT( "type" ), Request.Type );
+	Writer.EndObject();
+}
+
+bool UCapsaCoreJsonHelpers::ReadAuthenticationResponse( TConstArrayView<uint8> Json, FCapsaAuthenticationResponse& OutResponse )
+{
+	FCapsaJsonReader Reader( Json );
+	const bool bRead = Reader.ReadObject( [&Reader, &OutResponse]( FAnsiStringView Key )
+		{
+			if( Key.Equals( ANSITEXTVIEW( "token" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return Reader.ReadString( OutResponse.Token );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "logId" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return Reader.ReadString( OutResponse.LogId );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "linkWeb" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return Reader.ReadString( OutResponse.LinkWeb );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "expiry" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return Reader.ReadString( OutResponse.Expiry );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "policy" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return FCapsaLogPolicy::Read( Reader, OutResponse.Policy.Emplace() );
+			}
+			return Reader.SkipValue();
+		} );
 
-	for( const TPair<FString, TSharedPtr<FJsonValue>>& Item : Map)
+	return bRead == true && OutResponse.Token.IsEmpty() == false && OutResponse.LogId.IsEmpty() == false;
+}
+
+bool UCapsaCoreJsonHelpers::ReadLogPolicy( TConstArrayView<uint8> Json, TOptional<FCapsaLogPolicy>& OutPolicy )
+{
+	OutPolicy.Reset();
+
+	FCapsaJsonReader Reader( Json );
+	if( Reader.IsAtEnd() == true )
 	{
-		JsonObject->SetField( Item.Key, Item.Value );
+		return true;
 	}
-	
-	return JsonObject;
+
+	return Reader.ReadObject( [&Reader, &OutPolicy]( FAnsiStringView Key )
+		{
+			if( Key.Equals( ANSITEXTVIEW( "policy" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return FCapsaLogPolicy::Read( Reader, OutPolicy.Emplace() );
+			}
+			return Reader.SkipValue();
+		} );
 }
@@ -3,26 +3,72 @@
 #include "CapsaCoreSubsystem.h"
 
 #include "CapsaCore.h"
-#include "CapsaCoreAsync.h"
 #include "CapsaCoreJson.h"
-#include "JsonObjectConverter.h"
-#include "FunctionLibrary/CapsaCoreFunctionLibrary.h"
+#include "Telemetry/CapsaFrameBudget.h"
 #include "Settings/CapsaSettings.h"
+#include "Settings/CapsaSettingsSnapshot.h"
 
-#include "Interfaces/IHttpRequest.h"
-#include "Interfaces/IHttpResponse.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/CoreMisc.h"
+#include "Policies/CondensedJsonPrintPolicy.h"
 
-#include "Kismet/GameplayStatics.h"
-#include "GameFramework/GameModeBase.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaCoreSubsystem)
 
 
+/**
+* Sets the verbosity of a Log Category through the log suppression system, which also keeps track of the default
+* verbosity to return to, and ignores categories that are not registered.
+* Names are validated, they come from the Capsa Server and must not turn into a different command.
+*
+* @param Category The Log Category to change.
+* @param Verbosity The verbosity to set, or "Default" for the configured verbosity.
+*/
+static void SetLogCategoryVerbosity( const FName& Category, const TCHAR* Verbosity )
+{
+    const FString CategoryName = Category.ToString();
+    bool bValid = CategoryName.IsEmpty() == false
+        && CategoryName.Equals( TEXT( "list" ), ESearchCase::IgnoreCase ) == false
+        && CategoryName.Equals( TEXT( "reset" ), ESearchCase::IgnoreCase ) == false;
+    for( const TCHAR Character : CategoryName )
+    {
+        bValid &= FChar::IsAlnum( Character ) == true || Character == TEXT( '_' );
+    }
+
+    if( bValid == false )
+    {
+        UE_LOG( LogCapsaCore, Warning, TEXT( "SetLogCategoryVerbosity | Ignoring invalid Log Category name in log policy" ) );
+        return;
+    }
+
+    FSelfRegisteringExec::StaticExec( nullptr, *FString::Printf( TEXT( "Log %s %s" ), *CategoryName, Verbosity ), *GLog );
+}
+
+/**
+* Returns the Log Pipeline settings configured in CapsaSettings.
+*/
+static FCapsaLogPipelineSettings GetLogPipelineSettings( const UCapsaSettings* CapsaSettings )
+{
+    FCapsaLogPipelineSettings PipelineSettings;
+    if( CapsaSettings != nullptr && CapsaSettings->IsValidLowLevelFast() == true )
+    {
+        PipelineSettings.MaxChunksInFlight = CapsaSettings->GetMaxChunksInFlight();
+        PipelineSettings.MaxParallelEncodes = CapsaSettings->GetMaxParallelChunkEncodes();
+        PipelineSettings.MaxConcurrentUploads = CapsaSettings->GetMaxConcurrentUploads();
+        PipelineSettings.MaxLinesPerSubChunk = CapsaSettings->GetMaxLinesPerSubChunk();
+        PipelineSettings.NumThreads = CapsaSettings->GetPipelineThreadCount();
+        PipelineSettings.ThreadPriority = CapsaSettings->GetPipelineThreadPriority();
+        PipelineSettings.ThreadAffinityMask = CapsaSettings->GetPipelineThreadAffinityMask();
+        PipelineSettings.MaxPooledBufferBytes = CapsaSettings->GetMaxPooledBufferBytes();
+    }
+    return PipelineSettings;
+}
+
+
 UCapsaCoreSubsystem::UCapsaCoreSubsystem()
-    : Token( "" )
-    , LogID( "" )
-    , LinkWeb( "" )
-    , Expiry( "" )
+    : NextWorldLogSessionID( 1 )
+    , LogPolicyPollInterval( 0.f )
     , CapsaActorComponent( nullptr )
 {
 }
@@ -33,404 +79,347 @@ void UCapsaCoreSubsystem::Initialize( FSubsystemCollectionBase& Collection )
 
     UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::Initialize | Starting Up..." ) );
 
-    RequestClientAuth();
+    FCapsaSettingsSnapshot::Update();
+
+    const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+    if( CapsaSettings != nullptr && CapsaSettings->IsValidLowLevelFast() == true )
+    {
+        if( CapsaSettings->GetUseFrameBudget() == true )
+        {
+            FCapsaFrameBudget::Get().Start( CapsaSettings->GetFrameBudgetMilliseconds(), CapsaSettings->GetFrameBudgetThrottleVerbosity(),
+                CapsaSettings->GetFrameBudgetSampleRate(), CapsaSettings->GetFrameBudgetRecoverySeconds() );
+        }
+
+        if( CapsaSettings->GetApplyServerLogPolicy() == true )
+        {
+            SetLogPolicyPollInterval( CapsaSettings->GetLogPolicyPollInterval() );
+        }
+    }
+
+    Session = MakeShared<FCapsaLogSession, ESPMode::ThreadSafe>( 0, TEXT( "Process" ) );
+    Session->OnAuthChanged.AddUObject( this, &UCapsaCoreSubsystem::OnSessionAuthChanged );
+    Session->OnLogPolicyReceived.BindUObject( this, &UCapsaCoreSubsystem::ApplyLogPolicy );
 
-    OnPostWorldInitializationHandle = FWorldDelegates::OnPostWorldInitialization.AddUObject( this, &UCapsaCoreSubsystem::OnPostWorldInit );
+    // The log sessions of the Worlds run on the threads of the process session, a pool per World would add up on multi-match servers
+    FCapsaLogPipelineSettings PipelineSettings = GetLogPipelineSettings( CapsaSettings );
+    PipelineThreadPool = FCapsaLogPipeline::CreateThreadPool( PipelineSettings );
+    PipelineSettings.ThreadPool = PipelineThreadPool;
+    Session->Start( PipelineSettings );
 }
 
 void UCapsaCoreSubsystem::Deinitialize()
 {
-    if( OnPostWorldInitializationHandle.IsValid() == true )
+    SetLogPolicyPollInterval( 0.f );
+
+    for( const TPair<uint32, TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe>>& WorldLogSession : WorldLogSessions )
     {
-        FWorldDelegates::OnPostWorldInitialization.Remove( OnPostWorldInitializationHandle );
+        WorldLogSession.Value->Shutdown();
     }
+    WorldLogSessions.Empty();
+    WorldLogSessionIDs.Empty();
 
-    FGameModeEvents::GameModePostLoginEvent.RemoveAll( this );
-    FGameModeEvents::GameModeLogoutEvent.RemoveAll( this );
+    if( Session.IsValid() == true )
+    {
+        Session->Shutdown();
+        Session.Reset();
+    }
+    PipelineThreadPool.Reset();
+
+    FCapsaFrameBudget::Get().Stop();
 
 	Super::Deinitialize();
 }
 
 void UCapsaCoreSubsystem::RegisterMetadataString( const FString& Key, const FString& Value )
 {
-    TSharedPtr<FJsonValueString> JsonValue = MakeShared<FJsonValueString>( Value );
-    RegisterAdditionalMetadata( Key, JsonValue );
-    UE_LOG( LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::RegisterMetadata | Registered metadata with key: %s, value :%s"), *Key, *Value );
+    SetMetadataString( Key, Value );
 }
 
-FCapsaSharedData UCapsaCoreSubsystem::GetServerCapsaData() const
+void UCapsaCoreSubsystem::SetMetadataString( const FString& Key, const FString& Value )
 {
-    if( CapsaActorComponent.IsValid() == false )
-    {
-        UE_LOG( LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::GetServerCapsaData | No valid reference to CapsaActorComponent" ) );
-        return FCapsaSharedData{};
-    }
-
-    return CapsaActorComponent->CapsaServerData;
+    SetMetadata( Key, FCapsaMetadataValue( Value ) );
 }
 
-bool UCapsaCoreSubsystem::IsAuthenticated() const
+void UCapsaCoreSubsystem::SetMetadataInteger( const FString& Key, int64 Value )
 {
-    return ( Token.IsEmpty() == false ) && ( LogID.IsEmpty() == false );
+    SetMetadata( Key, FCapsaMetadataValue( Value ) );
 }
 
-FString UCapsaCoreSubsystem::GetLogID() const
+void UCapsaCoreSubsystem::SetMetadataFloat( const FString& Key, double Value )
 {
-    return LogID;
+    SetMetadata( Key, FCapsaMetadataValue( Value ) );
 }
 
-FString UCapsaCoreSubsystem::GetLogURL() const
+void UCapsaCoreSubsystem::SetMetadataBool( const FString& Key, bool Value )
 {
-    return LinkWeb;
+    SetMetadata( Key, FCapsaMetadataValue( Value ) );
 }
 
-bool UCapsaCoreSubsystem::RegisterLinkedLogID( const FString& LinkedLogID, const FString& Description )
+void UCapsaCoreSubsystem::SetMetadataStringArray( const FString& Key, const TArray<FString>& Values )
 {
-    // Don't link with self.
-    if( LogID.Equals( LinkedLogID ) == true )
+    TArray<FCapsaMetadataValue> Array;
+    Array.Reserve( Values.Num() );
+    for( const FString& Value : Values )
     {
-        return false;
+        Array.Emplace( Value );
     }
-
-    if( LinkedLogIDs.Contains( LinkedLogID ) == true )
-    {
-        return false;
-    }
-
-    UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::RegisterLinkedLogID | Registering LinkedLogID: %s" ), *LinkedLogID );
-    
-    LinkedLogIDs.Add( LinkedLogID, Description );
-    RequestSendMetadata();
-    return true;
+    SetMetadata( Key, FCapsaMetadataValue( MoveTemp( Array ) ) );
 }
 
-void UCapsaCoreSubsystem::RegisterAdditionalMetadata( const FString& Key, const TSharedPtr<FJsonValue>& Value )
+void UCapsaCoreSubsystem::SetMetadata( const FString& Key, FCapsaMetadataValue&& Value )
 {
-    AdditionalMetadata.Add( Key, Value );
-    UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "UCapsaCoreSubsystem::RegisterAdditionalMetadata | Added metadata with key %s" ), *Key );
-    RequestSendMetadata();
+    Session->SetMetadata( Key, MoveTemp( Value ) );
 }
 
-void UCapsaCoreSubsystem::SendLog( TArray<FBufferedLine>& LogBuffer )
+FCapsaSharedData UCapsaCoreSubsystem::GetServerCapsaData() const
 {
-    const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
-    if( CapsaSettings == nullptr || CapsaSettings->IsValidLowLevelFast() == false )
+    if( CapsaActorComponent.IsValid() == false )
     {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::SendLog | Failed to load CapsaSettings." ) );
-        return;
+        UE_LOG( LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::GetServerCapsaData | No valid reference to CapsaActorComponent" ) );
+        return FCapsaSharedData{};
     }
 
-    if( CapsaSettings->GetUseCompression() == true )
-    {
-        FAsyncBinaryFromBufferCallback CallbackFunc = [this]( const TArray<uint8>& CompressedLog )
-            {
-                RequestSendCompressedLog( CompressedLog );
-            };
-        // Example AsyncTask to attempt to SAVE the file using the LogID (as filename), whether compressed or not, then fire the Callback.
-        // This requires a Binary Callback, not an FString
-        ( new FAutoDeleteAsyncTask<FSaveCompressedStringFromBufferTask>( LogID, CapsaSettings->GetWriteToDiskPlain(), CapsaSettings->GetWriteToDiskCompressed(), MoveTemp(LogBuffer), CallbackFunc) )->StartBackgroundTask();
-    }
-    else // bUseCompression == false
-    {
-        FAsyncStringFromBufferCallback CallbackFunc = [this]( const FString& Log )
-            {
-                RequestSendLog( Log );
-            };
-        // These all require an FString Callback.
-        // Example AsyncTask to generate a Log and Optionally write it to Disk, then fire the Callback.
-        ( new FAutoDeleteAsyncTask<FSaveStringFromBufferTask>( LogID, CapsaSettings->GetWriteToDiskPlain(), MoveTemp( LogBuffer ), CallbackFunc ) )->StartBackgroundTask();
-    }
+    return CapsaActorComponent->CapsaServerData;
 }
 
-void UCapsaCoreSubsystem::RequestClientAuth()
+UCapsaActorComponent* UCapsaCoreSubsystem::GetCapsaActorComponent() const
 {
-    UE_LOG( LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::RequestClientAuth | Starting client authentication" ) );
-    
-    const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
-    if( CapsaSettings == nullptr || CapsaSettings->IsValidLowLevelFast() == false )
-    {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::RequestClientAuth | Failed to load CapsaSettings." ) );
-        return;
-    }
-    if (CapsaSettings->GetCapsaServerURL().IsEmpty() == true)
-    {
-        UE_LOG( LogCapsaCore, Error, TEXT("UCapsaCoreSubsystem::RequestClientAuth | Base URL is Empty!") );
-        return;
-    }
-
-    FCapsaAuthenticationRequest AuthenticationRequest = FCapsaAuthenticationRequest(
-        CapsaSettings->GetCapsaEnvironmentKey(),
-        UCapsaCoreFunctionLibrary::GetPlatformString(),
-        UCapsaCoreFunctionLibrary::GetHostTypeString()
-    );
-    
-    FString AuthContent;
-    if( FJsonObjectConverter::UStructToJsonObjectString( AuthenticationRequest, AuthContent ) == false )
-    {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::RequestClientAuth | FJsonObjectConverter::UStructToJsonObjectString has failed" ) );
-    }
-
-    FHttpRequestRef ClientAuthRequest = FHttpModule::Get().CreateRequest();
-    ClientAuthRequest->SetURL( CapsaSettings->GetServerEndpointClientAuth() );
-    ClientAuthRequest->SetVerb( "POST" );
-    ClientAuthRequest->SetHeader( "Content-Type", "application/json" );
-    ClientAuthRequest->SetContentAsString( AuthContent );
-    ClientAuthRequest->OnProcessRequestComplete().BindUObject( this, &UCapsaCoreSubsystem::ClientAuthResponse );
-    ClientAuthRequest->ProcessRequest();
-
-    UE_LOG( LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::RequestClientAuth | Authentication request sent") );
+    return CapsaActorComponent.Get();
 }
 
-void UCapsaCoreSubsystem::RequestSendLog( const FString& Log )
+void UCapsaCoreSubsystem::SetCapsaActorComponent( UCapsaActorComponent* Component )
 {
-    UE_LOG( LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::RequestSendLog | Sending log chunk without compression") );
-
-    const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
-    if( CapsaSettings == nullptr || CapsaSettings->IsValidLowLevelFast() == false )
-    {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::RequestSendLog | Failed to load CapsaSettings." ) );
-        return;
-    }
-
-    FHttpRequestRef LogRequest = FHttpModule::Get().CreateRequest();
-    LogRequest->SetURL( CapsaSettings->GetServerEndpointClientLogChunk() );
-    LogRequest->SetVerb( "POST" );
-    LogRequest->SetHeader( "Authorization", GetAuthHeader() );
-    LogRequest->SetHeader( "Content-Type", "text/plain" );
-    LogRequest->SetContentAsString( Log );
-    LogRequest->OnProcessRequestComplete().BindUObject( this, &UCapsaCoreSubsystem::LogResponse );
-    LogRequest->ProcessRequest();
+    CapsaActorComponent = Component;
 
-    UE_LOG( LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::RequestSendLog | Log sent") );
+    UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "UCapsaCoreSubsystem::SetCapsaActorComponent | UCapsaActorComponent reference %s" ), Component != nullptr ? TEXT( "stored" ) : TEXT( "cleared" ) );
 }
 
-void UCapsaCoreSubsystem::RequestSendCompressedLog( const TArray<uint8>& CompressedLog )
+bool UCapsaCoreSubsystem::IsAuthenticated() const
 {
-    UE_LOG( LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::RequestSendCompressedLog | Sending log chunk with compression") );
+    return Session.IsValid() == true && Session->IsAuthenticated() == true;
+}
 
-    const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
-    if( CapsaSettings == nullptr || CapsaSettings->IsValidLowLevelFast() == false )
-    {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::RequestSendCompressedLog | Failed to load CapsaSettings." ) );
-        return;
-    }
+FString UCapsaCoreSubsystem::GetLogID() const
+{
+    return Session.IsValid() == true ? Session->GetLogID() : FString();
+}
 
-    FHttpRequestRef LogRequest = FHttpModule::Get().CreateRequest();
-    LogRequest->SetURL( CapsaSettings->GetServerEndpointClientLogChunk() );
-    LogRequest->SetVerb( "POST" );
-    LogRequest->SetHeader( "Authorization", GetAuthHeader() );
-    LogRequest->SetHeader( "Content-Type", "application/zlib" );
-    LogRequest->SetContent( CompressedLog );
-    LogRequest->OnProcessRequestComplete().BindUObject( this, &UCapsaCoreSubsystem::LogResponse );
-    LogRequest->ProcessRequest();
+FString UCapsaCoreSubsystem::GetLogURL() const
+{
+    return Session.IsValid() == true ? Session->GetLogURL() : FString();
+}
 
-    UE_LOG( LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::RequestSendCompressedLog | Compressed log sent") );
+const FCapsaLogPolicy& UCapsaCoreSubsystem::GetLogPolicy() const
+{
+    return LogPolicy;
 }
 
-void UCapsaCoreSubsystem::RequestSendMetadata()
+bool UCapsaCoreSubsystem::RegisterLinkedLogID( const FString& LinkedLogID, const FString& Description )
 {
-    UE_LOG (LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::RequestSendMetadata | Storing metadata") );
+    return Session->RegisterLinkedLogID( LinkedLogID, Description );
+}
 
-    const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
-    if( CapsaSettings == nullptr || CapsaSettings->IsValidLowLevelFast() == false )
+void UCapsaCoreSubsystem::RegisterAdditionalMetadata( const FString& Key, const TSharedPtr<FJsonValue>& Value )
+{
+    if( Value.IsValid() == false )
     {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::RequestSendMetadata | Failed to load CapsaSettings" ) );
+        UE_LOG( LogCapsaCore, Warning, TEXT( "UCapsaCoreSubsystem::RegisterAdditionalMetadata | Invalid value for key %s" ), *Key );
         return;
     }
-    
-    TSharedPtr<FJsonObject> JsonObject = MakeShareable( new FJsonObject );
-    JsonObject->SetObjectField( TEXT( "linkedLogs" ), UCapsaCoreJsonHelpers::TMapToJsonObject(LinkedLogIDs) );
-    JsonObject->SetObjectField( TEXT( "additionalMetadata" ), UCapsaCoreJsonHelpers::TMapToJsonObject(AdditionalMetadata) );
 
-    FString MetadataContent;
-    TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create( &MetadataContent, 0 );
-    FJsonSerializer::Serialize( JsonObject.ToSharedRef(), Writer );
+    FString Json;
+    TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create( &Json );
+    FJsonSerializer::Serialize( Value, FString(), Writer );
 
-    FHttpRequestRef LogRequest = FHttpModule::Get().CreateRequest();
-    LogRequest->SetURL( CapsaSettings->GetServerEndpointClientLogMetadata() );
-    LogRequest->SetVerb( "POST" );
-    LogRequest->SetHeader( "Authorization", GetAuthHeader() );
-    LogRequest->AppendToHeader( "Content-Type", "application/json" );
-    LogRequest->SetContentAsString( MetadataContent );
-    LogRequest->OnProcessRequestComplete().BindUObject( this, &UCapsaCoreSubsystem::LogResponse );
-    LogRequest->ProcessRequest();
-
-    UE_LOG (LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::RequestSendMetadata | Metadata sent") );
+    const FTCHARToUTF8 Utf8( *Json, Json.Len() );
+    SetMetadata( Key, FCapsaMetadataValue::FromJson( TArray<uint8>( reinterpret_cast<const uint8*>( Utf8.Get() ), Utf8.Length() ) ) );
 }
 
-void UCapsaCoreSubsystem::ClientAuthResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess )
+void UCapsaCoreSubsystem::SendLog( TArray<FBufferedLine>& LogBuffer, FCapsaDeferredLogBuffer&& DeferredLines )
 {
-    UE_LOG( LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::ClientAuthResponse | Authentication resonse received sent") );
-
-    TSharedPtr<FJsonObject> JsonObject = ProcessResponse( TEXT( "UCapsaCoreSubsystem::ClientAuthResponse" ), Request, Response, bSuccess );
-    if( JsonObject == nullptr || JsonObject.IsValid() == false )
-    {
-        UE_LOG( LogCapsaCore, Warning, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Invalid JSON object" ) );
-        return;
-    }
-    
-    FCapsaAuthenticationResponse AuthenticationResponse;
-    if ( FJsonObjectConverter::JsonObjectToUStruct( JsonObject.ToSharedRef(), &AuthenticationResponse ) == false )
-    {
-        UE_LOG( LogCapsaCore, Warning, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | FJsonObjectConverter::JsonObjectToUStruc failed" ) );
-        return;
-    };
-
-    // Set the authentication data if the current data is empty
-    if( Token.IsEmpty() || LogID.IsEmpty() || LinkWeb.IsEmpty() )
-    {
-        UE_LOG( LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Authentication info not present, setting values" ) );
-        Token = AuthenticationResponse.Token;
-        LogID = AuthenticationResponse.LogId;
-        LinkWeb = AuthenticationResponse.LinkWeb;
-        Expiry = AuthenticationResponse.Expiry;
-        UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Capsa ID: %s | CapsaLogURL: %s" ), *LogID, *LinkWeb);
-    } else
-    {
-        UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::ClientAuthResponse | Ignoring AuthenticationResponse (CapsaID: %s), as the authentication is already present" ), *LogID );
-    }
-    
-    // Broadcast auth changed regardless whether it has changed or not
-    OnAuthChanged.Broadcast( LogID, LinkWeb );
-    OnAuthChangedDynamic.Broadcast( LogID, LinkWeb );
+    Session->SendLog( LogBuffer, MoveTemp( DeferredLines ) );
 }
 
-void UCapsaCoreSubsystem::LogResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess )
+bool UCapsaCoreSubsystem::CanSendLog() const
 {
-    UE_LOG( LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::LogResponse | Log chunk stored") );
+    return Session.IsValid() == true && Session->CanSendLog() == true;
+}
 
-    ProcessResponse( TEXT( "UCapsaCoreSubsystem::LogResponse" ), Request, Response, bSuccess );
+void UCapsaCoreSubsystem::RequestClientAuth()
+{
+    Session->RequestClientAuth();
 }
 
-void UCapsaCoreSubsystem::MetadataResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess )
+uint32 UCapsaCoreSubsystem::CreateWorldLogSession( const UWorld* World )
 {
-    UE_LOG( LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::MetadataResponse | Metadata stored") );
+    const uint32 SessionID = NextWorldLogSessionID++;
+    const FString Name = World != nullptr ? World->GetName() : FString::Printf( TEXT( "World%u" ), SessionID );
+
+    UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::CreateWorldLogSession | Creating log session %u for %s" ), SessionID, *Name );
+
+    // The Worlds share the thread pool of the process session
+    FCapsaLogPipelineSettings PipelineSettings = GetLogPipelineSettings( GetDefault<UCapsaSettings>() );
+    PipelineSettings.ThreadPool = PipelineThreadPool;
 
-    // Remove metadata on success
-    if( bSuccess == true && Response->GetResponseCode() < 299 )
+    TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe> WorldLogSession = MakeShared<FCapsaLogSession, ESPMode::ThreadSafe>( SessionID, Name );
+    WorldLogSession->OnAuthChanged.AddWeakLambda( this, [this, SessionID]( const FString& CapsaLogId, const FString& CapsaLogURL )
+        {
+            OnWorldLogSessionAuthChanged( SessionID );
+        } );
+    WorldLogSession->SetMetadata( TEXT( "world" ), FCapsaMetadataValue( Name ) );
+    WorldLogSessions.Add( SessionID, WorldLogSession );
+    if( World != nullptr )
     {
-        UE_LOG( LogCapsaCore, Verbose, TEXT("UCapsaCoreSubsystem::MetadataResponse | Clearing metadata.") );
-        LinkedLogIDs.Empty();
-        AdditionalMetadata.Empty();
+        WorldLogSessionIDs.Add( World, SessionID );
     }
+    WorldLogSession->Start( PipelineSettings );
 
-    ProcessResponse( TEXT( "UCapsaCoreSubsystem::MetadataResponse" ), Request, Response, bSuccess );
+    return SessionID;
 }
 
-TSharedPtr<FJsonObject> UCapsaCoreSubsystem::ProcessResponse( const FString& RequestName, FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess )
+void UCapsaCoreSubsystem::RemoveWorldLogSession( uint32 SessionID )
 {
-    // Exit early if request failed
-    if( bSuccess == false )
+    TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe> WorldLogSession;
+    if( WorldLogSessions.RemoveAndCopyValue( SessionID, WorldLogSession ) == false )
     {
-        UE_LOG( LogCapsaCore, Error, TEXT("%s | HTTP Request Failed: %s."), *RequestName, (Response == nullptr || Response.IsValid() == false) ? TEXT("Invalid Response Ptr") : *Response->GetContentAsString() );
-        return nullptr;
+        return;
     }
 
-    if( Response->GetResponseCode() > 299 )
+    for( TMap<TObjectKey<UWorld>, uint32>::TIterator It = WorldLogSessionIDs.CreateIterator(); It; ++It )
     {
-        UE_LOG( LogCapsaCore, Warning, TEXT("%s | Received non-2xx response code %d: %s."), *RequestName, Response->GetResponseCode(), (Response == nullptr || Response.IsValid() == false) ? TEXT("Invalid Response Ptr") : *Response->GetContentAsString() );
+        if( It.Value() == SessionID )
+        {
+            It.RemoveCurrent();
+        }
     }
 
-    if( Response->GetContentAsString().IsEmpty() ) 
+    UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::RemoveWorldLogSession | Removing log session %u of %s" ), SessionID, *WorldLogSession->GetName() );
+    WorldLogSession->Shutdown();
+}
+
+FCapsaLogSession& UCapsaCoreSubsystem::FindLogSession( uint32 SessionID ) const
+{
+    if( SessionID != 0 )
     {
-        UE_LOG( LogCapsaCore, VeryVerbose, TEXT("%s | Not deserializing JSON due to empty response body"), *RequestName );
-        return nullptr;
+        const TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe>* WorldLogSession = WorldLogSessions.Find( SessionID );
+        if( WorldLogSession != nullptr )
+        {
+            return **WorldLogSession;
+        }
     }
+    return *Session;
+}
 
-    // Deserialize the JSON
-    TSharedPtr<FJsonObject> JsonObject = MakeShareable( new FJsonObject );
-    TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create( Response->GetContentAsString() );
+FCapsaLogSession& UCapsaCoreSubsystem::GetLogSession( const UObject* WorldContext ) const
+{
+    const UWorld* World = WorldContext != nullptr ? WorldContext->GetWorld() : nullptr;
+    const uint32* SessionID = World != nullptr ? WorldLogSessionIDs.Find( World ) : nullptr;
+    return FindLogSession( SessionID != nullptr ? *SessionID : 0 );
+}
 
-    if( FJsonSerializer::Deserialize( Reader, JsonObject ) == true )
+void UCapsaCoreSubsystem::OnSessionAuthChanged( const FString& CapsaLogId, const FString& CapsaLogURL )
+{
+    // World sessions that authenticated first could not link back yet
+    for( const TPair<uint32, TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe>>& WorldLogSession : WorldLogSessions )
     {
-        return JsonObject;
+        if( WorldLogSession.Value->IsAuthenticated() == true )
+        {
+            WorldLogSession.Value->RegisterLinkedLogID( CapsaLogId, Session->GetName() );
+        }
     }
 
-    UE_LOG( LogCapsaCore, Error, TEXT( "%s | Failed to deserialize JSON" ), *RequestName);
-
-    return nullptr;
+    OnAuthChanged.Broadcast( CapsaLogId, CapsaLogURL );
+    OnAuthChangedDynamic.Broadcast( CapsaLogId, CapsaLogURL );
 }
 
-void UCapsaCoreSubsystem::OnPostWorldInit( UWorld* World, const UWorld::InitializationValues )
+void UCapsaCoreSubsystem::OnWorldLogSessionAuthChanged( uint32 SessionID )
 {
-    if( World == nullptr || World->IsValidLowLevelFast() == false )
+    const TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe>* WorldLogSession = WorldLogSessions.Find( SessionID );
+    if( WorldLogSession == nullptr )
     {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::OnPostLoadMapWithWorld | World is Invalid!" ) );
         return;
     }
 
-    if( World->GetNetMode() == NM_Client )
+    // Already linked logs are not sent again, so this can be called for every authentication response
+    Session->RegisterLinkedLogID( ( *WorldLogSession )->GetLogID(), ( *WorldLogSession )->GetName() );
+    if( Session->IsAuthenticated() == true )
     {
-        return;
+        ( *WorldLogSession )->RegisterLinkedLogID( Session->GetLogID(), Session->GetName() );
     }
+}
 
-    // Fall through - some kind of Server (anything that's NOT an NM_Client is some kind of server)
-    
+void UCapsaCoreSubsystem::ApplyLogPolicy( const FCapsaLogPolicy& Policy )
+{
     const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
-    if( CapsaSettings == nullptr || CapsaSettings->IsValidLowLevelFast() == false )
+    if( CapsaSettings == nullptr || CapsaSettings->GetApplyServerLogPolicy() == false )
     {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::OnPostLoadMapWithWorld | Failed to load CapsaSettings." ) );
+        UE_LOG( LogCapsaCore, Verbose, TEXT( "UCapsaCoreSubsystem::ApplyLogPolicy | Ignoring log policy, bApplyServerLogPolicy is disabled" ) );
         return;
     }
 
-    if( CapsaSettings->GetShouldAutoAddCapsaComponent() == false )
+    if( Policy == LogPolicy )
     {
         return;
     }
 
-    if( CapsaSettings->GetAutoAddClass() == nullptr )
+    UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::ApplyLogPolicy | Applying log policy %s" ), Policy.Revision.IsEmpty() == true ? TEXT( "<unnamed>" ) : *Policy.Revision );
+
+    // Categories the previous policy changed go back to their configured verbosity
+    for( const TPair<FName, FCapsaLogPolicy::FCategory>& Category : LogPolicy.Categories )
     {
-        return;
+        const FCapsaLogPolicy::FCategory* NewCategory = Policy.Categories.Find( Category.Key );
+        if( Category.Value.Verbosity.IsSet() == true && ( NewCategory == nullptr || NewCategory->Verbosity.IsSet() == false ) )
+        {
+            SetLogCategoryVerbosity( Category.Key, TEXT( "Default" ) );
+        }
     }
-    
-    FGameModeEvents::GameModePostLoginEvent.AddUObject( this, &UCapsaCoreSubsystem::OnPlayerLoggedIn );
-    FGameModeEvents::GameModeLogoutEvent.AddUObject( this, &UCapsaCoreSubsystem::OnPlayerLoggedOut );
 
-    UE_LOG( LogCapsaCore, Log, TEXT("UCapsaCoreSubsystem::OnPostWorldInit | GameModePostLoginEvent and GameModeLogoutEvent delegates added") );
-}
-
-void UCapsaCoreSubsystem::OnPlayerLoggedIn( AGameModeBase* GameMode, APlayerController* Player )
-{
-    const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
-    if( CapsaSettings == nullptr || CapsaSettings->IsValidLowLevelFast() == false )
+    // The category verbosity is checked before a line reaches Capsa, so it is changed on the category itself
+    for( const TPair<FName, FCapsaLogPolicy::FCategory>& Category : Policy.Categories )
     {
-        UE_LOG( LogCapsaCore, Error, TEXT( "UCapsaCoreSubsystem::OnPlayerLoggedIn | Failed to load CapsaSettings." ) );
-        return;
+        const FCapsaLogPolicy::FCategory* OldCategory = LogPolicy.Categories.Find( Category.Key );
+        if( Category.Value.Verbosity.IsSet() == true && ( OldCategory == nullptr || OldCategory->Verbosity != Category.Value.Verbosity ) )
+        {
+            SetLogCategoryVerbosity( Category.Key, ToString( Category.Value.Verbosity.GetValue() ) );
+        }
     }
 
-    TArray<AActor*> ActorsToAddComp;
-    UGameplayStatics::GetAllActorsOfClass( GameMode, CapsaSettings->GetAutoAddClass(), ActorsToAddComp );
+    LogPolicy = Policy;
+    FCapsaSettingsSnapshot::SetLogPolicy( LogPolicy );
 
-    if( ActorsToAddComp.IsEmpty() == true )
+    const float PollInterval = LogPolicy.PollInterval.Get( CapsaSettings->GetLogPolicyPollInterval() );
+    if( PollInterval != LogPolicyPollInterval )
     {
-        UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaCoreSubsystem::OnPlayerLoggedIn | Unable to add Capsa Component, no Actors of class %s found." ), *CapsaSettings->GetAutoAddClass()->GetName() );
-        return;
+        SetLogPolicyPollInterval( PollInterval );
     }
 
-    // Once we have a valid one, send OUR CapsaID via the RPC
-    for( AActor* Actor : ActorsToAddComp )
+    if( LogPolicy.Revision.IsEmpty() == false )
     {
-        if( Actor->FindComponentByClass<UCapsaActorComponent>() != nullptr )
-        {
-            // Don't add again, if we already have a UCapsaActorComponent on this class.
-            continue;
-        }
-
-        UActorComponent* ActorComponent = Actor->AddComponentByClass( UCapsaActorComponent::StaticClass(), false, FTransform(), false );
-        if( CapsaActorComponent.IsValid() == false )
-        {
-            // Store a Weak Reference to the first made Actor Component.
-            CapsaActorComponent = Cast<UCapsaActorComponent>( ActorComponent );
+        SetMetadataString( TEXT( "logPolicy" ), LogPolicy.Revision );
+    }
+}
 
-            UE_LOG(LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::OnPlayerLoggedIn | UCapsaActorComponent reference stored"));
-        }
+void UCapsaCoreSubsystem::SetLogPolicyPollInterval( float Interval )
+{
+    if( LogPolicyPollHandle.IsValid() == true )
+    {
+        FTSTicker::GetCoreTicker().RemoveTicker( LogPolicyPollHandle );
+        LogPolicyPollHandle.Reset();
     }
 
-    UE_LOG(LogCapsaCore, VeryVerbose, TEXT("UCapsaCoreSubsystem::OnPlayerLoggedIn | Finished"));
+    LogPolicyPollInterval = FMath::Max( Interval, 0.f );
+    if( LogPolicyPollInterval > 0.f )
+    {
+        LogPolicyPollHandle = FTSTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateUObject( this, &UCapsaCoreSubsystem::PollLogPolicy ), LogPolicyPollInterval );
+    }
 }
 
-void UCapsaCoreSubsystem::OnPlayerLoggedOut( AGameModeBase* GameMode, AController* Controller )
+bool UCapsaCoreSubsystem::PollLogPolicy( float DeltaTime )
 {
+    UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "UCapsaCoreSubsystem::PollLogPolicy | Polling for a new log policy" ) );
+
+    Session->RequestSendMetadata( true );
+    return true;
 }
 
 void UCapsaCoreSubsystem::OpenClientLogInBrowser()
@@ -445,7 +434,7 @@ void UCapsaCoreSubsystem::OpenClientLogInBrowser()
         return;
     }
 
-    UCapsaCoreSubsystem::OpenBrowser(CapsaCore->LinkWeb);
+    UCapsaCoreSubsystem::OpenBrowser( CapsaCore->GetLogURL() );
 }
 
 void UCapsaCoreSubsystem::OpenServerLogInBrowser()
@@ -476,6 +465,22 @@ void UCapsaCoreSubsystem::OpenServerLogInBrowser()
     UCapsaCoreSubsystem::OpenBrowser( LogURL );
 }
 
+void UCapsaCoreSubsystem::LogPipelineStats()
+{
+    UCapsaCoreSubsystem* CapsaCore = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
+    if( CapsaCore == nullptr || CapsaCore->IsValidLowLevelFast() == false || CapsaCore->Session.IsValid() == false )
+    {
+        UE_LOG( LogCapsaCore, Error, TEXT( "Unable to log the Log Pipeline stats: CapsaCore Subsystem is invalid." ) );
+        return;
+    }
+
+    CapsaCore->Session->LogPipelineStats();
+    for( const TPair<uint32, TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe>>& WorldLogSession : CapsaCore->WorldLogSessions )
+    {
+        WorldLogSession.Value->LogPipelineStats();
+    }
+}
+
 void UCapsaCoreSubsystem::OpenBrowser( const FString& URL )
 {
     FPlatformProcess::LaunchURL( *URL, nullptr, nullptr );
@@ -494,3 +499,10 @@ static FAutoConsoleCommand CVarCapsaViewServerLog(
     TEXT( "and open the Capsa Log URL for the connected server in the current session." ),
     FConsoleCommandDelegate::CreateStatic( UCapsaCoreSubsystem::OpenServerLogInBrowser ),
     ECVF_Cheat );
+
+static FAutoConsoleCommand CVarCapsaPipelineStats(
+    TEXT( "Capsa.Pipeline.Stats" ),
+    TEXT( "Writes the number of log chunks in flight and the time spent " )
+    TEXT( "in each stage of the Capsa Log Pipeline to the log." ),
+    FConsoleCommandDelegate::CreateStatic( UCapsaCoreSubsystem::LogPipelineStats ),
+    ECVF_Cheat );
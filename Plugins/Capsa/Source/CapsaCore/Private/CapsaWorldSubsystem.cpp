@@ -0,0 +1,298 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "CapsaWorldSubsystem.h"
+
+#include "CapsaCore.h"
+#include "CapsaCoreSubsystem.h"
+#include "Components/CapsaActorComponent.h"
+#include "Logging/CapsaLogSession.h"
+#include "Settings/CapsaSettings.h"
+#include "Settings/CapsaSettingsSnapshot.h"
+
+#include "Engine/Engine.h"
+#include "Engine/Level.h"
+#include "EngineUtils.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+
+#include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaWorldSubsystem)
+
+
+/**
+* Whether the Capsa Component is added to the AutoAddClass Actors, which is only done on servers.
+*/
+static bool ShouldAutoAddCapsaComponent()
+{
+#if !WITH_SERVER_CODE
+	return false;
+#else
+	const FCapsaSettingsSnapshot::FRef CapsaSettings = FCapsaSettingsSnapshot::Get();
+	return CapsaSettings->bAutoAddCapsaComponent == true && CapsaSettings->AutoAddClass != nullptr;
+#endif
+}
+
+bool UCapsaWorldSubsystem::ShouldCreateSubsystem( UObject* Outer ) const
+{
+	if( Super::ShouldCreateSubsystem( Outer ) == false )
+	{
+		return false;
+	}
+
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	return ShouldAutoAddCapsaComponent() == true || ( CapsaSettings != nullptr && CapsaSettings->GetUseWorldLogSessions() == true );
+}
+
+void UCapsaWorldSubsystem::Initialize( FSubsystemCollectionBase& Collection )
+{
+	Super::Initialize( Collection );
+
+	LogSessionID = 0;
+	UWorld* World = GetWorld();
+
+	if( ShouldAutoAddCapsaComponent() == true )
+	{
+		AutoAddClass = FCapsaSettingsSnapshot::Get()->AutoAddClass;
+
+		OnActorSpawnedHandle = World->AddOnActorSpawnedHandler( FOnActorSpawned::FDelegate::CreateUObject( this, &UCapsaWorldSubsystem::OnActorSpawned ) );
+		OnLevelAddedToWorldHandle = FWorldDelegates::LevelAddedToWorld.AddUObject( this, &UCapsaWorldSubsystem::OnLevelAddedToWorld );
+		OnPostLoginHandle = FGameModeEvents::GameModePostLoginEvent.AddUObject( this, &UCapsaWorldSubsystem::OnPlayerLoggedIn );
+		OnLogoutHandle = FGameModeEvents::GameModeLogoutEvent.AddUObject( this, &UCapsaWorldSubsystem::OnPlayerLoggedOut );
+
+		UE_LOG( LogCapsaCore, Log, TEXT( "UCapsaWorldSubsystem::Initialize | Adding the Capsa Component to %s Actors in %s" ), *AutoAddClass->GetName(), *World->GetName() );
+	}
+
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine != nullptr ? GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>() : nullptr;
+	if( CapsaSettings != nullptr && CapsaSettings->GetUseWorldLogSessions() == true && CapsaCoreSubsystem != nullptr )
+	{
+		LogSessionID = CapsaCoreSubsystem->CreateWorldLogSession( World );
+
+		// Network traffic is dispatched after the tick start, so RPCs are logged to the session of the World as well
+		OnWorldTickStartHandle = FWorldDelegates::OnWorldTickStart.AddUObject( this, &UCapsaWorldSubsystem::OnWorldTickStart );
+		OnWorldPostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject( this, &UCapsaWorldSubsystem::OnWorldPostActorTick );
+	}
+}
+
+void UCapsaWorldSubsystem::Deinitialize()
+{
+	UWorld* World = GetWorld();
+	if( World != nullptr )
+	{
+		World->RemoveOnActorSpawnedHandler( OnActorSpawnedHandle );
+	}
+	FWorldDelegates::LevelAddedToWorld.Remove( OnLevelAddedToWorldHandle );
+	FGameModeEvents::GameModePostLoginEvent.Remove( OnPostLoginHandle );
+	FGameModeEvents::GameModeLogoutEvent.Remove( OnLogoutHandle );
+	FWorldDelegates::OnWorldTickStart.Remove( OnWorldTickStartHandle );
+	FWorldDelegates::OnWorldPostActorTick.Remove( OnWorldPostActorTickHandle );
+
+	// The components of this World are going away, don't leave them on the Core Subsystem
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine != nullptr ? GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>() : nullptr;
+	if( CapsaCoreSubsystem != nullptr )
+	{
+		UCapsaActorComponent* Component = CapsaCoreSubsystem->GetCapsaActorComponent();
+		if( Component != nullptr && Component->GetWorld() == World )
+		{
+			CapsaCoreSubsystem->SetCapsaActorComponent( nullptr );
+		}
+
+		if( LogSessionID != 0 )
+		{
+			CapsaCoreSubsystem->RemoveWorldLogSession( LogSessionID );
+		}
+	}
+
+	if( LogSessionID != 0 && FCapsaLogSession::GetCurrentID() == LogSessionID )
+	{
+		FCapsaLogSession::SetCurrentID( 0 );
+	}
+	LogSessionID = 0;
+
+	PlayerComponents.Empty();
+	WorldComponents.Empty();
+
+	Super::Deinitialize();
+}
+
+void UCapsaWorldSubsystem::OnWorldBeginPlay( UWorld& InWorld )
+{
+	Super::OnWorldBeginPlay( InWorld );
+
+	if( AutoAddClass == nullptr || IsServerWorld() == false )
+	{
+		return;
+	}
+
+	// The Actors loaded with the map were not spawned, iterate the Actors of the class only, not the whole World
+	for( TActorIterator<AActor> It( &InWorld, AutoAddClass ); It; ++It )
+	{
+		AddCapsaComponent( *It );
+	}
+}
+
+int32 UCapsaWorldSubsystem::GetNumTrackedPlayers() const
+{
+	return PlayerComponents.Num();
+}
+
+bool UCapsaWorldSubsystem::DoesSupportWorldType( const EWorldType::Type WorldType ) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UCapsaWorldSubsystem::OnActorSpawned( AActor* Actor )
+{
+	if( Actor != nullptr && Actor->IsA( AutoAddClass ) == true && IsServerWorld() == true )
+	{
+		AddCapsaComponent( Actor );
+	}
+}
+
+void UCapsaWorldSubsystem::OnLevelAddedToWorld( ULevel* Level, UWorld* World )
+{
+	if( Level == nullptr || World != GetWorld() || World->HasBegunPlay() == false )
+	{
+		return;
+	}
+
+	for( AActor* Actor : Level->Actors )
+	{
+		OnActorSpawned( Actor );
+	}
+}
+
+void UCapsaWorldSubsystem::OnPlayerLoggedIn( AGameModeBase* GameMode, APlayerController* Player )
+{
+	if( GameMode == nullptr || GameMode->GetWorld() != GetWorld() || Player == nullptr )
+	{
+		return;
+	}
+
+	// Covers Actors of the new player that were spawned before this subsystem existed
+	OnActorSpawned( Player );
+	OnActorSpawned( Player->PlayerState );
+	OnActorSpawned( Player->GetPawn() );
+
+	UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "UCapsaWorldSubsystem::OnPlayerLoggedIn | Finished" ) );
+}
+
+void UCapsaWorldSubsystem::OnPlayerLoggedOut( AGameModeBase* GameMode, AController* Controller )
+{
+	if( GameMode == nullptr || GameMode->GetWorld() != GetWorld() || Controller == nullptr )
+	{
+		return;
+	}
+
+	TArray<TWeakObjectPtr<UCapsaActorComponent>> Components;
+	PlayerComponents.RemoveAndCopyValue( Controller, Components );
+
+	// The Actors of the player are destroyed after the logout, the Core Subsystem should not hold on to one of them
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
+	if( CapsaCoreSubsystem != nullptr && Components.Contains( CapsaCoreSubsystem->GetCapsaActorComponent() ) == true )
+	{
+		CapsaCoreSubsystem->SetCapsaActorComponent( nullptr );
+		UpdateCoreSubsystemComponent();
+	}
+
+	WorldComponents.RemoveAllSwap( []( const TWeakObjectPtr<UCapsaActorComponent>& Component )
+		{
+			return Component.IsValid() == false;
+		} );
+
+	UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "UCapsaWorldSubsystem::OnPlayerLoggedOut | Released %d components, tracking %d players" ), Components.Num(), PlayerComponents.Num() );
+}
+
+void UCapsaWorldSubsystem::OnWorldTickStart( UWorld* World, ELevelTick TickType, float DeltaSeconds )
+{
+	if( World == GetWorld() )
+	{
+		FCapsaLogSession::SetCurrentID( LogSessionID );
+	}
+}
+
+void UCapsaWorldSubsystem::OnWorldPostActorTick( UWorld* World, ELevelTick TickType, float DeltaSeconds )
+{
+	if( World == GetWorld() )
+	{
+		FCapsaLogSession::SetCurrentID( 0 );
+	}
+}
+
+bool UCapsaWorldSubsystem::IsServerWorld() const
+{
+	// Anything that's NOT an NM_Client is some kind of server
+	const UWorld* World = GetWorld();
+	return World != nullptr && World->GetNetMode() != NM_Client;
+}
+
+void UCapsaWorldSubsystem::AddCapsaComponent( AActor* Actor )
+{
+	if( Actor == nullptr || Actor->FindComponentByClass<UCapsaActorComponent>() != nullptr )
+	{
+		// Don't add again, if we already have a UCapsaActorComponent on this Actor.
+		return;
+	}
+
+	UCapsaActorComponent* Component = Cast<UCapsaActorComponent>( Actor->AddComponentByClass( UCapsaActorComponent::StaticClass(), false, FTransform(), false ) );
+	if( Component == nullptr )
+	{
+		return;
+	}
+
+	// PlayerStates and possessed Pawns are owned by their PlayerController
+	APlayerController* Player = Cast<APlayerController>( Actor );
+	if( Player == nullptr )
+	{
+		Player = Cast<APlayerController>( Actor->GetOwner() );
+	}
+
+	if( Player != nullptr )
+	{
+		PlayerComponents.FindOrAdd( Player ).Add( Component );
+	} else
+	{
+		// Amortized, Actors that are not owned by a player are only released when they are destroyed
+		if( WorldComponents.Num() >= 64 && FMath::IsPowerOfTwo( WorldComponents.Num() ) == true )
+		{
+			WorldComponents.RemoveAllSwap( []( const TWeakObjectPtr<UCapsaActorComponent>& WorldComponent )
+				{
+					return WorldComponent.IsValid() == false;
+				} );
+		}
+		WorldComponents.Add( Component );
+	}
+
+	UpdateCoreSubsystemComponent();
+}
+
+void UCapsaWorldSubsystem::UpdateCoreSubsystemComponent()
+{
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
+	if( CapsaCoreSubsystem == nullptr || CapsaCoreSubsystem->GetCapsaActorComponent() != nullptr )
+	{
+		return;
+	}
+
+	for( const TWeakObjectPtr<UCapsaActorComponent>& Component : WorldComponents )
+	{
+		if( Component.IsValid() == true )
+		{
+			CapsaCoreSubsystem->SetCapsaActorComponent( Component.Get() );
+			return;
+		}
+	}
+
+	for( const TPair<TObjectKey<AController>, TArray<TWeakObjectPtr<UCapsaActorComponent>>>& Player : PlayerComponents )
+	{
+		for( const TWeakObjectPtr<UCapsaActorComponent>& Component : Player.Value )
+		{
+			if( Component.IsValid() == true )
+			{
+				CapsaCoreSubsystem->SetCapsaActorComponent( Component.Get() );
+				return;
+			}
+		}
+	}
+}
@@ -4,26 +4,142 @@
 
 #include "CapsaCore.h"
 #include "CapsaCoreSubsystem.h"
+#include "Telemetry/CapsaFrameBudget.h"
 
+#include "Net/Core/PushModel/PushModel.h"
 #include "Net/UnrealNetwork.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaActorComponent)
 
 
+namespace CapsaSharedData
+{
+	/**
+	* The descriptions GetDefaultDescription() returns, replicated as their index. Keep the order, clients and
+	* servers of different versions have to agree on it. Index 0 is a custom description, sent as a string.
+	*/
+	enum class EDescription : uint8
+	{
+		Custom,
+		DedicatedServer,
+		ListenServer,
+		Editor,
+		Player,
+		Num
+	};
+
+	static const TCHAR* const DescriptionNames[] = { TEXT( "" ), TEXT( "DedicatedServer" ), TEXT( "ListenServer" ), TEXT( "Editor" ), TEXT( "Player" ) };
+	static_assert( UE_ARRAY_COUNT( DescriptionNames ) == static_cast<int32>( EDescription::Num ), "A description is missing a name" );
+
+	static constexpr int32 NumDescriptionBits = 3;
+	static_assert( static_cast<int32>( EDescription::Num ) <= ( 1 << NumDescriptionBits ), "Not enough bits for the descriptions" );
+
+	static EDescription FindDescription( const FString& Description )
+	{
+		for( int32 Index = 1; Index < static_cast<int32>( EDescription::Num ); ++Index )
+		{
+			if( Description.Equals( DescriptionNames[Index], ESearchCase::CaseSensitive ) == true )
+			{
+				return static_cast<EDescription>( Index );
+			}
+		}
+		return EDescription::Custom;
+	}
+
+	/**
+	* Capsa Log IDs are UUIDs, only send them as a GUID if the string can be recreated exactly.
+	*/
+	static bool ParseLogID( const FString& LogID, FGuid& OutGuid )
+	{
+		return LogID.Len() == 36 && FGuid::ParseExact( LogID, EGuidFormats::DigitsWithHyphens, OutGuid ) == true
+			&& OutGuid.ToString( EGuidFormats::DigitsWithHyphensLower ).Equals( LogID, ESearchCase::CaseSensitive ) == true;
+	}
+}
+
 FString GetDefaultDescription( bool bIsServer )
 {
+	using namespace CapsaSharedData;
+
 #if UE_SERVER
-	return TEXT("DedicatedServer");
+	return DescriptionNames[static_cast<int32>( EDescription::DedicatedServer )];
 #elif UE_EDITOR
-	return TEXT("Editor");
+	return DescriptionNames[static_cast<int32>( EDescription::Editor )];
 #else
-	return bIsServer ? TEXT("ListenServer") : TEXT("Player");
+	return DescriptionNames[static_cast<int32>( bIsServer ? EDescription::ListenServer : EDescription::Player )];
 #endif
 }
 
+bool FCapsaSharedData::NetSerialize( FArchive& Ar, UPackageMap* Map, bool& bOutSuccess )
+{
+	using namespace CapsaSharedData;
+
+	FGuid LogGuid;
+	uint8 bLogIDIsGuid = 0;
+	uint8 bLogURLFromBase = 0;
+	uint8 DescriptionIndex = 0;
+	if( Ar.IsSaving() == true )
+	{
+		bLogIDIsGuid = ParseLogID( LogID, LogGuid ) == true ? 1 : 0;
+		bLogURLFromBase = LogID.IsEmpty() == false && LogURL.EndsWith( LogID, ESearchCase::CaseSensitive ) == true ? 1 : 0;
+		DescriptionIndex = static_cast<uint8>( FindDescription( Description ) );
+	}
+
+	Ar.SerializeBits( &bLogIDIsGuid, 1 );
+	Ar.SerializeBits( &bLogURLFromBase, 1 );
+	Ar.SerializeBits( &DescriptionIndex, NumDescriptionBits );
+
+	if( bLogIDIsGuid == 1 )
+	{
+		Ar << LogGuid;
+		if( Ar.IsLoading() == true )
+		{
+			LogID = LogGuid.ToString( EGuidFormats::DigitsWithHyphensLower );
+		}
+	} else
+	{
+		Ar << LogID;
+	}
+
+	// The web URL of a log is the same for every log of a Capsa environment, except for the LogID at the end
+	if( bLogURLFromBase == 1 )
+	{
+		FString LogURLBase;
+		if( Ar.IsSaving() == true )
+		{
+			LogURLBase = LogURL.LeftChop( LogID.Len() );
+		}
+		Ar << LogURLBase;
+		if( Ar.IsLoading() == true )
+		{
+			LogURL = LogURLBase + LogID;
+		}
+	} else
+	{
+		Ar << LogURL;
+	}
+
+	if( DescriptionIndex == static_cast<uint8>( EDescription::Custom ) )
+	{
+		Ar << Description;
+	} else if( Ar.IsLoading() == true )
+	{
+		if( DescriptionIndex >= static_cast<uint8>( EDescription::Num ) )
+		{
+			Ar.SetError();
+		} else
+		{
+			Description = DescriptionNames[DescriptionIndex];
+		}
+	}
+
+	bOutSuccess = Ar.IsError() == false;
+	return true;
+}
+
 UCapsaActorComponent::UCapsaActorComponent()
 	: CapsaServerData( FCapsaSharedData{} )
 	, CapsaData( FCapsaSharedData{} )
+	, NumLinkedLogs( 0 )
 {
 	SetIsReplicatedByDefault( true );
 	SetAutoActivate( true );
@@ -33,11 +149,16 @@ void UCapsaActorComponent::GetLifetimeReplicatedProps( TArray<FLifetimeProperty>
 {
 	Super::GetLifetimeReplicatedProps( OutLifetimeProps );
 
-	DOREPLIFETIME( UCapsaActorComponent, CapsaServerData );
+	// Only changes when the server authenticates, don't compare it on every net update
+	FDoRepLifetimeParams Params;
+	Params.bIsPushBased = true;
+	DOREPLIFETIME_WITH_PARAMS_FAST( UCapsaActorComponent, CapsaServerData, Params );
 }
 
 void UCapsaActorComponent::ServerRegisterLinkedCapsaLog_Implementation( const FCapsaSharedData& ClientCapsaData )
 {
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
 	FString OldCapsaId = CapsaData.LogID;
 	FString NewCapsaId = ClientCapsaData.LogID;
 
@@ -45,6 +166,17 @@ void UCapsaActorComponent::ServerRegisterLinkedCapsaLog_Implementation( const FC
 
 	UE_LOG( LogCapsaCore, Log, TEXT("UCapsaActorComponent::ServerRegisterLinkedCapsaLog_Implementation | OldCapsaId: %s, NewCapsaId: %s"), *OldCapsaId, *NewCapsaId );
 
+	if( OldCapsaId.Equals( NewCapsaId ) == true )
+	{
+		return;
+	}
+
+	if( NumLinkedLogs >= MaxLinkedLogsPerComponent )
+	{
+		UE_LOG( LogCapsaCore, Warning, TEXT("UCapsaActorComponent::ServerRegisterLinkedCapsaLog_Implementation | Ignoring linked log %s, this client already linked %d logs"), *NewCapsaId, NumLinkedLogs );
+		return;
+	}
+
 	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
 	if( CapsaCoreSubsystem == nullptr )
 	{
@@ -54,11 +186,17 @@ void UCapsaActorComponent::ServerRegisterLinkedCapsaLog_Implementation( const FC
 
 	UE_LOG( LogCapsaCore, Log, TEXT("UCapsaActorComponent::ServerRegisterLinkedCapsaLog_Implementation | Adding linked log with ID: %s, Description: %s"), *ClientCapsaData.LogID, *ClientCapsaData.Description );
 	
-	CapsaCoreSubsystem->RegisterLinkedLogID( ClientCapsaData.LogID, ClientCapsaData.Description );
+	// With bUseWorldLogSessions, the client is linked with the log of this World
+	if( CapsaCoreSubsystem->GetLogSession( this ).RegisterLinkedLogID( ClientCapsaData.LogID, ClientCapsaData.Description ) == true )
+	{
+		++NumLinkedLogs;
+	}
 }
 
 void UCapsaActorComponent::OnRep_CapsaServerData()
 {
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
 	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
 	if( CapsaCoreSubsystem == nullptr )
 	{
@@ -66,7 +204,7 @@ void UCapsaActorComponent::OnRep_CapsaServerData()
 		return;
 	}
 
-	CapsaCoreSubsystem->RegisterLinkedLogID( CapsaServerData.LogID, CapsaServerData.Description );
+	CapsaCoreSubsystem->GetLogSession( this ).RegisterLinkedLogID( CapsaServerData.LogID, CapsaServerData.Description );
 	CapsaCoreSubsystem->OnServerCapsaDataChangedDynamic.Broadcast( CapsaServerData.LogID, CapsaServerData.LogURL );
 	
 	UE_LOG( LogCapsaCore, Verbose, TEXT( "UCapsaActorComponent::OnCapsaServerDataUpdated | CapsaServerId Updated: %s" ), *CapsaServerData.ToString() );
@@ -85,12 +223,13 @@ void UCapsaActorComponent::BeginPlay()
 		return;
 	}
 
-	// Add a callback for whenever the authentication changes
-	CapsaCoreSubsystem->OnAuthChanged.AddUObject( this, &UCapsaActorComponent::OnAuthenticationDelegate );
+	// Add a callback for whenever the authentication of the log of this World changes
+	FCapsaLogSession& LogSession = CapsaCoreSubsystem->GetLogSession( this );
+	LogSession.OnAuthChanged.AddUObject( this, &UCapsaActorComponent::OnAuthenticationDelegate );
 
 	// Populate the data with the currently present data
-	FString CapsaLogId = CapsaCoreSubsystem->GetLogID();
-	FString CapsaLogURL = CapsaCoreSubsystem->GetLogURL();
+	FString CapsaLogId = LogSession.GetLogID();
+	FString CapsaLogURL = LogSession.GetLogURL();
 
 	bool bIsServer = GetIsServer();
 	
@@ -127,7 +266,10 @@ void UCapsaActorComponent::EndPlay( EEndPlayReason::Type EndPlayReason )
 	if( CapsaCoreSubsystem == nullptr )
 	{
 		UE_LOG( LogCapsaCore, Error, TEXT("UCapsaActorComponent::EndPlay | CapsaCoreSubsystem is nullptr") );
-		return;
+	} else
+	{
+		// Added in BeginPlay, one per component over the whole uptime of a server otherwise
+		CapsaCoreSubsystem->GetLogSession( this ).OnAuthChanged.RemoveAll( this );
 	}
 
 	Super::EndPlay( EndPlayReason );
@@ -145,6 +287,7 @@ void UCapsaActorComponent::OnAuthenticationDelegate( const FString& LogId, const
 	if( bIsServer )
 	{
 		CapsaServerData = CapsaData;
+		MARK_PROPERTY_DIRTY_FROM_NAME( UCapsaActorComponent, CapsaServerData, this );
 		OnRep_CapsaServerData(); // Replicate to clients
 
 		UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
@@ -161,8 +304,15 @@ void UCapsaActorComponent::OnAuthenticationDelegate( const FString& LogId, const
 		UE_LOG( LogCapsaCore, Verbose, TEXT("UCapsaActorComponent::OnAuthenticationDelegate | OnRep_CapsaServerData called"));
 	}
 	
-	// Will only reach the server on connections we are authorized to do so.
+	// Only reaches the server from the owning client, and the server does not link with itself.
 	// This will trigger the server to add a log link to the joined client
+	AActor* Owner = GetOwner();
+	if( bIsServer == true || Owner == nullptr || Owner->GetNetConnection() == nullptr || CapsaData.LogID.Equals( RegisteredLogID ) == true )
+	{
+		return;
+	}
+
+	RegisteredLogID = CapsaData.LogID;
 	ServerRegisterLinkedCapsaLog( CapsaData );
 }
 
@@ -0,0 +1,270 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Encoding/CapsaColumnarEncoder.h"
+
+#include "CapsaCore.h"
+#include "FunctionLibrary/CapsaCoreFunctionLibrary.h"
+
+
+namespace CapsaColumnar
+{
+	static const uint8 Magic[4] = { 'C', 'P', 'S', 'C' };
+
+	static void WriteVarUInt( TArray<uint8>& Out, uint64 Value )
+	{
+		do
+		{
+			uint8 Byte = Value & 0x7F;
+			Value >>= 7;
+			if( Value != 0 )
+			{
+				Byte |= 0x80;
+			}
+			Out.Add( Byte );
+		} while( Value != 0 );
+	}
+
+	static void WriteVarInt( TArray<uint8>& Out, int64 Value )
+	{
+		WriteVarUInt( Out, ( static_cast<uint64>( Value ) << 1 ) ^ static_cast<uint64>( Value >> 63 ) );
+	}
+
+	/**
+	* Appends Message as UTF-8, returns the number of bytes written.
+	*/
+	static int32 WriteUtf8( TArray<uint8>& Out, const TCHAR* Message, int32 Len )
+	{
+		const int32 Utf8Len = FPlatformString::ConvertedLength<UTF8CHAR>( Message, Len );
+		const int32 Offset = Out.AddUninitialized( Utf8Len );
+		FPlatformString::Convert( reinterpret_cast<UTF8CHAR*>( Out.GetData() + Offset ), Utf8Len, Message, Len );
+		return Utf8Len;
+	}
+
+	static void WriteColumn( TArray<uint8>& Out, const TArray<uint8>& Column )
+	{
+		WriteVarUInt( Out, Column.Num() );
+		Out.Append( Column );
+	}
+
+	class FReader
+	{
+	public:
+
+		explicit FReader( TConstArrayView<uint8> InData )
+			: Data( InData )
+			, Offset( 0 )
+			, bError( false )
+		{
+		}
+
+		uint64						ReadVarUInt()
+		{
+			uint64 Value = 0;
+			for( int32 Shift = 0; Shift < 64; Shift += 7 )
+			{
+				if( Offset >= Data.Num() )
+				{
+					bError = true;
+					return 0;
+				}
+
+				const uint8 Byte = Data[Offset++];
+				Value |= static_cast<uint64>( Byte & 0x7F ) << Shift;
+				if( ( Byte & 0x80 ) == 0 )
+				{
+					return Value;
+				}
+			}
+
+			bError = true;
+			return 0;
+		}
+
+		int64						ReadVarInt()
+		{
+			const uint64 Value = ReadVarUInt();
+			return static_cast<int64>( Value >> 1 ) ^ -static_cast<int64>( Value & 1 );
+		}
+
+		/**
+		* Returns a reader for the next Size bytes, and skips them.
+		*/
+		FReader						ReadBlock( uint64 Size )
+		{
+			if( Size > static_cast<uint64>( Data.Num() - Offset ) )
+			{
+				bError = true;
+				return FReader( TConstArrayView<uint8>() );
+			}
+
+			FReader Block( Data.Slice( Offset, static_cast<int32>( Size ) ) );
+			Offset += static_cast<int32>( Size );
+			return Block;
+		}
+
+		FReader						ReadColumn()
+		{
+			return ReadBlock( ReadVarUInt() );
+		}
+
+		FString						ReadUtf8( uint64 Size )
+		{
+			FReader Block = ReadBlock( Size );
+			if( Block.Data.IsEmpty() == true )
+			{
+				return FString();
+			}
+			return FString( FUTF8ToTCHAR( reinterpret_cast<const ANSICHAR*>( Block.Data.GetData() ), Block.Data.Num() ) );
+		}
+
+		uint8						ReadByte()
+		{
+			if( Offset >= Data.Num() )
+			{
+				bError = true;
+				return 0;
+			}
+			return Data[Offset++];
+		}
+
+		bool						HasError() const
+		{
+			return bError;
+		}
+
+	private:
+
+		TConstArrayView<uint8>		Data;
+		int32						Offset;
+		bool						bError;
+	};
+}
+
+
+void FCapsaColumnarEncoder::EncodeChunk( TConstArrayView<FBufferedLine> Lines, TArray<uint8>& OutChunk )
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaColumnarEncoder::EncodeChunk);
+
+	TArray<uint8> Dictionary;
+	TArray<uint8> TimeColumn;
+	TArray<uint8> VerbosityColumn;
+	TArray<uint8> CategoryColumn;
+	TArray<uint8> LengthColumn;
+	TArray<uint8> Heap;
+
+	TimeColumn.Reserve( Lines.Num() * 3 );
+	VerbosityColumn.Reserve( Lines.Num() );
+	CategoryColumn.Reserve( Lines.Num() );
+	LengthColumn.Reserve( Lines.Num() * 2 );
+
+	// Every category the chunk uses gets a dictionary entry, the IDs stay the same for the whole session
+	TSet<uint32> ChunkCategoryIDs;
+	{
+		FScopeLock ScopeLock( &CriticalSection );
+
+		for( const FBufferedLine& Line : Lines )
+		{
+			const FName Category = Line.Category.Resolve();
+			uint32* CategoryID = CategoryIDs.Find( Category );
+			if( CategoryID == nullptr )
+			{
+				CategoryID = &CategoryIDs.Add( Category, CategoryIDs.Num() );
+			}
+
+			bool bAlreadyInChunk = false;
+			ChunkCategoryIDs.Add( *CategoryID, &bAlreadyInChunk );
+			if( bAlreadyInChunk == false )
+			{
+				const FString CategoryName = Category.ToString();
+				TArray<uint8> Name;
+				CapsaColumnar::WriteUtf8( Name, *CategoryName, CategoryName.Len() );
+				CapsaColumnar::WriteVarUInt( Dictionary, *CategoryID );
+				CapsaColumnar::WriteVarUInt( Dictionary, Name.Num() );
+				Dictionary.Append( Name );
+			}
+			CapsaColumnar::WriteVarUInt( CategoryColumn, *CategoryID );
+		}
+	}
+
+	int64 PreviousTimeBits = 0;
+	for( const FBufferedLine& Line : Lines )
+	{
+		const int64 TimeBits = static_cast<int64>( FGenericPlatformMath::AsUInt( Line.Time ) );
+		CapsaColumnar::WriteVarInt( TimeColumn, TimeBits - PreviousTimeBits );
+		PreviousTimeBits = TimeBits;
+
+		VerbosityColumn.Add( static_cast<uint8>( Line.Verbosity & ELogVerbosity::VerbosityMask ) );
+
+		const TCHAR* Message = Line.Data.Get();
+		CapsaColumnar::WriteVarUInt( LengthColumn, CapsaColumnar::WriteUtf8( Heap, Message, FCString::Strlen( Message ) ) );
+	}
+
+	OutChunk.Reserve( OutChunk.Num() + 16 + Dictionary.Num() + TimeColumn.Num() + VerbosityColumn.Num() + CategoryColumn.Num() + LengthColumn.Num() + Heap.Num() );
+	OutChunk.Append( CapsaColumnar::Magic, UE_ARRAY_COUNT( CapsaColumnar::Magic ) );
+	OutChunk.Add( Version );
+	CapsaColumnar::WriteVarUInt( OutChunk, Lines.Num() );
+	CapsaColumnar::WriteVarUInt( OutChunk, ChunkCategoryIDs.Num() );
+	OutChunk.Append( Dictionary );
+	CapsaColumnar::WriteColumn( OutChunk, TimeColumn );
+	CapsaColumnar::WriteColumn( OutChunk, VerbosityColumn );
+	CapsaColumnar::WriteColumn( OutChunk, CategoryColumn );
+	CapsaColumnar::WriteColumn( OutChunk, LengthColumn );
+	CapsaColumnar::WriteColumn( OutChunk, Heap );
+}
+
+int32 FCapsaColumnarEncoder::GetNumCategories() const
+{
+	FScopeLock ScopeLock( &CriticalSection );
+	return CategoryIDs.Num();
+}
+
+bool FCapsaColumnarEncoder::DecodeChunk( TConstArrayView<uint8> Chunk, TMap<uint32, FString>& Categories, FString& OutLog )
+{
+	if( Chunk.Num() < 5 || FMemory::Memcmp( Chunk.GetData(), CapsaColumnar::Magic, 4 ) != 0 || Chunk[4] != Version )
+	{
+		return false;
+	}
+
+	CapsaColumnar::FReader Reader( Chunk.RightChop( 5 ) );
+	const uint64 NumLines = Reader.ReadVarUInt();
+
+	const uint64 NumCategories = Reader.ReadVarUInt();
+	for( uint64 Index = 0; Index < NumCategories && Reader.HasError() == false; ++Index )
+	{
+		const uint32 CategoryID = static_cast<uint32>( Reader.ReadVarUInt() );
+		const uint64 NameLength = Reader.ReadVarUInt();
+		Categories.Add( CategoryID, Reader.ReadUtf8( NameLength ) );
+	}
+
+	CapsaColumnar::FReader TimeColumn = Reader.ReadColumn();
+	CapsaColumnar::FReader VerbosityColumn = Reader.ReadColumn();
+	CapsaColumnar::FReader CategoryColumn = Reader.ReadColumn();
+	CapsaColumnar::FReader LengthColumn = Reader.ReadColumn();
+	CapsaColumnar::FReader Heap = Reader.ReadColumn();
+	if( Reader.HasError() == true )
+	{
+		return false;
+	}
+
+	int64 TimeBits = 0;
+	for( uint64 Index = 0; Index < NumLines; ++Index )
+	{
+		TimeBits += TimeColumn.ReadVarInt();
+		const double Time = FGenericPlatformMath::AsFloat( static_cast<uint64>( TimeBits ) );
+		const ELogVerbosity::Type Verbosity = static_cast<ELogVerbosity::Type>( VerbosityColumn.ReadByte() );
+		const FString* Category = Categories.Find( static_cast<uint32>( CategoryColumn.ReadVarUInt() ) );
+		const FString Message = Heap.ReadUtf8( LengthColumn.ReadVarUInt() );
+
+		if( Category == nullptr || TimeColumn.HasError() == true || VerbosityColumn.HasError() == true
+			|| CategoryColumn.HasError() == true || LengthColumn.HasError() == true || Heap.HasError() == true )
+		{
+			return false;
+		}
+
+		UCapsaCoreFunctionLibrary::AppendLogLinePrefix( OutLog, Time, Verbosity, FName( *Category ) );
+		OutLog.Append( Message );
+		OutLog.Append( LINE_TERMINATOR_ANSI );
+	}
+
+	return true;
+}
@@ -0,0 +1,328 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Encoding/CapsaJsonReader.h"
+
+#include "Misc/Parse.h"
+
+
+FCapsaJsonReader::FCapsaJsonReader( TConstArrayView<uint8> InJson )
+	: Current( reinterpret_cast<const ANSICHAR*>( InJson.GetData() ) )
+	, End( reinterpret_cast<const ANSICHAR*>( InJson.GetData() ) + InJson.Num() )
+{
+	// Skip a UTF-8 byte order mark
+	if( End - Current >= 3 && static_cast<uint8>( Current[0] ) == 0xEF && static_cast<uint8>( Current[1] ) == 0xBB && static_cast<uint8>( Current[2] ) == 0xBF )
+	{
+		Current += 3;
+	}
+}
+
+bool FCapsaJsonReader::ReadObject( TFunctionRef<bool( FAnsiStringView Key )> Visitor )
+{
+	if( Consume( '{' ) == false )
+	{
+		return false;
+	}
+
+	if( Consume( '}' ) == true )
+	{
+		return true;
+	}
+
+	do
+	{
+		FAnsiStringView Key;
+		bool bEscaped = false;
+		if( ReadRawString( Key, bEscaped ) == false || Consume( ':' ) == false )
+		{
+			return false;
+		}
+
+		if( Visitor( Key ) == false )
+		{
+			return false;
+		}
+	} while( Consume( ',' ) == true );
+
+	return Consume( '}' );
+}
+
+bool FCapsaJsonReader::ReadString( FString& OutValue )
+{
+	FAnsiStringView Raw;
+	bool bEscaped = false;
+	if( ReadRawString( Raw, bEscaped ) == false )
+	{
+		return false;
+	}
+
+	OutValue.Reset();
+	if( bEscaped == false )
+	{
+		const FUTF8ToTCHAR Converted( Raw.GetData(), Raw.Len() );
+		OutValue.AppendChars( Converted.Get(), Converted.Length() );
+		return true;
+	}
+
+	const ANSICHAR* RunStart = Raw.GetData();
+	const ANSICHAR* const RawEnd = Raw.GetData() + Raw.Len();
+	auto FlushRun = [&OutValue, &RunStart]( const ANSICHAR* RunEnd )
+		{
+			if( RunEnd > RunStart )
+			{
+				const FUTF8ToTCHAR Converted( RunStart, static_cast<int32>( RunEnd - RunStart ) );
+				OutValue.AppendChars( Converted.Get(), Converted.Length() );
+			}
+		};
+
+	const ANSICHAR* Char = RunStart;
+	while( Char < RawEnd )
+	{
+		if( *Char != '\\' )
+		{
+			++Char;
+			continue;
+		}
+
+		FlushRun( Char );
+		++Char;
+		if( Char >= RawEnd )
+		{
+			return false;
+		}
+
+		switch( *Char++ )
+		{
+		case '"': OutValue.AppendChar( TEXT( '"' ) ); break;
+		case '\\': OutValue.AppendChar( TEXT( '\\' ) ); break;
+		case '/': OutValue.AppendChar( TEXT( '/' ) ); break;
+		case 'b': OutValue.AppendChar( TEXT( '\b' ) ); break;
+		case 'f': OutValue.AppendChar( TEXT( '\f' ) ); break;
+		case 'n': OutValue.AppendChar( TEXT( '\n' ) ); break;
+		case 'r': OutValue.AppendChar( TEXT( '\r' ) ); break;
+		case 't': OutValue.AppendChar( TEXT( '\t' ) ); break;
+		case 'u':
+		{
+			uint32 CodePoint = 0;
+			if( ReadHex4( Char, RawEnd, CodePoint ) == false )
+			{
+				return false;
+			}
+
+			// Surrogate pair
+			if( CodePoint >= 0xD800 && CodePoint <= 0xDBFF && RawEnd - Char >= 6 && Char[0] == '\\' && Char[1] == 'u' )
+			{
+				const ANSICHAR* LowStart = Char + 2;
+				uint32 Low = 0;
+				if( ReadHex4( LowStart, RawEnd, Low ) == true && Low >= 0xDC00 && Low <= 0xDFFF )
+				{
+					CodePoint = 0x10000 + ( ( CodePoint - 0xD800 ) << 10 ) + ( Low - 0xDC00 );
+					Char = LowStart;
+				}
+			}
+
+			if( CodePoint >= 0x10000 && sizeof( TCHAR ) == 2 )
+			{
+				OutValue.AppendChar( static_cast<TCHAR>( 0xD800 + ( ( CodePoint - 0x10000 ) >> 10 ) ) );
+				OutValue.AppendChar( static_cast<TCHAR>( 0xDC00 + ( ( CodePoint - 0x10000 ) & 0x3FF ) ) );
+			} else
+			{
+				OutValue.AppendChar( static_cast<TCHAR>( CodePoint ) );
+			}
+			break;
+		}
+		default:
+			return false;
+		}
+		RunStart = Char;
+	}
+	FlushRun( RawEnd );
+
+	return true;
+}
+
+bool FCapsaJsonReader::ReadNumber( double& OutValue )
+{
+	SkipWhitespace();
+
+	const ANSICHAR* Start = Current;
+	while( Current < End && ( FCharAnsi::IsDigit( *Current ) == true || *Current == '-' || *Current == '+' || *Current == '.' || *Current == 'e' || *Current == 'E' ) )
+	{
+		++Current;
+	}
+
+	const int32 Length = static_cast<int32>( Current - Start );
+	ANSICHAR Number[64];
+	if( Length == 0 || Length >= UE_ARRAY_COUNT( Number ) )
+	{
+		return false;
+	}
+
+	FMemory::Memcpy( Number, Start, Length );
+	Number[Length] = '\0';
+	OutValue = FCStringAnsi::Atod( Number );
+	return true;
+}
+
+bool FCapsaJsonReader::ReadBool( bool& bOutValue )
+{
+	SkipWhitespace();
+
+	if( End - Current >= 4 && FCStringAnsi::Strncmp( Current, "true", 4 ) == 0 )
+	{
+		Current += 4;
+		bOutValue = true;
+		return true;
+	}
+
+	if( End - Current >= 5 && FCStringAnsi::Strncmp( Current, "false", 5 ) == 0 )
+	{
+		Current += 5;
+		bOutValue = false;
+		return true;
+	}
+
+	return false;
+}
+
+bool FCapsaJsonReader::SkipValue()
+{
+	return SkipValue( 0 );
+}
+
+bool FCapsaJsonReader::IsAtEnd()
+{
+	SkipWhitespace();
+	return Current >= End;
+}
+
+void FCapsaJsonReader::SkipWhitespace()
+{
+	while( Current < End && ( *Current == ' ' || *Current == '\t' || *Current == '\n' || *Current == '\r' ) )
+	{
+		++Current;
+	}
+}
+
+bool FCapsaJsonReader::Consume( ANSICHAR Char )
+{
+	SkipWhitespace();
+	if( Current < End && *Current == Char )
+	{
+		++Current;
+		return true;
+	}
+	return false;
+}
+
+bool FCapsaJsonReader::ReadRawString( FAnsiStringView& OutRaw, bool& bOutEscaped )
+{
+	if( Consume( '"' ) == false )
+	{
+		return false;
+	}
+
+	bOutEscaped = false;
+	const ANSICHAR* Start = Current;
+	while( Current < End )
+	{
+		if( *Current == '"' )
+		{
+			OutRaw = FAnsiStringView( Start, static_cast<int32>( Current - Start ) );
+			++Current;
+			return true;
+		}
+
+		if( *Current == '\\' )
+		{
+			bOutEscaped = true;
+			if( ++Current >= End )
+			{
+				break;
+			}
+		}
+		++Current;
+	}
+
+	return false;
+}
+
+bool FCapsaJsonReader::SkipValue( int32 Depth )
+{
+	if( Depth > MaxDepth )
+	{
+		return false;
+	}
+
+	SkipWhitespace();
+	if( Current >= End )
+	{
+		return false;
+	}
+
+	switch( *Current )
+	{
+	case '"':
+	{
+		FAnsiStringView Raw;
+		bool bEscaped = false;
+		return ReadRawString( Raw, bEscaped );
+	}
+	case '{':
+		return ReadObject( [this, Depth]( FAnsiStringView )
+			{
+				return SkipValue( Depth + 1 );
+			} );
+	case '[':
+		++Current;
+		if( Consume( ']' ) == true )
+		{
+			return true;
+		}
+		do
+		{
+			if( SkipValue( Depth + 1 ) == false )
+			{
+				return false;
+			}
+		} while( Consume( ',' ) == true );
+		return Consume( ']' );
+	case 't':
+	case 'f':
+	{
+		bool bValue = false;
+		return ReadBool( bValue );
+	}
+	case 'n':
+		if( End - Current >= 4 && FCStringAnsi::Strncmp( Current, "null", 4 ) == 0 )
+		{
+			Current += 4;
+			return true;
+		}
+		return false;
+	default:
+	{
+		double Value = 0.0;
+		return ReadNumber( Value );
+	}
+	}
+}
+
+bool FCapsaJsonReader::ReadHex4( const ANSICHAR*& Char, const ANSICHAR* HexEnd, uint32& OutValue ) const
+{
+	if( HexEnd - Char < 4 )
+	{
+		return false;
+	}
+
+	OutValue = 0;
+	for( int32 Index = 0; Index < 4; ++Index, ++Char )
+	{
+		const ANSICHAR Digit = *Char;
+		if( FCharAnsi::IsHexDigit( Digit ) == false )
+		{
+			return false;
+		}
+		OutValue = ( OutValue << 4 ) | FParse::HexDigit( Digit );
+	}
+	return true;
+}
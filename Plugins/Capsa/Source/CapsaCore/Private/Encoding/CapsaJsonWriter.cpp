@@ -0,0 +1,215 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Encoding/CapsaJsonWriter.h"
+
+
+FCapsaJsonWriter::FCapsaJsonWriter( TArray<uint8>& InBuffer )
+	: Buffer( InBuffer )
+	, bAfterKey( false )
+{
+}
+
+void FCapsaJsonWriter::BeginObject()
+{
+	BeginValue();
+	WriteAnsi( "{", 1 );
+	HasValue.Push( false );
+}
+
+void FCapsaJsonWriter::EndObject()
+{
+	check( HasValue.Num() > 0 && bAfterKey == false );
+	HasValue.Pop( EAllowShrinking::No );
+	WriteAnsi( "}", 1 );
+}
+
+void FCapsaJsonWriter::BeginArray()
+{
+	BeginValue();
+	WriteAnsi( "[", 1 );
+	HasValue.Push( false );
+}
+
+void FCapsaJsonWriter::EndArray()
+{
+	check( HasValue.Num() > 0 && bAfterKey == false );
+	HasValue.Pop( EAllowShrinking::No );
+	WriteAnsi( "]", 1 );
+}
+
+void FCapsaJsonWriter::WriteKey( FStringView Key )
+{
+	check( bAfterKey == false );
+	BeginValue();
+	WriteEscaped( Key );
+	WriteAnsi( ":", 1 );
+	bAfterKey = true;
+}
+
+void FCapsaJsonWriter::WriteString( FStringView Value )
+{
+	BeginValue();
+	WriteEscaped( Value );
+}
+
+void FCapsaJsonWriter::WriteInteger( int64 Value )
+{
+	BeginValue();
+	ANSICHAR Text[32];
+	WriteAnsi( Text, FCStringAnsi::Snprintf( Text, UE_ARRAY_COUNT( Text ), "%lld", Value ) );
+}
+
+void FCapsaJsonWriter::WriteUnsigned( uint64 Value )
+{
+	BeginValue();
+	ANSICHAR Text[32];
+	WriteAnsi( Text, FCStringAnsi::Snprintf( Text, UE_ARRAY_COUNT( Text ), "%llu", Value ) );
+}
+
+void FCapsaJsonWriter::WriteDouble( double Value )
+{
+	if( FMath::IsFinite( Value ) == false )
+	{
+		WriteNull();
+		return;
+	}
+
+	BeginValue();
+	ANSICHAR Text[32];
+	WriteAnsi( Text, FCStringAnsi::Snprintf( Text, UE_ARRAY_COUNT( Text ), "%.17g", Value ) );
+}
+
+void FCapsaJsonWriter::WriteBool( bool Value )
+{
+	BeginValue();
+	if( Value == true )
+	{
+		WriteAnsi( "true", 4 );
+	} else
+	{
+		WriteAnsi( "false", 5 );
+	}
+}
+
+void FCapsaJsonWriter::WriteNull()
+{
+	BeginValue();
+	WriteAnsi( "null", 4 );
+}
+
+void FCapsaJsonWriter::WriteRaw( TConstArrayView<uint8> Json )
+{
+	BeginValue();
+	Buffer.Append( Json.GetData(), Json.Num() );
+}
+
+void FCapsaJsonWriter::WriteString( FStringView Key, FStringView Value )
+{
+	WriteKey( Key );
+	WriteString( Value );
+}
+
+void FCapsaJsonWriter::WriteInteger( FStringView Key, int64 Value )
+{
+	WriteKey( Key );
+	WriteInteger( Value );
+}
+
+void FCapsaJsonWriter::WriteUnsigned( FStringView Key, uint64 Value )
+{
+	WriteKey( Key );
+	WriteUnsigned( Value );
+}
+
+void FCapsaJsonWriter::WriteDouble( FStringView Key, double Value )
+{
+	WriteKey( Key );
+	WriteDouble( Value );
+}
+
+void FCapsaJsonWriter::WriteBool( FStringView Key, bool Value )
+{
+	WriteKey( Key );
+	WriteBool( Value );
+}
+
+void FCapsaJsonWriter::BeginValue()
+{
+	if( bAfterKey == true )
+	{
+		bAfterKey = false;
+		return;
+	}
+
+	if( HasValue.Num() > 0 )
+	{
+		if( HasValue.Last() == true )
+		{
+			WriteAnsi( ",", 1 );
+		}
+		HasValue.Last() = true;
+	}
+}
+
+void FCapsaJsonWriter::WriteAnsi( const ANSICHAR* Text, int32 Length )
+{
+	Buffer.Append( reinterpret_cast<const uint8*>( Text ), Length );
+}
+
+void FCapsaJsonWriter::WriteEscaped( FStringView Value )
+{
+	WriteAnsi( "\"", 1 );
+
+	// Characters that need no escaping are converted in runs, runs only end at ASCII characters so
+	// surrogate pairs are never split
+	const TCHAR* RunStart = Value.GetData();
+	const TCHAR* const End = Value.GetData() + Value.Len();
+	auto FlushRun = [this, &RunStart]( const TCHAR* RunEnd )
+		{
+			if( RunEnd > RunStart )
+			{
+				const FTCHARToUTF8 Utf8( RunStart, static_cast<int32>( RunEnd - RunStart ) );
+				Buffer.Append( reinterpret_cast<const uint8*>( Utf8.Get() ), Utf8.Length() );
+			}
+		};
+
+	for( const TCHAR* Char = RunStart; Char < End; ++Char )
+	{
+		const TCHAR Character = *Char;
+		if( Character >= 0x20 && Character != TCHAR( '"' ) && Character != TCHAR( '\\' ) )
+		{
+			continue;
+		}
+
+		FlushRun( Char );
+		RunStart = Char + 1;
+
+		switch( Character )
+		{
+		case TCHAR( '"' ):
+			WriteAnsi( "\\\"", 2 );
+			break;
+		case TCHAR( '\\' ):
+			WriteAnsi( "\\\\", 2 );
+			break;
+		case TCHAR( '\n' ):
+			WriteAnsi( "\\n", 2 );
+			break;
+		case TCHAR( '\r' ):
+			WriteAnsi( "\\r", 2 );
+			break;
+		case TCHAR( '\t' ):
+			WriteAnsi( "\\t", 2 );
+			break;
+		default:
+		{
+			ANSICHAR Escaped[8];
+			WriteAnsi( Escaped, FCStringAnsi::Snprintf( Escaped, UE_ARRAY_COUNT( Escaped ), "\\u%04x", static_cast<uint32>( Character ) ) );
+			break;
+		}
+		}
+	}
+	FlushRun( End );
+
+	WriteAnsi( "\"", 1 );
+}
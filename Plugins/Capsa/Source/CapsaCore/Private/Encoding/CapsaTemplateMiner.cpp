@@ -0,0 +1,415 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Encoding/CapsaTemplateMiner.h"
+
+#include "CapsaCore.h"
+
+
+const TCHAR* const FCapsaTemplateMiner::Wildcard = TEXT( "<*>" );
+
+FCapsaTemplateMiner::FCapsaTemplateMiner( float InSimilarityThreshold, int32 InMaxClusters )
+	: SimilarityThreshold( FMath::Clamp( InSimilarityThreshold, 0.f, 1.f ) )
+	, MaxClusters( FMath::Max( InMaxClusters, 1 ) )
+	, NextTemplateID( RawTemplateID + 1 )
+	, LastClusterIndex( INDEX_NONE )
+{
+}
+
+uint32 FCapsaTemplateMiner::AddLine( FStringView Line, TArray<FStringView>& OutParams )
+{
+	OutParams.Reset();
+	LastClusterIndex = INDEX_NONE;
+
+	Tokenize( Line, TokenScratch );
+	if( TokenScratch.Num() > MaxTokens )
+	{
+		OutParams.Add( Line );
+		return RawTemplateID;
+	}
+
+	const int32 NumTokens = TokenScratch.Num();
+	TArray<int32>& Leaf = Leaves.FindOrAdd( GetLeafKey( TokenScratch ) );
+
+	// Find the most similar cluster in the leaf
+	int32 BestCluster = INDEX_NONE;
+	float BestSimilarity = -1.f;
+	int32 BestNumWildcards = -1;
+	for( int32 ClusterIndex : Leaf )
+	{
+		const FCluster& Cluster = Clusters[ClusterIndex];
+		if( Cluster.Tokens.Num() != NumTokens )
+		{
+			continue;
+		}
+
+		int32 NumEqual = 0;
+		int32 NumWildcards = 0;
+		for( int32 TokenIndex = 0; TokenIndex < NumTokens; ++TokenIndex )
+		{
+			const FString& TemplateToken = Cluster.Tokens[TokenIndex];
+			if( IsWildcard( TemplateToken ) == true )
+			{
+				++NumWildcards;
+			} else if( TokenScratch[TokenIndex].Equals( TemplateToken, ESearchCase::CaseSensitive ) == true )
+			{
+				++NumEqual;
+			}
+		}
+
+		const float Similarity = NumTokens > 0 ? static_cast<float>( NumEqual ) / NumTokens : 1.f;
+		if( Similarity > BestSimilarity || ( Similarity == BestSimilarity && NumWildcards > BestNumWildcards ) )
+		{
+			BestCluster = ClusterIndex;
+			BestSimilarity = Similarity;
+			BestNumWildcards = NumWildcards;
+		}
+	}
+
+	if( BestCluster != INDEX_NONE && BestSimilarity >= SimilarityThreshold )
+	{
+		// Generalize the template where this line differs
+		FCluster& Cluster = Clusters[BestCluster];
+		bool bChanged = false;
+		for( int32 TokenIndex = 0; TokenIndex < NumTokens; ++TokenIndex )
+		{
+			FString& TemplateToken = Cluster.Tokens[TokenIndex];
+			if( IsWildcard( TemplateToken ) == false
+				&& TokenScratch[TokenIndex].Equals( TemplateToken, ESearchCase::CaseSensitive ) == false )
+			{
+				TemplateToken = Wildcard;
+				bChanged = true;
+			}
+		}
+
+		if( bChanged == true )
+		{
+			PublishTemplate( Cluster );
+		}
+
+		for( int32 TokenIndex = 0; TokenIndex < NumTokens; ++TokenIndex )
+		{
+			if( IsWildcard( Cluster.Tokens[TokenIndex] ) == true )
+			{
+				OutParams.Add( TokenScratch[TokenIndex] );
+			}
+		}
+
+		LastClusterIndex = BestCluster;
+		return Cluster.TemplateID;
+	}
+
+	if( Clusters.Num() >= MaxClusters )
+	{
+		OutParams.Add( Line );
+		return RawTemplateID;
+	}
+
+	// Start a new cluster, tokens with digits are assumed to be variable from the start.
+	// A literal wildcard token is always a param, the template could not tell it apart otherwise.
+	// So is a token with a line break, dictionary entries are not escaped and must stay on one line.
+	const int32 NewClusterIndex = Clusters.AddDefaulted();
+	FCluster& Cluster = Clusters[NewClusterIndex];
+	Cluster.Tokens.Reserve( NumTokens );
+	for( FStringView Token : TokenScratch )
+	{
+		if( HasDigit( Token ) == true || IsWildcard( Token ) == true || HasLineBreak( Token ) == true )
+		{
+			Cluster.Tokens.Emplace( Wildcard );
+			OutParams.Add( Token );
+		} else
+		{
+			Cluster.Tokens.Emplace( Token );
+		}
+	}
+	Leaf.Add( NewClusterIndex );
+	PublishTemplate( Cluster );
+
+	LastClusterIndex = NewClusterIndex;
+	return Cluster.TemplateID;
+}
+
+void FCapsaTemplateMiner::EncodeLine( FStringView Line, FString& Out )
+{
+	const uint32 TemplateID = AddLine( Line, ParamScratch );
+
+	// The cluster still has the template of TemplateID, it only changes on the next AddLine
+	bool bAlreadyInChunk = true;
+	if( LastClusterIndex != INDEX_NONE )
+	{
+		ChunkTemplateIDs.Add( TemplateID, &bAlreadyInChunk );
+	}
+	if( bAlreadyInChunk == false )
+	{
+		ChunkTemplates.Append( TEXT( "#T " ) );
+		ChunkTemplates.AppendInt( TemplateID );
+		ChunkTemplates.AppendChar( TEXT( ' ' ) );
+		const TArray<FString>& Tokens = Clusters[LastClusterIndex].Tokens;
+		for( int32 TokenIndex = 0; TokenIndex < Tokens.Num(); ++TokenIndex )
+		{
+			if( TokenIndex > 0 )
+			{
+				ChunkTemplates.AppendChar( TEXT( ' ' ) );
+			}
+			ChunkTemplates.Append( Tokens[TokenIndex] );
+		}
+		ChunkTemplates.Append( LINE_TERMINATOR_ANSI );
+	}
+
+	Out.AppendChar( TEXT( '@' ) );
+	Out.AppendInt( TemplateID );
+	for( FStringView Param : ParamScratch )
+	{
+		Out.AppendChar( ParamSeparator );
+		AppendEscapedParam( Param, Out );
+	}
+}
+
+int32 FCapsaTemplateMiner::ConsumeChunkTemplates( FString& Out )
+{
+	const int32 NumChunkTemplates = ChunkTemplateIDs.Num();
+	Out.Append( ChunkTemplates );
+	ChunkTemplates.Reset();
+	ChunkTemplateIDs.Reset();
+
+	return NumChunkTemplates;
+}
+
+int32 FCapsaTemplateMiner::GetNumClusters() const
+{
+	return Clusters.Num();
+}
+
+FCriticalSection& FCapsaTemplateMiner::GetCriticalSection()
+{
+	return CriticalSection;
+}
+
+bool FCapsaTemplateMiner::DecodeChunk( FStringView Chunk, TMap<uint32, FString>& Dictionary, FString& OutLog )
+{
+	bool bSuccess = true;
+	TArray<FStringView> TemplateTokens;
+	TArray<FString> Params;
+
+	while( Chunk.IsEmpty() == false )
+	{
+		int32 LineEnd = INDEX_NONE;
+		FStringView Line = Chunk;
+		if( Chunk.FindChar( TEXT( '\n' ), LineEnd ) == true )
+		{
+			Line = Chunk.Left( LineEnd );
+			Chunk.RightChopInline( LineEnd + 1 );
+		} else
+		{
+			Chunk = FStringView();
+		}
+
+		// Line breaks in messages are escaped, a \r here is part of the line terminator
+		if( Line.EndsWith( TEXT( '\r' ) ) == true )
+		{
+			Line.LeftChopInline( 1 );
+		}
+
+		if( Line.StartsWith( TEXT( "#T " ) ) == true )
+		{
+			FStringView Entry = Line.RightChop( 3 );
+			int32 IDEnd = INDEX_NONE;
+			Entry.FindChar( TEXT( ' ' ), IDEnd );
+			if( IDEnd == INDEX_NONE )
+			{
+				bSuccess = false;
+				continue;
+			}
+
+			const uint32 TemplateID = FCString::Atoi( *FString( Entry.Left( IDEnd ) ) );
+			Dictionary.Add( TemplateID, FString( Entry.RightChop( IDEnd + 1 ) ) );
+			continue;
+		}
+
+		// The prefix ends after the third closing bracket, followed by ": "
+		int32 PrefixEnd = INDEX_NONE;
+		int32 NumBrackets = 0;
+		for( int32 Index = 0; Index < Line.Len(); ++Index )
+		{
+			if( Line[Index] == TEXT( ']' ) && ++NumBrackets == 3 )
+			{
+				PrefixEnd = Index + 3;
+				break;
+			}
+		}
+
+		if( PrefixEnd == INDEX_NONE || PrefixEnd >= Line.Len() || Line[PrefixEnd] != TEXT( '@' ) )
+		{
+			bSuccess = false;
+			continue;
+		}
+
+		OutLog.Append( Line.Left( PrefixEnd ) );
+
+		// Split "@<TemplateID>{\x1F<Param>}", the Template ID has no escaped characters
+		FStringView Body = Line.RightChop( PrefixEnd + 1 );
+		Params.Reset();
+		int32 SeparatorIndex = INDEX_NONE;
+		Body.FindChar( ParamSeparator, SeparatorIndex );
+		const uint32 TemplateID = FCString::Atoi( *FString( SeparatorIndex == INDEX_NONE ? Body : Body.Left( SeparatorIndex ) ) );
+		if( SeparatorIndex != INDEX_NONE )
+		{
+			Params.AddDefaulted();
+			for( int32 Index = SeparatorIndex + 1; Index < Body.Len(); ++Index )
+			{
+				if( Body[Index] == EscapeCharacter && Index + 1 < Body.Len() )
+				{
+					const TCHAR Escaped = Body[++Index];
+					Params.Last().AppendChar( Escaped == TEXT( 'n' ) ? TEXT( '\n' ) : Escaped == TEXT( 'r' ) ? TEXT( '\r' ) : Escaped );
+				} else if( Body[Index] == ParamSeparator )
+				{
+					Params.AddDefaulted();
+				} else
+				{
+					Params.Last().AppendChar( Body[Index] );
+				}
+			}
+		}
+
+		if( TemplateID == RawTemplateID )
+		{
+			if( Params.Num() == 1 )
+			{
+				OutLog.Append( Params[0] );
+			}
+		} else if( const FString* Template = Dictionary.Find( TemplateID ) )
+		{
+			Tokenize( *Template, TemplateTokens );
+			int32 ParamIndex = 0;
+			for( int32 TokenIndex = 0; TokenIndex < TemplateTokens.Num(); ++TokenIndex )
+			{
+				if( TokenIndex > 0 )
+				{
+					OutLog.AppendChar( TEXT( ' ' ) );
+				}
+
+				if( IsWildcard( TemplateTokens[TokenIndex] ) == true && Params.IsValidIndex( ParamIndex ) == true )
+				{
+					OutLog.Append( Params[ParamIndex++] );
+				} else
+				{
+					OutLog.Append( TemplateTokens[TokenIndex] );
+				}
+			}
+		} else
+		{
+			bSuccess = false;
+		}
+
+		OutLog.Append( LINE_TERMINATOR_ANSI );
+	}
+
+	return bSuccess;
+}
+
+void FCapsaTemplateMiner::Tokenize( FStringView Line, TArray<FStringView>& OutTokens )
+{
+	OutTokens.Reset();
+
+	int32 TokenStart = 0;
+	for( int32 Index = 0; Index < Line.Len(); ++Index )
+	{
+		if( Line[Index] == TEXT( ' ' ) )
+		{
+			OutTokens.Add( Line.Mid( TokenStart, Index - TokenStart ) );
+			TokenStart = Index + 1;
+		}
+	}
+	OutTokens.Add( Line.Mid( TokenStart ) );
+}
+
+bool FCapsaTemplateMiner::IsWildcard( FStringView Token )
+{
+	return Token.Equals( Wildcard, ESearchCase::CaseSensitive );
+}
+
+bool FCapsaTemplateMiner::HasDigit( FStringView Token )
+{
+	for( TCHAR Character : Token )
+	{
+		if( FChar::IsDigit( Character ) == true )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool FCapsaTemplateMiner::HasLineBreak( FStringView Token )
+{
+	for( TCHAR Character : Token )
+	{
+		if( Character == TEXT( '\n' ) || Character == TEXT( '\r' ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint64 FCapsaTemplateMiner::GetLeafKey( TConstArrayView<FStringView> Tokens )
+{
+	const int32 NumTokens = Tokens.Num();
+
+	uint64 Key = static_cast<uint64>( NumTokens );
+	for( int32 Depth = 0; Depth < PrefixDepth && Depth < NumTokens; ++Depth )
+	{
+		// Variable looking tokens share the wildcard branch
+		const uint32 TokenHash = HasDigit( Tokens[Depth] ) == true ? 0 : GetTypeHash( Tokens[Depth] );
+		Key = ( Key * 1099511628211ull ) ^ TokenHash;
+	}
+
+	if( Leaves.Contains( Key ) == true )
+	{
+		return Key;
+	}
+
+	// Limit the fan out per token count, overflow goes to the all-wildcard branch
+	int32& NumLeaves = NumLeavesPerLength.FindOrAdd( NumTokens );
+	if( NumLeaves >= MaxLeavesPerLength )
+	{
+		Key = static_cast<uint64>( NumTokens );
+		for( int32 Depth = 0; Depth < PrefixDepth && Depth < NumTokens; ++Depth )
+		{
+			Key = ( Key * 1099511628211ull ) ^ 0;
+		}
+		return Key;
+	}
+
+	++NumLeaves;
+	return Key;
+}
+
+void FCapsaTemplateMiner::PublishTemplate( FCluster& Cluster )
+{
+	Cluster.TemplateID = NextTemplateID++;
+}
+
+void FCapsaTemplateMiner::AppendEscapedParam( FStringView Param, FString& Out )
+{
+	int32 SpanStart = 0;
+	for( int32 Index = 0; Index < Param.Len(); ++Index )
+	{
+		const TCHAR Character = Param[Index];
+		if( Character == ParamSeparator || Character == EscapeCharacter || Character == TEXT( '\n' ) || Character == TEXT( '\r' ) )
+		{
+			Out.Append( Param.Mid( SpanStart, Index - SpanStart ) );
+			Out.AppendChar( EscapeCharacter );
+			if( Character == TEXT( '\n' ) || Character == TEXT( '\r' ) )
+			{
+				Out.AppendChar( Character == TEXT( '\n' ) ? TEXT( 'n' ) : TEXT( 'r' ) );
+				SpanStart = Index + 1;
+			} else
+			{
+				SpanStart = Index;
+			}
+		}
+	}
+	Out.Append( Param.Mid( SpanStart ) );
+}
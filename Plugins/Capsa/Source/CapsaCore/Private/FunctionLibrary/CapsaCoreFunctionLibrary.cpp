@@ -71,3 +71,15 @@ FString UCapsaCoreFunctionLibrary::GetLogVerbosityString( ELogVerbosity::Type Ve
 	
 	return TEXT( "Unknown" );
 }
+
+void UCapsaCoreFunctionLibrary::AppendLogLinePrefix( FString& Log, double Time, ELogVerbosity::Type Verbosity, const FName& Category )
+{
+	// format: yyyy.mm.dd-hh.mm.ss:mil
+	Log.AppendChar( TEXT( '[' ) );
+	Log.Append( FDateTime::FromUnixTimestampDecimal( Time ).ToString( TEXT( "%Y.%m.%d-%H.%M.%S.%s" ) ) );
+	Log.Append( TEXT( "][" ) );
+	Log.Append( GetLogVerbosityString( Verbosity ) );
+	Log.Append( TEXT( "][" ) );
+	Category.AppendString( Log );
+	Log.Append( TEXT( "]: " ) );
+}
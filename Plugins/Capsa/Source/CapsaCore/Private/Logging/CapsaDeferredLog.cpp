@@ -0,0 +1,568 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Logging/CapsaDeferredLog.h"
+
+#include "CapsaCore.h"
+#include "Misc/ScopeRWLock.h"
+#include "Misc/StringBuilder.h"
+
+#include <stdarg.h>
+
+
+namespace CapsaDeferredLog
+{
+	static FRWLock SinkLock;
+	static TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe> Sink;
+	static std::atomic<bool> bHasSink( false );
+
+	static FRWLock SitesLock;
+	static TArray<TUniquePtr<FCapsaRegisteredLogSite>> Sites;
+
+	/**
+	* Reads the arguments written by FCapsaLogArgWriter.
+	*/
+	class FArgReader
+	{
+	public:
+
+		explicit FArgReader( TConstArrayView<uint8> InData )
+			: Data( InData )
+			, Offset( 0 )
+		{
+		}
+
+		bool						IsEmpty() const
+		{
+			return Offset >= Data.Num();
+		}
+
+		ECapsaLogArgType			PeekType() const
+		{
+			return static_cast<ECapsaLogArgType>( Data[Offset] );
+		}
+
+		int64						ReadInt()
+		{
+			switch( ReadType() )
+			{
+			case ECapsaLogArgType::Double:
+				return static_cast<int64>( Read<double>() );
+			case ECapsaLogArgType::String:
+				SkipString();
+				return 0;
+			default:
+				return Read<int64>();
+			}
+		}
+
+		double						ReadDouble()
+		{
+			switch( ReadType() )
+			{
+			case ECapsaLogArgType::Double:
+				return Read<double>();
+			case ECapsaLogArgType::UInt:
+			case ECapsaLogArgType::Pointer:
+				return static_cast<double>( Read<uint64>() );
+			case ECapsaLogArgType::String:
+				SkipString();
+				return 0.0;
+			default:
+				return static_cast<double>( Read<int64>() );
+			}
+		}
+
+		/**
+		* Returns a pointer to the NUL terminated string, or nullptr if the argument is not a string.
+		* Valid until the next call.
+		*/
+		const TCHAR*				ReadString( int32& OutLen )
+		{
+			if( ReadType() != ECapsaLogArgType::String )
+			{
+				Offset += sizeof( uint64 );
+				OutLen = 0;
+				return nullptr;
+			}
+
+			OutLen = static_cast<int32>( Read<uint32>() );
+			Offset = Align( Offset, alignof( TCHAR ) );
+			const uint8* String = Data.GetData() + Offset;
+			const int32 Size = ( OutLen + 1 ) * sizeof( TCHAR );
+			Offset += Size;
+
+			// The offset is aligned, but the inline storage of FCapsaLogArgWriter may not be
+			if( IsAligned( String, alignof( TCHAR ) ) == false )
+			{
+				UnalignedString.SetNumUninitialized( OutLen + 1, EAllowShrinking::No );
+				FMemory::Memcpy( UnalignedString.GetData(), String, Size );
+				return UnalignedString.GetData();
+			}
+
+			return reinterpret_cast<const TCHAR*>( String );
+		}
+
+	private:
+
+		ECapsaLogArgType			ReadType()
+		{
+			return static_cast<ECapsaLogArgType>( Data[Offset++] );
+		}
+
+		void						SkipString()
+		{
+			const uint32 Len = Read<uint32>();
+			Offset = Align( Offset, alignof( TCHAR ) ) + ( Len + 1 ) * sizeof( TCHAR );
+		}
+
+		template <typename ValueType>
+		ValueType					Read()
+		{
+			ValueType Value;
+			FMemory::Memcpy( &Value, Data.GetData() + Offset, sizeof( ValueType ) );
+			Offset += sizeof( ValueType );
+			return Value;
+		}
+
+		TConstArrayView<uint8>		Data;
+		int32						Offset;
+		TArray<TCHAR>				UnalignedString;
+	};
+
+	/**
+	* Formats a single value with a single printf conversion, through the engine's printf implementation.
+	*/
+	static int32 FormatValue( TCHAR* Dest, int32 DestSize, const TCHAR* Spec, ... )
+	{
+		va_list ArgPtr;
+		va_start( ArgPtr, Spec );
+		const int32 Result = FCString::GetVarArgs( Dest, DestSize, Spec, ArgPtr );
+		va_end( ArgPtr );
+		return Result;
+	}
+
+	template <typename ValueType>
+	static void AppendValue( FString& Out, const TCHAR* Spec, ValueType Value )
+	{
+		TCHAR Buffer[512];
+		const int32 Len = FormatValue( Buffer, UE_ARRAY_COUNT( Buffer ), Spec, Value );
+		if( Len > 0 )
+		{
+			Out.Append( Buffer, FMath::Min( Len, static_cast<int32>( UE_ARRAY_COUNT( Buffer ) ) - 1 ) );
+		}
+	}
+
+	/**
+	* Merges two arrays of lines that are ordered by time into Out.
+	*/
+	static void MergeLines( const TArray<FBufferedLine>& A, const TArray<FBufferedLine>& B, TArray<FBufferedLine>& Out )
+	{
+		Out.Reserve( A.Num() + B.Num() );
+
+		int32 IndexA = 0;
+		int32 IndexB = 0;
+		while( IndexA < A.Num() || IndexB < B.Num() )
+		{
+			const bool bTakeA = IndexB >= B.Num() || ( IndexA < A.Num() && A[IndexA].Time <= B[IndexB].Time );
+			const FBufferedLine& Line = bTakeA == true ? A[IndexA++] : B[IndexB++];
+			Out.Emplace( Line.Data.Get(), Line.Category.Resolve(), Line.Verbosity, Line.Time );
+		}
+	}
+}
+
+
+FCapsaLogFormatSite::FCapsaLogFormatSite( const FName& InCategory, ELogVerbosity::Type InVerbosity, const TCHAR* InFormat, const ANSICHAR* InFile, int32 InLine )
+	: Format( InFormat )
+	, Category( InCategory )
+	, Verbosity( InVerbosity )
+	, File( InFile )
+	, Line( InLine )
+	, ID( 0 )
+{
+	ID = FCapsaDeferredLog::RegisterSite( *this );
+}
+
+void FCapsaLogArgWriter::AddInt( int64 Value )
+{
+	Data.Add( static_cast<uint8>( ECapsaLogArgType::Int ) );
+	Data.Append( reinterpret_cast<const uint8*>( &Value ), sizeof( Value ) );
+}
+
+void FCapsaLogArgWriter::AddUInt( uint64 Value )
+{
+	Data.Add( static_cast<uint8>( ECapsaLogArgType::UInt ) );
+	Data.Append( reinterpret_cast<const uint8*>( &Value ), sizeof( Value ) );
+}
+
+void FCapsaLogArgWriter::AddDouble( double Value )
+{
+	Data.Add( static_cast<uint8>( ECapsaLogArgType::Double ) );
+	Data.Append( reinterpret_cast<const uint8*>( &Value ), sizeof( Value ) );
+}
+
+void FCapsaLogArgWriter::AddString( const TCHAR* Value )
+{
+	if( Value == nullptr )
+	{
+		Value = TEXT( "(null)" );
+	}
+
+	const uint32 Len = FCString::Strlen( Value );
+	Data.Add( static_cast<uint8>( ECapsaLogArgType::String ) );
+	Data.Append( reinterpret_cast<const uint8*>( &Len ), sizeof( Len ) );
+	Data.AddZeroed( Align( Data.Num(), alignof( TCHAR ) ) - Data.Num() );
+	Data.Append( reinterpret_cast<const uint8*>( Value ), ( Len + 1 ) * sizeof( TCHAR ) );
+}
+
+void FCapsaLogArgWriter::AddString( const ANSICHAR* Value )
+{
+	AddString( Value != nullptr ? *FString( Value ) : nullptr );
+}
+
+void FCapsaLogArgWriter::AddPointer( const void* Value )
+{
+	const uint64 Address = reinterpret_cast<UPTRINT>( Value );
+	Data.Add( static_cast<uint8>( ECapsaLogArgType::Pointer ) );
+	Data.Append( reinterpret_cast<const uint8*>( &Address ), sizeof( Address ) );
+}
+
+void FCapsaDeferredLogBuffer::AddLine( uint32 SiteID, double Time, TConstArrayView<uint8> Args )
+{
+	// The header is 16 bytes and the args are padded, so every record starts aligned like the first
+	const uint32 ArgsSize = Args.Num();
+	Data.Append( reinterpret_cast<const uint8*>( &Time ), sizeof( Time ) );
+	Data.Append( reinterpret_cast<const uint8*>( &SiteID ), sizeof( SiteID ) );
+	Data.Append( reinterpret_cast<const uint8*>( &ArgsSize ), sizeof( ArgsSize ) );
+	Data.Append( Args.GetData(), Args.Num() );
+	Data.AddZeroed( Align( Args.Num(), alignof( TCHAR ) ) - Args.Num() );
+	++NumLines;
+}
+
+void FCapsaDeferredLogBuffer::AddRecord( const UE::FLogRecord& Record, double Time )
+{
+	FDeferredRecord& Deferred = Records.Emplace_GetRef( FDeferredRecord{ Record, Time } );
+
+	// The fields may reference memory owned by the caller
+	FCbObject Fields = Record.GetFields();
+	Fields.MakeOwned();
+	Deferred.Record.SetFields( MoveTemp( Fields ) );
+}
+
+int32 FCapsaDeferredLogBuffer::Num() const
+{
+	return NumLines + Records.Num();
+}
+
+bool FCapsaDeferredLogBuffer::IsEmpty() const
+{
+	return Num() == 0;
+}
+
+void FCapsaDeferredLogBuffer::Reset()
+{
+	Data.Reset();
+	NumLines = 0;
+	Records.Reset();
+}
+
+int64 FCapsaDeferredLogBuffer::GetAllocatedSize() const
+{
+	return Data.GetAllocatedSize() + Records.GetAllocatedSize();
+}
+
+double FCapsaDeferredLogBuffer::GetFirstLineTime() const
+{
+	// Both kinds of lines are added in time order, the oldest is the first of either
+	double FirstLineTime = 0.0;
+	if( NumLines > 0 )
+	{
+		FMemory::Memcpy( &FirstLineTime, Data.GetData(), sizeof( FirstLineTime ) );
+	}
+	if( Records.IsEmpty() == false && ( FirstLineTime == 0.0 || Records[0].Time < FirstLineTime ) )
+	{
+		FirstLineTime = Records[0].Time;
+	}
+
+	return FirstLineTime;
+}
+
+void FCapsaDeferredLogBuffer::FormatInto( TArray<FBufferedLine>& Lines ) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaDeferredLogBuffer::FormatInto);
+
+	if( IsEmpty() == true )
+	{
+		return;
+	}
+
+	FString Line;
+
+	TArray<FBufferedLine> CapsaLogLines;
+	CapsaLogLines.Reserve( NumLines );
+	int32 Offset = 0;
+	while( Offset < Data.Num() )
+	{
+		double Time;
+		uint32 SiteID;
+		uint32 ArgsSize;
+		FMemory::Memcpy( &Time, Data.GetData() + Offset, sizeof( Time ) );
+		FMemory::Memcpy( &SiteID, Data.GetData() + Offset + sizeof( Time ), sizeof( SiteID ) );
+		FMemory::Memcpy( &ArgsSize, Data.GetData() + Offset + sizeof( Time ) + sizeof( SiteID ), sizeof( ArgsSize ) );
+		Offset += sizeof( Time ) + sizeof( SiteID ) + sizeof( ArgsSize );
+
+		const TConstArrayView<uint8> Args( Data.GetData() + Offset, ArgsSize );
+		Offset += Align( ArgsSize, alignof( TCHAR ) );
+
+		const FCapsaRegisteredLogSite* Site = FCapsaDeferredLog::FindSite( SiteID );
+		if( Site == nullptr )
+		{
+			continue;
+		}
+
+		Line.Reset();
+		FCapsaDeferredLog::FormatArgs( *Site->Format, Args, Line );
+		CapsaLogLines.Emplace( *Line, Site->Category, Site->Verbosity, Time );
+	}
+
+	TArray<FBufferedLine> RecordLines;
+	RecordLines.Reserve( Records.Num() );
+	TStringBuilder<512> Builder;
+	for( const FDeferredRecord& Deferred : Records )
+	{
+		Builder.Reset();
+		Deferred.Record.FormatMessageTo( Builder );
+		RecordLines.Emplace( Builder.ToString(), Deferred.Record.GetCategory(), Deferred.Record.GetVerbosity(), Deferred.Time );
+	}
+
+	TArray<FBufferedLine> DeferredLines;
+	CapsaDeferredLog::MergeLines( CapsaLogLines, RecordLines, DeferredLines );
+
+	TArray<FBufferedLine> Merged;
+	CapsaDeferredLog::MergeLines( Lines, DeferredLines, Merged );
+	Lines = MoveTemp( Merged );
+}
+
+void FCapsaDeferredLog::SetSink( const TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe>& Sink )
+{
+	// Release the previous sink outside the lock, its destructor may log
+	TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe> PreviousSink;
+	{
+		FWriteScopeLock WriteLock( CapsaDeferredLog::SinkLock );
+		PreviousSink = MoveTemp( CapsaDeferredLog::Sink );
+		CapsaDeferredLog::Sink = Sink;
+		CapsaDeferredLog::bHasSink.store( Sink.IsValid(), std::memory_order_relaxed );
+	}
+}
+
+TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe> FCapsaDeferredLog::GetSink()
+{
+	FReadScopeLock ReadLock( CapsaDeferredLog::SinkLock );
+	return CapsaDeferredLog::Sink;
+}
+
+bool FCapsaDeferredLog::IsEnabled()
+{
+	return CapsaDeferredLog::bHasSink.load( std::memory_order_relaxed );
+}
+
+bool FCapsaDeferredLog::Dispatch( const FCapsaLogFormatSite& Site, TConstArrayView<uint8> Args )
+{
+	// The reference keeps the sink alive while dispatching. The lock is not held across the call: the sink may log,
+	// and a nested read lock blocks behind a waiting SetSink
+	TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe> Sink;
+	{
+		FReadScopeLock ReadLock( CapsaDeferredLog::SinkLock );
+		Sink = CapsaDeferredLog::Sink;
+	}
+
+	if( Sink.IsValid() == false )
+	{
+		return false;
+	}
+
+	Sink->SerializeDeferred( Site, Args );
+	return true;
+}
+
+uint32 FCapsaDeferredLog::RegisterSite( const FCapsaLogFormatSite& Site )
+{
+	TUniquePtr<FCapsaRegisteredLogSite> Registered = MakeUnique<FCapsaRegisteredLogSite>();
+	Registered->Format = Site.Format;
+	Registered->Category = Site.Category;
+	Registered->Verbosity = Site.Verbosity;
+	Registered->File = Site.File;
+	Registered->Line = Site.Line;
+
+	FWriteScopeLock WriteLock( CapsaDeferredLog::SitesLock );
+	return CapsaDeferredLog::Sites.Add( MoveTemp( Registered ) ) + 1;
+}
+
+const FCapsaRegisteredLogSite* FCapsaDeferredLog::FindSite( uint32 SiteID )
+{
+	// The copies are never freed, the pointer stays valid after the lock is released
+	FReadScopeLock ReadLock( CapsaDeferredLog::SitesLock );
+	const int32 Index = static_cast<int32>( SiteID ) - 1;
+	return CapsaDeferredLog::Sites.IsValidIndex( Index ) == true ? CapsaDeferredLog::Sites[Index].Get() : nullptr;
+}
+
+void FCapsaDeferredLog::FormatArgs( const TCHAR* Format, TConstArrayView<uint8> Args, FString& Out )
+{
+	CapsaDeferredLog::FArgReader Reader( Args );
+
+	const TCHAR* Cursor = Format;
+	while( *Cursor != TEXT( '\0' ) )
+	{
+		// Copy the literal text up to the next conversion
+		const TCHAR* LiteralStart = Cursor;
+		while( *Cursor != TEXT( '\0' ) && *Cursor != TEXT( '%' ) )
+		{
+			++Cursor;
+		}
+		Out.Append( LiteralStart, UE_PTRDIFF_TO_INT32( Cursor - LiteralStart ) );
+
+		if( *Cursor == TEXT( '\0' ) )
+		{
+			break;
+		}
+
+		if( Cursor[1] == TEXT( '%' ) )
+		{
+			Out.AppendChar( TEXT( '%' ) );
+			Cursor += 2;
+			continue;
+		}
+
+		// Rebuild the conversion with a known length modifier: %[flags][width][.precision]<conversion>
+		const TCHAR* SpecStart = Cursor++;
+		TStringBuilder<32> Spec;
+		Spec.AppendChar( TEXT( '%' ) );
+		int32 Width = 0;
+
+		while( *Cursor != TEXT( '\0' ) && FCString::Strchr( TEXT( "-+ #0" ), *Cursor ) != nullptr )
+		{
+			Spec.AppendChar( *Cursor++ );
+		}
+
+		if( *Cursor == TEXT( '*' ) )
+		{
+			Width = static_cast<int32>( Reader.IsEmpty() == false ? Reader.ReadInt() : 0 );
+			Spec.Appendf( TEXT( "%d" ), Width );
+			++Cursor;
+		}
+		while( FChar::IsDigit( *Cursor ) == true )
+		{
+			Width = Width * 10 + ( *Cursor - TEXT( '0' ) );
+			Spec.AppendChar( *Cursor++ );
+		}
+
+		if( *Cursor == TEXT( '.' ) )
+		{
+			Spec.AppendChar( *Cursor++ );
+			if( *Cursor == TEXT( '*' ) )
+			{
+				Spec.Appendf( TEXT( "%d" ), static_cast<int32>( Reader.IsEmpty() == false ? Reader.ReadInt() : 0 ) );
+				++Cursor;
+			}
+			while( FChar::IsDigit( *Cursor ) == true )
+			{
+				Spec.AppendChar( *Cursor++ );
+			}
+		}
+
+		// Skip the length modifier, values are captured as 64 bit
+		while( *Cursor != TEXT( '\0' ) && FCString::Strchr( TEXT( "hlLzjtqI" ), *Cursor ) != nullptr )
+		{
+			if( *Cursor == TEXT( 'I' ) )
+			{
+				while( FChar::IsDigit( Cursor[1] ) == true )
+				{
+					++Cursor;
+				}
+			}
+			++Cursor;
+		}
+
+		const TCHAR Conversion = *Cursor;
+		if( Conversion == TEXT( '\0' ) || Reader.IsEmpty() == true )
+		{
+			// Malformed or missing argument, keep the conversion as is
+			Out.Append( SpecStart, UE_PTRDIFF_TO_INT32( ( Conversion == TEXT( '\0' ) ? Cursor : Cursor + 1 ) - SpecStart ) );
+			if( Conversion == TEXT( '\0' ) )
+			{
+				break;
+			}
+			++Cursor;
+			continue;
+		}
+		++Cursor;
+
+		switch( Conversion )
+		{
+		case TEXT( 'd' ):
+		case TEXT( 'i' ):
+			Spec << TEXT( "lld" );
+			CapsaDeferredLog::AppendValue( Out, Spec.ToString(), static_cast<long long>( Reader.ReadInt() ) );
+			break;
+		case TEXT( 'u' ):
+		case TEXT( 'x' ):
+		case TEXT( 'X' ):
+		case TEXT( 'o' ):
+			Spec << TEXT( "ll" );
+			Spec.AppendChar( Conversion );
+			CapsaDeferredLog::AppendValue( Out, Spec.ToString(), static_cast<unsigned long long>( Reader.ReadInt() ) );
+			break;
+		case TEXT( 'c' ):
+			Spec.AppendChar( TEXT( 'c' ) );
+			CapsaDeferredLog::AppendValue( Out, Spec.ToString(), static_cast<int32>( Reader.ReadInt() ) );
+			break;
+		case TEXT( 'f' ):
+		case TEXT( 'F' ):
+		case TEXT( 'e' ):
+		case TEXT( 'E' ):
+		case TEXT( 'g' ):
+		case TEXT( 'G' ):
+		case TEXT( 'a' ):
+		case TEXT( 'A' ):
+			Spec.AppendChar( Conversion );
+			CapsaDeferredLog::AppendValue( Out, Spec.ToString(), Reader.ReadDouble() );
+			break;
+		case TEXT( 'p' ):
+			Spec.AppendChar( TEXT( 'p' ) );
+			CapsaDeferredLog::AppendValue( Out, Spec.ToString(), reinterpret_cast<void*>( static_cast<UPTRINT>( Reader.ReadInt() ) ) );
+			break;
+		case TEXT( 's' ):
+		case TEXT( 'S' ):
+		{
+			if( Reader.PeekType() != ECapsaLogArgType::String )
+			{
+				// A number passed for a string, print the number rather than reading garbage
+				Out.Appendf( TEXT( "%lld" ), static_cast<long long>( Reader.ReadInt() ) );
+				break;
+			}
+
+			int32 Len = 0;
+			const TCHAR* String = Reader.ReadString( Len );
+			if( Spec.Len() == 1 ) // No flags, width or precision
+			{
+				Out.Append( String, Len );
+				break;
+			}
+
+			Spec.AppendChar( TEXT( 's' ) );
+			TArray<TCHAR> Buffer;
+			Buffer.SetNumUninitialized( FMath::Max( Len, Width ) + 1 );
+			const int32 Written = CapsaDeferredLog::FormatValue( Buffer.GetData(), Buffer.Num(), Spec.ToString(), String );
+			if( Written > 0 )
+			{
+				Out.Append( Buffer.GetData(), FMath::Min( Written, Buffer.Num() - 1 ) );
+			}
+			break;
+		}
+		default:
+			// Unknown conversion, keep it as is and skip the argument
+			Out.Append( SpecStart, UE_PTRDIFF_TO_INT32( Cursor - SpecStart ) );
+			Reader.ReadInt();
+			break;
+		}
+	}
+}
@@ -0,0 +1,250 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Logging/CapsaLogRecording.h"
+
+#include "CapsaCore.h"
+
+#include "HAL/FileManager.h"
+#include "Misc/Compression.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+
+static const ANSICHAR RecordingMagic[8] = { 'C', 'A', 'P', 'S', 'A', 'R', 'E', 'C' };
+
+enum class ECapsaRecordKind : uint8
+{
+	Category = 0,
+	Line = 1,
+};
+
+FCapsaLogRecordingWriter::~FCapsaLogRecordingWriter()
+{
+	Close();
+}
+
+bool FCapsaLogRecordingWriter::Open( const FString& FilePath )
+{
+	Close();
+
+	File.Reset( IFileManager::Get().CreateFileWriter( *FilePath ) );
+	if( File.IsValid() == false )
+	{
+		UE_LOG( LogCapsaCore, Error, TEXT( "FCapsaLogRecordingWriter::Open | Failed to create %s" ), *FilePath );
+		return false;
+	}
+
+	uint32 Version = CapsaLogRecording::Version;
+	File->Serialize( const_cast<ANSICHAR*>( RecordingMagic ), sizeof( RecordingMagic ) );
+	*File << Version;
+
+	CategoryIndices.Reset();
+	Block.Reset();
+	NumLines = 0;
+	return true;
+}
+
+void FCapsaLogRecordingWriter::AddLines( TConstArrayView<FBufferedLine> Lines )
+{
+	if( File.IsValid() == false )
+	{
+		return;
+	}
+
+	FMemoryWriter Writer( Block );
+	Writer.Seek( Block.Num() );
+
+	for( const FBufferedLine& Line : Lines )
+	{
+		const FName Category = Line.Category.Resolve();
+		uint32* CategoryIndex = CategoryIndices.Find( Category );
+		if( CategoryIndex == nullptr )
+		{
+			const FTCHARToUTF8 Name( *Category.ToString() );
+			uint8 Kind = static_cast<uint8>( ECapsaRecordKind::Category );
+			uint16 Length = static_cast<uint16>( FMath::Min( Name.Length(), static_cast<int32>( MAX_uint16 ) ) );
+			Writer << Kind;
+			Writer << Length;
+			Writer.Serialize( const_cast<ANSICHAR*>( Name.Get() ), Length );
+			CategoryIndex = &CategoryIndices.Add( Category, CategoryIndices.Num() );
+		}
+
+		const FTCHARToUTF8 Text( Line.Data.Get() );
+		uint8 Kind = static_cast<uint8>( ECapsaRecordKind::Line );
+		double Time = Line.Time;
+		uint8 Verbosity = static_cast<uint8>( Line.Verbosity );
+		uint32 Length = Text.Length();
+		Writer << Kind;
+		Writer << Time;
+		Writer << *CategoryIndex;
+		Writer << Verbosity;
+		Writer << Length;
+		Writer.Serialize( const_cast<ANSICHAR*>( Text.Get() ), Length );
+		++NumLines;
+
+		if( Block.Num() >= CapsaLogRecording::BlockSize )
+		{
+			Flush();
+			Writer.Seek( 0 );
+		}
+	}
+}
+
+void FCapsaLogRecordingWriter::Flush()
+{
+	if( File.IsValid() == false || Block.IsEmpty() == true )
+	{
+		return;
+	}
+
+	CompressedBlock.SetNumUninitialized( FCompression::CompressMemoryBound( NAME_Zlib, Block.Num() ) );
+	int32 CompressedSize = CompressedBlock.Num();
+	if( FCompression::CompressMemory( NAME_Zlib, CompressedBlock.GetData(), CompressedSize, Block.GetData(), Block.Num() ) == false )
+	{
+		UE_LOG( LogCapsaCore, Error, TEXT( "FCapsaLogRecordingWriter::Flush | Failed to compress a block, %d bytes are lost" ), Block.Num() );
+		Block.Reset();
+		return;
+	}
+
+	uint32 UncompressedSize = Block.Num();
+	uint32 CompressedSize32 = CompressedSize;
+	*File << UncompressedSize;
+	*File << CompressedSize32;
+	File->Serialize( CompressedBlock.GetData(), CompressedSize );
+	File->Flush();
+
+	Block.Reset();
+}
+
+void FCapsaLogRecordingWriter::Close()
+{
+	if( File.IsValid() == false )
+	{
+		return;
+	}
+
+	Flush();
+	File->Close();
+	File.Reset();
+}
+
+bool FCapsaLogRecordingWriter::IsOpen() const
+{
+	return File.IsValid() == true;
+}
+
+int64 FCapsaLogRecordingWriter::GetNumLines() const
+{
+	return NumLines;
+}
+
+bool FCapsaLogRecordingReader::Open( const FString& FilePath )
+{
+	File.Reset( IFileManager::Get().CreateFileReader( *FilePath ) );
+	if( File.IsValid() == false )
+	{
+		UE_LOG( LogCapsaCore, Error, TEXT( "FCapsaLogRecordingReader::Open | Failed to open %s" ), *FilePath );
+		return false;
+	}
+
+	ANSICHAR Magic[sizeof( RecordingMagic )];
+	uint32 Version = 0;
+	File->Serialize( Magic, sizeof( Magic ) );
+	*File << Version;
+	if( File->IsError() == true || FMemory::Memcmp( Magic, RecordingMagic, sizeof( Magic ) ) != 0 || Version != CapsaLogRecording::Version )
+	{
+		UE_LOG( LogCapsaCore, Error, TEXT( "FCapsaLogRecordingReader::Open | %s is not a version %u Capsa recording" ), *FilePath, CapsaLogRecording::Version );
+		File.Reset();
+		return false;
+	}
+
+	Categories.Reset();
+	bCorrupt = false;
+	return true;
+}
+
+bool FCapsaLogRecordingReader::ReadBlock( TArray<FBufferedLine>& OutLines )
+{
+	if( File.IsValid() == false || bCorrupt == true || File->AtEnd() == true )
+	{
+		return false;
+	}
+
+	uint32 UncompressedSize = 0;
+	uint32 CompressedSize = 0;
+	*File << UncompressedSize;
+	*File << CompressedSize;
+	if( File->IsError() == true || CompressedSize > File->TotalSize() - File->Tell() || UncompressedSize > 16 * CapsaLogRecording::BlockSize )
+	{
+		bCorrupt = true;
+		return false;
+	}
+
+	CompressedBlock.SetNumUninitialized( CompressedSize );
+	File->Serialize( CompressedBlock.GetData(), CompressedSize );
+	Block.SetNumUninitialized( UncompressedSize );
+	if( File->IsError() == true || FCompression::UncompressMemory( NAME_Zlib, Block.GetData(), UncompressedSize, CompressedBlock.GetData(), CompressedSize ) == false )
+	{
+		bCorrupt = true;
+		return false;
+	}
+
+	FMemoryReader Reader( Block );
+	TArray<ANSICHAR> Text;
+	while( Reader.AtEnd() == false && Reader.IsError() == false )
+	{
+		uint8 Kind = 0;
+		Reader << Kind;
+		if( Kind == static_cast<uint8>( ECapsaRecordKind::Category ) )
+		{
+			uint16 Length = 0;
+			Reader << Length;
+			Text.SetNumUninitialized( Length );
+			Reader.Serialize( Text.GetData(), Length );
+			Categories.Add( FName( FUTF8ToTCHAR( Text.GetData(), Length ) ) );
+		} else if( Kind == static_cast<uint8>( ECapsaRecordKind::Line ) )
+		{
+			double Time = 0.0;
+			uint32 CategoryIndex = 0;
+			uint8 Verbosity = 0;
+			uint32 Length = 0;
+			Reader << Time;
+			Reader << CategoryIndex;
+			Reader << Verbosity;
+			Reader << Length;
+			if( Reader.IsError() == true || CategoryIndex >= static_cast<uint32>( Categories.Num() ) || Length > UncompressedSize )
+			{
+				bCorrupt = true;
+				break;
+			}
+
+			Text.SetNumUninitialized( Length );
+			Reader.Serialize( Text.GetData(), Length );
+			const FUTF8ToTCHAR Converted( Text.GetData(), Length );
+			const FString Line( Converted.Length(), Converted.Get() );
+			OutLines.Emplace( *Line, Categories[CategoryIndex], static_cast<ELogVerbosity::Type>( Verbosity ), Time );
+		} else
+		{
+			bCorrupt = true;
+			break;
+		}
+	}
+
+	if( Reader.IsError() == true || bCorrupt == true )
+	{
+		bCorrupt = true;
+		UE_LOG( LogCapsaCore, Error, TEXT( "FCapsaLogRecordingReader::ReadBlock | The recording is corrupt" ) );
+		return false;
+	}
+
+	return true;
+}
+
+bool FCapsaLogRecordingReader::ReadAll( TArray<FBufferedLine>& OutLines )
+{
+	while( ReadBlock( OutLines ) == true )
+	{
+	}
+
+	return bCorrupt == false;
+}
@@ -0,0 +1,572 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Logging/CapsaLogSession.h"
+
+#include "CapsaCore.h"
+#include "CapsaCoreAsync.h"
+#include "CapsaCoreJson.h"
+#include "Encoding/CapsaColumnarEncoder.h"
+#include "Encoding/CapsaJsonWriter.h"
+#include "Encoding/CapsaTemplateMiner.h"
+#include "FunctionLibrary/CapsaCoreFunctionLibrary.h"
+#include "Settings/CapsaLogPolicy.h"
+#include "Settings/CapsaSettings.h"
+#include "Settings/CapsaSettingsSnapshot.h"
+#include "Telemetry/CapsaFrameBudget.h"
+#include "Telemetry/CapsaTelemetry.h"
+
+#include "HttpModule.h"
+
+
+/**
+* Streams a compressed chunk into its HTTP request. The request and the response handler share the reader, so the
+* payload lives as long as the request needs it and then goes back to the buffer pool of the Log Pipeline.
+*/
+class FCapsaPayloadReader : public FArchive
+{
+public:
+
+	explicit FCapsaPayloadReader( TArray<uint8>&& InPayload )
+		: Payload( MoveTemp( InPayload ) )
+		, Offset( 0 )
+	{
+		SetIsLoading( true );
+	}
+
+	virtual void Serialize( void* Data, int64 Num ) override
+	{
+		if( Num > 0 && Offset + Num <= Payload.Num() )
+		{
+			FMemory::Memcpy( Data, Payload.GetData() + Offset, Num );
+			Offset += Num;
+		} else if( Num > 0 )
+		{
+			SetError();
+		}
+	}
+
+	virtual int64 Tell() override
+	{
+		return Offset;
+	}
+
+	virtual int64 TotalSize() override
+	{
+		return Payload.Num();
+	}
+
+	virtual void Seek( int64 InPos ) override
+	{
+		Offset = FMath::Clamp<int64>( InPos, 0, Payload.Num() );
+	}
+
+	virtual FString GetArchiveName() const override
+	{
+		return TEXT( "FCapsaPayloadReader" );
+	}
+
+	TArray<uint8>	Payload;
+	int64			Offset;
+};
+
+namespace CapsaLogSession
+{
+	/**
+	* The session lines logged on this thread belong to, see FCapsaLogSession::SetCurrentID().
+	*/
+	static thread_local uint32 CurrentID = 0;
+
+	/**
+	* Returns the value of the X-Capsa-Chunk-Format header for the given chunk format.
+	*/
+	static const TCHAR* GetChunkFormatHeaderValue( ECapsaChunkFormat Format )
+	{
+		switch( Format )
+		{
+		case ECapsaChunkFormat::Template:
+			return TEXT( "template" );
+		case ECapsaChunkFormat::Columnar:
+			return TEXT( "columnar" );
+		case ECapsaChunkFormat::PlainText:
+		default:
+			return TEXT( "plain" );
+		}
+	}
+
+	/**
+	* Sets the headers that describe the uploaded sub-chunk. X-Capsa-Chunk-ID is the position of the chunk in the
+	* Log Pipeline of the session, X-Capsa-Chunk-Part the index of the sub-chunk and the number of sub-chunks,
+	* so the Capsa Server can tell which uploads were split from the same chunk.
+	*/
+	static void SetChunkHeaders( const FHttpRequestRef& Request, const FCapsaPipelineChunk& Chunk, int32 SubChunkIndex )
+	{
+		Request->SetHeader( TEXT( "X-Capsa-Chunk-Format" ), GetChunkFormatHeaderValue( Chunk.Builder.GetFormat() ) );
+		Request->SetHeader( TEXT( "X-Capsa-Chunk-ID" ), LexToString( Chunk.Sequence ) );
+		Request->SetHeader( TEXT( "X-Capsa-Chunk-Part" ), FString::Printf( TEXT( "%d/%d" ), SubChunkIndex, Chunk.SubChunks.Num() ) );
+	}
+}
+
+FCapsaLogSession::FCapsaLogSession( uint32 InID, const FString& InName )
+	: ID( InID )
+	, Name( InName )
+	, bAuthRequestInFlight( false )
+	, SentMetadataRevision( 0 )
+	, bMetadataRequestInFlight( false )
+	, bMetadataRequestPending( false )
+{
+}
+
+FCapsaLogSession::~FCapsaLogSession()
+{
+	Shutdown();
+}
+
+void FCapsaLogSession::Start( const FCapsaLogPipelineSettings& PipelineSettings )
+{
+	// Uploads are started from a game thread task, the session may be gone by then
+	TWeakPtr<FCapsaLogSession, ESPMode::ThreadSafe> WeakThis( AsShared() );
+	LogPipeline = MakeShared<FCapsaLogPipeline, ESPMode::ThreadSafe>( PipelineSettings, [WeakThis]( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID )
+		{
+			TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe> Session = WeakThis.Pin();
+			if( Session.IsValid() == false )
+			{
+				return false;
+			}
+
+			FCapsaPipelineSubChunk& SubChunk = Chunk.SubChunks[SubChunkIndex];
+			if( Chunk.bCompress == true )
+			{
+				// The payload is not needed after the upload, hand it to the request instead of copying it
+				return Session->RequestSendCompressedLog( MoveTemp( SubChunk.Payload ), Chunk, SubChunkIndex, UploadID );
+			}
+			return Session->RequestSendLog( SubChunk.Log, Chunk, SubChunkIndex, UploadID );
+		} );
+
+	RequestClientAuth();
+}
+
+void FCapsaLogSession::Shutdown()
+{
+	if( LinkedLogBatchHandle.IsValid() == true )
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker( LinkedLogBatchHandle );
+		LinkedLogBatchHandle.Reset();
+	}
+
+	if( LogPipeline.IsValid() == true )
+	{
+		LogPipeline->Shutdown();
+		LogPipeline.Reset();
+	}
+}
+
+void FCapsaLogSession::RequestClientAuth()
+{
+	// The output device retries on every flush while the session is not authenticated
+	if( bAuthRequestInFlight == true )
+	{
+		return;
+	}
+
+	UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::RequestClientAuth | Starting client authentication for %s" ), *Name );
+
+	const FCapsaSettingsSnapshot::FRef CapsaSettings = FCapsaSettingsSnapshot::Get();
+	if( CapsaSettings->bHasServerURL == false )
+	{
+		UE_LOG( LogCapsaCore, Error, TEXT( "FCapsaLogSession::RequestClientAuth | Base URL is Empty!" ) );
+		return;
+	}
+
+	FCapsaAuthenticationRequest AuthenticationRequest = FCapsaAuthenticationRequest(
+		CapsaSettings->EnvironmentKey,
+		UCapsaCoreFunctionLibrary::GetPlatformString(),
+		UCapsaCoreFunctionLibrary::GetHostTypeString()
+	);
+
+	TArray<uint8> AuthContent;
+	UCapsaCoreJsonHelpers::WriteAuthenticationRequest( AuthenticationRequest, AuthContent );
+
+	FHttpRequestRef ClientAuthRequest = FHttpModule::Get().CreateRequest();
+	ClientAuthRequest->SetURL( CapsaSettings->ClientAuthURL );
+	ClientAuthRequest->SetVerb( "POST" );
+	ClientAuthRequest->SetHeader( "Content-Type", "application/json" );
+	ClientAuthRequest->SetContent( MoveTemp( AuthContent ) );
+	ClientAuthRequest->OnProcessRequestComplete().BindThreadSafeSP( AsShared(), &FCapsaLogSession::ClientAuthResponse );
+	bAuthRequestInFlight = ClientAuthRequest->ProcessRequest();
+
+	UE_LOG( LogCapsaCore, Log, TEXT( "FCapsaLogSession::RequestClientAuth | Authentication request sent for %s" ), *Name );
+}
+
+void FCapsaLogSession::SendLog( TArray<FBufferedLine>& LogBuffer, FCapsaDeferredLogBuffer&& DeferredLines )
+{
+	const FCapsaSettingsSnapshot::FRef CapsaSettings = FCapsaSettingsSnapshot::Get();
+
+	FCapsaChunkFormatOptions FormatOptions;
+	FormatOptions.Format = CapsaSettings->ChunkFormat;
+	if( FormatOptions.Format == ECapsaChunkFormat::Template )
+	{
+		if( TemplateMiner.IsValid() == false )
+		{
+			TemplateMiner = MakeShared<FCapsaTemplateMiner, ESPMode::ThreadSafe>( CapsaSettings->TemplateSimilarityThreshold );
+		}
+		FormatOptions.TemplateMiner = TemplateMiner;
+	} else if( FormatOptions.Format == ECapsaChunkFormat::Columnar )
+	{
+		if( ColumnarEncoder.IsValid() == false )
+		{
+			ColumnarEncoder = MakeShared<FCapsaColumnarEncoder, ESPMode::ThreadSafe>();
+		}
+		FormatOptions.ColumnarEncoder = ColumnarEncoder;
+	}
+	const ECapsaChunkFormat Format = FormatOptions.Format;
+
+	TSharedRef<FCapsaPipelineChunk, ESPMode::ThreadSafe> Chunk = MakeShared<FCapsaPipelineChunk, ESPMode::ThreadSafe>( MoveTemp( LogBuffer ), MoveTemp( FormatOptions ), MoveTemp( DeferredLines ) );
+	Chunk->LogID = LogID;
+	// Binary chunks can not be sent as a string, they are always compressed
+	Chunk->bCompress = CapsaSettings->bUseCompression == true || Format == ECapsaChunkFormat::Columnar;
+	Chunk->bWriteToDiskPlain = CapsaSettings->bWriteToDiskPlain;
+	Chunk->bWriteToDiskCompressed = CapsaSettings->bWriteToDiskCompressed;
+
+	if( LogPipeline.IsValid() == false || LogPipeline->Submit( Chunk ) == false )
+	{
+		FCapsaTelemetry::Get().AddDroppedLines( Chunk->Builder.GetNumLines() );
+		UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogSession::SendLog | Log Pipeline of %s is full, dropped %d lines" ), *Name, Chunk->Builder.GetNumLines() );
+	}
+}
+
+bool FCapsaLogSession::CanSendLog() const
+{
+	return LogPipeline.IsValid() == true && LogPipeline->CanSubmit() == true;
+}
+
+bool FCapsaLogSession::RegisterLinkedLogID( const FString& LinkedLogID, const FString& Description )
+{
+	FCapsaTelemetry::Get().AddLinkedLogRegistration();
+
+	// Don't link with self.
+	if( LinkedLogID.IsEmpty() == true || LogID.Equals( LinkedLogID ) == true )
+	{
+		return false;
+	}
+
+	// Reconnecting players register the same log again
+	if( LinkedLogIDs.Contains( LinkedLogID ) == true || StoredLinkedLogIDs.Contains( LinkedLogID ) == true )
+	{
+		return false;
+	}
+
+	// Links come from clients, every reconnect can send a new one
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	const int32 MaxLinkedLogs = CapsaSettings != nullptr ? CapsaSettings->GetMaxLinkedLogsPerSession() : 10000;
+	if( LinkedLogIDs.Num() + StoredLinkedLogIDs.Num() >= MaxLinkedLogs )
+	{
+		UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogSession::RegisterLinkedLogID | Ignoring LinkedLogID: %s, %s already links %d logs" ), *LinkedLogID, *Name, MaxLinkedLogs );
+		return false;
+	}
+
+	UE_LOG( LogCapsaCore, Log, TEXT( "FCapsaLogSession::RegisterLinkedLogID | Registering LinkedLogID: %s with %s" ), *LinkedLogID, *Name );
+
+	LinkedLogIDs.Add( LinkedLogID, Description );
+
+	const float BatchSeconds = CapsaSettings != nullptr ? CapsaSettings->GetLinkedLogBatchSeconds() : 0.f;
+	if( BatchSeconds <= 0.f )
+	{
+		RequestSendMetadata();
+	} else if( LinkedLogBatchHandle.IsValid() == false )
+	{
+		// The first link of a batch starts the window, the following ones wait for it
+		LinkedLogBatchHandle = FTSTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateThreadSafeSP( AsShared(), &FCapsaLogSession::FlushLinkedLogIDs ), BatchSeconds );
+	}
+	return true;
+}
+
+void FCapsaLogSession::SetMetadata( const FString& Key, FCapsaMetadataValue&& Value )
+{
+	if( AdditionalMetadata.Set( Key, MoveTemp( Value ) ) == false )
+	{
+		return;
+	}
+
+	UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "FCapsaLogSession::SetMetadata | Set metadata with key %s" ), *Key );
+	RequestSendMetadata();
+}
+
+void FCapsaLogSession::RequestSendMetadata( bool bPollLogPolicy )
+{
+	if( bMetadataRequestInFlight == true )
+	{
+		bMetadataRequestPending = true;
+		return;
+	}
+	bMetadataRequestPending = false;
+
+	// Sent once authenticated, see ClientAuthResponse
+	if( IsAuthenticated() == false || ( bPollLogPolicy == false && LinkedLogIDs.Num() == 0 && AdditionalMetadata.IsDirty() == false ) )
+	{
+		return;
+	}
+
+	UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::RequestSendMetadata | Storing metadata of %s" ), *Name );
+
+	const FCapsaSettingsSnapshot::FRef CapsaSettings = FCapsaSettingsSnapshot::Get();
+
+	MetadataBuffer.Reset();
+	SentLinkedLogIDs.Reset();
+
+	FCapsaJsonWriter Writer( MetadataBuffer );
+	Writer.BeginObject();
+	Writer.WriteKey( TEXT( "linkedLogs" ) );
+	Writer.BeginObject();
+	// Pending links go along with any metadata request, the batch does not have to wait for its window
+	for( const TPair<FString, FString>& LinkedLog : LinkedLogIDs )
+	{
+		Writer.WriteString( LinkedLog.Key, LinkedLog.Value );
+		SentLinkedLogIDs.Add( LinkedLog.Key );
+	}
+	Writer.EndObject();
+	Writer.WriteKey( TEXT( "additionalMetadata" ) );
+	SentMetadataRevision = AdditionalMetadata.WriteDirty( Writer );
+	Writer.EndObject();
+
+	FHttpRequestRef LogRequest = FHttpModule::Get().CreateRequest();
+	LogRequest->SetURL( CapsaSettings->ClientLogMetadataURL );
+	LogRequest->SetVerb( "POST" );
+	LogRequest->SetHeader( "Authorization", GetAuthHeader() );
+	LogRequest->AppendToHeader( "Content-Type", "application/json" );
+	LogRequest->SetContent( MetadataBuffer );
+	LogRequest->OnProcessRequestComplete().BindThreadSafeSP( AsShared(), &FCapsaLogSession::MetadataResponse );
+	bMetadataRequestInFlight = LogRequest->ProcessRequest();
+	if( bMetadataRequestInFlight == true )
+	{
+		FCapsaTelemetry::Get().AddMetadataRequest();
+	}
+
+	UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "FCapsaLogSession::RequestSendMetadata | Metadata sent" ) );
+}
+
+bool FCapsaLogSession::IsAuthenticated() const
+{
+	return ( Token.IsEmpty() == false ) && ( LogID.IsEmpty() == false );
+}
+
+uint32 FCapsaLogSession::GetID() const
+{
+	return ID;
+}
+
+const FString& FCapsaLogSession::GetName() const
+{
+	return Name;
+}
+
+const FString& FCapsaLogSession::GetLogID() const
+{
+	return LogID;
+}
+
+const FString& FCapsaLogSession::GetLogURL() const
+{
+	return LinkWeb;
+}
+
+void FCapsaLogSession::LogPipelineStats() const
+{
+	if( LogPipeline.IsValid() == true )
+	{
+		UE_LOG( LogCapsaCore, Display, TEXT( "FCapsaLogSession::LogPipelineStats | %s:" ), *Name );
+		LogPipeline->LogStats();
+	}
+}
+
+uint32 FCapsaLogSession::GetCurrentID()
+{
+	return CapsaLogSession::CurrentID;
+}
+
+void FCapsaLogSession::SetCurrentID( uint32 InID )
+{
+	CapsaLogSession::CurrentID = InID;
+}
+
+FString FCapsaLogSession::GetAuthHeader() const
+{
+	return TEXT( "Bearer " ) + Token;
+}
+
+bool FCapsaLogSession::RequestSendLog( const FString& Log, const FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID )
+{
+	UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::RequestSendLog | Sending log chunk without compression" ) );
+
+	const FCapsaSettingsSnapshot::FRef CapsaSettings = FCapsaSettingsSnapshot::Get();
+
+	FHttpRequestRef LogRequest = FHttpModule::Get().CreateRequest();
+	LogRequest->SetURL( CapsaSettings->ClientLogChunkURL );
+	LogRequest->SetVerb( "POST" );
+	LogRequest->SetHeader( "Authorization", GetAuthHeader() );
+	LogRequest->SetHeader( "Content-Type", "text/plain" );
+	CapsaLogSession::SetChunkHeaders( LogRequest, Chunk, SubChunkIndex );
+	LogRequest->SetContentAsString( Log );
+	LogRequest->OnProcessRequestComplete().BindThreadSafeSP( AsShared(), &FCapsaLogSession::LogChunkResponse, UploadID, TSharedPtr<FCapsaPayloadReader, ESPMode::ThreadSafe>() );
+
+	UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "FCapsaLogSession::RequestSendLog | Log sent" ) );
+
+	return LogRequest->ProcessRequest();
+}
+
+bool FCapsaLogSession::RequestSendCompressedLog( TArray<uint8>&& CompressedLog, const FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID )
+{
+	UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::RequestSendCompressedLog | Sending log chunk with compression" ) );
+
+	const FCapsaSettingsSnapshot::FRef CapsaSettings = FCapsaSettingsSnapshot::Get();
+
+	FHttpRequestRef LogRequest = FHttpModule::Get().CreateRequest();
+	LogRequest->SetURL( CapsaSettings->ClientLogChunkURL );
+	LogRequest->SetVerb( "POST" );
+	LogRequest->SetHeader( "Authorization", GetAuthHeader() );
+	LogRequest->SetHeader( "Content-Type", "application/zlib" );
+	CapsaLogSession::SetChunkHeaders( LogRequest, Chunk, SubChunkIndex );
+	// Streamed from the pooled buffer, SetContent() would keep the buffer in the request
+	TSharedRef<FCapsaPayloadReader, ESPMode::ThreadSafe> Payload = MakeShared<FCapsaPayloadReader, ESPMode::ThreadSafe>( MoveTemp( CompressedLog ) );
+	LogRequest->SetContentFromStream( Payload );
+	LogRequest->OnProcessRequestComplete().BindThreadSafeSP( AsShared(), &FCapsaLogSession::LogChunkResponse, UploadID, TSharedPtr<FCapsaPayloadReader, ESPMode::ThreadSafe>( Payload ) );
+
+	UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "FCapsaLogSession::RequestSendCompressedLog | Compressed log sent" ) );
+
+	return LogRequest->ProcessRequest();
+}
+
+bool FCapsaLogSession::FlushLinkedLogIDs( float DeltaTime )
+{
+	LinkedLogBatchHandle.Reset();
+
+	UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::FlushLinkedLogIDs | Sending %d linked logs" ), LinkedLogIDs.Num() );
+
+	RequestSendMetadata();
+	return false;
+}
+
+bool FCapsaLogSession::CheckResponse( const TCHAR* RequestName, FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess ) const
+{
+	// Exit early if request failed
+	if( bSuccess == false || Response.IsValid() == false )
+	{
+		UE_LOG( LogCapsaCore, Error, TEXT( "%s | HTTP Request Failed: %s." ), RequestName, Response.IsValid() == false ? TEXT( "Invalid Response Ptr" ) : *Response->GetContentAsString() );
+		return false;
+	}
+
+	if( Response->GetResponseCode() > 299 )
+	{
+		UE_LOG( LogCapsaCore, Warning, TEXT( "%s | Received non-2xx response code %d: %s." ), RequestName, Response->GetResponseCode(), *Response->GetContentAsString() );
+		return false;
+	}
+
+	return true;
+}
+
+void FCapsaLogSession::ClientAuthResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess )
+{
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
+	UE_LOG( LogCapsaCore, Log, TEXT( "FCapsaLogSession::ClientAuthResponse | Authentication response received for %s" ), *Name );
+
+	bAuthRequestInFlight = false;
+
+	if( CheckResponse( TEXT( "FCapsaLogSession::ClientAuthResponse" ), Request, Response, bSuccess ) == false )
+	{
+		return;
+	}
+
+	FCapsaAuthenticationResponse AuthenticationResponse;
+	if( UCapsaCoreJsonHelpers::ReadAuthenticationResponse( Response->GetContent(), AuthenticationResponse ) == false )
+	{
+		UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogSession::ClientAuthResponse | Invalid authentication response" ) );
+		return;
+	}
+
+	// Set the authentication data if the current data is empty
+	if( Token.IsEmpty() || LogID.IsEmpty() || LinkWeb.IsEmpty() )
+	{
+		UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::ClientAuthResponse | Authentication info not present, setting values" ) );
+		Token = AuthenticationResponse.Token;
+		LogID = AuthenticationResponse.LogId;
+		LinkWeb = AuthenticationResponse.LinkWeb;
+		Expiry = AuthenticationResponse.Expiry;
+		// New session, the template and category dictionaries have to be sent again
+		TemplateMiner.Reset();
+		ColumnarEncoder.Reset();
+		UE_LOG( LogCapsaCore, Log, TEXT( "FCapsaLogSession::ClientAuthResponse | %s | Capsa ID: %s | CapsaLogURL: %s" ), *Name, *LogID, *LinkWeb );
+
+		// Metadata registered before authentication
+		RequestSendMetadata();
+	} else
+	{
+		UE_LOG( LogCapsaCore, Log, TEXT( "FCapsaLogSession::ClientAuthResponse | Ignoring AuthenticationResponse (CapsaID: %s), as the authentication is already present" ), *LogID );
+	}
+
+	if( AuthenticationResponse.Policy.IsSet() == true )
+	{
+		OnLogPolicyReceived.ExecuteIfBound( AuthenticationResponse.Policy.GetValue() );
+	}
+
+	// Broadcast auth changed regardless whether it has changed or not
+	OnAuthChanged.Broadcast( LogID, LinkWeb );
+}
+
+void FCapsaLogSession::LogChunkResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess, uint64 UploadID, TSharedPtr<FCapsaPayloadReader, ESPMode::ThreadSafe> Payload )
+{
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
+	UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::LogChunkResponse | Log chunk stored" ) );
+
+	CheckResponse( TEXT( "FCapsaLogSession::LogChunkResponse" ), Request, Response, bSuccess );
+
+	if( LogPipeline.IsValid() == true )
+	{
+		const bool bStored = bSuccess == true && Response.IsValid() == true && Response->GetResponseCode() <= 299;
+		FCapsaTelemetry::Get().RecordUpload( Request.IsValid() == true ? Request->GetElapsedTime() : 0.0, bStored );
+		LogPipeline->OnUploadComplete( UploadID, bStored );
+		if( Payload.IsValid() == true )
+		{
+			LogPipeline->ReleasePayload( MoveTemp( Payload->Payload ) );
+		}
+	}
+}
+
+void FCapsaLogSession::MetadataResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess )
+{
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
+	UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::MetadataResponse | Metadata stored" ) );
+
+	bMetadataRequestInFlight = false;
+
+	// Only clear what was sent, metadata set while the request was in flight is still dirty
+	if( bSuccess == true && Response.IsValid() == true && Response->GetResponseCode() < 299 )
+	{
+		UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogSession::MetadataResponse | Clearing metadata." ) );
+		for( const FString& LinkedLogID : SentLinkedLogIDs )
+		{
+			LinkedLogIDs.Remove( LinkedLogID );
+			StoredLinkedLogIDs.Add( LinkedLogID );
+		}
+		AdditionalMetadata.ClearDirty( SentMetadataRevision );
+
+		TOptional<FCapsaLogPolicy> Policy;
+		if( UCapsaCoreJsonHelpers::ReadLogPolicy( Response->GetContent(), Policy ) == false )
+		{
+			UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogSession::MetadataResponse | Invalid log policy in the response" ) );
+		} else if( Policy.IsSet() == true )
+		{
+			OnLogPolicyReceived.ExecuteIfBound( Policy.GetValue() );
+		}
+	}
+	SentLinkedLogIDs.Reset();
+
+	CheckResponse( TEXT( "FCapsaLogSession::MetadataResponse" ), Request, Response, bSuccess );
+
+	// Failed requests are retried with the next change
+	if( bMetadataRequestPending == true )
+	{
+		RequestSendMetadata();
+	}
+}
@@ -0,0 +1,204 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Metadata/CapsaMetadataStore.h"
+
+#include "Encoding/CapsaJsonWriter.h"
+
+
+FCapsaMetadataValue::FCapsaMetadataValue()
+	: Type( ECapsaMetadataType::String )
+	, Integer( 0 )
+	, Float( 0.0 )
+	, bBool( false )
+{
+}
+
+FCapsaMetadataValue::FCapsaMetadataValue( const FString& InString )
+	: FCapsaMetadataValue()
+{
+	String = InString;
+}
+
+FCapsaMetadataValue::FCapsaMetadataValue( FString&& InString )
+	: FCapsaMetadataValue()
+{
+	String = MoveTemp( InString );
+}
+
+FCapsaMetadataValue::FCapsaMetadataValue( const TCHAR* InString )
+	: FCapsaMetadataValue()
+{
+	String = InString;
+}
+
+FCapsaMetadataValue::FCapsaMetadataValue( int32 InInteger )
+	: FCapsaMetadataValue( static_cast<int64>( InInteger ) )
+{
+}
+
+FCapsaMetadataValue::FCapsaMetadataValue( int64 InInteger )
+	: FCapsaMetadataValue()
+{
+	Type = ECapsaMetadataType::Integer;
+	Integer = InInteger;
+}
+
+FCapsaMetadataValue::FCapsaMetadataValue( double InFloat )
+	: FCapsaMetadataValue()
+{
+	Type = ECapsaMetadataType::Float;
+	Float = InFloat;
+}
+
+FCapsaMetadataValue::FCapsaMetadataValue( bool bInBool )
+	: FCapsaMetadataValue()
+{
+	Type = ECapsaMetadataType::Bool;
+	bBool = bInBool;
+}
+
+FCapsaMetadataValue::FCapsaMetadataValue( TArray<FCapsaMetadataValue>&& InArray )
+	: FCapsaMetadataValue()
+{
+	Type = ECapsaMetadataType::Array;
+	Array = MoveTemp( InArray );
+}
+
+FCapsaMetadataValue FCapsaMetadataValue::FromJson( TArray<uint8>&& InJson )
+{
+	FCapsaMetadataValue Value;
+	Value.Type = ECapsaMetadataType::Json;
+	Value.Json = MoveTemp( InJson );
+	return Value;
+}
+
+void FCapsaMetadataValue::Write( FCapsaJsonWriter& Writer ) const
+{
+	switch( Type )
+	{
+	case ECapsaMetadataType::String:
+		Writer.WriteString( String );
+		break;
+	case ECapsaMetadataType::Integer:
+		Writer.WriteInteger( Integer );
+		break;
+	case ECapsaMetadataType::Float:
+		Writer.WriteDouble( Float );
+		break;
+	case ECapsaMetadataType::Bool:
+		Writer.WriteBool( bBool );
+		break;
+	case ECapsaMetadataType::Array:
+		Writer.BeginArray();
+		for( const FCapsaMetadataValue& Element : Array )
+		{
+			Element.Write( Writer );
+		}
+		Writer.EndArray();
+		break;
+	case ECapsaMetadataType::Json:
+		if( Json.IsEmpty() == true )
+		{
+			Writer.WriteNull();
+		} else
+		{
+			Writer.WriteRaw( Json );
+		}
+		break;
+	}
+}
+
+bool FCapsaMetadataValue::operator==( const FCapsaMetadataValue& Other ) const
+{
+	if( Type != Other.Type )
+	{
+		return false;
+	}
+
+	switch( Type )
+	{
+	case ECapsaMetadataType::String:
+		return String.Equals( Other.String, ESearchCase::CaseSensitive );
+	case ECapsaMetadataType::Integer:
+		return Integer == Other.Integer;
+	case ECapsaMetadataType::Float:
+		return Float == Other.Float;
+	case ECapsaMetadataType::Bool:
+		return bBool == Other.bBool;
+	case ECapsaMetadataType::Array:
+		return Array == Other.Array;
+	case ECapsaMetadataType::Json:
+		return Json == Other.Json;
+	default:
+		return false;
+	}
+}
+
+bool FCapsaMetadataStore::Set( const FString& Key, FCapsaMetadataValue&& Value )
+{
+	FEntry* Entry = Entries.Find( Key );
+	if( Entry == nullptr )
+	{
+		Entry = &Entries.Add( Key );
+	} else if( Entry->Value == Value )
+	{
+		return false;
+	}
+
+	if( Entry->DirtyRevision == 0 )
+	{
+		++NumDirty;
+	}
+	Entry->Value = MoveTemp( Value );
+	Entry->DirtyRevision = ++Revision;
+	return true;
+}
+
+const FCapsaMetadataValue* FCapsaMetadataStore::Find( const FString& Key ) const
+{
+	const FEntry* Entry = Entries.Find( Key );
+	return Entry != nullptr ? &Entry->Value : nullptr;
+}
+
+bool FCapsaMetadataStore::IsDirty() const
+{
+	return NumDirty > 0;
+}
+
+uint64 FCapsaMetadataStore::WriteDirty( FCapsaJsonWriter& Writer ) const
+{
+	Writer.BeginObject();
+	for( const TPair<FString, FEntry>& Pair : Entries )
+	{
+		if( Pair.Value.DirtyRevision != 0 )
+		{
+			Writer.WriteKey( Pair.Key );
+			Pair.Value.Value.Write( Writer );
+		}
+	}
+	Writer.EndObject();
+
+	return Revision;
+}
+
+void FCapsaMetadataStore::ClearDirty( uint64 SentRevision )
+{
+	for( TPair<FString, FEntry>& Pair : Entries )
+	{
+		if( Pair.Value.DirtyRevision != 0 && Pair.Value.DirtyRevision <= SentRevision )
+		{
+			Pair.Value.DirtyRevision = 0;
+			--NumDirty;
+		}
+	}
+}
+
+void FCapsaMetadataStore::MarkAllDirty()
+{
+	++Revision;
+	for( TPair<FString, FEntry>& Pair : Entries )
+	{
+		Pair.Value.DirtyRevision = Revision;
+	}
+	NumDirty = Entries.Num();
+}
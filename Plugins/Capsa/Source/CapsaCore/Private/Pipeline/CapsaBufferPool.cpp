@@ -0,0 +1,155 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Pipeline/CapsaBufferPool.h"
+
+
+FCapsaBufferPool::FCapsaBufferPool( int64 InMaxPooledBytes )
+	: MaxPooledBytes( FMath::Max<int64>( InMaxPooledBytes, 0 ) )
+	, PooledBytes( 0 )
+	, NumAcquired( 0 )
+	, NumReused( 0 )
+{
+}
+
+TArray<uint8> FCapsaBufferPool::AcquireBytes( int32 MinCapacity )
+{
+	++NumAcquired;
+
+	TArray<uint8> Buffer;
+	{
+		FScopeLock ScopeLock( &CriticalSection );
+		const int32 Index = FindBuffer( BytesCapacities, MinCapacity );
+		if( Index != INDEX_NONE )
+		{
+			Buffer = MoveTemp( Bytes[Index] );
+			PooledBytes -= BytesCapacities[Index];
+			Bytes.RemoveAtSwap( Index, 1, EAllowShrinking::No );
+			BytesCapacities.RemoveAtSwap( Index, 1, EAllowShrinking::No );
+			++NumReused;
+		}
+	}
+
+	Buffer.Reserve( MinCapacity );
+	return Buffer;
+}
+
+void FCapsaBufferPool::ReleaseBytes( TArray<uint8>&& InBytes )
+{
+	TArray<uint8> Buffer = MoveTemp( InBytes );
+	const int64 Capacity = Buffer.Max();
+	if( Capacity == 0 )
+	{
+		return;
+	}
+
+	// Keep the allocation, only drop the contents
+	Buffer.Reset();
+
+	FScopeLock ScopeLock( &CriticalSection );
+	if( PooledBytes + Capacity > MaxPooledBytes )
+	{
+		return;
+	}
+	Bytes.Add( MoveTemp( Buffer ) );
+	BytesCapacities.Add( Capacity );
+	PooledBytes += Capacity;
+}
+
+FString FCapsaBufferPool::AcquireString( int32 MinCapacity )
+{
+	++NumAcquired;
+
+	FString String;
+	{
+		FScopeLock ScopeLock( &CriticalSection );
+		const int32 Index = FindBuffer( StringCapacities, static_cast<int64>( MinCapacity ) * sizeof( TCHAR ) );
+		if( Index != INDEX_NONE )
+		{
+			String = MoveTemp( Strings[Index] );
+			PooledBytes -= StringCapacities[Index];
+			Strings.RemoveAtSwap( Index, 1, EAllowShrinking::No );
+			StringCapacities.RemoveAtSwap( Index, 1, EAllowShrinking::No );
+			++NumReused;
+		}
+	}
+
+	String.Reserve( MinCapacity );
+	return String;
+}
+
+void FCapsaBufferPool::ReleaseString( FString&& InString )
+{
+	FString String = MoveTemp( InString );
+	const int64 Capacity = static_cast<int64>( String.GetCharArray().Max() ) * sizeof( TCHAR );
+	if( Capacity == 0 )
+	{
+		return;
+	}
+
+	// Keep the allocation, only drop the contents
+	String.Reset();
+
+	FScopeLock ScopeLock( &CriticalSection );
+	if( PooledBytes + Capacity > MaxPooledBytes )
+	{
+		return;
+	}
+	Strings.Add( MoveTemp( String ) );
+	StringCapacities.Add( Capacity );
+	PooledBytes += Capacity;
+}
+
+void FCapsaBufferPool::Trim()
+{
+	FScopeLock ScopeLock( &CriticalSection );
+	Bytes.Empty();
+	BytesCapacities.Empty();
+	Strings.Empty();
+	StringCapacities.Empty();
+	PooledBytes = 0;
+}
+
+uint64 FCapsaBufferPool::GetNumAcquired() const
+{
+	return NumAcquired.load();
+}
+
+uint64 FCapsaBufferPool::GetNumReused() const
+{
+	return NumReused.load();
+}
+
+int64 FCapsaBufferPool::GetPooledBytes() const
+{
+	FScopeLock ScopeLock( &CriticalSection );
+	return PooledBytes;
+}
+
+int32 FCapsaBufferPool::FindBuffer( const TArray<int64>& Capacities, int64 MinCapacity )
+{
+	if( MinCapacity <= 0 )
+	{
+		// Without a size hint, the largest buffer is the least likely to grow
+		MinCapacity = MAX_int64;
+	}
+
+	int32 BestIndex = INDEX_NONE;
+	for( int32 Index = 0; Index < Capacities.Num(); ++Index )
+	{
+		if( BestIndex == INDEX_NONE )
+		{
+			BestIndex = Index;
+			continue;
+		}
+
+		const int64 Capacity = Capacities[Index];
+		const int64 BestCapacity = Capacities[BestIndex];
+		const bool bFits = Capacity >= MinCapacity;
+		const bool bBestFits = BestCapacity >= MinCapacity;
+		if( ( bFits == true && ( bBestFits == false || Capacity < BestCapacity ) ) || ( bFits == false && bBestFits == false && Capacity > BestCapacity ) )
+		{
+			BestIndex = Index;
+		}
+	}
+	return BestIndex;
+}
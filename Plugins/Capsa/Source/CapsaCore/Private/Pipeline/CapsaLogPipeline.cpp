@@ -0,0 +1,717 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Pipeline/CapsaLogPipeline.h"
+
+#include "CapsaCore.h"
+#include "Telemetry/CapsaTelemetry.h"
+#include "Telemetry/CapsaTrace.h"
+
+#include "Async/Async.h"
+#include "Misc/CoreDelegates.h"
+
+
+static FCapsaLogPipelineSettings ClampPipelineSettings( FCapsaLogPipelineSettings InSettings )
+{
+	InSettings.MaxChunksInFlight = FMath::Max( InSettings.MaxChunksInFlight, 1 );
+	InSettings.MaxParallelEncodes = FMath::Max( InSettings.MaxParallelEncodes, 1 );
+	InSettings.MaxConcurrentUploads = FMath::Max( InSettings.MaxConcurrentUploads, 1 );
+	InSettings.MaxLinesPerSubChunk = FMath::Max( InSettings.MaxLinesPerSubChunk, 0 );
+	InSettings.NumThreads = FMath::Max( InSettings.NumThreads, 0 );
+	InSettings.MaxPooledBufferBytes = FMath::Max<int64>( InSettings.MaxPooledBufferBytes, 0 );
+	InSettings.PooledBufferIdleSeconds = FMath::Max( InSettings.PooledBufferIdleSeconds, 0.f );
+	return InSettings;
+}
+
+/**
+* Pool threads are created by FQueuedThreadPool without an affinity, apply it the first time a thread runs a stage.
+*/
+static void ApplyPipelineThreadAffinity( uint64 AffinityMask )
+{
+	static thread_local bool bAffinityApplied = false;
+	if( AffinityMask != 0 && bAffinityApplied == false )
+	{
+		FPlatformProcess::SetThreadAffinityMask( AffinityMask );
+		bAffinityApplied = true;
+	}
+}
+
+
+FCapsaLogPipeline::FCapsaLogPipeline( const FCapsaLogPipelineSettings& InSettings, FCapsaPipelineUploadFunction InUploadFunction )
+	: Settings( ClampPipelineSettings( InSettings ) )
+	, UploadFunction( MoveTemp( InUploadFunction ) )
+	, BufferPool( Settings.MaxPooledBufferBytes )
+	, NextSequence( 0 )
+	, NextUploadID( 0 )
+	, NumChunksInFlight( 0 )
+	, NumRejected( 0 )
+	, NumFailed( 0 )
+	, LastNumAcquired( 0 )
+	, bShutdown( false )
+{
+	EncodeTasks.SetNum( Settings.MaxParallelEncodes );
+
+	if( Settings.PooledBufferIdleSeconds > 0.f )
+	{
+		TrimTickerHandle = FTSTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateRaw( this, &FCapsaLogPipeline::TrimIdleBuffers ), Settings.PooledBufferIdleSeconds );
+	}
+	MemoryTrimHandle = FCoreDelegates::GetMemoryTrimDelegate().AddRaw( this, &FCapsaLogPipeline::OnMemoryTrim );
+
+	ThreadPool = Settings.ThreadPool.IsValid() == true ? Settings.ThreadPool : CreateThreadPool( Settings );
+}
+
+TSharedPtr<FQueuedThreadPool, ESPMode::ThreadSafe> FCapsaLogPipeline::CreateThreadPool( const FCapsaLogPipelineSettings& InSettings )
+{
+	if( InSettings.NumThreads <= 0 || FPlatformProcess::SupportsMultithreading() == false )
+	{
+		return nullptr;
+	}
+
+	// Destroying the pool waits for its threads, the last pipeline releases it in Shutdown()
+	TSharedPtr<FQueuedThreadPool, ESPMode::ThreadSafe> Pool( FQueuedThreadPool::Allocate() );
+	if( Pool->Create( InSettings.NumThreads, 256 * 1024, InSettings.ThreadPriority, TEXT( "CapsaPipelinePool" ) ) == false )
+	{
+		UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogPipeline::CreateThreadPool | Failed to create the thread pool, using the task workers" ) );
+		return nullptr;
+	}
+	return Pool;
+}
+
+FCapsaLogPipeline::~FCapsaLogPipeline()
+{
+	UnregisterBufferTrim();
+}
+
+bool FCapsaLogPipeline::CanSubmit() const
+{
+	return bShutdown == false && NumChunksInFlight.load() < Settings.MaxChunksInFlight;
+}
+
+bool FCapsaLogPipeline::Submit( const FChunkRef& Chunk )
+{
+	// Reserve room for the chunk, the caller keeps its lines buffered when the pipeline is full
+	int32 InFlight = NumChunksInFlight.load();
+	do
+	{
+		if( InFlight >= Settings.MaxChunksInFlight )
+		{
+			++NumRejected;
+			return false;
+		}
+	} while( NumChunksInFlight.compare_exchange_weak( InFlight, InFlight + 1 ) == false );
+
+	FScopeLock ScopeLock( &SubmitCriticalSection );
+	if( bShutdown == true )
+	{
+		// The chunk never entered the pipeline
+		--NumChunksInFlight;
+		return false;
+	}
+
+	Chunk->Sequence = NextSequence++;
+	Chunk->FirstLineTime = Chunk->Builder.GetFirstLineTime();
+	Chunk->bTraced = FCapsaTrace::BeginChunk( Chunk->Sequence, Chunk->Builder.GetNumLines() );
+
+	// The line ranges are set by the format stage, once the deferred lines are formatted
+	const int32 NumLines = Chunk->Builder.GetNumLines();
+	const int32 NumSubChunks = Settings.MaxLinesPerSubChunk > 0 ? FMath::Max( FMath::DivideAndRoundUp( NumLines, Settings.MaxLinesPerSubChunk ), 1 ) : 1;
+	Chunk->SubChunks.SetNum( NumSubChunks );
+	const TSharedRef<FCapsaLogPipeline, ESPMode::ThreadSafe> Pipeline = AsShared();
+	const int32 EncodeSlot = static_cast<int32>( Chunk->Sequence % EncodeTasks.Num() );
+
+	// Bound the number of chunks encoding in parallel, and keep chunks that update a session dictionary in order
+	TArray<UE::Tasks::FTask, TInlineAllocator<2>> FormatPrerequisites;
+	if( EncodeTasks[EncodeSlot].IsValid() == true )
+	{
+		FormatPrerequisites.Add( EncodeTasks[EncodeSlot] );
+	}
+	if( Chunk->Builder.UsesSessionDictionary() == true && LastFormatTask.IsValid() == true )
+	{
+		FormatPrerequisites.Add( LastFormatTask );
+	}
+
+	// Dictionary entries have to end up in the first sub-chunk that uses them, other chunks format their sub-chunks in parallel
+	const bool bFormatSubChunksInParallel = NumSubChunks > 1 && Chunk->Builder.UsesSessionDictionary() == false;
+	UE::Tasks::FTask FormatTask = LaunchStage( TEXT( "CapsaLogPipeline.Format" ),
+		[Pipeline, Chunk, bFormatSubChunksInParallel]()
+		{
+			if( bFormatSubChunksInParallel == true )
+			{
+				Pipeline->PrepareSubChunks( *Chunk );
+			} else
+			{
+				Pipeline->RunFormatStage( *Chunk );
+			}
+		},
+		FormatPrerequisites );
+
+	// Sub-chunks are compressed independently, in parallel, each as soon as it is formatted
+	UE::Tasks::FTask CompressTask = FormatTask;
+	if( Chunk->bCompress == true || bFormatSubChunksInParallel == true )
+	{
+		TArray<UE::Tasks::FTask, TInlineAllocator<8>> SubChunkTasks;
+		for( int32 SubChunkIndex = 0; SubChunkIndex < NumSubChunks; ++SubChunkIndex )
+		{
+			const UE::Tasks::FTask SubChunkFormatTask = bFormatSubChunksInParallel == false ? FormatTask
+				: LaunchStage( TEXT( "CapsaLogPipeline.FormatSubChunk" ),
+					[Pipeline, Chunk, SubChunkIndex]()
+					{
+						Pipeline->RunFormatSubChunkStage( *Chunk, SubChunkIndex );
+					},
+					MakeArrayView( &FormatTask, 1 ) );
+
+			if( Chunk->bCompress == false )
+			{
+				SubChunkTasks.Add( SubChunkFormatTask );
+				continue;
+			}
+
+			SubChunkTasks.Add( LaunchStage( TEXT( "CapsaLogPipeline.Compress" ),
+				[Pipeline, Chunk, SubChunkIndex]()
+				{
+					Pipeline->RunCompressStage( *Chunk, SubChunkIndex );
+				},
+				MakeArrayView( &SubChunkFormatTask, 1 ) ) );
+		}
+
+		CompressTask = SubChunkTasks.Num() == 1 ? SubChunkTasks[0]
+			: UE::Tasks::Launch( TEXT( "CapsaLogPipeline.Compress" ), []() {}, SubChunkTasks, UE::Tasks::ETaskPriority::High, UE::Tasks::EExtendedTaskPriority::Inline );
+	}
+
+	// Persist one chunk at a time in submission order, which also hands the chunks to the upload stage in order
+	TArray<UE::Tasks::FTask, TInlineAllocator<2>> PersistPrerequisites;
+	PersistPrerequisites.Add( CompressTask );
+	if( LastPersistTask.IsValid() == true )
+	{
+		PersistPrerequisites.Add( LastPersistTask );
+	}
+
+	UE::Tasks::FTask PersistTask = LaunchStage( TEXT( "CapsaLogPipeline.Persist" ),
+		[Pipeline, Chunk]()
+		{
+			Pipeline->RunPersistStage( *Chunk );
+			Pipeline->EnqueueUpload( Chunk );
+		},
+		PersistPrerequisites );
+
+	LastFormatTask = FormatTask;
+	EncodeTasks[EncodeSlot] = CompressTask;
+	LastPersistTask = PersistTask;
+
+	UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "FCapsaLogPipeline::Submit | Chunk %llu submitted, %d chunks in flight" ), Chunk->Sequence, NumChunksInFlight.load() );
+
+	return true;
+}
+
+void FCapsaLogPipeline::OnUploadComplete( uint64 UploadID, bool bSuccess )
+{
+	uint64 StartCycles = 0;
+	uint64 Sequence = 0;
+	int32 SubChunkIndex = 0;
+	int32 NumLines = 0;
+	double FirstLineTime = 0.0;
+	TSharedPtr<FCapsaPipelineChunk, ESPMode::ThreadSafe> FinishedChunk;
+	{
+		FScopeLock ScopeLock( &UploadCriticalSection );
+		const FActiveUpload* ActiveUpload = ActiveUploads.Find( UploadID );
+		if( ActiveUpload == nullptr )
+		{
+			return;
+		}
+
+		FCapsaPipelineChunk& Chunk = *ActiveUpload->Chunk;
+		StartCycles = ActiveUpload->StartCycles;
+		Sequence = Chunk.Sequence;
+		SubChunkIndex = ActiveUpload->SubChunkIndex;
+		NumLines = Chunk.SubChunks[SubChunkIndex].NumLines;
+		FirstLineTime = Chunk.FirstLineTime;
+
+		// Whatever the upload function did not move into the request can be reused
+		FCapsaPipelineSubChunk& SubChunk = Chunk.SubChunks[SubChunkIndex];
+		BufferPool.ReleaseString( MoveTemp( SubChunk.Log ) );
+		BufferPool.ReleaseBytes( MoveTemp( SubChunk.Payload ) );
+		if( --Chunk.NumSubChunksToUpload == 0 )
+		{
+			FinishedChunk = ActiveUpload->Chunk;
+		}
+
+		ActiveUploads.Remove( UploadID );
+	}
+
+	RecordStage( ECapsaPipelineStage::Upload, StartCycles );
+	FCapsaTrace::ChunkEvent( bSuccess == true ? ECapsaTraceChunkEvent::Acked : ECapsaTraceChunkEvent::Failed, Sequence, SubChunkIndex, NumLines, 0 );
+	if( bSuccess == false )
+	{
+		++NumFailed;
+		FCapsaTelemetry::Get().AddDroppedLines( NumLines );
+		UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogPipeline::OnUploadComplete | Failed to upload chunk %llu.%d" ), Sequence, SubChunkIndex );
+	} else if( FirstLineTime > 0.0 )
+	{
+		FCapsaTelemetry::Get().RecordDelivery( FDateTime::Now().ToUnixTimestampDecimal() - FirstLineTime, NumLines );
+	}
+
+	if( FinishedChunk.IsValid() == true )
+	{
+		FinishChunk( *FinishedChunk );
+	}
+	StartUploads();
+}
+
+void FCapsaLogPipeline::ReleasePayload( TArray<uint8>&& Payload )
+{
+	BufferPool.ReleaseBytes( MoveTemp( Payload ) );
+}
+
+void FCapsaLogPipeline::Shutdown()
+{
+	// Every persist task depends on the previous one, so this waits for all chunks still being processed
+	UE::Tasks::FTask PersistTask;
+	{
+		FScopeLock ScopeLock( &SubmitCriticalSection );
+		bShutdown = true;
+		PersistTask = LastPersistTask;
+	}
+	if( PersistTask.IsValid() == true )
+	{
+		PersistTask.Wait();
+	}
+
+	// Start the uploads still waiting regardless of MaxConcurrentUploads, the requests complete on their own
+	TArray<TPair<uint64, FPendingUpload>> UploadsToStart;
+	{
+		FScopeLock ScopeLock( &UploadCriticalSection );
+		UploadsToStart.Reserve( PendingUploads.Num() );
+		for( FPendingUpload& Upload : PendingUploads )
+		{
+			const uint64 UploadID = NextUploadID++;
+			ActiveUploads.Add( UploadID, FActiveUpload{ Upload.Chunk, Upload.SubChunkIndex, FPlatformTime::Cycles64() } );
+			UploadsToStart.Emplace( UploadID, MoveTemp( Upload ) );
+		}
+		PendingUploads.Empty();
+	}
+
+	// Only the sub-chunks that could not be started are dropped, OnUploadComplete() counts them
+	int32 NumDropped = 0;
+	for( const TPair<uint64, FPendingUpload>& Upload : UploadsToStart )
+	{
+		if( StartUpload( Upload.Key, Upload.Value.Chunk, Upload.Value.SubChunkIndex ) == false )
+		{
+			++NumDropped;
+		}
+	}
+
+	if( NumDropped > 0 )
+	{
+		UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogPipeline::Shutdown | Dropped %d sub-chunks that could not be uploaded" ), NumDropped );
+	}
+
+	// Other pipelines may still run on a shared pool, it is destroyed with the last reference
+	ThreadPool.Reset();
+
+	// No stage runs anymore, the pooled buffers would only be freed with the last reference to the pipeline
+	UnregisterBufferTrim();
+	BufferPool.Trim();
+}
+
+int32 FCapsaLogPipeline::GetNumChunksInFlight() const
+{
+	return NumChunksInFlight.load();
+}
+
+uint64 FCapsaLogPipeline::GetNumRejected() const
+{
+	return NumRejected.load();
+}
+
+uint64 FCapsaLogPipeline::GetNumFailed() const
+{
+	return NumFailed.load();
+}
+
+FCapsaPipelineStageStats FCapsaLogPipeline::GetStageStats( ECapsaPipelineStage Stage ) const
+{
+	const FStageCounters& Counters = StageCounters[static_cast<int32>( Stage )];
+
+	FCapsaPipelineStageStats Stats;
+	Stats.Count = Counters.Count.load();
+	Stats.TotalSeconds = FPlatformTime::ToSeconds64( Counters.TotalCycles.load() );
+	Stats.MaxSeconds = FPlatformTime::ToSeconds64( Counters.MaxCycles.load() );
+	return Stats;
+}
+
+const FCapsaBufferPool& FCapsaLogPipeline::GetBufferPool() const
+{
+	return BufferPool;
+}
+
+void FCapsaLogPipeline::LogStats() const
+{
+	int32 NumPendingUploads = 0;
+	int32 NumActiveUploads = 0;
+	{
+		FScopeLock ScopeLock( &UploadCriticalSection );
+		NumPendingUploads = PendingUploads.Num();
+		NumActiveUploads = ActiveUploads.Num();
+	}
+
+	UE_LOG( LogCapsaCore, Log, TEXT( "FCapsaLogPipeline::LogStats | Chunks in flight: %d/%d, waiting for upload: %d, uploading: %d, rejected: %llu, failed: %llu" ),
+		GetNumChunksInFlight(), Settings.MaxChunksInFlight, NumPendingUploads, NumActiveUploads, GetNumRejected(), GetNumFailed() );
+	UE_LOG( LogCapsaCore, Log, TEXT( "FCapsaLogPipeline::LogStats | Buffers acquired: %llu, reused: %llu, pooled: %.1f KiB" ),
+		BufferPool.GetNumAcquired(), BufferPool.GetNumReused(), BufferPool.GetPooledBytes() / 1024.0 );
+
+	for( int32 StageIndex = 0; StageIndex < static_cast<int32>( ECapsaPipelineStage::Num ); ++StageIndex )
+	{
+		const ECapsaPipelineStage Stage = static_cast<ECapsaPipelineStage>( StageIndex );
+		const FCapsaPipelineStageStats Stats = GetStageStats( Stage );
+		const double AverageMilliseconds = Stats.Count > 0 ? Stats.TotalSeconds * 1000.0 / Stats.Count : 0.0;
+
+		UE_LOG( LogCapsaCore, Log, TEXT( "FCapsaLogPipeline::LogStats | %-8s runs: %llu, total: %.3f s, avg: %.3f ms, max: %.3f ms" ),
+			GetStageName( Stage ), Stats.Count, Stats.TotalSeconds, AverageMilliseconds, Stats.MaxSeconds * 1000.0 );
+	}
+}
+
+const TCHAR* FCapsaLogPipeline::GetStageName( ECapsaPipelineStage Stage )
+{
+	switch( Stage )
+	{
+	case ECapsaPipelineStage::Format:
+		return TEXT( "Format" );
+	case ECapsaPipelineStage::Compress:
+		return TEXT( "Compress" );
+	case ECapsaPipelineStage::Persist:
+		return TEXT( "Persist" );
+	case ECapsaPipelineStage::Upload:
+		return TEXT( "Upload" );
+	default:
+		return TEXT( "Unknown" );
+	}
+}
+
+UE::Tasks::FTask FCapsaLogPipeline::LaunchStage( const TCHAR* DebugName, TUniqueFunction<void()>&& Work, TConstArrayView<UE::Tasks::FTask> Prerequisites )
+{
+	if( ThreadPool.IsValid() == false )
+	{
+		return UE::Tasks::Launch( DebugName, MoveTemp( Work ), Prerequisites, UE::Tasks::ETaskPriority::BackgroundNormal );
+	}
+
+	// The task system keeps track of the order, the work itself runs on the thread pool. The dispatch runs inline
+	// on the thread that completes the last prerequisite, so no task worker is occupied by Capsa work.
+	UE::Tasks::FTaskEvent WorkDone( DebugName );
+	TSharedPtr<FQueuedThreadPool, ESPMode::ThreadSafe> Pool = ThreadPool;
+	const uint64 AffinityMask = Settings.ThreadAffinityMask;
+
+	UE::Tasks::Launch( DebugName,
+		[Pool = MoveTemp( Pool ), AffinityMask, Work = MoveTemp( Work ), WorkDone]() mutable
+		{
+			AsyncPool( *Pool, [AffinityMask, Work = MoveTemp( Work ), WorkDone]() mutable
+				{
+					ApplyPipelineThreadAffinity( AffinityMask );
+					Work();
+					WorkDone.Trigger();
+				} );
+		},
+		Prerequisites, UE::Tasks::ETaskPriority::High, UE::Tasks::EExtendedTaskPriority::Inline );
+
+	return UE::Tasks::Launch( DebugName, []() {}, UE::Tasks::Prerequisites( WorkDone ), UE::Tasks::ETaskPriority::High, UE::Tasks::EExtendedTaskPriority::Inline );
+}
+
+void FCapsaLogPipeline::RunFormatStage( FCapsaPipelineChunk& Chunk )
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaLogPipeline::RunFormatStage);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	PrepareSubChunks( Chunk );
+
+	// Working memory of the template format, the output buffers come from the pool as well
+	FString Scratch = BufferPool.AcquireString();
+
+	// Sub-chunks are formatted in order, so dictionary entries end up in the first sub-chunk that uses them
+	for( int32 SubChunkIndex = 0; SubChunkIndex < Chunk.SubChunks.Num(); ++SubChunkIndex )
+	{
+		FormatSubChunk( Chunk, SubChunkIndex, Scratch );
+	}
+
+	BufferPool.ReleaseString( MoveTemp( Scratch ) );
+
+	RecordStage( ECapsaPipelineStage::Format, StartCycles );
+	FCapsaTelemetry::Get().RecordFormat( FPlatformTime::ToSeconds64( FPlatformTime::Cycles64() - StartCycles ) );
+}
+
+void FCapsaLogPipeline::RunFormatSubChunkStage( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex )
+{
+	if( Chunk.SubChunks[SubChunkIndex].NumLines == 0 )
+	{
+		return;
+	}
+
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaLogPipeline::RunFormatSubChunkStage);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	FString Scratch = BufferPool.AcquireString();
+	FormatSubChunk( Chunk, SubChunkIndex, Scratch );
+	BufferPool.ReleaseString( MoveTemp( Scratch ) );
+
+	RecordStage( ECapsaPipelineStage::Format, StartCycles );
+	FCapsaTelemetry::Get().RecordFormat( FPlatformTime::ToSeconds64( FPlatformTime::Cycles64() - StartCycles ) );
+}
+
+void FCapsaLogPipeline::PrepareSubChunks( FCapsaPipelineChunk& Chunk )
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaLogPipeline::PrepareSubChunks);
+
+	Chunk.Builder.FormatDeferredLines();
+
+	const int32 NumLines = Chunk.Builder.GetNumLines();
+	const int32 LinesPerSubChunk = FMath::DivideAndRoundUp( NumLines, Chunk.SubChunks.Num() );
+	for( int32 SubChunkIndex = 0; SubChunkIndex < Chunk.SubChunks.Num(); ++SubChunkIndex )
+	{
+		FCapsaPipelineSubChunk& SubChunk = Chunk.SubChunks[SubChunkIndex];
+		SubChunk.FirstLine = SubChunkIndex * LinesPerSubChunk;
+		SubChunk.NumLines = FMath::Clamp( NumLines - SubChunk.FirstLine, 0, LinesPerSubChunk );
+	}
+}
+
+void FCapsaLogPipeline::FormatSubChunk( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, FString& Scratch )
+{
+	FCapsaChunkBuilder& Builder = Chunk.Builder;
+	FCapsaPipelineSubChunk& SubChunk = Chunk.SubChunks[SubChunkIndex];
+	if( SubChunk.NumLines == 0 )
+	{
+		return;
+	}
+
+	if( Chunk.bCompress == true && Builder.IsBinaryChunkFormat() == true )
+	{
+		SubChunk.Payload = BufferPool.AcquireBytes();
+		Builder.MakeChunkBinary( SubChunk.Payload, SubChunk.FirstLine, SubChunk.NumLines );
+	} else
+	{
+		SubChunk.Log = BufferPool.AcquireString();
+		Builder.BuildChunkString( SubChunk.Log, Scratch, SubChunk.FirstLine, SubChunk.NumLines );
+		if( Chunk.bCompress == true )
+		{
+			SubChunk.Payload = BufferPool.AcquireBytes();
+			FCapsaChunkBuilder::ConvertToUtf8( SubChunk.Log, SubChunk.Payload );
+
+			// The Log is only kept for the plain text file
+			if( Chunk.bWriteToDiskPlain == false )
+			{
+				BufferPool.ReleaseString( MoveTemp( SubChunk.Log ) );
+			}
+		}
+	}
+
+	const int64 FormattedBytes = Chunk.bCompress == true ? SubChunk.Payload.Num() : SubChunk.Log.Len();
+	FCapsaTrace::ChunkEvent( ECapsaTraceChunkEvent::Formatted, Chunk.Sequence, SubChunkIndex, SubChunk.NumLines, FormattedBytes );
+}
+
+void FCapsaLogPipeline::RunCompressStage( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex )
+{
+	FCapsaPipelineSubChunk& SubChunk = Chunk.SubChunks[SubChunkIndex];
+	if( SubChunk.NumLines == 0 )
+	{
+		return;
+	}
+
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaLogPipeline::RunCompressStage);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	const int32 UncompressedSize = SubChunk.Payload.Num();
+
+	TArray<uint8> CompressedLog = BufferPool.AcquireBytes( FCompression::CompressMemoryBound( NAME_Zlib, SubChunk.Payload.Num() ) );
+	if( FCapsaChunkBuilder::CompressBytes( SubChunk.Payload, CompressedLog ) == false )
+	{
+		UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogPipeline::RunCompressStage | Failed to compress chunk %llu.%d" ), Chunk.Sequence, SubChunkIndex );
+		SubChunk.bFailed = true;
+	}
+	BufferPool.ReleaseBytes( MoveTemp( SubChunk.Payload ) );
+
+	// The pooled buffer itself goes to the upload, which hands it back with ReleasePayload() once the request is done
+	SubChunk.Payload = MoveTemp( CompressedLog );
+
+	RecordStage( ECapsaPipelineStage::Compress, StartCycles );
+	FCapsaTrace::ChunkEvent( ECapsaTraceChunkEvent::Compressed, Chunk.Sequence, SubChunkIndex, SubChunk.NumLines, SubChunk.Payload.Num() );
+	FCapsaTelemetry::Get().RecordCompress( FPlatformTime::ToSeconds64( FPlatformTime::Cycles64() - StartCycles ), UncompressedSize, SubChunk.Payload.Num() );
+}
+
+void FCapsaLogPipeline::RunPersistStage( FCapsaPipelineChunk& Chunk )
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaLogPipeline::RunPersistStage);
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	for( int32 SubChunkIndex = 0; SubChunkIndex < Chunk.SubChunks.Num(); ++SubChunkIndex )
+	{
+		FCapsaPipelineSubChunk& SubChunk = Chunk.SubChunks[SubChunkIndex];
+		if( SubChunk.NumLines == 0 )
+		{
+			continue;
+		}
+
+		if( Chunk.bWriteToDiskCompressed == true && Chunk.bCompress == true && SubChunk.bFailed == false )
+		{
+			const FString Suffix = Chunk.SubChunks.Num() > 1 ? FString::Printf( TEXT( ".%d" ), SubChunkIndex ) : FString();
+			if( Chunk.Builder.SaveBinaryToFile( SubChunk.Payload, Chunk.LogID, Suffix ) == false )
+			{
+				UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogPipeline::RunPersistStage | Failed to write compressed file to disk" ) );
+			}
+		}
+
+		if( Chunk.bWriteToDiskPlain == true )
+		{
+			if( Chunk.Builder.SavePlainLogToFile( SubChunk.Log, Chunk.LogID, SubChunk.FirstLine, SubChunk.NumLines ) == false )
+			{
+				UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogPipeline::RunPersistStage | Failed to write plain text file to disk" ) );
+			}
+		}
+
+		// Only the upload payload is needed from here on
+		if( Chunk.bCompress == true )
+		{
+			BufferPool.ReleaseString( MoveTemp( SubChunk.Log ) );
+		}
+	}
+
+	const int32 NumLines = Chunk.Builder.GetNumLines();
+	Chunk.Builder.ReleaseBuffer();
+
+	RecordStage( ECapsaPipelineStage::Persist, StartCycles );
+	FCapsaTrace::ChunkEvent( ECapsaTraceChunkEvent::Persisted, Chunk.Sequence, INDEX_NONE, NumLines, 0 );
+}
+
+void FCapsaLogPipeline::EnqueueUpload( const FChunkRef& Chunk )
+{
+	{
+		// Chunks persisted while Shutdown() waits are queued as well, it starts their uploads
+		FScopeLock ScopeLock( &UploadCriticalSection );
+		for( int32 SubChunkIndex = 0; SubChunkIndex < Chunk->SubChunks.Num(); ++SubChunkIndex )
+		{
+			const FCapsaPipelineSubChunk& SubChunk = Chunk->SubChunks[SubChunkIndex];
+			if( SubChunk.bFailed == true )
+			{
+				++NumFailed;
+				FCapsaTelemetry::Get().AddDroppedLines( SubChunk.NumLines );
+			} else if( SubChunk.NumLines > 0 )
+			{
+				PendingUploads.Add( FPendingUpload{ Chunk, SubChunkIndex } );
+				++Chunk->NumSubChunksToUpload;
+			}
+		}
+
+		if( Chunk->NumSubChunksToUpload == 0 )
+		{
+			FinishChunk( *Chunk );
+			return;
+		}
+	}
+
+	StartUploads();
+}
+
+void FCapsaLogPipeline::StartUploads()
+{
+	// The persist task queues the uploads, HTTP requests and the session state are only touched on the game thread
+	if( Settings.bUploadOnGameThread == true && IsInGameThread() == false )
+	{
+		TWeakPtr<FCapsaLogPipeline, ESPMode::ThreadSafe> WeakPipeline( AsShared() );
+		AsyncTask( ENamedThreads::GameThread, [WeakPipeline]()
+			{
+				TSharedPtr<FCapsaLogPipeline, ESPMode::ThreadSafe> Pipeline = WeakPipeline.Pin();
+				if( Pipeline.IsValid() == true && Pipeline->bShutdown == false )
+				{
+					Pipeline->StartUploads();
+				}
+			} );
+		return;
+	}
+
+	TArray<TPair<uint64, FPendingUpload>, TInlineAllocator<4>> UploadsToStart;
+	{
+		FScopeLock ScopeLock( &UploadCriticalSection );
+		while( PendingUploads.IsEmpty() == false && ActiveUploads.Num() < Settings.MaxConcurrentUploads )
+		{
+			FPendingUpload Upload = PendingUploads[0];
+			PendingUploads.RemoveAt( 0 );
+
+			const uint64 UploadID = NextUploadID++;
+			ActiveUploads.Add( UploadID, FActiveUpload{ Upload.Chunk, Upload.SubChunkIndex, FPlatformTime::Cycles64() } );
+			UploadsToStart.Emplace( UploadID, MoveTemp( Upload ) );
+		}
+		FCapsaTelemetry::Get().SetUploadQueueDepth( PendingUploads.Num() + ActiveUploads.Num() );
+	}
+
+	for( const TPair<uint64, FPendingUpload>& Upload : UploadsToStart )
+	{
+		StartUpload( Upload.Key, Upload.Value.Chunk, Upload.Value.SubChunkIndex );
+	}
+}
+
+bool FCapsaLogPipeline::StartUpload( uint64 UploadID, const FChunkRef& Chunk, int32 SubChunkIndex )
+{
+	if( FCapsaTrace::IsEnabled() == true )
+	{
+		const FCapsaPipelineSubChunk& SubChunk = Chunk->SubChunks[SubChunkIndex];
+		const int64 Bytes = Chunk->bCompress == true ? SubChunk.Payload.Num() : SubChunk.Log.Len();
+		FCapsaTrace::ChunkEvent( ECapsaTraceChunkEvent::UploadStarted, Chunk->Sequence, SubChunkIndex, SubChunk.NumLines, Bytes );
+	}
+
+	if( UploadFunction( *Chunk, SubChunkIndex, UploadID ) == false )
+	{
+		OnUploadComplete( UploadID, false );
+		return false;
+	}
+
+	return true;
+}
+
+void FCapsaLogPipeline::FinishChunk( const FCapsaPipelineChunk& Chunk )
+{
+	FCapsaTrace::EndChunk( Chunk.Sequence, Chunk.bTraced );
+	--NumChunksInFlight;
+}
+
+void FCapsaLogPipeline::RecordStage( ECapsaPipelineStage Stage, uint64 StartCycles )
+{
+	const uint64 Cycles = FPlatformTime::Cycles64() - StartCycles;
+	FStageCounters& Counters = StageCounters[static_cast<int32>( Stage )];
+
+	Counters.Count.fetch_add( 1 );
+	Counters.TotalCycles.fetch_add( Cycles );
+
+	uint64 MaxCycles = Counters.MaxCycles.load();
+	while( Cycles > MaxCycles && Counters.MaxCycles.compare_exchange_weak( MaxCycles, Cycles ) == false )
+	{
+	}
+}
+
+bool FCapsaLogPipeline::TrimIdleBuffers( float DeltaTime )
+{
+	const uint64 NumAcquired = BufferPool.GetNumAcquired();
+	if( NumAcquired == LastNumAcquired && BufferPool.GetPooledBytes() > 0 )
+	{
+		UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaLogPipeline::TrimIdleBuffers | Freeing %lld pooled bytes" ), BufferPool.GetPooledBytes() );
+		BufferPool.Trim();
+	}
+	LastNumAcquired = NumAcquired;
+	return true;
+}
+
+void FCapsaLogPipeline::OnMemoryTrim()
+{
+	BufferPool.Trim();
+}
+
+void FCapsaLogPipeline::UnregisterBufferTrim()
+{
+	if( TrimTickerHandle.IsValid() == true )
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker( TrimTickerHandle );
+		TrimTickerHandle.Reset();
+	}
+	if( MemoryTrimHandle.IsValid() == true )
+	{
+		FCoreDelegates::GetMemoryTrimDelegate().Remove( MemoryTrimHandle );
+		MemoryTrimHandle.Reset();
+	}
+}
@@ -0,0 +1,134 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Settings/CapsaLogPolicy.h"
+
+#include "CapsaCore.h"
+#include "Encoding/CapsaJsonReader.h"
+
+#include "Logging/LogVerbosity.h"
+
+
+namespace CapsaLogPolicy
+{
+	static bool ReadVerbosity( FCapsaJsonReader& Reader, TOptional<ELogVerbosity::Type>& OutVerbosity )
+	{
+		FString Value;
+		if( Reader.ReadString( Value ) == false )
+		{
+			return false;
+		}
+
+		const ELogVerbosity::Type Verbosity = ParseLogVerbosityFromString( Value );
+		if( Verbosity == ELogVerbosity::NoLogging && Value.Equals( TEXT( "NoLogging" ), ESearchCase::IgnoreCase ) == false )
+		{
+			UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaLogPolicy::Read | Ignoring unknown verbosity %s" ), *Value );
+			return true;
+		}
+
+		OutVerbosity = Verbosity;
+		return true;
+	}
+
+	template<typename NumberType>
+	static bool ReadNumber( FCapsaJsonReader& Reader, TOptional<NumberType>& OutValue )
+	{
+		double Value = 0.0;
+		if( Reader.ReadNumber( Value ) == false )
+		{
+			return false;
+		}
+
+		OutValue = static_cast<NumberType>( Value );
+		return true;
+	}
+
+	static bool ReadCategory( FCapsaJsonReader& Reader, FCapsaLogPolicy::FCategory& OutCategory )
+	{
+		return Reader.ReadObject( [&Reader, &OutCategory]( FAnsiStringView Key )
+			{
+				if( Key.Equals( ANSITEXTVIEW( "verbosity" ), ESearchCase::IgnoreCase ) == true )
+				{
+					return ReadVerbosity( Reader, OutCategory.Verbosity );
+				}
+				if( Key.Equals( ANSITEXTVIEW( "sampleRate" ), ESearchCase::IgnoreCase ) == true )
+				{
+					return ReadNumber( Reader, OutCategory.SampleRate );
+				}
+				if( Key.Equals( ANSITEXTVIEW( "linesPerSecond" ), ESearchCase::IgnoreCase ) == true )
+				{
+					return ReadNumber( Reader, OutCategory.LinesPerSecond );
+				}
+				if( Key.Equals( ANSITEXTVIEW( "burstLines" ), ESearchCase::IgnoreCase ) == true )
+				{
+					return ReadNumber( Reader, OutCategory.BurstLines );
+				}
+				return Reader.SkipValue();
+			} );
+	}
+}
+
+bool FCapsaLogPolicy::FCategory::HasRateLimit() const
+{
+	return SampleRate.IsSet() == true || LinesPerSecond.IsSet() == true || BurstLines.IsSet() == true;
+}
+
+void FCapsaLogPolicy::FCategory::ApplyRateLimit( FCapsaCategoryRateLimit& Limit ) const
+{
+	Limit.SampleRate = SampleRate.Get( Limit.SampleRate );
+	Limit.LinesPerSecond = LinesPerSecond.Get( Limit.LinesPerSecond );
+	Limit.BurstLines = BurstLines.Get( Limit.BurstLines );
+}
+
+bool FCapsaLogPolicy::FCategory::operator==( const FCategory& Other ) const
+{
+	return Verbosity == Other.Verbosity && SampleRate == Other.SampleRate && LinesPerSecond == Other.LinesPerSecond && BurstLines == Other.BurstLines;
+}
+
+bool FCapsaLogPolicy::Read( FCapsaJsonReader& Reader, FCapsaLogPolicy& OutPolicy )
+{
+	using namespace CapsaLogPolicy;
+
+	OutPolicy = FCapsaLogPolicy();
+	return Reader.ReadObject( [&Reader, &OutPolicy]( FAnsiStringView Key )
+		{
+			if( Key.Equals( ANSITEXTVIEW( "revision" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return Reader.ReadString( OutPolicy.Revision );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "verbosity" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return ReadVerbosity( Reader, OutPolicy.Verbosity );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "maxTimeBetweenFlushes" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return ReadNumber( Reader, OutPolicy.MaxTimeBetweenLogFlushes );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "maxLinesBetweenFlushes" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return ReadNumber( Reader, OutPolicy.MaxLogLinesBetweenLogFlushes );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "pollInterval" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return ReadNumber( Reader, OutPolicy.PollInterval );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "defaultLimit" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return ReadCategory( Reader, OutPolicy.DefaultLimit );
+			}
+			if( Key.Equals( ANSITEXTVIEW( "categories" ), ESearchCase::IgnoreCase ) == true )
+			{
+				return Reader.ReadObject( [&Reader, &OutPolicy]( FAnsiStringView Category )
+					{
+						return ReadCategory( Reader, OutPolicy.Categories.FindOrAdd( FName( Category ) ) );
+					} );
+			}
+			return Reader.SkipValue();
+		} );
+}
+
+bool FCapsaLogPolicy::operator==( const FCapsaLogPolicy& Other ) const
+{
+	return Revision == Other.Revision && Verbosity == Other.Verbosity && MaxTimeBetweenLogFlushes == Other.MaxTimeBetweenLogFlushes
+		&& MaxLogLinesBetweenLogFlushes == Other.MaxLogLinesBetweenLogFlushes && PollInterval == Other.PollInterval
+		&& DefaultLimit == Other.DefaultLimit && Categories.OrderIndependentCompareEqual( Other.Categories ) == true;
+}
@@ -2,6 +2,8 @@
 
 #include "Settings/CapsaSettings.h"
 
+#include "Settings/CapsaSettingsSnapshot.h"
+
 #include "GameFramework/PlayerState.h"
 
 #include UE_INLINE_GENERATED_CPP_BY_NAME(CapsaSettings)
@@ -20,13 +22,53 @@ UCapsaSettings::UCapsaSettings()
 #endif
 	, MaxLogLinesBetweenLogFlushes( 1000 )
 	, bUseCompression( true )
+	, ChunkFormat( ECapsaChunkFormat::PlainText )
+	, TemplateSimilarityThreshold( 0.5f )
+	, bUseDeferredFormatting( false )
+	, bCapsaLogSkipsLocalLog( false )
 	, bWriteToDiskPlain( true )
 	, bWriteToDiskCompressed( false )
+	, bUseFlightRecorder( false )
+	, FlightRecorderVerbosity( ECapsaLogVerbosity::Log )
+	, FlightRecorderCapacity( 10000 )
+	, FlightRecorderSecondsBefore( 30.f )
+	, FlightRecorderSecondsAfter( 10.f )
+	, bUseFrameBudget( false )
+	, FrameBudgetMilliseconds( 0.5f )
+	, FrameBudgetThrottleVerbosity( ECapsaLogVerbosity::Display )
+	, FrameBudgetSampleRate( 10 )
+	, FrameBudgetRecoverySeconds( 10.f )
+	, TopTalkersMetadataInterval( 300.f )
+	, NumTopTalkers( 10 )
+	, bApplyServerLogPolicy( true )
+	, LogPolicyPollInterval( 0.f )
+	, LinkedLogBatchSeconds( 2.f )
+	, MaxLinkedLogsPerSession( 10000 )
+	, bUseWorldLogSessions( false )
+	, MaxChunksInFlight( 4 )
+	, MaxBufferedLogLines( 200000 )
+	, MaxParallelChunkEncodes( 2 )
+	, MaxConcurrentUploads( 1 )
+	, MaxLinesPerSubChunk( 20000 )
+	, MaxPooledBufferMegabytes( 64 )
+	, PipelineThreadCount( -1 )
+	, PipelineThreadPriority( ECapsaThreadPriority::Lowest )
+	, PipelineThreadAffinityMask( 0 )
 	, bAutoAddCapsaComponent( true )
 	, AutoAddClass( APlayerState::StaticClass() )
 {
 }
 
+#if WITH_EDITOR
+void UCapsaSettings::PostEditChangeProperty( FPropertyChangedEvent& PropertyChangedEvent )
+{
+	Super::PostEditChangeProperty( PropertyChangedEvent );
+
+	// Apply the change to the running session, like the Capsa.Log.* console variables
+	FCapsaSettingsSnapshot::Update();
+}
+#endif
+
 FString UCapsaSettings::GetProtocol() const
 {
 	return Protocol;
@@ -87,6 +129,26 @@ bool UCapsaSettings::GetUseCompression() const
 	return bUseCompression;
 }
 
+ECapsaChunkFormat UCapsaSettings::GetChunkFormat() const
+{
+	return ChunkFormat;
+}
+
+float UCapsaSettings::GetTemplateSimilarityThreshold() const
+{
+	return TemplateSimilarityThreshold;
+}
+
+bool UCapsaSettings::GetUseDeferredFormatting() const
+{
+	return bUseDeferredFormatting;
+}
+
+bool UCapsaSettings::GetCapsaLogSkipsLocalLog() const
+{
+	return bCapsaLogSkipsLocalLog;
+}
+
 bool UCapsaSettings::GetWriteToDiskPlain() const
 {
 	return bWriteToDiskPlain;
@@ -97,6 +159,162 @@ bool UCapsaSettings::GetWriteToDiskCompressed() const
 	return bWriteToDiskCompressed;
 }
 
+const TMap<FName, FCapsaCategoryRateLimit>& UCapsaSettings::GetCategoryRateLimits() const
+{
+	return CategoryRateLimits;
+}
+
+const FCapsaCategoryRateLimit& UCapsaSettings::GetDefaultCategoryRateLimit() const
+{
+	return DefaultCategoryRateLimit;
+}
+
+bool UCapsaSettings::GetUseFlightRecorder() const
+{
+	return bUseFlightRecorder;
+}
+
+ELogVerbosity::Type UCapsaSettings::GetFlightRecorderVerbosity() const
+{
+	return static_cast<ELogVerbosity::Type>( FlightRecorderVerbosity );
+}
+
+int32 UCapsaSettings::GetFlightRecorderCapacity() const
+{
+	return FlightRecorderCapacity;
+}
+
+float UCapsaSettings::GetFlightRecorderSecondsBefore() const
+{
+	return FlightRecorderSecondsBefore;
+}
+
+float UCapsaSettings::GetFlightRecorderSecondsAfter() const
+{
+	return FlightRecorderSecondsAfter;
+}
+
+bool UCapsaSettings::GetUseFrameBudget() const
+{
+	return bUseFrameBudget;
+}
+
+float UCapsaSettings::GetFrameBudgetMilliseconds() const
+{
+	return FrameBudgetMilliseconds;
+}
+
+ELogVerbosity::Type UCapsaSettings::GetFrameBudgetThrottleVerbosity() const
+{
+	return static_cast<ELogVerbosity::Type>( FrameBudgetThrottleVerbosity );
+}
+
+int32 UCapsaSettings::GetFrameBudgetSampleRate() const
+{
+	return FrameBudgetSampleRate;
+}
+
+float UCapsaSettings::GetFrameBudgetRecoverySeconds() const
+{
+	return FrameBudgetRecoverySeconds;
+}
+
+float UCapsaSettings::GetTopTalkersMetadataInterval() const
+{
+	return TopTalkersMetadataInterval;
+}
+
+int32 UCapsaSettings::GetNumTopTalkers() const
+{
+	return NumTopTalkers;
+}
+
+bool UCapsaSettings::GetApplyServerLogPolicy() const
+{
+	return bApplyServerLogPolicy;
+}
+
+float UCapsaSettings::GetLogPolicyPollInterval() const
+{
+	return LogPolicyPollInterval;
+}
+
+float UCapsaSettings::GetLinkedLogBatchSeconds() const
+{
+	return LinkedLogBatchSeconds;
+}
+
+int32 UCapsaSettings::GetMaxLinkedLogsPerSession() const
+{
+	return FMath::Max( MaxLinkedLogsPerSession, 1 );
+}
+
+bool UCapsaSettings::GetUseWorldLogSessions() const
+{
+	return bUseWorldLogSessions;
+}
+
+int32 UCapsaSettings::GetMaxChunksInFlight() const
+{
+	return MaxChunksInFlight;
+}
+
+int32 UCapsaSettings::GetMaxBufferedLogLines() const
+{
+	return FMath::Max( MaxBufferedLogLines, 1 );
+}
+
+int32 UCapsaSettings::GetMaxParallelChunkEncodes() const
+{
+	return MaxParallelChunkEncodes;
+}
+
+int32 UCapsaSettings::GetMaxConcurrentUploads() const
+{
+	return MaxConcurrentUploads;
+}
+
+int32 UCapsaSettings::GetMaxLinesPerSubChunk() const
+{
+	return MaxLinesPerSubChunk;
+}
+
+int64 UCapsaSettings::GetMaxPooledBufferBytes() const
+{
+	return static_cast<int64>( FMath::Max( MaxPooledBufferMegabytes, 0 ) ) * 1024 * 1024;
+}
+
+int32 UCapsaSettings::GetPipelineThreadCount() const
+{
+	// A smaller pool would serialize the encodes MaxParallelChunkEncodes allows
+	if( PipelineThreadCount < 0 )
+	{
+		return FMath::Max( MaxParallelChunkEncodes, 1 );
+	}
+	return PipelineThreadCount;
+}
+
+EThreadPriority UCapsaSettings::GetPipelineThreadPriority() const
+{
+	switch( PipelineThreadPriority )
+	{
+	case ECapsaThreadPriority::Normal:
+		return TPri_Normal;
+	case ECapsaThreadPriority::SlightlyBelowNormal:
+		return TPri_SlightlyBelowNormal;
+	case ECapsaThreadPriority::BelowNormal:
+		return TPri_BelowNormal;
+	case ECapsaThreadPriority::Lowest:
+	default:
+		return TPri_Lowest;
+	}
+}
+
+uint64 UCapsaSettings::GetPipelineThreadAffinityMask() const
+{
+	return static_cast<uint64>( PipelineThreadAffinityMask );
+}
+
 bool UCapsaSettings::GetShouldAutoAddCapsaComponent() const
 {
 	return bAutoAddCapsaComponent;
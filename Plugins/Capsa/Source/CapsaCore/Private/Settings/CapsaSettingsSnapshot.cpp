@@ -0,0 +1,233 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Settings/CapsaSettingsSnapshot.h"
+
+#include "CapsaCore.h"
+#include "Settings/CapsaLogPolicy.h"
+#include "Settings/CapsaSettings.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Logging/LogVerbosity.h"
+#include "Misc/ScopeRWLock.h"
+
+
+namespace CapsaSettingsSnapshot
+{
+	static FRWLock										Lock;
+	static TSharedPtr<const FCapsaSettingsSnapshot, ESPMode::ThreadSafe> Current;
+	static uint32										Revision = 0;
+
+	/**
+	* The policy pushed by the Capsa Server, only used on the game thread.
+	*/
+	static FCapsaLogPolicy								Policy;
+
+	static void OnConsoleVariableChanged( IConsoleVariable* Variable )
+	{
+		// Console variables can be set from ini files before the settings exist, those are picked up by the first Update
+		bool bHasSnapshot = false;
+		{
+			FReadScopeLock ReadLock( Lock );
+			bHasSnapshot = Current.IsValid();
+		}
+
+		if( bHasSnapshot == true )
+		{
+			FCapsaSettingsSnapshot::Update();
+		}
+	}
+
+	static TAutoConsoleVariable<float> CVarTickRate(
+		TEXT( "Capsa.Log.TickRate" ),
+		-1.f,
+		TEXT( "How often (in seconds) the Capsa Log Device checks whether to flush. Negative uses LogTickRate from the Capsa Settings." ),
+		FConsoleVariableDelegate::CreateStatic( &OnConsoleVariableChanged ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<float> CVarMaxTimeBetweenFlushes(
+		TEXT( "Capsa.Log.MaxTimeBetweenFlushes" ),
+		-1.f,
+		TEXT( "The maximum time (in seconds) between log uploads. Negative uses MaxTimeBetweenLogFlushes from the Capsa Settings." ),
+		FConsoleVariableDelegate::CreateStatic( &OnConsoleVariableChanged ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<int32> CVarMaxLinesBetweenFlushes(
+		TEXT( "Capsa.Log.MaxLinesBetweenFlushes" ),
+		-1,
+		TEXT( "The number of buffered lines that triggers a log upload. Negative uses MaxLogLinesBetweenLogFlushes from the Capsa Settings." ),
+		FConsoleVariableDelegate::CreateStatic( &OnConsoleVariableChanged ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<int32> CVarUseCompression(
+		TEXT( "Capsa.Log.UseCompression" ),
+		-1,
+		TEXT( "Whether log chunks are compressed before uploading (0 or 1). Negative uses bUseCompression from the Capsa Settings." ),
+		FConsoleVariableDelegate::CreateStatic( &OnConsoleVariableChanged ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<FString> CVarChunkFormat(
+		TEXT( "Capsa.Log.ChunkFormat" ),
+		TEXT( "" ),
+		TEXT( "The encoding of uploaded log chunks: PlainText, Template or Columnar. Empty uses ChunkFormat from the Capsa Settings." ),
+		FConsoleVariableDelegate::CreateStatic( &OnConsoleVariableChanged ),
+		ECVF_Default );
+
+	static TAutoConsoleVariable<FString> CVarVerbosity(
+		TEXT( "Capsa.Log.Verbosity" ),
+		TEXT( "" ),
+		TEXT( "Lines more verbose than this (for example Log or Warning) are not captured by Capsa. Empty captures all lines." ),
+		FConsoleVariableDelegate::CreateStatic( &OnConsoleVariableChanged ),
+		ECVF_Default );
+
+	static bool ParseChunkFormat( const FString& Value, ECapsaChunkFormat& OutFormat )
+	{
+		if( Value.Equals( TEXT( "PlainText" ), ESearchCase::IgnoreCase ) == true || Value.Equals( TEXT( "Plain" ), ESearchCase::IgnoreCase ) == true )
+		{
+			OutFormat = ECapsaChunkFormat::PlainText;
+			return true;
+		}
+		if( Value.Equals( TEXT( "Template" ), ESearchCase::IgnoreCase ) == true )
+		{
+			OutFormat = ECapsaChunkFormat::Template;
+			return true;
+		}
+		if( Value.Equals( TEXT( "Columnar" ), ESearchCase::IgnoreCase ) == true )
+		{
+			OutFormat = ECapsaChunkFormat::Columnar;
+			return true;
+		}
+		return false;
+	}
+}
+
+FCapsaSettingsSnapshot::FCapsaSettingsSnapshot()
+	: ChunkFormat( ECapsaChunkFormat::PlainText )
+{
+}
+
+FCapsaSettingsSnapshot::FRef FCapsaSettingsSnapshot::Get()
+{
+	{
+		FReadScopeLock ReadLock( CapsaSettingsSnapshot::Lock );
+		if( CapsaSettingsSnapshot::Current.IsValid() == true )
+		{
+			return CapsaSettingsSnapshot::Current.ToSharedRef();
+		}
+	}
+
+	Update();
+
+	FReadScopeLock ReadLock( CapsaSettingsSnapshot::Lock );
+	return CapsaSettingsSnapshot::Current.ToSharedRef();
+}
+
+void FCapsaSettingsSnapshot::Update()
+{
+	using namespace CapsaSettingsSnapshot;
+
+	TSharedRef<FCapsaSettingsSnapshot, ESPMode::ThreadSafe> Snapshot = MakeShared<FCapsaSettingsSnapshot, ESPMode::ThreadSafe>();
+
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	if( CapsaSettings != nullptr && CapsaSettings->IsValidLowLevelFast() == true )
+	{
+		Snapshot->EnvironmentKey = CapsaSettings->GetCapsaEnvironmentKey();
+		Snapshot->bHasServerURL = CapsaSettings->GetCapsaServerURL().IsEmpty() == false;
+		Snapshot->ClientAuthURL = CapsaSettings->GetServerEndpointClientAuth();
+		Snapshot->ClientLogChunkURL = CapsaSettings->GetServerEndpointClientLogChunk();
+		Snapshot->ClientLogMetadataURL = CapsaSettings->GetServerEndpointClientLogMetadata();
+
+		Snapshot->LogTickRate = CapsaSettings->GetLogTickRate();
+		Snapshot->MaxTimeBetweenLogFlushes = CapsaSettings->GetMaxTimeBetweenLogFlushes();
+		Snapshot->MaxLogLinesBetweenLogFlushes = CapsaSettings->GetMaxLogLinesBetweenLogFlushes();
+		Snapshot->CategoryRateLimits = CapsaSettings->GetCategoryRateLimits();
+		Snapshot->DefaultCategoryRateLimit = CapsaSettings->GetDefaultCategoryRateLimit();
+
+		Snapshot->bUseCompression = CapsaSettings->GetUseCompression();
+		Snapshot->ChunkFormat = CapsaSettings->GetChunkFormat();
+		Snapshot->TemplateSimilarityThreshold = CapsaSettings->GetTemplateSimilarityThreshold();
+		Snapshot->bWriteToDiskPlain = CapsaSettings->GetWriteToDiskPlain();
+		Snapshot->bWriteToDiskCompressed = CapsaSettings->GetWriteToDiskCompressed();
+
+		Snapshot->bAutoAddCapsaComponent = CapsaSettings->GetShouldAutoAddCapsaComponent();
+		Snapshot->AutoAddClass = CapsaSettings->GetAutoAddClass();
+	} else
+	{
+		UE_LOG( LogCapsaCore, Error, TEXT( "FCapsaSettingsSnapshot::Update | Failed to load CapsaSettings, using defaults." ) );
+	}
+
+	// Log policy overrides
+	Snapshot->PolicyRevision = Policy.Revision;
+	if( Policy.Verbosity.IsSet() == true )
+	{
+		Snapshot->Verbosity = Policy.Verbosity.GetValue();
+	}
+	if( Policy.MaxTimeBetweenLogFlushes.IsSet() == true )
+	{
+		Snapshot->MaxTimeBetweenLogFlushes = Policy.MaxTimeBetweenLogFlushes.GetValue();
+	}
+	if( Policy.MaxLogLinesBetweenLogFlushes.IsSet() == true )
+	{
+		Snapshot->MaxLogLinesBetweenLogFlushes = Policy.MaxLogLinesBetweenLogFlushes.GetValue();
+	}
+	Policy.DefaultLimit.ApplyRateLimit( Snapshot->DefaultCategoryRateLimit );
+	for( const TPair<FName, FCapsaLogPolicy::FCategory>& Category : Policy.Categories )
+	{
+		if( Category.Value.HasRateLimit() == true )
+		{
+			// Categories without their own limit start from the default
+			FCapsaCategoryRateLimit* Limit = Snapshot->CategoryRateLimits.Find( Category.Key );
+			if( Limit == nullptr )
+			{
+				Limit = &Snapshot->CategoryRateLimits.Add( Category.Key, Snapshot->DefaultCategoryRateLimit );
+			}
+			Category.Value.ApplyRateLimit( *Limit );
+		}
+	}
+
+	// Console variable overrides
+	if( CVarTickRate.GetValueOnAnyThread() >= 0.f )
+	{
+		Snapshot->LogTickRate = CVarTickRate.GetValueOnAnyThread();
+	}
+	if( CVarMaxTimeBetweenFlushes.GetValueOnAnyThread() >= 0.f )
+	{
+		Snapshot->MaxTimeBetweenLogFlushes = CVarMaxTimeBetweenFlushes.GetValueOnAnyThread();
+	}
+	if( CVarMaxLinesBetweenFlushes.GetValueOnAnyThread() >= 0 )
+	{
+		Snapshot->MaxLogLinesBetweenLogFlushes = CVarMaxLinesBetweenFlushes.GetValueOnAnyThread();
+	}
+	if( CVarUseCompression.GetValueOnAnyThread() >= 0 )
+	{
+		Snapshot->bUseCompression = CVarUseCompression.GetValueOnAnyThread() != 0;
+	}
+
+	const FString ChunkFormat = CVarChunkFormat.GetValueOnAnyThread();
+	if( ChunkFormat.IsEmpty() == false && ParseChunkFormat( ChunkFormat, Snapshot->ChunkFormat ) == false )
+	{
+		UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaSettingsSnapshot::Update | Unknown Capsa.Log.ChunkFormat %s, using the Capsa Settings." ), *ChunkFormat );
+	}
+
+	const FString Verbosity = CVarVerbosity.GetValueOnAnyThread();
+	if( Verbosity.IsEmpty() == false )
+	{
+		const ELogVerbosity::Type ParsedVerbosity = ParseLogVerbosityFromString( Verbosity );
+		if( ParsedVerbosity != ELogVerbosity::NoLogging || Verbosity.Equals( TEXT( "NoLogging" ), ESearchCase::IgnoreCase ) == true )
+		{
+			Snapshot->Verbosity = ParsedVerbosity;
+		} else
+		{
+			UE_LOG( LogCapsaCore, Warning, TEXT( "FCapsaSettingsSnapshot::Update | Unknown Capsa.Log.Verbosity %s, capturing all lines." ), *Verbosity );
+		}
+	}
+
+	FWriteScopeLock WriteLock( Lock );
+	Snapshot->Revision = ++CapsaSettingsSnapshot::Revision;
+	Current = Snapshot;
+}
+
+void FCapsaSettingsSnapshot::SetLogPolicy( const FCapsaLogPolicy& Policy )
+{
+	CapsaSettingsSnapshot::Policy = Policy;
+	Update();
+}
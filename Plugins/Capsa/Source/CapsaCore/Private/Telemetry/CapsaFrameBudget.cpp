@@ -0,0 +1,199 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Telemetry/CapsaFrameBudget.h"
+
+#include "CapsaCore.h"
+#include "Telemetry/CapsaTelemetry.h"
+
+#include "Misc/CoreDelegates.h"
+
+
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Game Thread ms/Frame" ), STAT_CapsaGameThreadMilliseconds, STATGROUP_Capsa );
+DECLARE_DWORD_COUNTER_STAT( TEXT( "Throttle Level" ), STAT_CapsaThrottleLevel, STATGROUP_Capsa );
+
+
+FCapsaFrameBudget::FScope::FScope()
+	: bGameThread( IsInGameThread() )
+	, StartCycles( 0 )
+{
+	if( bGameThread == true && FCapsaFrameBudget::Get().ScopeDepth++ == 0 )
+	{
+		StartCycles = FPlatformTime::Cycles64();
+	}
+}
+
+FCapsaFrameBudget::FScope::~FScope()
+{
+	if( bGameThread == false )
+	{
+		return;
+	}
+
+	FCapsaFrameBudget& FrameBudget = FCapsaFrameBudget::Get();
+	if( --FrameBudget.ScopeDepth == 0 )
+	{
+		FrameBudget.FrameCycles += FPlatformTime::Cycles64() - StartCycles;
+	}
+}
+
+FCapsaFrameBudget& FCapsaFrameBudget::Get()
+{
+	static FCapsaFrameBudget FrameBudget;
+	return FrameBudget;
+}
+
+FCapsaFrameBudget::FCapsaFrameBudget()
+	: ThrottleLevel( ECapsaThrottleLevel::None )
+	, SampleCounter( 0 )
+	, NumThrottledLines( 0 )
+	, ThrottleVerbosity( ELogVerbosity::Log )
+	, SampleRate( 10 )
+	, BudgetMilliseconds( 0.0 )
+	, RecoverySeconds( 0.0 )
+	, ScopeDepth( 0 )
+	, FrameCycles( 0 )
+	, WindowCycles( 0 )
+	, WindowFrames( 0 )
+	, WindowStartTime( 0.0 )
+	, RecoveryStartTime( 0.0 )
+	, MillisecondsPerFrame( 0.0 )
+{
+}
+
+void FCapsaFrameBudget::Start( float InBudgetMilliseconds, ELogVerbosity::Type InThrottleVerbosity, int32 InSampleRate, float InRecoverySeconds )
+{
+	check( IsInGameThread() );
+
+	BudgetMilliseconds = FMath::Max( InBudgetMilliseconds, 0.f );
+	ThrottleVerbosity = InThrottleVerbosity;
+	SampleRate = FMath::Max( InSampleRate, 1 );
+	RecoverySeconds = FMath::Max( InRecoverySeconds, 0.f );
+
+	FrameCycles = 0;
+	WindowCycles = 0;
+	WindowFrames = 0;
+	WindowStartTime = FPlatformTime::Seconds();
+	RecoveryStartTime = 0.0;
+
+	if( OnEndFrameHandle.IsValid() == false )
+	{
+		OnEndFrameHandle = FCoreDelegates::OnEndFrame.AddRaw( this, &FCapsaFrameBudget::OnEndFrame );
+	}
+}
+
+void FCapsaFrameBudget::Stop()
+{
+	if( OnEndFrameHandle.IsValid() == true )
+	{
+		FCoreDelegates::OnEndFrame.Remove( OnEndFrameHandle );
+		OnEndFrameHandle.Reset();
+	}
+
+	ThrottleLevel.store( ECapsaThrottleLevel::None, std::memory_order_relaxed );
+}
+
+ECapsaThrottleLevel FCapsaFrameBudget::GetThrottleLevel() const
+{
+	return ThrottleLevel.load( std::memory_order_relaxed );
+}
+
+double FCapsaFrameBudget::GetMillisecondsPerFrame() const
+{
+	return MillisecondsPerFrame;
+}
+
+bool FCapsaFrameBudget::ShouldCaptureThrottled( ECapsaThrottleLevel Level, ELogVerbosity::Type Verbosity )
+{
+	bool bCapture = Verbosity <= ThrottleVerbosity;
+	if( bCapture == true && Level == ECapsaThrottleLevel::Sample )
+	{
+		bCapture = SampleCounter.fetch_add( 1, std::memory_order_relaxed ) % SampleRate == 0;
+	}
+
+	if( bCapture == false )
+	{
+		NumThrottledLines.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	return bCapture;
+}
+
+void FCapsaFrameBudget::OnEndFrame()
+{
+	WindowCycles += FrameCycles;
+	FrameCycles = 0;
+	++WindowFrames;
+
+	const double Now = FPlatformTime::Seconds();
+	if( Now - WindowStartTime < WindowSeconds )
+	{
+		return;
+	}
+
+	MillisecondsPerFrame = FPlatformTime::ToMilliseconds64( WindowCycles ) / WindowFrames;
+	WindowCycles = 0;
+	WindowFrames = 0;
+	WindowStartTime = Now;
+
+	SET_FLOAT_STAT( STAT_CapsaGameThreadMilliseconds, MillisecondsPerFrame );
+	SET_DWORD_STAT( STAT_CapsaThrottleLevel, static_cast<uint32>( GetThrottleLevel() ) );
+
+	if( BudgetMilliseconds > 0.0 )
+	{
+		UpdateThrottle( Now, MillisecondsPerFrame );
+	}
+}
+
+void FCapsaFrameBudget::UpdateThrottle( double Now, double InMillisecondsPerFrame )
+{
+	const ECapsaThrottleLevel Level = GetThrottleLevel();
+	if( InMillisecondsPerFrame > BudgetMilliseconds )
+	{
+		RecoveryStartTime = 0.0;
+		if( Level != ECapsaThrottleLevel::Sample )
+		{
+			SetThrottleLevel( static_cast<ECapsaThrottleLevel>( static_cast<uint8>( Level ) + 1 ), InMillisecondsPerFrame );
+		}
+		return;
+	}
+
+	// Only recover well under the budget, so the throttle does not flip every window
+	if( Level == ECapsaThrottleLevel::None || InMillisecondsPerFrame > BudgetMilliseconds * 0.5 )
+	{
+		RecoveryStartTime = 0.0;
+		return;
+	}
+
+	if( RecoveryStartTime == 0.0 )
+	{
+		RecoveryStartTime = Now;
+	} else if( Now - RecoveryStartTime >= RecoverySeconds )
+	{
+		RecoveryStartTime = Now;
+		SetThrottleLevel( static_cast<ECapsaThrottleLevel>( static_cast<uint8>( Level ) - 1 ), InMillisecondsPerFrame );
+	}
+}
+
+void FCapsaFrameBudget::SetThrottleLevel( ECapsaThrottleLevel Level, double InMillisecondsPerFrame )
+{
+	ThrottleLevel.store( Level, std::memory_order_relaxed );
+
+	const uint64 NumThrottled = NumThrottledLines.exchange( 0, std::memory_order_relaxed );
+
+	UE_LOG( LogCapsaThrottle, Warning, TEXT( "FCapsaFrameBudget::SetThrottleLevel | Capsa throttle is now %s: game thread cost %.3f ms/frame, budget %.3f ms, %llu lines were throttled at the previous level" ),
+		GetThrottleLevelName( Level ), InMillisecondsPerFrame, BudgetMilliseconds, NumThrottled );
+}
+
+const TCHAR* FCapsaFrameBudget::GetThrottleLevelName( ECapsaThrottleLevel Level )
+{
+	switch( Level )
+	{
+	case ECapsaThrottleLevel::Filter:
+		return TEXT( "Filter" );
+	case ECapsaThrottleLevel::Sample:
+		return TEXT( "Sample" );
+	case ECapsaThrottleLevel::None:
+	default:
+		return TEXT( "None" );
+	}
+}
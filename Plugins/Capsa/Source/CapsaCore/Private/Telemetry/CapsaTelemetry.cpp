@@ -0,0 +1,342 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Telemetry/CapsaTelemetry.h"
+
+#include "ProfilingDebugging/CsvProfiler.h"
+
+
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Lines Captured/s" ), STAT_CapsaLinesCapturedPerSecond, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Lines Filtered/s" ), STAT_CapsaLinesFilteredPerSecond, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Lines Dropped/s" ), STAT_CapsaLinesDroppedPerSecond, STATGROUP_Capsa );
+DECLARE_MEMORY_STAT( TEXT( "Buffered Bytes" ), STAT_CapsaBufferedBytes, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Format ms/Chunk" ), STAT_CapsaFormatMilliseconds, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Compress ms/Chunk" ), STAT_CapsaCompressMilliseconds, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Compression Ratio" ), STAT_CapsaCompressionRatio, STATGROUP_Capsa );
+DECLARE_DWORD_COUNTER_STAT( TEXT( "Upload Queue Depth" ), STAT_CapsaUploadQueueDepth, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Upload Latency P50 ms" ), STAT_CapsaUploadLatencyP50, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Upload Latency P95 ms" ), STAT_CapsaUploadLatencyP95, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Upload Latency P99 ms" ), STAT_CapsaUploadLatencyP99, STATGROUP_Capsa );
+DECLARE_DWORD_COUNTER_STAT( TEXT( "Upload Failures" ), STAT_CapsaUploadFailures, STATGROUP_Capsa );
+DECLARE_DWORD_COUNTER_STAT( TEXT( "Auth Retries" ), STAT_CapsaAuthRetries, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Delivery Latency P50 ms" ), STAT_CapsaDeliveryLatencyP50, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Delivery Latency P95 ms" ), STAT_CapsaDeliveryLatencyP95, STATGROUP_Capsa );
+DECLARE_FLOAT_COUNTER_STAT( TEXT( "Delivery Latency P99 ms" ), STAT_CapsaDeliveryLatencyP99, STATGROUP_Capsa );
+
+CSV_DEFINE_CATEGORY( Capsa, true );
+
+
+FCapsaTelemetry& FCapsaTelemetry::Get()
+{
+	static FCapsaTelemetry Telemetry;
+	return Telemetry;
+}
+
+FCapsaTelemetry::FCapsaTelemetry()
+	: LinesCaptured( 0 )
+	, LinesFiltered( 0 )
+	, LinesDropped( 0 )
+	, BufferedBytes( 0 )
+	, NumFormats( 0 )
+	, FormatNanoseconds( 0 )
+	, NumCompresses( 0 )
+	, CompressNanoseconds( 0 )
+	, UncompressedBytes( 0 )
+	, CompressedBytes( 0 )
+	, UploadQueueDepth( 0 )
+	, NumUploads( 0 )
+	, UploadFailures( 0 )
+	, AuthRetries( 0 )
+	, LinesDelivered( 0 )
+	, LinkedLogRegistrations( 0 )
+	, MetadataRequests( 0 )
+	, WindowStartTime( 0.0 )
+	, WindowLinesCaptured( 0 )
+	, WindowLinesFiltered( 0 )
+	, WindowLinesDropped( 0 )
+	, WindowNumFormats( 0 )
+	, WindowFormatNanoseconds( 0 )
+	, WindowNumCompresses( 0 )
+	, WindowCompressNanoseconds( 0 )
+	, WindowUncompressedBytes( 0 )
+	, WindowCompressedBytes( 0 )
+{
+	UploadLatencies.Samples.Reserve( NumLatencySamples );
+	DeliveryLatencies.Samples.Reserve( NumLatencySamples );
+}
+
+void FCapsaTelemetry::Start()
+{
+	if( TickerHandle.IsValid() == true )
+	{
+		return;
+	}
+
+	WindowStartTime = FPlatformTime::Seconds();
+	// A delay of 0 ticks every frame, so every frame of a CSV capture has a value
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateRaw( this, &FCapsaTelemetry::Tick ), 0.0f );
+}
+
+void FCapsaTelemetry::Stop()
+{
+	if( TickerHandle.IsValid() == true )
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker( TickerHandle );
+		TickerHandle.Reset();
+	}
+}
+
+void FCapsaTelemetry::AddCapturedLines( int32 NumLines )
+{
+	LinesCaptured.fetch_add( NumLines, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::AddFilteredLines( int32 NumLines )
+{
+	LinesFiltered.fetch_add( NumLines, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::AddDroppedLines( int32 NumLines )
+{
+	LinesDropped.fetch_add( NumLines, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::SetBufferedBytes( int64 Bytes )
+{
+	BufferedBytes.store( Bytes, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::RecordFormat( double Seconds )
+{
+	FormatNanoseconds.fetch_add( static_cast<uint64>( Seconds * 1e9 ), std::memory_order_relaxed );
+	NumFormats.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::RecordCompress( double Seconds, int64 InUncompressedBytes, int64 InCompressedBytes )
+{
+	CompressNanoseconds.fetch_add( static_cast<uint64>( Seconds * 1e9 ), std::memory_order_relaxed );
+	UncompressedBytes.fetch_add( InUncompressedBytes, std::memory_order_relaxed );
+	CompressedBytes.fetch_add( InCompressedBytes, std::memory_order_relaxed );
+	NumCompresses.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::SetUploadQueueDepth( int32 Depth )
+{
+	UploadQueueDepth.store( Depth, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::RecordUpload( double LatencySeconds, bool bSuccess )
+{
+	NumUploads.fetch_add( 1, std::memory_order_relaxed );
+	if( bSuccess == false )
+	{
+		UploadFailures.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	FScopeLock ScopeLock( &LatencyCriticalSection );
+	UploadLatencies.Add( LatencySeconds );
+}
+
+void FCapsaTelemetry::AddAuthRetry()
+{
+	AuthRetries.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::AddLinkedLogRegistration()
+{
+	LinkedLogRegistrations.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::AddMetadataRequest()
+{
+	MetadataRequests.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::RecordDelivery( double LatencySeconds, int32 NumLines )
+{
+	LinesDelivered.fetch_add( NumLines, std::memory_order_relaxed );
+
+	FScopeLock ScopeLock( &LatencyCriticalSection );
+	DeliveryLatencies.Add( LatencySeconds );
+}
+
+FCapsaTelemetrySnapshot FCapsaTelemetry::GetSnapshot() const
+{
+	FScopeLock ScopeLock( &SnapshotCriticalSection );
+	return Snapshot;
+}
+
+FCapsaTelemetryTotals FCapsaTelemetry::GetTotals() const
+{
+	FCapsaTelemetryTotals Totals;
+	Totals.LinesCaptured = LinesCaptured.load( std::memory_order_relaxed );
+	Totals.LinesFiltered = LinesFiltered.load( std::memory_order_relaxed );
+	Totals.LinesDropped = LinesDropped.load( std::memory_order_relaxed );
+	Totals.LinesDelivered = LinesDelivered.load( std::memory_order_relaxed );
+	Totals.FormatSeconds = FormatNanoseconds.load( std::memory_order_relaxed ) / 1e9;
+	Totals.CompressSeconds = CompressNanoseconds.load( std::memory_order_relaxed ) / 1e9;
+	Totals.UncompressedBytes = UncompressedBytes.load( std::memory_order_relaxed );
+	Totals.CompressedBytes = CompressedBytes.load( std::memory_order_relaxed );
+	Totals.Uploads = NumUploads.load( std::memory_order_relaxed );
+	Totals.UploadFailures = UploadFailures.load( std::memory_order_relaxed );
+	Totals.AuthRetries = AuthRetries.load( std::memory_order_relaxed );
+	Totals.LinkedLogRegistrations = LinkedLogRegistrations.load( std::memory_order_relaxed );
+	Totals.MetadataRequests = MetadataRequests.load( std::memory_order_relaxed );
+	return Totals;
+}
+
+void FCapsaTelemetry::FLatencySamples::Add( double LatencySeconds )
+{
+	const float LatencyMilliseconds = static_cast<float>( LatencySeconds * 1000.0 );
+	if( Samples.Num() < NumLatencySamples )
+	{
+		Samples.Add( LatencyMilliseconds );
+	} else
+	{
+		Samples[NextSample] = LatencyMilliseconds;
+	}
+	NextSample = ( NextSample + 1 ) % NumLatencySamples;
+	bNewSamples = true;
+}
+
+bool FCapsaTelemetry::FLatencySamples::TakeSorted( TArray<float, TInlineAllocator<NumLatencySamples>>& OutSorted )
+{
+	if( bNewSamples == false )
+	{
+		return false;
+	}
+
+	OutSorted = Samples;
+	OutSorted.Sort();
+	bNewSamples = false;
+	return true;
+}
+
+bool FCapsaTelemetry::Tick( float DeltaTime )
+{
+	const double Now = FPlatformTime::Seconds();
+	if( Now - WindowStartTime >= WindowSeconds )
+	{
+		UpdateSnapshot( Now );
+	}
+
+	Publish();
+	return true;
+}
+
+void FCapsaTelemetry::UpdateSnapshot( double Now )
+{
+	const double Elapsed = Now - WindowStartTime;
+	WindowStartTime = Now;
+
+	// Returns the growth of the counter during the window, and moves the window forward
+	auto TakeDelta = []( const std::atomic<uint64>& Counter, uint64& WindowValue )
+		{
+			const uint64 Value = Counter.load( std::memory_order_relaxed );
+			const uint64 Delta = Value - WindowValue;
+			WindowValue = Value;
+			return Delta;
+		};
+
+	const uint64 DeltaCaptured = TakeDelta( LinesCaptured, WindowLinesCaptured );
+	const uint64 DeltaFiltered = TakeDelta( LinesFiltered, WindowLinesFiltered );
+	const uint64 DeltaDropped = TakeDelta( LinesDropped, WindowLinesDropped );
+	const uint64 DeltaFormats = TakeDelta( NumFormats, WindowNumFormats );
+	const uint64 DeltaFormatNanoseconds = TakeDelta( FormatNanoseconds, WindowFormatNanoseconds );
+	const uint64 DeltaCompresses = TakeDelta( NumCompresses, WindowNumCompresses );
+	const uint64 DeltaCompressNanoseconds = TakeDelta( CompressNanoseconds, WindowCompressNanoseconds );
+	const uint64 DeltaUncompressedBytes = TakeDelta( UncompressedBytes, WindowUncompressedBytes );
+	const uint64 DeltaCompressedBytes = TakeDelta( CompressedBytes, WindowCompressedBytes );
+
+	// Only sort when uploads finished since the last window
+	TArray<float, TInlineAllocator<NumLatencySamples>> SortedUploadLatencies;
+	TArray<float, TInlineAllocator<NumLatencySamples>> SortedDeliveryLatencies;
+	{
+		FScopeLock ScopeLock( &LatencyCriticalSection );
+		UploadLatencies.TakeSorted( SortedUploadLatencies );
+		DeliveryLatencies.TakeSorted( SortedDeliveryLatencies );
+	}
+
+	auto Percentile = []( const TArray<float, TInlineAllocator<NumLatencySamples>>& SortedLatencies, double Fraction )
+		{
+			const int32 Index = FMath::Clamp( FMath::CeilToInt32( Fraction * SortedLatencies.Num() ) - 1, 0, SortedLatencies.Num() - 1 );
+			return static_cast<double>( SortedLatencies[Index] );
+		};
+
+	FScopeLock ScopeLock( &SnapshotCriticalSection );
+	Snapshot.LinesCapturedPerSecond = DeltaCaptured / Elapsed;
+	Snapshot.LinesFilteredPerSecond = DeltaFiltered / Elapsed;
+	Snapshot.LinesDroppedPerSecond = DeltaDropped / Elapsed;
+	if( DeltaFormats > 0 )
+	{
+		Snapshot.FormatMillisecondsPerChunk = DeltaFormatNanoseconds / 1e6 / DeltaFormats;
+	}
+	if( DeltaCompresses > 0 )
+	{
+		Snapshot.CompressMillisecondsPerChunk = DeltaCompressNanoseconds / 1e6 / DeltaCompresses;
+	}
+	if( DeltaCompressedBytes > 0 )
+	{
+		Snapshot.CompressionRatio = static_cast<double>( DeltaUncompressedBytes ) / DeltaCompressedBytes;
+	}
+	if( SortedUploadLatencies.IsEmpty() == false )
+	{
+		Snapshot.UploadLatencyP50Milliseconds = Percentile( SortedUploadLatencies, 0.50 );
+		Snapshot.UploadLatencyP95Milliseconds = Percentile( SortedUploadLatencies, 0.95 );
+		Snapshot.UploadLatencyP99Milliseconds = Percentile( SortedUploadLatencies, 0.99 );
+	}
+	if( SortedDeliveryLatencies.IsEmpty() == false )
+	{
+		Snapshot.DeliveryLatencyP50Milliseconds = Percentile( SortedDeliveryLatencies, 0.50 );
+		Snapshot.DeliveryLatencyP95Milliseconds = Percentile( SortedDeliveryLatencies, 0.95 );
+		Snapshot.DeliveryLatencyP99Milliseconds = Percentile( SortedDeliveryLatencies, 0.99 );
+	}
+	Snapshot.BufferedBytes = BufferedBytes.load( std::memory_order_relaxed );
+	Snapshot.UploadQueueDepth = UploadQueueDepth.load( std::memory_order_relaxed );
+	Snapshot.UploadFailures = UploadFailures.load( std::memory_order_relaxed );
+	Snapshot.AuthRetries = AuthRetries.load( std::memory_order_relaxed );
+}
+
+void FCapsaTelemetry::Publish() const
+{
+	FCapsaTelemetrySnapshot Values = GetSnapshot();
+
+	// The gauges and totals do not need a window, publish their current value
+	Values.BufferedBytes = BufferedBytes.load( std::memory_order_relaxed );
+	Values.UploadQueueDepth = UploadQueueDepth.load( std::memory_order_relaxed );
+	Values.UploadFailures = UploadFailures.load( std::memory_order_relaxed );
+	Values.AuthRetries = AuthRetries.load( std::memory_order_relaxed );
+
+	SET_FLOAT_STAT( STAT_CapsaLinesCapturedPerSecond, Values.LinesCapturedPerSecond );
+	SET_FLOAT_STAT( STAT_CapsaLinesFilteredPerSecond, Values.LinesFilteredPerSecond );
+	SET_FLOAT_STAT( STAT_CapsaLinesDroppedPerSecond, Values.LinesDroppedPerSecond );
+	SET_MEMORY_STAT( STAT_CapsaBufferedBytes, Values.BufferedBytes );
+	SET_FLOAT_STAT( STAT_CapsaFormatMilliseconds, Values.FormatMillisecondsPerChunk );
+	SET_FLOAT_STAT( STAT_CapsaCompressMilliseconds, Values.CompressMillisecondsPerChunk );
+	SET_FLOAT_STAT( STAT_CapsaCompressionRatio, Values.CompressionRatio );
+	SET_DWORD_STAT( STAT_CapsaUploadQueueDepth, Values.UploadQueueDepth );
+	SET_FLOAT_STAT( STAT_CapsaUploadLatencyP50, Values.UploadLatencyP50Milliseconds );
+	SET_FLOAT_STAT( STAT_CapsaUploadLatencyP95, Values.UploadLatencyP95Milliseconds );
+	SET_FLOAT_STAT( STAT_CapsaUploadLatencyP99, Values.UploadLatencyP99Milliseconds );
+	SET_DWORD_STAT( STAT_CapsaUploadFailures, Values.UploadFailures );
+	SET_DWORD_STAT( STAT_CapsaAuthRetries, Values.AuthRetries );
+	SET_FLOAT_STAT( STAT_CapsaDeliveryLatencyP50, Values.DeliveryLatencyP50Milliseconds );
+	SET_FLOAT_STAT( STAT_CapsaDeliveryLatencyP95, Values.DeliveryLatencyP95Milliseconds );
+	SET_FLOAT_STAT( STAT_CapsaDeliveryLatencyP99, Values.DeliveryLatencyP99Milliseconds );
+
+	CSV_CUSTOM_STAT( Capsa, LinesCapturedPerSecond, static_cast<float>( Values.LinesCapturedPerSecond ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, LinesFilteredPerSecond, static_cast<float>( Values.LinesFilteredPerSecond ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, LinesDroppedPerSecond, static_cast<float>( Values.LinesDroppedPerSecond ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, BufferedKiB, static_cast<float>( Values.BufferedBytes / 1024.0 ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, FormatMsPerChunk, static_cast<float>( Values.FormatMillisecondsPerChunk ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, CompressMsPerChunk, static_cast<float>( Values.CompressMillisecondsPerChunk ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, CompressionRatio, static_cast<float>( Values.CompressionRatio ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, UploadQueueDepth, Values.UploadQueueDepth, ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, UploadLatencyP50Ms, static_cast<float>( Values.UploadLatencyP50Milliseconds ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, UploadLatencyP95Ms, static_cast<float>( Values.UploadLatencyP95Milliseconds ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, UploadLatencyP99Ms, static_cast<float>( Values.UploadLatencyP99Milliseconds ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, UploadFailures, static_cast<int32>( Values.UploadFailures ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, AuthRetries, static_cast<int32>( Values.AuthRetries ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, DeliveryLatencyP50Ms, static_cast<float>( Values.DeliveryLatencyP50Milliseconds ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, DeliveryLatencyP95Ms, static_cast<float>( Values.DeliveryLatencyP95Milliseconds ), ECsvCustomStatOp::Set );
+	CSV_CUSTOM_STAT( Capsa, DeliveryLatencyP99Ms, static_cast<float>( Values.DeliveryLatencyP99Milliseconds ), ECsvCustomStatOp::Set );
+}
@@ -0,0 +1,85 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Telemetry/CapsaTrace.h"
+
+#include "Misc/StringBuilder.h"
+#include "ProfilingDebugging/MiscTrace.h"
+
+
+#if CAPSA_TRACE_ENABLED
+
+UE_TRACE_CHANNEL_DEFINE( CapsaChannel );
+
+UE_TRACE_EVENT_BEGIN( Capsa, ChunkEvent )
+	UE_TRACE_EVENT_FIELD( uint64, Cycle )
+	UE_TRACE_EVENT_FIELD( uint64, ChunkID )
+	UE_TRACE_EVENT_FIELD( int32, SubChunkIndex )
+	UE_TRACE_EVENT_FIELD( uint8, Event )
+	UE_TRACE_EVENT_FIELD( int32, NumLines )
+	UE_TRACE_EVENT_FIELD( int64, Bytes )
+UE_TRACE_EVENT_END()
+
+/**
+* Regions are matched by name, build it on the stack instead of formatting an FString for every chunk.
+*/
+static void MakeChunkRegionName( uint64 ChunkID, TStringBuilder<64>& OutName )
+{
+	OutName << TEXT( "Capsa Chunk " ) << ChunkID;
+}
+
+#endif
+
+
+void FCapsaTrace::ChunkEvent( ECapsaTraceChunkEvent Event, uint64 ChunkID, int32 SubChunkIndex, int32 NumLines, int64 Bytes )
+{
+#if CAPSA_TRACE_ENABLED
+	UE_TRACE_LOG( Capsa, ChunkEvent, CapsaChannel )
+		<< ChunkEvent.Cycle( FPlatformTime::Cycles64() )
+		<< ChunkEvent.ChunkID( ChunkID )
+		<< ChunkEvent.SubChunkIndex( SubChunkIndex )
+		<< ChunkEvent.Event( static_cast<uint8>( Event ) )
+		<< ChunkEvent.NumLines( NumLines )
+		<< ChunkEvent.Bytes( Bytes );
+#endif
+}
+
+bool FCapsaTrace::BeginChunk( uint64 ChunkID, int32 NumLines )
+{
+#if CAPSA_TRACE_ENABLED
+	if( IsEnabled() == false )
+	{
+		return false;
+	}
+
+	TStringBuilder<64> RegionName;
+	MakeChunkRegionName( ChunkID, RegionName );
+	TRACE_BEGIN_REGION( *RegionName );
+	ChunkEvent( ECapsaTraceChunkEvent::Captured, ChunkID, INDEX_NONE, NumLines, 0 );
+	return true;
+#else
+	return false;
+#endif
+}
+
+void FCapsaTrace::EndChunk( uint64 ChunkID, bool bBegun )
+{
+#if CAPSA_TRACE_ENABLED
+	if( bBegun == false )
+	{
+		return;
+	}
+
+	TStringBuilder<64> RegionName;
+	MakeChunkRegionName( ChunkID, RegionName );
+	TRACE_END_REGION( *RegionName );
+#endif
+}
+
+bool FCapsaTrace::IsEnabled()
+{
+#if CAPSA_TRACE_ENABLED
+	return UE_TRACE_CHANNELEXPR_IS_ENABLED( CapsaChannel );
+#else
+	return false;
+#endif
+}
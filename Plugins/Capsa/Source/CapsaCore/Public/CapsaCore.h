@@ -6,6 +6,8 @@
 #include "Modules/ModuleManager.h"
 
 DECLARE_LOG_CATEGORY_EXTERN( LogCapsaCore, Log, All );
+/** Frame budget throttle changes. Never throttled or suppressed by Capsa, so every change reaches the uploaded log. */
+DECLARE_LOG_CATEGORY_EXTERN( LogCapsaThrottle, Log, All );
 
 class FCapsaCoreModule : public IModuleInterface
 {
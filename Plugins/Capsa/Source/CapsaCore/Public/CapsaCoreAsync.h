@@ -3,99 +3,298 @@
 #pragma once
 
 #include "CapsaCore.h"
+#include "Encoding/CapsaColumnarEncoder.h"
+#include "Encoding/CapsaTemplateMiner.h"
 #include "FunctionLibrary/CapsaCoreFunctionLibrary.h"
+#include "Logging/CapsaDeferredLog.h"
+#include "Settings/CapsaSettings.h"
 
 
-typedef TFunction<void( const FString& )> FAsyncStringFromBufferCallback;
-typedef TFunction<void( const TArray<uint8>& )> FAsyncBinaryFromBufferCallback;
+/**
+* Describes how a FCapsaChunkBuilder should encode the Log chunk it builds.
+*/
+struct FCapsaChunkFormatOptions
+{
+    /**
+    * The encoding of the chunk.
+    */
+    ECapsaChunkFormat                               Format = ECapsaChunkFormat::PlainText;
+
+    /**
+    * The session-scoped Template Miner, required for ECapsaChunkFormat::Template.
+    */
+    TSharedPtr<FCapsaTemplateMiner, ESPMode::ThreadSafe> TemplateMiner;
+
+    /**
+    * The session-scoped Columnar Encoder, required for ECapsaChunkFormat::Columnar.
+    */
+    TSharedPtr<FCapsaColumnarEncoder, ESPMode::ThreadSafe> ColumnarEncoder;
+};
 
 
 /**
-* Base Capsa Async Task.
-* Stores the Buffer and Callback function. Also contains base helper methods like
-* those to construct a single Log String from the Buffer.
+* Builds a single Log chunk from a Buffer of lines.
+* Stores the Buffer and contains the helper methods used by the stages of FCapsaLogPipeline, like
+* those to construct a single Log String from the Buffer, compress it and write it to disk.
 */
-template <typename CallbackType>
-class FCapsaAsyncTask : public FNonAbandonableTask
+class FCapsaChunkBuilder
 {
 public:
-    friend class FAutoDeleteAsyncTask<FCapsaAsyncTask>;
 
-    FCapsaAsyncTask( TArray<FBufferedLine> InBuffer, CallbackType InCallbackFunction )
+    FCapsaChunkBuilder( TArray<FBufferedLine> InBuffer, FCapsaChunkFormatOptions InFormatOptions = FCapsaChunkFormatOptions(), FCapsaDeferredLogBuffer InDeferredLines = FCapsaDeferredLogBuffer() )
         : Buffer( MoveTemp( InBuffer ) )
-        , CallbackFunction( InCallbackFunction )
+        , FormatOptions( MoveTemp( InFormatOptions ) )
+        , DeferredLines( MoveTemp( InDeferredLines ) )
         , LogExtension( TEXT( ".capsa.log" ) )
         , CompressedExtension( TEXT( ".capsa.log.zlib" ) )
     {
     }
 
+    /**
+    * Returns the encoding of the chunk.
+    *
+    * @return ECapsaChunkFormat The chunk format.
+    */
+    ECapsaChunkFormat               GetFormat() const
+    {
+        return FormatOptions.Format;
+    }
+
+    /**
+    * Whether building the chunk updates a session-scoped dictionary (templates, categories).
+    * Such chunks have to be built in the order they are uploaded in, so dictionary entries are
+    * sent before they are used.
+    *
+    * @return bool True if the chunk has to be built in upload order.
+    */
+    bool                            UsesSessionDictionary() const
+    {
+        return ( FormatOptions.Format == ECapsaChunkFormat::Template && FormatOptions.TemplateMiner.IsValid() == true )
+            || ( FormatOptions.Format == ECapsaChunkFormat::Columnar && FormatOptions.ColumnarEncoder.IsValid() == true );
+    }
+
+    /**
+    * Returns the number of lines in the chunk, including lines that still need formatting.
+    *
+    * @return int32 The number of lines.
+    */
+    int32                           GetNumLines() const
+    {
+        return Buffer.Num() + DeferredLines.Num();
+    }
+
+    /**
+    * Returns the time of the first line in the chunk, the line that waited longest to be uploaded.
+    *
+    * @return double The time in unix seconds, 0 if the chunk has no lines.
+    */
+    double                          GetFirstLineTime() const
+    {
+        const double DeferredTime = DeferredLines.GetFirstLineTime();
+        if( Buffer.IsEmpty() == true )
+        {
+            return DeferredTime;
+        }
+
+        return DeferredTime > 0.0 ? FMath::Min( Buffer[0].Time, DeferredTime ) : Buffer[0].Time;
+    }
+
+    /**
+    * Frees the lines once the chunk no longer needs them.
+    */
+    void                            ReleaseBuffer()
+    {
+        Buffer.Empty();
+        DeferredLines.Reset();
+    }
+
+    /**
+    * Formats the lines captured with deferred formatting (CAPSA_LOG, UE_LOGFMT) and merges them
+    * into the Buffer in time order. Call before building the Log.
+    */
+    void                            FormatDeferredLines()
+    {
+        DeferredLines.FormatInto( Buffer );
+        DeferredLines.Reset();
+    }
+
     /**
     * Builds a Log string from the Buffer, with the format:
     * [Timestamp][LogVerbosity][LogCategory]: LogData\n
     * 
+    * @param FirstLine The index of the first line to include.
+    * @param NumLines The maximum number of lines to include.
     * @return FString The generated Log from the Buffer.
     */
-    FString                         MakeLogString()
+    FString                         MakeLogString( int32 FirstLine = 0, int32 NumLines = MAX_int32 )
+    {
+        FString Log;
+        BuildLogString( Log, FirstLine, NumLines );
+        return Log;
+    }
+
+    /**
+    * Builds a Log string from the Buffer into Log, see MakeLogString().
+    * Log is cleared first, but keeps its allocation.
+    *
+    * @param Log The FString to write to.
+    * @param FirstLine The index of the first line to include.
+    * @param NumLines The maximum number of lines to include.
+    */
+    void                            BuildLogString( FString& Log, int32 FirstLine = 0, int32 NumLines = MAX_int32 )
     {
         TRACE_CPUPROFILER_EVENT_SCOPE(MakeLogString);
         
-        FString Log;
-        for( const FBufferedLine& Line : Buffer )
+        Log.Reset();
+        for( const FBufferedLine& Line : GetLines( FirstLine, NumLines ) )
         {
-            // Construct the Time from the Seconds when the Line was added
-            FDateTime Time = FDateTime::FromUnixTimestampDecimal( Line.Time );
-            FWideStringBuilderBase TimeStamp;
-            // format: yyyy.mm.dd-hh.mm.ss:mil
-            Log.Append( FString::Printf( TEXT( "[%s]" ), *Time.ToString( TEXT( "%Y.%m.%d-%H.%M.%S.%s" ) ) ) );
-            Log.Append( FString::Printf( TEXT( "[%s]" ), *UCapsaCoreFunctionLibrary::GetLogVerbosityString( Line.Verbosity ) ) );
-            Log.Append( FString::Printf( TEXT( "[%s]: " ), *Line.Category.Resolve().ToString() ) );
+            UCapsaCoreFunctionLibrary::AppendLogLinePrefix( Log, Line.Time, Line.Verbosity, Line.Category.Resolve() );
             Log.Append( Line.Data.Get() );
             Log.Append( LINE_TERMINATOR_ANSI ); // Use lf ending on all platforms
         }
+    }
+
+    /**
+    * Builds a template encoded Log string from the Buffer into Log, see FCapsaTemplateMiner.
+    * Dictionary entries for every template the chunk uses come before the lines, so the chunk can be decoded on its own.
+    * Log and Scratch are cleared first, but keep their allocation.
+    *
+    * @param Log The FString to write to.
+    * @param Scratch Holds the encoded lines while the dictionary entries are collected.
+    * @param FirstLine The index of the first line to include.
+    * @param NumLines The maximum number of lines to include.
+    */
+    void                            BuildTemplateLogString( FString& Log, FString& Scratch, int32 FirstLine = 0, int32 NumLines = MAX_int32 )
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MakeTemplateLogString);
+
+        check( FormatOptions.TemplateMiner.IsValid() );
+        FCapsaTemplateMiner& TemplateMiner = *FormatOptions.TemplateMiner;
+
+        Log.Reset();
+        Scratch.Reset();
+        {
+            // Hold the lock for the whole chunk, so the dictionary entries of other chunks do not end up in this one
+            FScopeLock ScopeLock( &TemplateMiner.GetCriticalSection() );
+            for( const FBufferedLine& Line : GetLines( FirstLine, NumLines ) )
+            {
+                UCapsaCoreFunctionLibrary::AppendLogLinePrefix( Scratch, Line.Time, Line.Verbosity, Line.Category.Resolve() );
+                TemplateMiner.EncodeLine( Line.Data.Get(), Scratch );
+                Scratch.Append( LINE_TERMINATOR_ANSI );
+            }
+            TemplateMiner.ConsumeChunkTemplates( Log );
+        }
+        Log.Append( Scratch );
+    }
 
+    /**
+    * Builds the Log string from the Buffer in the chunk format set in FormatOptions.
+    * Binary chunk formats can not be stored in a string, they fall back to plain text.
+    *
+    * @param FirstLine The index of the first line to include.
+    * @param NumLines The maximum number of lines to include.
+    * @return FString The encoded Log from the Buffer.
+    */
+    FString                         MakeChunkString( int32 FirstLine = 0, int32 NumLines = MAX_int32 )
+    {
+        FString Log;
+        FString Scratch;
+        BuildChunkString( Log, Scratch, FirstLine, NumLines );
         return Log;
     }
 
     /**
-    * Uses MakeLogString() to generate the Log.
-    * Then compresses said log using GZip, ZLib or Oodle compression.
+    * Builds the Log string from the Buffer into Log, see MakeChunkString().
+    * Log and Scratch are cleared first, but keep their allocation.
+    *
+    * @param Log The FString to write to.
+    * @param Scratch Working memory for chunk formats that need it.
+    * @param FirstLine The index of the first line to include.
+    * @param NumLines The maximum number of lines to include.
+    */
+    void                            BuildChunkString( FString& Log, FString& Scratch, int32 FirstLine = 0, int32 NumLines = MAX_int32 )
+    {
+        if( FormatOptions.Format == ECapsaChunkFormat::Template && FormatOptions.TemplateMiner.IsValid() == true )
+        {
+            BuildTemplateLogString( Log, Scratch, FirstLine, NumLines );
+            return;
+        }
+
+        BuildLogString( Log, FirstLine, NumLines );
+    }
+
+    /**
+    * Whether the chunk format set in FormatOptions is binary, and can not be built with MakeChunkString().
+    *
+    * @return bool True for binary chunk formats.
+    */
+    bool                            IsBinaryChunkFormat() const
+    {
+        return FormatOptions.Format == ECapsaChunkFormat::Columnar && FormatOptions.ColumnarEncoder.IsValid() == true;
+    }
+
+    /**
+    * Builds the chunk from the Buffer in the chunk format set in FormatOptions, as the bytes to upload
+    * before compression. Text formats are converted to UTF-8.
+    *
+    * @param Chunk The Binary Array to write to.
+    * @param FirstLine The index of the first line to include.
+    * @param NumLines The maximum number of lines to include.
+    */
+    void                            MakeChunkBinary( TArray<uint8>& Chunk, int32 FirstLine = 0, int32 NumLines = MAX_int32 )
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(MakeChunkBinary);
+
+        if( IsBinaryChunkFormat() == true )
+        {
+            FormatOptions.ColumnarEncoder->EncodeChunk( GetLines( FirstLine, NumLines ), Chunk );
+            return;
+        }
+
+        ConvertToUtf8( MakeChunkString( FirstLine, NumLines ), Chunk );
+    }
+
+    /**
+    * Converts the Log to UTF-8.
     *
-    * @param UncompressedLog The reference to the Uncompressed Log FString to write to.
-    * @param BinaryData The reference to the Binary Array to write to.
+    * @param Log The Log FString to convert.
+    * @param Utf8Bytes The Binary Array to write to.
+    */
+    static void                     ConvertToUtf8( const FString& Log, TArray<uint8>& Utf8Bytes )
+    {
+        const int32 Utf8Length = FPlatformString::ConvertedLength<UTF8CHAR>( *Log, Log.Len() );
+        Utf8Bytes.SetNumUninitialized( Utf8Length );
+        FPlatformString::Convert( (UTF8CHAR*)Utf8Bytes.GetData(), Utf8Bytes.Num(), *Log, Log.Len() );
+    }
+
+    /**
+    * Compresses the chunk using ZLib compression.
+    *
+    * @param Chunk The bytes to compress.
+    * @param BinaryData The reference to the Binary Array to write to, sized to the compressed data.
     * @return bool True if compression was successful.
     */
-    bool                            MakeCompressedLogBinary( FString& UncompressedLog, TArray<uint8>& BinaryData )
+    static bool                     CompressBytes( const TArray<uint8>& Chunk, TArray<uint8>& BinaryData )
     {
-        TRACE_CPUPROFILER_EVENT_SCOPE(MakeCompressedLogBinary);
+        TRACE_CPUPROFILER_EVENT_SCOPE(CompressBytes);
 
-        UE_LOG( LogCapsaCore, VeryVerbose, TEXT("FCapsaAsyncTask::MakeCompressedLogBinary | Start compression") )
-        
-        // Get log string, uncompressed
-        UncompressedLog = MakeLogString();
-        UE_LOG( LogCapsaCore, VeryVerbose, TEXT("FCapsaAsyncTask::MakeCompressedLogBinary | Uncompressed log length: %d"), UncompressedLog.Len() );
-        
-        // Convert log string to uint8*
-        TArray<uint8> UncompressedLogBytes;
-        uint64 Utf8Length = FPlatformString::ConvertedLength<UTF8CHAR>(*UncompressedLog, UncompressedLog.Len());
-        UncompressedLogBytes.SetNumUninitialized(Utf8Length);
-        FPlatformString::Convert((UTF8CHAR*)UncompressedLogBytes.GetData(), UncompressedLogBytes.Num(), *UncompressedLog, UncompressedLog.Len());
-        
-        
-        // Reserve memory for compressed data, setting 4/3 in case compressed turns out longer
-        BinaryData.SetNumUninitialized( UncompressedLog.Len() * 4/3 );
+        // Reserve memory for compressed data, using the worst case size
+        BinaryData.SetNumUninitialized( FCompression::CompressMemoryBound( NAME_Zlib, Chunk.Num() ) );
         int32 CompressedSize = BinaryData.Num();
-        UE_LOG( LogCapsaCore, VeryVerbose, TEXT("FCapsaAsyncTask::FCapsaAsyncTask | Utf8Length: %llu"), Utf8Length )
         
         // Compress data 
         const bool bSuccess = FCompression::CompressMemory(
             NAME_Zlib,
             BinaryData.GetData(),
             CompressedSize,
-            UncompressedLogBytes.GetData(),
-            UncompressedLogBytes.Num()
+            Chunk.GetData(),
+            Chunk.Num()
         );
+
+        // Only keep the compressed bytes, the rest of the reserved memory is garbage
+        BinaryData.SetNum( bSuccess == true ? CompressedSize : 0, EAllowShrinking::No );
         
-        UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaAsyncTask::MakeCompressedLogBinary | Success: %d, compressed size: %d" ), bSuccess, CompressedSize );
+        UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaChunkBuilder::CompressBytes | Success: %d, compressed size: %d" ), bSuccess, CompressedSize );
 
         return bSuccess;
     }
@@ -115,7 +314,7 @@ public:
         
         FString FilePath = FPaths::ProjectLogDir() + FileName + LogExtension;
         
-        UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaAsyncTask::SaveStringToFile | Attempting to write/append to: %s" ), *FilePath );
+        UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaChunkBuilder::SaveStringToFile | Attempting to write/append to: %s" ), *FilePath );
         
         return FFileHelper::SaveStringToFile( LogToSave, *FilePath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), EFileWrite::FILEWRITE_Append );
     }
@@ -126,142 +325,56 @@ public:
     *
     * @param BinaryData The Source Binary Array to save to file.
     * @param FileName The name of the file to save.
+    * @param Suffix Appended to the timestamp in the file name, to tell apart chunks saved at the same time.
     *
     * @return bool True if successfully written to file, otherwise false.
     */
-    bool                            SaveBinaryToFile( TArray<uint8> BinaryData, const FString& FileName )
+    bool                            SaveBinaryToFile( const TArray<uint8>& BinaryData, const FString& FileName, const FString& Suffix = FString() )
     {
         TRACE_CPUPROFILER_EVENT_SCOPE(SaveBinaryToFile);
         
         FString CapsaCompressedDirectory = TEXT( "CapsaCompressedChunks/" ) + FileName + TEXT( "/" );
-        FString FilePath = FPaths::ProjectLogDir() + CapsaCompressedDirectory + FDateTime::Now().ToString(TEXT( "%Y-%m-%dT%H.%M.%S.%s" )) + CompressedExtension;
+        FString FilePath = FPaths::ProjectLogDir() + CapsaCompressedDirectory + FDateTime::Now().ToString(TEXT( "%Y-%m-%dT%H.%M.%S.%s" )) + Suffix + CompressedExtension;
 
-        UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaAsyncTask::SaveBinaryToFile | Attempting to write to: %s" ), *FilePath );
+        UE_LOG( LogCapsaCore, Verbose, TEXT( "FCapsaChunkBuilder::SaveBinaryToFile | Attempting to write to: %s" ), *FilePath );
         
         return FFileHelper::SaveArrayToFile( BinaryData, *FilePath, &IFileManager::Get(), EFileWrite::FILEWRITE_Append );
     }
     
-    void                            DoWork()
-    {
-        // Default does nothing.
-    }
-
-    FORCEINLINE TStatId             GetStatId() const
-    {
-        RETURN_QUICK_DECLARE_CYCLE_STAT( FCapsaAsyncTask, STATGROUP_ThreadPoolAsyncTasks );
-    }
-
-protected:
-
-    TArray<FBufferedLine>           Buffer;
-    CallbackType                    CallbackFunction;
-    const FString                   LogExtension;
-    const FString                   CompressedExtension;
-};
-
-/**
-* Async task to create a FString that we can send over HTTP
-* from a FBufferredLine TArray.
-* And then save this Raw String to File.
-*/
-class FSaveStringFromBufferTask : public FCapsaAsyncTask<FAsyncStringFromBufferCallback>
-{
-public:
-    friend class FAutoDeleteAsyncTask<FSaveStringFromBufferTask>;
-
-    FSaveStringFromBufferTask( FString InLogID, bool bInWriteToDisk, TArray<FBufferedLine> InBuffer, FAsyncStringFromBufferCallback InCallbackFunction )
-        : FCapsaAsyncTask<FAsyncStringFromBufferCallback>( MoveTemp( InBuffer ), InCallbackFunction )
-        , LogID( InLogID )
-        , bWriteToDiskPlain( bInWriteToDisk )
-    {
-    }
-
-    void                            DoWork()
+    /**
+    * Saves the Log to file as plain text. Reuses the encoded Log if the chunk format
+    * is plain text already, otherwise builds the plain text Log first.
+    *
+    * @param EncodedLog The Log as encoded for upload.
+    * @param FileName The name of the file to save.
+    * @param FirstLine The index of the first line in EncodedLog.
+    * @param NumLines The maximum number of lines in EncodedLog.
+    *
+    * @return bool True if successfully written to file, otherwise false.
+    */
+    bool                            SavePlainLogToFile( const FString& EncodedLog, const FString& FileName, int32 FirstLine = 0, int32 NumLines = MAX_int32 )
     {
-        FString Log = MakeLogString();
-        if( bWriteToDiskPlain == true )
+        if( FormatOptions.Format == ECapsaChunkFormat::PlainText )
         {
-            if( SaveStringToFile( Log, LogID ) == false )
-            {
-                UE_LOG( LogCapsaCore, Warning, TEXT( "Failed to write plain text file to disk" ) )
-            }
+            return SaveStringToFile( EncodedLog, FileName );
         }
-        CallbackFunction( Log );
-    }
 
-    FORCEINLINE TStatId             GetStatId() const
-    {
-        RETURN_QUICK_DECLARE_CYCLE_STAT( FSaveStringFromBufferTask, STATGROUP_ThreadPoolAsyncTasks );
+        return SaveStringToFile( MakeLogString( FirstLine, NumLines ), FileName );
     }
 
 protected:
 
-    FString                         LogID;
-    bool                            bWriteToDiskPlain;
-};
-
-/**
-* Async task to create a Binary Array that we can send over HTTP
-* from a FBufferredLine TArray.
-* And then save this compressed Binary Array to File.
-*/
-class FSaveCompressedStringFromBufferTask : public FCapsaAsyncTask<FAsyncBinaryFromBufferCallback>
-{
-public:
-    friend class FAutoDeleteAsyncTask<FSaveCompressedStringFromBufferTask>;
-
-    FSaveCompressedStringFromBufferTask( FString InLogID, bool bInWriteToDiskPlain, bool bInWriteToDiskCompressed, TArray<FBufferedLine> InBuffer, FAsyncBinaryFromBufferCallback InCallbackFunction )
-        : FCapsaAsyncTask( MoveTemp( InBuffer ), InCallbackFunction )
-        , LogID( InLogID )
-        , bWriteToDiskPlain( bInWriteToDiskPlain )
-        , bWriteToDiskCompressed( bInWriteToDiskCompressed )
-    {
-    }
-
-    void                            DoWork()
-    {
-        FString Log;
-        TArray<uint8> CompressedLog;
-
-        // Compress data
-        if( MakeCompressedLogBinary( Log, CompressedLog ) == false)
-        {
-            UE_LOG( LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to compress log binary" ) )
-        } else
-        {
-            UE_LOG( LogCapsaCore, VeryVerbose, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Compressed log binary, length: %hhu" ), *CompressedLog.GetData() )
-            
-            // Save compressed file to disk
-            if( bWriteToDiskCompressed == true )
-            {
-                if( SaveBinaryToFile( CompressedLog, LogID ) == false )
-                {
-                    UE_LOG( LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to write compressed file to disk" ) )
-                }
-            }
-        }
-
-        // Save plain text to disk
-        if( bWriteToDiskPlain == true )
-        {
-            if( SaveStringToFile( Log, LogID ) == false )
-            {
-                UE_LOG( LogCapsaCore, Warning, TEXT( "FSaveCompressedStringFromBufferTask::DoWork | Failed to write plain text file to disk" ) )
-            } 
-        }
-        
-        CallbackFunction( CompressedLog );
-    }
-
-    FORCEINLINE TStatId             GetStatId() const
+    /**
+    * Returns the lines in the given range of the Buffer, clamped to the Buffer.
+    */
+    TConstArrayView<FBufferedLine>  GetLines( int32 FirstLine, int32 NumLines ) const
     {
-        RETURN_QUICK_DECLARE_CYCLE_STAT( FSaveCompressedStringFromBufferTask, STATGROUP_ThreadPoolAsyncTasks );
+        return TConstArrayView<FBufferedLine>( Buffer ).Mid( FirstLine, NumLines );
     }
 
-protected:
-
-    FString                         LogID;
-    bool                            bWriteToDiskPlain;
-    bool                            bWriteToDiskCompressed;
+    TArray<FBufferedLine>           Buffer;
+    FCapsaChunkFormatOptions        FormatOptions;
+    FCapsaDeferredLogBuffer         DeferredLines;
+    const FString                   LogExtension;
+    const FString                   CompressedExtension;
 };
-
@@ -2,15 +2,46 @@
 
 #pragma once
 
+#include "Settings/CapsaLogPolicy.h"
+
 #include "CapsaCoreJson.generated.h"
 
-class UCapsaCoreJsonHelpers
+struct FCapsaAuthenticationRequest;
+struct FCapsaAuthenticationResponse;
+
+class CAPSACORE_API UCapsaCoreJsonHelpers
 {
 	public:
 
 	static TSharedPtr<FJsonObject>	TMapToJsonObject( const TMap<FString, FString>& Map );
 
-	static TSharedPtr<FJsonObject>	TMapToJsonObject( const TMap<FString, TSharedPtr<FJsonValue>>& Map );
+	/**
+	* Writes the authentication request as UTF-8 JSON, with the keys FJsonObjectConverter uses,
+	* without going through reflection or an FJsonObject.
+	*
+	* @param Request The request to write.
+	* @param OutJson Receives the JSON, replacing its contents.
+	*/
+	static void						WriteAuthenticationRequest( const FCapsaAuthenticationRequest& Request, TArray<uint8>& OutJson );
+
+	/**
+	* Reads an authentication response from the UTF-8 response body. Keys are matched case insensitively,
+	* like FJsonObjectConverter does, unknown keys are skipped.
+	*
+	* @param Json The response body.
+	* @param OutResponse Receives the response.
+	* @return bool True if the body is a JSON object with a token and a log ID.
+	*/
+	static bool						ReadAuthenticationResponse( TConstArrayView<uint8> Json, FCapsaAuthenticationResponse& OutResponse );
+
+	/**
+	* Reads the log policy from the "policy" member of a UTF-8 response body, such as the metadata response.
+	*
+	* @param Json The response body, can be empty.
+	* @param OutPolicy Receives the policy, unset if the body does not contain one.
+	* @return bool False if the body is not a JSON object or the policy is invalid.
+	*/
+	static bool						ReadLogPolicy( TConstArrayView<uint8> Json, TOptional<FCapsaLogPolicy>& OutPolicy );
 };
 
 USTRUCT()
@@ -63,4 +94,9 @@ public:
 	
 	UPROPERTY()
 	FString							Expiry;
+
+	/**
+	* The log policy, if the Capsa Server sent one.
+	*/
+	TOptional<FCapsaLogPolicy>		Policy;
 };
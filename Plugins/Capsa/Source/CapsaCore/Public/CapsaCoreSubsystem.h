@@ -3,15 +3,21 @@
 #pragma once
 
 #include "Components/CapsaActorComponent.h"
+#include "Logging/CapsaDeferredLog.h"
+#include "Logging/CapsaLogSession.h"
+#include "Metadata/CapsaMetadataStore.h"
+#include "Settings/CapsaLogPolicy.h"
 
 #include "CoreMinimal.h"
+#include "Containers/Ticker.h"
 #include "Subsystems/EngineSubsystem.h"
-#include "HttpModule.h"
+#include "UObject/ObjectKey.h"
 
 #include "CapsaCoreSubsystem.generated.h"
 
 // Forward Declarations
 class UCapsaActorComponent;
+class UWorld;
 
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams( FCapsaCoreDataChangedDynamicDelegate, const FString&, CapsaLogId, const FString&, CapsaLogURL );
@@ -38,7 +44,7 @@ public:
 	* Request a Capsa Auth Token.
 	* Builds the response based off details in CapsaSettings. Check and set these in the Editor
 	* or Engine.ini.
-	* Will call ClientAuthResponse.
+	* Will call OnAuthChanged once the log session of the process is authenticated.
 	*/
 	void									RequestClientAuth();
 
@@ -63,16 +69,70 @@ public:
 	FCapsaCoreOnAuthChangedDelegate			OnAuthChanged;
 	
 	/**
-	 * @deprecated This will be removed and replaced with a generic K2 node to add arbitrary metadata. This function should not be used in Blueprints.
+	 * @deprecated Use SetMetadataString instead.
 	 *
 	 * Register a FString Value for the given Key in the metadata.
 	 * 
 	 * @param Key Metadata Key
 	 * @param Value Metadata value 
 	 */
-	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaCoreSubsystem|Metadata" )
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaCoreSubsystem|Metadata", meta = ( DeprecatedFunction, DeprecationMessage = "Use SetMetadataString instead." ) )
 	void									RegisterMetadataString(const FString& Key, const FString& Value);
 
+	/**
+	* Sets a string in the metadata of the log. Only keys that changed are sent to the Capsa Server.
+	*
+	* @param Key Metadata Key
+	* @param Value Metadata value
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaCoreSubsystem|Metadata" )
+	void									SetMetadataString( const FString& Key, const FString& Value );
+
+	/**
+	* Sets an integer in the metadata of the log.
+	*
+	* @param Key Metadata Key
+	* @param Value Metadata value
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaCoreSubsystem|Metadata" )
+	void									SetMetadataInteger( const FString& Key, int64 Value );
+
+	/**
+	* Sets a number in the metadata of the log.
+	*
+	* @param Key Metadata Key
+	* @param Value Metadata value
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaCoreSubsystem|Metadata" )
+	void									SetMetadataFloat( const FString& Key, double Value );
+
+	/**
+	* Sets a bool in the metadata of the log.
+	*
+	* @param Key Metadata Key
+	* @param Value Metadata value
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaCoreSubsystem|Metadata" )
+	void									SetMetadataBool( const FString& Key, bool Value );
+
+	/**
+	* Sets an array of strings in the metadata of the log.
+	*
+	* @param Key Metadata Key
+	* @param Values Metadata values
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaCoreSubsystem|Metadata" )
+	void									SetMetadataStringArray( const FString& Key, const TArray<FString>& Values );
+
+	/**
+	* Sets any metadata value, including arrays and serialized JSON objects.
+	* Setting a key to the value it already has does not send it again.
+	*
+	* @param Key Metadata Key
+	* @param Value Metadata value
+	*/
+	void									SetMetadata( const FString& Key, FCapsaMetadataValue&& Value );
+
 	/**
 	 * Access the FCapsaSharedData as replicated on the CapsaActorComponent.
 	 * 
@@ -80,6 +140,21 @@ public:
 	 */
 	UFUNCTION( BlueprintPure, Category = "Capsa|Log|CapsaCoreSubsystem|SessionData" )
 	FCapsaSharedData						GetServerCapsaData() const;
+
+	/**
+	 * Returns the CapsaActorComponent GetServerCapsaData() reads from.
+	 * 
+	 * @return UCapsaActorComponent The component, or null if there is none.
+	 */
+	UCapsaActorComponent*					GetCapsaActorComponent() const;
+
+	/**
+	 * Sets the CapsaActorComponent GetServerCapsaData() reads from. Called by UCapsaWorldSubsystem when it
+	 * adds the first component to a World, and when the player owning the current one leaves.
+	 * 
+	 * @param Component The component, or null to clear it.
+	 */
+	void									SetCapsaActorComponent( UCapsaActorComponent* Component );
 	
 #pragma region GETTERS
 	/**
@@ -104,21 +179,39 @@ public:
 	*/
 	UFUNCTION( BlueprintPure, Category = "Capsa|Log|CapsaCoreSubsystem|SessionData" )
 	FString									GetLogURL() const;
+
+	/**
+	* Returns the log policy last received from the Capsa Server.
+	* 
+	* @return FCapsaLogPolicy The applied policy, empty if none was received.
+	*/
+	const FCapsaLogPolicy&					GetLogPolicy() const;
 #pragma endregion GETTERS
 
 #pragma region APICALLSPUBLIC
 	/**
 	* Attempts to send the provided Log Buffer to the Capsa Server.
 	* 
-	* This is performed asynchronously, converted the TArray of BufferedLine's into a single
-	* FString Log. If successful, calls RequestSendLog().
+	* The Buffer is submitted as a single chunk to the Log Pipeline, which formats, compresses and
+	* writes it to disk in the background and then calls RequestSendLog() or RequestSendCompressedLog().
+	* Check CanSendLog() first, the chunk is dropped if the pipeline is full.
 	* 
 	* @param LogBuffer The Log buffer to parse and send.
+	* @param DeferredLines Lines captured with deferred formatting, formatted and merged into the Log in the background.
+	*/
+	void									SendLog( TArray<FBufferedLine>& LogBuffer, FCapsaDeferredLogBuffer&& DeferredLines = FCapsaDeferredLogBuffer() );
+
+	/**
+	* Whether the Log Pipeline has room for another chunk. If not, keep buffering lines and try again later.
+	* 
+	* @return bool True if SendLog() would accept a chunk.
 	*/
-	void									SendLog( TArray<FBufferedLine>& LogBuffer );
+	bool									CanSendLog() const;
 	
 	/**
 	* Attempts to Register the provided Log ID as a Linked Log ID.
+	* New links are collected for LinkedLogBatchSeconds and sent together, a log that was already linked
+	* in this log session, for example by a player that reconnects, is not sent again.
 	* 
 	* @param FString The LinkedLogID to try and register.
 	* @param FString The Linked log's description, fe. whether it's a server or client
@@ -128,6 +221,7 @@ public:
 
 	/**
 	* Attempts to Register the provided JsonValue to the given Key which will be sent to the server for metadata storage. 
+	* The value is serialized once, prefer SetMetadata for values that change often.
 	* 
 	* @param FString Metadata key
 	* @param TSharedPtr<FJsonValue> Json value to be stored
@@ -135,6 +229,40 @@ public:
 	void									RegisterAdditionalMetadata( const FString& Key, const TSharedPtr<FJsonValue>& Description );
 #pragma endregion APICALLSPUBLIC
 
+#pragma region LOGSESSIONS
+	/**
+	* Creates a log session for a game World, used with bUseWorldLogSessions. The session authenticates on its own,
+	* and is linked with the log of the process both ways once it is. Called by UCapsaWorldSubsystem.
+	* 
+	* @param World The World the session logs for.
+	* @return uint32 The ID lines of the World are tagged with, see FCapsaLogSession::SetCurrentID().
+	*/
+	uint32									CreateWorldLogSession( const UWorld* World );
+
+	/**
+	* Shuts down the log session of a World, after uploading the lines submitted so far.
+	* 
+	* @param SessionID The ID returned by CreateWorldLogSession().
+	*/
+	void									RemoveWorldLogSession( uint32 SessionID );
+
+	/**
+	* Returns the log session lines tagged with SessionID are sent to.
+	* 
+	* @param SessionID The ID of a World log session, or 0.
+	* @return FCapsaLogSession The session, or the session of the process for 0 and removed sessions.
+	*/
+	FCapsaLogSession&						FindLogSession( uint32 SessionID ) const;
+
+	/**
+	* Returns the log session of the World of a context object.
+	* 
+	* @param WorldContext An object in the World, can be null.
+	* @return FCapsaLogSession The session of the World, or the session of the process if the World has none.
+	*/
+	FCapsaLogSession&						GetLogSession( const UObject* WorldContext ) const;
+#pragma endregion LOGSESSIONS
+
 #pragma region BROWSERMETHODS
 	/**
 	* Gets the URL for the Client Log and requests the Operating System launch a Browser
@@ -148,129 +276,78 @@ public:
 	*/
 	static void								OpenServerLogInBrowser();
 #pragma endregion BROWSERMETHODS
-	
-protected:
-
-#pragma region APICALLSPROTECTED
-	/**
-	 * Use the Token to generate the Authentication header value
-	 * 
-	 * @return FString header value for Authentication header
-	 */
-	FString 								GetAuthHeader() const
-	{
-		return TEXT( "Bearer " ) + Token ;
-	};
 
 	/**
-	* Generates Capsa supported Metadata and requests to send to the Capsa Server.
-	* Internally constructs the URL from the Config settings and uses the metadata stored on memory
+	* Writes the state and per-stage timing of the Log Pipeline of every log session to the log.
 	*/
-	void									RequestSendMetadata();
+	static void								LogPipelineStats();
 	
+protected:
+
+#pragma region APICALLSPROTECTED
 	/**
-	* Requests to Send a raw Log to the Capsa Server.
-	* Internally constructs the URL from the Config settings and uses the Auth token acquired from
-	* RequestClientAuth().
+	* Applies a log policy received from the Capsa Server, unless bApplyServerLogPolicy is disabled.
+	* Sets the verbosity of the Log Categories in the policy, passes the capture settings on to
+	* FCapsaSettingsSnapshot and updates the poll interval. Does nothing if the policy did not change.
 	* 
-	* @param Log The FString log to attempt to send.
+	* @param Policy The received policy.
 	*/
-	void									RequestSendLog( const FString& Log );
-#pragma endregion APICALLSPROTECTED
-	
-#pragma region APIRESPONSES
+	void									ApplyLogPolicy( const FCapsaLogPolicy& Policy );
+
 	/**
-	* Generic HTTP response processing function.
-	* If there is any JSON to gather, will get it out of the Response and return it.
+	* (Re)starts polling for the log policy.
 	* 
-	* @param RequestName The request name (such as calling function name) to prepend to Log Outputs.
-	* @param Request The FHttpRequestPtr that made the Request.
-	* @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
-	* @param bSuccess Whether the HTTP response was successful (true) or not (false).
-	* 
-	* @return TSharedPtr<FJsonObject> The JSON Object if any found. Can be null.
+	* @param Interval The poll interval (in seconds), 0 stops polling.
 	*/
-	virtual TSharedPtr<FJsonObject>			ProcessResponse( const FString& RequestName, FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess );
-	
+	void									SetLogPolicyPollInterval( float Interval );
+
 	/**
-	* Callback after a ClientAuth request. Will only update authentication data in case the instance isn't authenticated yet.
+	* Ticker callback that polls for the log policy with an empty metadata request.
 	* 
-	* @param Request The FHttpRequestPtr that made the Request.
-	* @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
-	* @param bSuccess Whether the HTTP response was successful (true) or not (false).
+	* @param DeltaTime The time since the last poll.
+	* @return bool Always true, to keep polling.
 	*/
-	virtual void							ClientAuthResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess );
+	bool									PollLogPolicy( float DeltaTime );
+#pragma endregion APICALLSPROTECTED
 
 	/**
-	* Requests to Send a Compressed Log to the Capsa Server.
-	* Internally constructs the URL from the Config settings and uses the Auth token acquired from
-	* RequestClientAuth().
-	*
-	* @param CompressedLog The TArray<uint8> binary log to attempt to send.
+	* Called when the log session of the process is authenticated. Broadcasts OnAuthChanged and OnAuthChangedDynamic.
+	* 
+	* @param CapsaLogId The LogID of the process.
+	* @param CapsaLogURL The LogURL of the process.
 	*/
-	void									RequestSendCompressedLog( const TArray<uint8>& CompressedLog );
+	void									OnSessionAuthChanged( const FString& CapsaLogId, const FString& CapsaLogURL );
 
 	/**
-	* Callback after a SendLog request.
-	*
-	* @param Request The FHttpRequestPtr that made the Request.
-	* @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
-	* @param bSuccess Whether the HTTP response was successful (true) or not (false).
-	*/
-	virtual void							LogResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess );
-	
-	/**
-	* Callback after a SendMetadata request.
-	* Empties the in-memory metadata in case of a success response.
-	*
-	* @param Request The FHttpRequestPtr that made the Request.
-	* @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
-	* @param bSuccess Whether the HTTP response was successful (true) or not (false).
+	* Called when the log session of a World is authenticated. Links it with the log of the process both ways.
+	* 
+	* @param SessionID The ID of the World log session.
 	*/
-	virtual void							MetadataResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess );
-#pragma endregion APIRESPONSES
+	void									OnWorldLogSessionAuthChanged( uint32 SessionID );
 	
-#pragma region UNREAL
+private:
+
+	static void								OpenBrowser( const FString& URL );
+
 	/**
-	* Called after the Map has loaded with the specified World.
-	* Perform any specific initialization on Actors that are required when there is a valid World. This is also
-	* called when a World changes, such as a new level or joining a server.
-	*
-	* @param World The UWorld associated with the Map that has loaded.
+	* The log session of the process, and the sessions of the Worlds with bUseWorldLogSessions.
 	*/
-	virtual void							OnPostWorldInit( UWorld* World, const UWorld::InitializationValues );
+	TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe> Session;
+	TMap<uint32, TSharedPtr<FCapsaLogSession, ESPMode::ThreadSafe>> WorldLogSessions;
+	TMap<TObjectKey<UWorld>, uint32>		WorldLogSessionIDs;
+	uint32									NextWorldLogSessionID;
 
 	/**
-	* Called after a Player has been successfully Logged in.
-	* Only bound in OnPostWorldInit and only if bAutoAddCapsaComponent is true.
-	* 
-	* @param GameMode The GameMode the player joined.
-	* @param Player The PlayerController for the player that has just joined.
+	* The threads the Log Pipelines of all log sessions run on, invalid when PipelineThreadCount is 0.
 	*/
-	virtual void							OnPlayerLoggedIn( AGameModeBase* GameMode, APlayerController* Player );
+	TSharedPtr<FQueuedThreadPool, ESPMode::ThreadSafe> PipelineThreadPool;
 
 	/**
-	* Called after a Player has been successfully Logged out.
-	* Only bound in OnPostWorldInit and only if bAutoAddCapsaComponent is true.
-	*
-	* @param GameMode The GameMode the player left.
-	* @param Player The Controller for the player that has just left.
+	* The log policy last applied by ApplyLogPolicy(), and how often it is polled.
 	*/
-	virtual void							OnPlayerLoggedOut( AGameModeBase* GameMode, AController* Controller );
-#pragma endregion UNREAL
-	
-private:
-
-	static void								OpenBrowser( const FString& URL );
-
-	FDelegateHandle							OnPostWorldInitializationHandle;
-
-	FString									Token;
-	FString									LogID;
-	FString									LinkWeb;
-	FString									Expiry;
-	TMap<FString, FString>					LinkedLogIDs;
-	TMap<FString, TSharedPtr<FJsonValue>>	AdditionalMetadata;
+	FCapsaLogPolicy							LogPolicy;
+	FTSTicker::FDelegateHandle				LogPolicyPollHandle;
+	float									LogPolicyPollInterval;
 
 	TWeakObjectPtr<UCapsaActorComponent>	CapsaActorComponent;
 
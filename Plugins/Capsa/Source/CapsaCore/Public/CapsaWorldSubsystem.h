@@ -0,0 +1,156 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/ObjectKey.h"
+
+#include "CapsaWorldSubsystem.generated.h"
+
+// Forward Declarations
+class AController;
+class AGameModeBase;
+class APlayerController;
+class UCapsaActorComponent;
+
+
+/**
+ * UCapsaWorldSubsystem adds the CapsaActorComponent to the AutoAddClass Actors of a server game World.
+ *
+ * It only exists for game and PIE Worlds with bAutoAddCapsaComponent or bUseWorldLogSessions, binds its delegates once
+ * when the World is initialized and removes them when the World is torn down. Components are added as Actors are spawned,
+ * so a login only touches the Actors of the new player, and the state of a player is released when they log out.
+ *
+ * With bUseWorldLogSessions it also owns the log session of the World, and tags the game thread with it while the World ticks.
+ */
+UCLASS()
+class CAPSACORE_API UCapsaWorldSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Begin USubsystem
+	virtual bool							ShouldCreateSubsystem( UObject* Outer ) const override;
+	virtual void							Initialize( FSubsystemCollectionBase& Collection ) override;
+	virtual void							Deinitialize() override;
+	// End USubsystem
+
+	// Begin UWorldSubsystem
+	virtual void							OnWorldBeginPlay( UWorld& InWorld ) override;
+	// End UWorldSubsystem
+
+	/**
+	* Returns the number of players that have a CapsaActorComponent tracked by this subsystem.
+	*
+	* @return int32 The number of tracked players.
+	*/
+	int32									GetNumTrackedPlayers() const;
+
+protected:
+
+	// Begin UWorldSubsystem
+	virtual bool							DoesSupportWorldType( const EWorldType::Type WorldType ) const override;
+	// End UWorldSubsystem
+
+	/**
+	* Called for every Actor spawned in the World. Adds the Capsa Component if the Actor is an AutoAddClass.
+	*
+	* @param Actor The spawned Actor.
+	*/
+	virtual void							OnActorSpawned( AActor* Actor );
+
+	/**
+	* Called when a streaming level is added to a World. Adds the Capsa Component to the AutoAddClass Actors in the level.
+	*
+	* @param Level The added level.
+	* @param World The World the level was added to, ignored if it is not the World of this subsystem.
+	*/
+	virtual void							OnLevelAddedToWorld( ULevel* Level, UWorld* World );
+
+	/**
+	* Called after a Player has been successfully Logged in, in any World.
+	* Only checks the PlayerController, PlayerState and Pawn of the new player, other Actors are handled by OnActorSpawned.
+	*
+	* @param GameMode The GameMode the player joined.
+	* @param Player The PlayerController for the player that has just joined.
+	*/
+	virtual void							OnPlayerLoggedIn( AGameModeBase* GameMode, APlayerController* Player );
+
+	/**
+	* Called after a Player has been successfully Logged out, in any World.
+	* Removes the Capsa Components of the player and forgets about them.
+	*
+	* @param GameMode The GameMode the player left.
+	* @param Controller The Controller for the player that has just left.
+	*/
+	virtual void							OnPlayerLoggedOut( AGameModeBase* GameMode, AController* Controller );
+
+	/**
+	* Called when any World starts its tick. Lines logged on the game thread go to the log session of this World from here on.
+	*
+	* @param World The World that ticks, ignored if it is not the World of this subsystem.
+	* @param TickType The kind of tick.
+	* @param DeltaSeconds The time since the last tick.
+	*/
+	virtual void							OnWorldTickStart( UWorld* World, ELevelTick TickType, float DeltaSeconds );
+
+	/**
+	* Called when any World finished ticking its Actors. Lines logged on the game thread go to the log of the process again.
+	*
+	* @param World The World that ticks, ignored if it is not the World of this subsystem.
+	* @param TickType The kind of tick.
+	* @param DeltaSeconds The time since the last tick.
+	*/
+	virtual void							OnWorldPostActorTick( UWorld* World, ELevelTick TickType, float DeltaSeconds );
+
+private:
+
+	/**
+	* Whether the World is a server, where the components are added.
+	*
+	* @return bool True if the World is not a client.
+	*/
+	bool									IsServerWorld() const;
+
+	/**
+	* Adds the Capsa Component to the Actor if it is an AutoAddClass and does not have one yet.
+	*
+	* @param Actor The Actor to check, can be null.
+	*/
+	void									AddCapsaComponent( AActor* Actor );
+
+	/**
+	* Makes sure the Core Subsystem reads the server data from a component that is still alive.
+	*/
+	void									UpdateCoreSubsystemComponent();
+
+	/**
+	* The class the Capsa Component is added to.
+	*/
+	TSubclassOf<AActor>						AutoAddClass;
+
+	FDelegateHandle							OnActorSpawnedHandle;
+	FDelegateHandle							OnLevelAddedToWorldHandle;
+	FDelegateHandle							OnPostLoginHandle;
+	FDelegateHandle							OnLogoutHandle;
+
+	/**
+	* The log session of the World with bUseWorldLogSessions, 0 otherwise.
+	*/
+	uint32									LogSessionID;
+	FDelegateHandle							OnWorldTickStartHandle;
+	FDelegateHandle							OnWorldPostActorTickHandle;
+
+	/**
+	* The components added to the Actors of each player, removed on logout.
+	*/
+	TMap<TObjectKey<AController>, TArray<TWeakObjectPtr<UCapsaActorComponent>>> PlayerComponents;
+
+	/**
+	* The components added to Actors that do not belong to a player, such as the GameState.
+	*/
+	TArray<TWeakObjectPtr<UCapsaActorComponent>> WorldComponents;
+};
@@ -7,9 +7,13 @@
 
 #include "CapsaActorComponent.generated.h"
 
+// Forward Declarations
+class UPackageMap;
+
 
 /**
 * FCapsaSharedData contains Capsa data that is shared between servers and clients.
+* It is sent compactly, see NetSerialize().
  */
 USTRUCT( BlueprintType )
 struct CAPSACORE_API FCapsaSharedData
@@ -63,6 +67,37 @@ public:
 	{
 		return LogID.IsEmpty() || LogURL.IsEmpty();
 	}
+
+	/**
+	* Sends the LogID as a 16 byte GUID, the Description as the index of a default description and the LogURL
+	* as the base URL the LogID is appended to. Values that do not fit those forms are sent as strings.
+	*
+	* @param Ar The archive to read from or write to.
+	* @param Map The package map, unused.
+	* @param bOutSuccess Set to false if the data could not be read.
+	* @return bool Always true, the struct is fully serialized here.
+	*/
+	bool					NetSerialize( FArchive& Ar, UPackageMap* Map, bool& bOutSuccess );
+
+	bool					operator==( const FCapsaSharedData& Other ) const
+	{
+		return LogID == Other.LogID && LogURL == Other.LogURL && Description == Other.Description;
+	}
+
+	bool					operator!=( const FCapsaSharedData& Other ) const
+	{
+		return ( *this == Other ) == false;
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FCapsaSharedData> : public TStructOpsTypeTraitsBase2<FCapsaSharedData>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
 };
 
 
@@ -82,6 +117,7 @@ public:
 
 	/**
 	* Registers the client's Capsa data as a linked log for the server.
+	* At most MaxLinkedLogsPerComponent different logs are linked per component, further ones are ignored.
 	*/
 	UFUNCTION( Server, Reliable )
 	void					ServerRegisterLinkedCapsaLog( const FCapsaSharedData& ClientCapsaData );
@@ -95,9 +131,16 @@ public:
 	/**
 	 * If running on a server, the field contains the server's own data.
 	 * If running on a client, the field will contain the data for the connected server.
+	 * Push-model replicated, mark it dirty with MARK_PROPERTY_DIRTY_FROM_NAME after changing it.
 	 */
 	UPROPERTY( ReplicatedUsing = OnRep_CapsaServerData )
 	FCapsaSharedData		CapsaServerData;
+
+	/**
+	* The number of different logs a single connection can link with ServerRegisterLinkedCapsaLog. The RPC comes from the
+	* client unvalidated. A reconnect gets a new component, the total is bounded by MaxLinkedLogsPerSession of the log session.
+	*/
+	static constexpr int32	MaxLinkedLogsPerComponent = 4;
 	
 
 	// TODO: Add way to modify the description for current instance
@@ -117,6 +160,16 @@ protected:
 	 */
 	FCapsaSharedData		CapsaData;
 
+	/**
+	* On client: the LogID last sent with ServerRegisterLinkedCapsaLog, so it is sent once per connection.
+	*/
+	FString					RegisteredLogID;
+
+	/**
+	* On server: the number of logs linked through ServerRegisterLinkedCapsaLog, see MaxLinkedLogsPerComponent.
+	*/
+	int32					NumLinkedLogs;
+
 	/**
 	*  Whether the game instance on which the actor is running should be considered a server or not.
 	*
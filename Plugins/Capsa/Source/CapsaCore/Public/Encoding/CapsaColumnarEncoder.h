@@ -0,0 +1,63 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/OutputDevice.h"
+
+
+/**
+* FCapsaColumnarEncoder encodes log chunks in the binary columnar format.
+*
+* Instead of repeating a text prefix per line, every field is stored in its own column. Categories are
+* replaced by IDs from a session-scoped dictionary. Every chunk carries the entries for the categories it uses,
+* so it can be decoded without the chunks before it. The encoder is shared between Log Pipeline tasks and is thread safe.
+*
+* Chunk layout, all varints are unsigned LEB128:
+*   "CPSC" magic, uint8 version (1)
+*   varint NumLines
+*   varint NumCategories, then per entry: varint CategoryID, varint ByteLength, UTF-8 name
+*   Columns, each prefixed with its varint byte size:
+*     Time      per line, zigzag varint delta of the IEEE-754 bit pattern of the unix time (seconds, double)
+*               to the previous line, the first line is relative to 0
+*     Verbosity per line, uint8 ELogVerbosity value
+*     Category  per line, varint CategoryID
+*     Length    per line, varint byte length of the UTF-8 message
+*     Heap      the UTF-8 messages, back to back
+*/
+class CAPSACORE_API FCapsaColumnarEncoder
+{
+public:
+
+	static constexpr uint8			Version = 1;
+
+	/**
+	* Encodes the lines as a single chunk.
+	*
+	* @param Lines The lines to encode.
+	* @param OutChunk The array to append the chunk to.
+	*/
+	void							EncodeChunk( TConstArrayView<FBufferedLine> Lines, TArray<uint8>& OutChunk );
+
+	/**
+	* Returns the number of categories in the session dictionary.
+	*
+	* @return int32 The number of categories.
+	*/
+	int32							GetNumCategories() const;
+
+	/**
+	* Reference decoder, turns a chunk back into the plain text log format.
+	*
+	* @param Chunk The encoded chunk.
+	* @param Categories The session dictionary, updated with the entries in the chunk.
+	* @param OutLog Receives the plain text log.
+	* @return bool True if the chunk could be decoded.
+	*/
+	static bool						DecodeChunk( TConstArrayView<uint8> Chunk, TMap<uint32, FString>& Categories, FString& OutLog );
+
+private:
+
+	mutable FCriticalSection		CriticalSection;
+	TMap<FName, uint32>				CategoryIDs;
+};
@@ -0,0 +1,99 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+* FCapsaJsonReader is a pull reader over a UTF-8 JSON buffer, for responses with a known shape. It reads in
+* place without building an FJsonObject DOM or converting the whole buffer to an FString: only the strings the
+* caller reads are decoded, everything else is skipped.
+*
+* Keys are passed to the visitor as views into the buffer. Keys containing escape sequences are passed as
+* they are written, so they will not match a plain key.
+*/
+class CAPSACORE_API FCapsaJsonReader
+{
+public:
+
+	/**
+	* @param InJson The UTF-8 JSON to read. Must outlive the reader.
+	*/
+	explicit FCapsaJsonReader( TConstArrayView<uint8> InJson );
+
+	/**
+	* Reads an object. Visitor is called with every key and has to read or skip the value.
+	*
+	* @param Visitor Called per member, returns false to stop reading.
+	* @return bool True if the object was read completely.
+	*/
+	bool							ReadObject( TFunctionRef<bool( FAnsiStringView Key )> Visitor );
+
+	/**
+	* Reads a string value.
+	*
+	* @param OutValue Receives the unescaped string.
+	* @return bool True if the next value was a valid string.
+	*/
+	bool							ReadString( FString& OutValue );
+
+	/**
+	* Reads a number value.
+	*
+	* @param OutValue Receives the number.
+	* @return bool True if the next value was a number.
+	*/
+	bool							ReadNumber( double& OutValue );
+
+	/**
+	* Reads a bool value.
+	*
+	* @param bOutValue Receives the bool.
+	* @return bool True if the next value was true or false.
+	*/
+	bool							ReadBool( bool& bOutValue );
+
+	/**
+	* Skips the next value, including nested objects and arrays.
+	*
+	* @return bool True if the value was valid.
+	*/
+	bool							SkipValue();
+
+	/**
+	* Whether only whitespace is left.
+	*
+	* @return bool True if the whole buffer was read.
+	*/
+	bool							IsAtEnd();
+
+	/**
+	* Nested objects and arrays deeper than this are rejected.
+	*/
+	static constexpr int32			MaxDepth = 64;
+
+private:
+
+	void							SkipWhitespace();
+
+	/**
+	* Consumes Char after any whitespace.
+	*/
+	bool							Consume( ANSICHAR Char );
+
+	/**
+	* Reads a string without unescaping it.
+	*
+	* @param OutRaw Receives the characters between the quotes.
+	* @param bOutEscaped Set if the string contains escape sequences.
+	*/
+	bool							ReadRawString( FAnsiStringView& OutRaw, bool& bOutEscaped );
+
+	bool							SkipValue( int32 Depth );
+
+	bool							ReadHex4( const ANSICHAR*& Char, const ANSICHAR* HexEnd, uint32& OutValue ) const;
+
+	const ANSICHAR*					Current;
+	const ANSICHAR*					End;
+};
@@ -0,0 +1,81 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+* FCapsaJsonWriter streams condensed JSON as UTF-8 straight into a byte buffer, without building an FJsonObject
+* DOM or an intermediate FString. The caller owns the buffer and can reuse it between documents.
+*
+* Commas are inserted automatically, the caller only has to balance Begin/End and write a key before every
+* value inside an object. Non-finite numbers are written as null.
+*/
+class CAPSACORE_API FCapsaJsonWriter
+{
+public:
+
+	/**
+	* @param InBuffer The buffer to append the JSON to. Must outlive the writer.
+	*/
+	explicit FCapsaJsonWriter( TArray<uint8>& InBuffer );
+
+	void							BeginObject();
+	void							EndObject();
+	void							BeginArray();
+	void							EndArray();
+
+	/**
+	* Writes the key of the next value in the current object.
+	*
+	* @param Key The key, escaped as a JSON string.
+	*/
+	void							WriteKey( FStringView Key );
+
+	void							WriteString( FStringView Value );
+	void							WriteInteger( int64 Value );
+	void							WriteUnsigned( uint64 Value );
+	void							WriteDouble( double Value );
+	void							WriteBool( bool Value );
+	void							WriteNull();
+
+	/**
+	* Writes a value that is already valid UTF-8 JSON, as produced by another FCapsaJsonWriter.
+	*
+	* @param Json The JSON value.
+	*/
+	void							WriteRaw( TConstArrayView<uint8> Json );
+
+	/**
+	* Convenience for WriteKey followed by a value.
+	*/
+	void							WriteString( FStringView Key, FStringView Value );
+	void							WriteInteger( FStringView Key, int64 Value );
+	void							WriteUnsigned( FStringView Key, uint64 Value );
+	void							WriteDouble( FStringView Key, double Value );
+	void							WriteBool( FStringView Key, bool Value );
+
+private:
+
+	/**
+	* Writes the separator needed before the next value or key.
+	*/
+	void							BeginValue();
+
+	void							WriteAnsi( const ANSICHAR* Text, int32 Length );
+
+	void							WriteEscaped( FStringView Value );
+
+	TArray<uint8>&					Buffer;
+
+	/**
+	* Per open object or array, whether it already has a value and needs a comma before the next one.
+	*/
+	TArray<bool, TInlineAllocator<8>> HasValue;
+
+	/**
+	* Set after WriteKey, the following value is written without a separator.
+	*/
+	bool							bAfterKey;
+};
@@ -0,0 +1,160 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+* FCapsaTemplateMiner is an online, Drain-style log template miner.
+*
+* Lines are split into space separated tokens and routed through a fixed depth parse tree (token count,
+* then the first tokens) to a small list of clusters. A line joins the most similar cluster if enough tokens
+* match, and the tokens that differ become wildcards. Each version of a template gets a new ID, so IDs
+* already sent to the server never change meaning.
+*
+* The miner is session-scoped and shared between Log Pipeline tasks, hold GetCriticalSection() while encoding a chunk.
+*
+* Encoded chunk format (UTF-8 text, one entry per line):
+*   #T <TemplateID> <Template>                                    dictionary entry, for every template the chunk uses
+*   [Timestamp][LogVerbosity][LogCategory]: @<TemplateID>{\x1F<Param>}   log line
+* Template ID 0 is used for lines that do not map to a template, its single param is the full line.
+* Every chunk carries the dictionary entries it needs, so it can be decoded without the chunks before it.
+* \x1F and \x1B in params are escaped with a preceding \x1B, line breaks as \x1Bn and \x1Br, so multi-line messages
+* stay on one line of the chunk. A line token that reads <*> or contains a line break is always a param.
+* Entries end with LINE_TERMINATOR_ANSI, a trailing \r is not part of the entry.
+*/
+class CAPSACORE_API FCapsaTemplateMiner
+{
+public:
+
+	/**
+	* Template ID for lines that are not mapped to a template.
+	*/
+	static constexpr uint32		RawTemplateID = 0;
+
+	/**
+	* Token used in templates for variable parts of a line.
+	*/
+	static const TCHAR* const	Wildcard;
+
+	/**
+	* Separates the Template ID and params in an encoded line.
+	*/
+	static constexpr TCHAR		ParamSeparator = TEXT( '\x1F' );
+
+	/**
+	* Precedes a ParamSeparator or EscapeCharacter that is part of a param, or n and r for a line break.
+	*/
+	static constexpr TCHAR		EscapeCharacter = TEXT( '\x1B' );
+
+	/**
+	* @param InSimilarityThreshold Fraction of tokens that must match for a line to join a cluster.
+	* @param InMaxClusters Upper bound on the number of clusters, lines beyond that are sent raw.
+	*/
+	explicit FCapsaTemplateMiner( float InSimilarityThreshold = 0.5f, int32 InMaxClusters = 4096 );
+
+	/**
+	* Maps the line to a template, creating or generalizing a template if needed.
+	*
+	* @param Line The log message, without prefix.
+	* @param OutParams Receives views into Line for every wildcard in the template, in order.
+	* @return uint32 The Template ID, or RawTemplateID.
+	*/
+	uint32						AddLine( FStringView Line, TArray<FStringView>& OutParams );
+
+	/**
+	* Appends the encoded form of the line (@<TemplateID>{\x1F<Param>}) to Out, and remembers the template
+	* for ConsumeChunkTemplates().
+	*
+	* @param Line The log message, without prefix.
+	* @param Out The string to append to.
+	*/
+	void						EncodeLine( FStringView Line, FString& Out );
+
+	/**
+	* Appends a dictionary entry for every template used by EncodeLine() since the last call to Out, and forgets them.
+	*
+	* @param Out The string to append to.
+	* @return int32 The number of dictionary entries appended.
+	*/
+	int32						ConsumeChunkTemplates( FString& Out );
+
+	/**
+	* Returns the number of clusters mined in this session.
+	*
+	* @return int32 The number of clusters.
+	*/
+	int32						GetNumClusters() const;
+
+	/**
+	* The lock that must be held while using the miner.
+	*
+	* @return FCriticalSection The miner lock.
+	*/
+	FCriticalSection&			GetCriticalSection();
+
+	/**
+	* Reference decoder, turns an encoded chunk back into the plain text log format.
+	*
+	* @param Chunk The encoded chunk.
+	* @param Dictionary The session dictionary, updated with the entries in the chunk.
+	* @param OutLog Receives the plain text log.
+	* @return bool True if every line could be decoded.
+	*/
+	static bool					DecodeChunk( FStringView Chunk, TMap<uint32, FString>& Dictionary, FString& OutLog );
+
+private:
+
+	struct FCluster
+	{
+		TArray<FString>			Tokens;
+		uint32					TemplateID = RawTemplateID;
+	};
+
+	/**
+	* Splits the Line on single spaces into Tokens, keeping empty tokens so the line can be rebuilt exactly.
+	*/
+	static void					Tokenize( FStringView Line, TArray<FStringView>& OutTokens );
+
+	static bool					IsWildcard( FStringView Token );
+
+	static bool					HasDigit( FStringView Token );
+
+	static bool					HasLineBreak( FStringView Token );
+
+	/**
+	* Returns the key of the parse tree leaf for the tokens.
+	*/
+	uint64						GetLeafKey( TConstArrayView<FStringView> Tokens );
+
+	/**
+	* Assigns a new Template ID to the cluster.
+	*/
+	void						PublishTemplate( FCluster& Cluster );
+
+	/**
+	* Appends Param to Out, escaping ParamSeparator, EscapeCharacter and line breaks.
+	*/
+	static void					AppendEscapedParam( FStringView Param, FString& Out );
+
+	static constexpr int32		MaxTokens = 128;
+	static constexpr int32		PrefixDepth = 2;
+	static constexpr int32		MaxLeavesPerLength = 100;
+
+	float						SimilarityThreshold;
+	int32						MaxClusters;
+	uint32						NextTemplateID;
+
+	TArray<FCluster>			Clusters;
+	TMap<uint64, TArray<int32>>	Leaves;
+	TMap<int32, int32>			NumLeavesPerLength;
+	int32						LastClusterIndex;
+	TSet<uint32>				ChunkTemplateIDs;
+	FString						ChunkTemplates;
+
+	TArray<FStringView>			TokenScratch;
+	TArray<FStringView>			ParamScratch;
+
+	FCriticalSection			CriticalSection;
+};
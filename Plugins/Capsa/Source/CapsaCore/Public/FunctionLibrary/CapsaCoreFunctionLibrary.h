@@ -42,4 +42,15 @@ public:
 	* @return FString ELogVerbosity::Type value as a string
 	*/
 	static FString						GetLogVerbosityString( ELogVerbosity::Type Verbosity );
+
+	/**
+	* Appends the Capsa log line prefix, with the format:
+	* [Timestamp][LogVerbosity][LogCategory]: 
+	*
+	* @param Log The string to append to.
+	* @param Time The Unix timestamp of the line.
+	* @param Verbosity The Verbosity of the line.
+	* @param Category The Log Category of the line.
+	*/
+	static void							AppendLogLinePrefix( FString& Log, double Time, ELogVerbosity::Type Verbosity, const FName& Category );
 };
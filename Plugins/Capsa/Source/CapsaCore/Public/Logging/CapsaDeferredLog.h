@@ -0,0 +1,346 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Logging/LogRecord.h"
+#include "Misc/OutputDevice.h"
+
+#include <type_traits>
+
+
+/**
+* A single CAPSA_LOG call site. Created once per call site as a function local static, the ID
+* identifies the format string for the lifetime of the process.
+*/
+struct CAPSACORE_API FCapsaLogFormatSite
+{
+	FCapsaLogFormatSite( const FName& InCategory, ELogVerbosity::Type InVerbosity, const TCHAR* InFormat, const ANSICHAR* InFile, int32 InLine );
+
+	/**
+	* The printf style format string, as passed to CAPSA_LOG.
+	*/
+	const TCHAR*					Format;
+
+	/**
+	* The Log Category of the call site.
+	*/
+	FName							Category;
+
+	/**
+	* The verbosity of the call site.
+	*/
+	ELogVerbosity::Type				Verbosity;
+
+	/**
+	* The source file of the call site.
+	*/
+	const ANSICHAR*					File;
+
+	/**
+	* The source line of the call site.
+	*/
+	int32							Line;
+
+	/**
+	* The format ID, unique per call site. 0 is never used.
+	*/
+	uint32							ID;
+};
+
+/**
+* The copy of a FCapsaLogFormatSite kept by FCapsaDeferredLog. The call site is a static in the module that logs it,
+* the copy stays valid for the lifetime of the process even if that module is unloaded before the line is formatted.
+*/
+struct CAPSACORE_API FCapsaRegisteredLogSite
+{
+	FString							Format;
+	FName							Category;
+	ELogVerbosity::Type				Verbosity;
+	FString							File;
+	int32							Line;
+};
+
+/**
+* The type tag of an argument captured by CAPSA_LOG.
+*/
+enum class ECapsaLogArgType : uint8
+{
+	Int,
+	UInt,
+	Double,
+	String,
+	Pointer,
+};
+
+/**
+* Captures the raw values of CAPSA_LOG arguments into a compact byte stream. Strings are copied,
+* as the pointers passed to CAPSA_LOG are not valid after the call returns. The characters of a string
+* start at an offset aligned to TCHAR, so they can be read in place.
+*/
+class CAPSACORE_API FCapsaLogArgWriter
+{
+public:
+
+	void							AddInt( int64 Value );
+	void							AddUInt( uint64 Value );
+	void							AddDouble( double Value );
+	void							AddString( const TCHAR* Value );
+	void							AddString( const ANSICHAR* Value );
+	void							AddPointer( const void* Value );
+
+	/**
+	* Captures a single printf compatible argument.
+	*
+	* @param Arg The argument, as passed to CAPSA_LOG.
+	*/
+	template <typename ArgType>
+	FORCEINLINE void				Add( ArgType Arg )
+	{
+		using FArg = std::decay_t<ArgType>;
+		if constexpr( std::is_same_v<FArg, bool> )
+		{
+			AddInt( Arg == true ? 1 : 0 );
+		} else if constexpr( std::is_floating_point_v<FArg> )
+		{
+			AddDouble( static_cast<double>( Arg ) );
+		} else if constexpr( std::is_enum_v<FArg> )
+		{
+			AddInt( static_cast<int64>( Arg ) );
+		} else if constexpr( std::is_integral_v<FArg> && std::is_signed_v<FArg> )
+		{
+			AddInt( static_cast<int64>( Arg ) );
+		} else if constexpr( std::is_integral_v<FArg> )
+		{
+			AddUInt( static_cast<uint64>( Arg ) );
+		} else if constexpr( std::is_convertible_v<FArg, const TCHAR*> )
+		{
+			AddString( static_cast<const TCHAR*>( Arg ) );
+		} else if constexpr( std::is_convertible_v<FArg, const ANSICHAR*> )
+		{
+			AddString( static_cast<const ANSICHAR*>( Arg ) );
+		} else if constexpr( std::is_pointer_v<FArg> )
+		{
+			AddPointer( static_cast<const void*>( Arg ) );
+		} else
+		{
+			static_assert( sizeof( FArg ) == 0, "CAPSA_LOG only supports printf compatible arguments, pass FStrings as *String." );
+		}
+	}
+
+	/**
+	* Returns the captured arguments.
+	*
+	* @return TConstArrayView<uint8> The captured arguments.
+	*/
+	TConstArrayView<uint8>			GetData() const
+	{
+		return Data;
+	}
+
+private:
+
+	TArray<uint8, TInlineAllocator<256>> Data;
+};
+
+/**
+* Receives CAPSA_LOG lines with their raw arguments, see FCapsaDeferredLog::SetSink.
+*/
+class CAPSACORE_API ICapsaDeferredLogSink
+{
+public:
+
+	virtual ~ICapsaDeferredLogSink() = default;
+
+	/**
+	* Called on the logging thread for every CAPSA_LOG line while this is the active sink. The sink is kept alive
+	* while a line is dispatched, but no lock is held, so it may log itself.
+	*
+	* @param Site The call site of the line.
+	* @param Args The captured arguments, see FCapsaLogArgWriter.
+	*/
+	virtual void					SerializeDeferred( const FCapsaLogFormatSite& Site, TConstArrayView<uint8> Args ) = 0;
+};
+
+/**
+* Holds captured CAPSA_LOG and UE_LOGFMT lines until they are formatted in the background.
+* Not thread safe, the owner guards access.
+*/
+class CAPSACORE_API FCapsaDeferredLogBuffer
+{
+public:
+
+	/**
+	* Adds a CAPSA_LOG line.
+	*
+	* @param SiteID The format ID of the call site.
+	* @param Time The time of the line, in unix seconds.
+	* @param Args The captured arguments.
+	*/
+	void							AddLine( uint32 SiteID, double Time, TConstArrayView<uint8> Args );
+
+	/**
+	* Adds a UE_LOGFMT line. The fields of the record are copied, so it can be formatted later.
+	*
+	* @param Record The log record.
+	* @param Time The time of the line, in unix seconds.
+	*/
+	void							AddRecord( const UE::FLogRecord& Record, double Time );
+
+	int32							Num() const;
+	bool							IsEmpty() const;
+	void							Reset();
+
+	/**
+	* Returns the memory held by the captured lines, not counting the fields of UE_LOGFMT records.
+	*
+	* @return int64 The allocated size in bytes.
+	*/
+	int64							GetAllocatedSize() const;
+
+	/**
+	* Returns the time of the oldest captured line.
+	*
+	* @return double The time in unix seconds, 0 if the buffer is empty.
+	*/
+	double							GetFirstLineTime() const;
+
+	/**
+	* Formats every captured line and merges them into Lines, keeping Lines ordered by time.
+	*
+	* @param Lines The already formatted lines, ordered by time.
+	*/
+	void							FormatInto( TArray<FBufferedLine>& Lines ) const;
+
+private:
+
+	struct FDeferredRecord
+	{
+		UE::FLogRecord				Record;
+		double						Time;
+	};
+
+	/**
+	* Records of [double Time][uint32 SiteID][uint32 ArgsSize][Args], back to back. Args are padded to a multiple of
+	* the alignment of TCHAR, so the strings in every record stay aligned.
+	*/
+	TArray<uint8>					Data;
+	int32							NumLines = 0;
+	TArray<FDeferredRecord>			Records;
+};
+
+/**
+* Entry point for deferred formatting, see CAPSA_LOG.
+*/
+class CAPSACORE_API FCapsaDeferredLog
+{
+public:
+
+	/**
+	* Sets the sink that receives CAPSA_LOG lines. While no sink is set, CAPSA_LOG behaves like UE_LOG.
+	* Lines that are being dispatched keep a reference to the previous sink until they return.
+	*
+	* @param Sink The new sink, or nullptr to stop deferring.
+	*/
+	static void						SetSink( const TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe>& Sink );
+
+	/**
+	* Returns the active sink.
+	*
+	* @return TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe> The active sink, or nullptr.
+	*/
+	static TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe> GetSink();
+
+	/**
+	* Whether a sink is set. Only a hint, the sink can be removed before the line is dispatched.
+	*
+	* @return bool True if CAPSA_LOG lines are currently deferred.
+	*/
+	static bool						IsEnabled();
+
+	/**
+	* Captures the arguments and passes the line to the sink. Fatal lines are never deferred.
+	*
+	* @param Site The call site.
+	* @param Args The arguments, as passed to CAPSA_LOG.
+	* @return bool True if the line was passed to the sink, false if it should be logged with UE_LOG.
+	*/
+	template <typename... ArgTypes>
+	static bool						TryLog( const FCapsaLogFormatSite& Site, ArgTypes... Args )
+	{
+		if( Site.Verbosity == ELogVerbosity::Fatal || IsEnabled() == false )
+		{
+			return false;
+		}
+
+		FCapsaLogArgWriter Writer;
+		( Writer.Add( Args ), ... );
+		return Dispatch( Site, Writer.GetData() );
+	}
+
+	/**
+	* Captures the arguments and passes the line to the given sink instead of the active one, for benchmarks.
+	*
+	* @param Sink The sink to pass the line to.
+	* @param Site The call site.
+	* @param Args The arguments, as passed to CAPSA_LOG.
+	*/
+	template <typename... ArgTypes>
+	static void						LogTo( ICapsaDeferredLogSink& Sink, const FCapsaLogFormatSite& Site, ArgTypes... Args )
+	{
+		FCapsaLogArgWriter Writer;
+		( Writer.Add( Args ), ... );
+		Sink.SerializeDeferred( Site, Writer.GetData() );
+	}
+
+	/**
+	* Registers a copy of a call site and returns its format ID.
+	*/
+	static uint32					RegisterSite( const FCapsaLogFormatSite& Site );
+
+	/**
+	* Returns the registered copy of the call site with the given format ID. Never freed.
+	*
+	* @return FCapsaRegisteredLogSite The call site, or nullptr if unknown.
+	*/
+	static const FCapsaRegisteredLogSite* FindSite( uint32 SiteID );
+
+	/**
+	* Formats the captured arguments with the printf style format string of the call site.
+	*
+	* @param Format The format string.
+	* @param Args The captured arguments.
+	* @param Out The string to append to.
+	*/
+	static void						FormatArgs( const TCHAR* Format, TConstArrayView<uint8> Args, FString& Out );
+
+private:
+
+	static bool						Dispatch( const FCapsaLogFormatSite& Site, TConstArrayView<uint8> Args );
+};
+
+/**
+* Logs like UE_LOG, but when deferred formatting is active (bUseDeferredFormatting and bCapsaLogSkipsLocalLog) only
+* a format ID and the raw argument values are captured on the calling thread. The line is formatted by the background
+* task that builds the log chunk. Deferred lines are only sent to Capsa: they skip GLog, so they are not written to the
+* console, the log file or any other Output Device. Use UE_LOG for lines that must always be in the local log.
+* Arguments must be printf compatible: integers, enums, floating point numbers, strings (TCHAR/ANSICHAR) and pointers.
+*
+* CAPSA_LOG( LogTemp, Log, TEXT( "Spawned %s at %.2f" ), *Name, Time );
+*/
+#if NO_LOGGING
+#define CAPSA_LOG( CategoryName, Verbosity, Format, ... ) UE_LOG( CategoryName, Verbosity, Format, ##__VA_ARGS__ )
+#else
+#define CAPSA_LOG( CategoryName, Verbosity, Format, ... ) \
+	do \
+	{ \
+		if( UE_LOG_ACTIVE( CategoryName, Verbosity ) ) \
+		{ \
+			static const FCapsaLogFormatSite CapsaLogSite( CategoryName.GetCategoryName(), ELogVerbosity::Verbosity, Format, __FILE__, __LINE__ ); \
+			if( FCapsaDeferredLog::TryLog( CapsaLogSite, ##__VA_ARGS__ ) == false ) \
+			{ \
+				UE_LOG( CategoryName, Verbosity, Format, ##__VA_ARGS__ ); \
+			} \
+		} \
+	} while( false )
+#endif
@@ -0,0 +1,117 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/OutputDevice.h"
+
+
+/**
+* A Capsa log recording stores captured lines exactly as the output device handed them to the Log Pipeline:
+* text, category, verbosity and capture time. Recordings are replayed by the CapsaReplay commandlet, to compare
+* plugin versions and settings on real data.
+*
+* The file starts with the "CAPSAREC" magic and a uint32 version, followed by zlib compressed blocks of
+* [uint32 UncompressedSize][uint32 CompressedSize][Data]. Uncompressed, a block is a sequence of records:
+* - Category: [uint8 0][uint16 Length][UTF-8 name], defines the next category index, starting at 0.
+* - Line: [uint8 1][double Time][uint32 CategoryIndex][uint8 Verbosity][uint32 Length][UTF-8 text].
+* Category indices are valid for the rest of the file.
+*/
+namespace CapsaLogRecording
+{
+	static constexpr uint32			Version = 1;
+	static constexpr int32			BlockSize = 1024 * 1024;
+	static const TCHAR* const		Extension = TEXT( ".capsarec" );
+}
+
+/**
+* Writes captured lines to a recording. Not thread safe, the owner guards access.
+*/
+class CAPSACORE_API FCapsaLogRecordingWriter
+{
+public:
+
+	~FCapsaLogRecordingWriter();
+
+	/**
+	* Creates the file and writes the header.
+	*
+	* @param FilePath The path of the recording, an existing file is overwritten.
+	* @return bool True if the file could be created.
+	*/
+	bool							Open( const FString& FilePath );
+
+	/**
+	* Appends lines to the recording. Lines are written to disk once a block is full, or on Flush.
+	*
+	* @param Lines The lines to append, in capture order.
+	*/
+	void							AddLines( TConstArrayView<FBufferedLine> Lines );
+
+	/**
+	* Compresses and writes the current block.
+	*/
+	void							Flush();
+
+	/**
+	* Flushes and closes the file.
+	*/
+	void							Close();
+
+	bool							IsOpen() const;
+
+	/**
+	* Returns the number of lines added since Open.
+	*
+	* @return int64 The number of recorded lines.
+	*/
+	int64							GetNumLines() const;
+
+private:
+
+	TUniquePtr<FArchive>			File;
+	TMap<FName, uint32>				CategoryIndices;
+	TArray<uint8>					Block;
+	TArray<uint8>					CompressedBlock;
+	int64							NumLines = 0;
+};
+
+/**
+* Reads a recording block by block.
+*/
+class CAPSACORE_API FCapsaLogRecordingReader
+{
+public:
+
+	/**
+	* Opens the file and checks the header.
+	*
+	* @param FilePath The path of the recording.
+	* @return bool True if the file is a recording this version can read.
+	*/
+	bool							Open( const FString& FilePath );
+
+	/**
+	* Reads the lines of the next block.
+	*
+	* @param OutLines The array to append the lines to.
+	* @return bool True if a block was read, false at the end of the file or if the file is corrupt.
+	*/
+	bool							ReadBlock( TArray<FBufferedLine>& OutLines );
+
+	/**
+	* Reads every remaining line.
+	*
+	* @param OutLines The array to append the lines to.
+	* @return bool True if the end of the file was reached without errors.
+	*/
+	bool							ReadAll( TArray<FBufferedLine>& OutLines );
+
+private:
+
+	TUniquePtr<FArchive>			File;
+	TArray<FName>					Categories;
+	TArray<uint8>					CompressedBlock;
+	TArray<uint8>					Block;
+	bool							bCorrupt = false;
+};
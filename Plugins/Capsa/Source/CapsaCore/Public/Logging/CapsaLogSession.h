@@ -0,0 +1,212 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "Logging/CapsaDeferredLog.h"
+#include "Metadata/CapsaMetadataStore.h"
+#include "Pipeline/CapsaLogPipeline.h"
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Interfaces/IHttpResponse.h"
+
+
+class FCapsaColumnarEncoder;
+class FCapsaPayloadReader;
+class FCapsaTemplateMiner;
+struct FCapsaLogPolicy;
+enum class ECapsaChunkFormat : uint8;
+
+DECLARE_MULTICAST_DELEGATE_TwoParams( FCapsaLogSessionAuthChangedDelegate, const FString& /* CapsaLogId */, const FString& /* CapsaLogURL */ );
+DECLARE_DELEGATE_OneParam( FCapsaLogSessionPolicyDelegate, const FCapsaLogPolicy& /* Policy */ );
+
+/**
+* FCapsaLogSession is a single log on the Capsa Server: it authenticates, uploads the chunks submitted with
+* SendLog() through its own Log Pipeline, and sends its metadata and linked logs.
+*
+* The Core Subsystem owns the session of the process, and with bUseWorldLogSessions one per game World.
+* Lines logged on a thread are routed to the session of GetCurrentID(), which UCapsaWorldSubsystem sets
+* while its World ticks. Call on the game thread, except for the static functions. The Log Pipeline starts the uploads
+* on the game thread as well, so the authentication is only read and written there.
+*/
+class CAPSACORE_API FCapsaLogSession : public TSharedFromThis<FCapsaLogSession, ESPMode::ThreadSafe>
+{
+public:
+
+	/**
+	* @param InID The ID lines are tagged with, 0 for the session of the process.
+	* @param InName Identifies the session in the log, for example the name of the World.
+	*/
+	FCapsaLogSession( uint32 InID, const FString& InName );
+	~FCapsaLogSession();
+
+	/**
+	* Creates the Log Pipeline and requests authentication.
+	*
+	* @param PipelineSettings The settings of the Log Pipeline of this session.
+	*/
+	void									Start( const FCapsaLogPipelineSettings& PipelineSettings );
+
+	/**
+	* Waits for the chunks in the Log Pipeline and stops sending requests.
+	*/
+	void									Shutdown();
+
+	/**
+	* Request a Capsa Auth Token. Calls OnAuthChanged once authenticated. Does nothing while a request is in flight.
+	*/
+	void									RequestClientAuth();
+
+	/**
+	* Sends the Log Buffer to the Log Pipeline as a single chunk. The chunk is dropped if the pipeline is full.
+	*
+	* @param LogBuffer The Log buffer to send.
+	* @param DeferredLines Lines captured with deferred formatting, formatted and merged into the Log in the background.
+	*/
+	void									SendLog( TArray<FBufferedLine>& LogBuffer, FCapsaDeferredLogBuffer&& DeferredLines = FCapsaDeferredLogBuffer() );
+
+	/**
+	* Whether the Log Pipeline has room for another chunk.
+	*
+	* @return bool True if SendLog() would accept a chunk.
+	*/
+	bool									CanSendLog() const;
+
+	/**
+	* Links another log to this one. New links are collected for LinkedLogBatchSeconds and sent together,
+	* a log that was already linked, for example by a player that reconnects, is not sent again.
+	* At most MaxLinkedLogsPerSession logs are linked, further ones are ignored.
+	*
+	* @param LinkedLogID The LogID to link.
+	* @param Description The description of the linked log, fe. whether it's a server or client.
+	* @return bool True if the ID is valid and not already registered. Otherwise false.
+	*/
+	bool									RegisterLinkedLogID( const FString& LinkedLogID, const FString& Description );
+
+	/**
+	* Sets a metadata value. Setting a key to the value it already has does not send it again.
+	*
+	* @param Key Metadata Key
+	* @param Value Metadata value
+	*/
+	void									SetMetadata( const FString& Key, FCapsaMetadataValue&& Value );
+
+	/**
+	* Sends the linked logs and metadata keys that changed since the last successful request, one request at a
+	* time: changes made while a request is in flight are sent when it completes.
+	*
+	* @param bPollLogPolicy Send the request even if nothing changed, to receive the log policy in the response.
+	*/
+	void									RequestSendMetadata( bool bPollLogPolicy = false );
+
+	bool									IsAuthenticated() const;
+	uint32									GetID() const;
+	const FString&							GetName() const;
+	const FString&							GetLogID() const;
+	const FString&							GetLogURL() const;
+
+	/**
+	* Writes the state and per-stage timing of the Log Pipeline to the log.
+	*/
+	void									LogPipelineStats() const;
+
+	/**
+	* Returns the session lines logged on the calling thread belong to.
+	*
+	* @return uint32 The ID of the session, 0 for the session of the process.
+	*/
+	static uint32							GetCurrentID();
+
+	/**
+	* Sets the session lines logged on the calling thread belong to, until it is set again.
+	*
+	* @param ID The ID of the session, 0 for the session of the process.
+	*/
+	static void								SetCurrentID( uint32 ID );
+
+	/**
+	* Called once the session is authenticated, also when an authentication response arrives for a session
+	* that already was.
+	*/
+	FCapsaLogSessionAuthChangedDelegate		OnAuthChanged;
+
+	/**
+	* Called with the log policy in an authentication or metadata response.
+	*/
+	FCapsaLogSessionPolicyDelegate			OnLogPolicyReceived;
+
+private:
+
+	FString									GetAuthHeader() const;
+
+	bool									RequestSendLog( const FString& Log, const FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID );
+	bool									RequestSendCompressedLog( TArray<uint8>&& CompressedLog, const FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID );
+
+	/**
+	* One-shot ticker callback that sends the linked logs collected since the first registration of the batch.
+	*
+	* @param DeltaTime The time since the batch was started.
+	* @return bool Always false, the next registration starts a new batch.
+	*/
+	bool									FlushLinkedLogIDs( float DeltaTime );
+
+	/**
+	* Checks whether an HTTP request succeeded, and logs why if not. Does not read the response body.
+	*
+	* @param RequestName The request name (such as calling function name) to prepend to Log Outputs.
+	* @param Request The FHttpRequestPtr that made the Request.
+	* @param Response The FHttpResponsePtr with response information. Payload if successful, error info if not.
+	* @param bSuccess Whether the HTTP response was successful (true) or not (false).
+	* @return bool True if the request succeeded with a 2xx response code.
+	*/
+	bool									CheckResponse( const TCHAR* RequestName, FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess ) const;
+
+	void									ClientAuthResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess );
+	void									LogChunkResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess, uint64 UploadID, TSharedPtr<FCapsaPayloadReader, ESPMode::ThreadSafe> Payload );
+	void									MetadataResponse( FHttpRequestPtr Request, FHttpResponsePtr Response, bool bSuccess );
+
+	uint32									ID;
+	FString									Name;
+
+	FString									Token;
+	FString									LogID;
+	FString									LinkWeb;
+	FString									Expiry;
+	bool									bAuthRequestInFlight;
+
+	/**
+	* The linked logs not stored yet, the ones stored by the Capsa Server, and the window of the pending batch.
+	*/
+	TMap<FString, FString>					LinkedLogIDs;
+	TSet<FString>							StoredLinkedLogIDs;
+	FTSTicker::FDelegateHandle				LinkedLogBatchHandle;
+
+	FCapsaMetadataStore						AdditionalMetadata;
+
+	/**
+	* The state of the metadata request in flight, see RequestSendMetadata().
+	*/
+	TArray<uint8>							MetadataBuffer;
+	TArray<FString>							SentLinkedLogIDs;
+	uint64									SentMetadataRevision;
+	bool									bMetadataRequestInFlight;
+	bool									bMetadataRequestPending;
+
+	/**
+	* Maps log lines to templates for ECapsaChunkFormat::Template. Scoped to the log session, as the
+	* template dictionary is only sent once per session.
+	*/
+	TSharedPtr<FCapsaTemplateMiner, ESPMode::ThreadSafe> TemplateMiner;
+
+	/**
+	* Encodes log chunks for ECapsaChunkFormat::Columnar. Scoped to the log session, as the
+	* category dictionary is only sent once per session.
+	*/
+	TSharedPtr<FCapsaColumnarEncoder, ESPMode::ThreadSafe> ColumnarEncoder;
+
+	/**
+	* Formats, compresses, persists and uploads the log chunks passed to SendLog().
+	*/
+	TSharedPtr<FCapsaLogPipeline, ESPMode::ThreadSafe> LogPipeline;
+};
@@ -0,0 +1,134 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+class FCapsaJsonWriter;
+
+enum class ECapsaMetadataType : uint8
+{
+	String,
+	Integer,
+	Float,
+	Bool,
+	Array,
+	/** A value that is already serialized JSON, for objects and anything the other types can't express. */
+	Json,
+};
+
+/**
+* A single metadata value. Only the member matching Type is used.
+*/
+struct CAPSACORE_API FCapsaMetadataValue
+{
+	FCapsaMetadataValue();
+	FCapsaMetadataValue( const FString& InString );
+	FCapsaMetadataValue( FString&& InString );
+	FCapsaMetadataValue( const TCHAR* InString );
+	FCapsaMetadataValue( int32 InInteger );
+	FCapsaMetadataValue( int64 InInteger );
+	FCapsaMetadataValue( double InFloat );
+	FCapsaMetadataValue( bool bInBool );
+	FCapsaMetadataValue( TArray<FCapsaMetadataValue>&& InArray );
+
+	/**
+	* Creates a value from serialized JSON.
+	*
+	* @param InJson The UTF-8 JSON, for example written by FCapsaJsonWriter.
+	* @return FCapsaMetadataValue The value.
+	*/
+	static FCapsaMetadataValue		FromJson( TArray<uint8>&& InJson );
+
+	/**
+	* Writes the value to the JSON writer.
+	*/
+	void							Write( FCapsaJsonWriter& Writer ) const;
+
+	bool							operator==( const FCapsaMetadataValue& Other ) const;
+	bool							operator!=( const FCapsaMetadataValue& Other ) const
+	{
+		return ( *this == Other ) == false;
+	}
+
+	ECapsaMetadataType				Type;
+	FString							String;
+	int64							Integer;
+	double							Float;
+	bool							bBool;
+	TArray<FCapsaMetadataValue>		Array;
+	TArray<uint8>					Json;
+};
+
+/**
+* FCapsaMetadataStore holds the metadata of the log session and tracks which keys changed since they were last
+* sent to the Capsa Server, so every request only carries the dirty keys. Setting a key to the value it already
+* has does not make it dirty.
+*
+* Sending is two-phased: WriteDirty returns a revision, and only keys that did not change after that revision
+* are marked clean by ClearDirty, so a key set while a request is in flight is sent again.
+*
+* Not thread safe, use it from the game thread.
+*/
+class CAPSACORE_API FCapsaMetadataStore
+{
+public:
+
+	/**
+	* Sets the value of a key.
+	*
+	* @param Key The metadata key.
+	* @param Value The metadata value.
+	* @return bool True if the value changed and the key is now dirty.
+	*/
+	bool							Set( const FString& Key, FCapsaMetadataValue&& Value );
+
+	/**
+	* Returns the value of a key.
+	*
+	* @param Key The metadata key.
+	* @return const FCapsaMetadataValue* The value, or nullptr if the key was never set.
+	*/
+	const FCapsaMetadataValue*		Find( const FString& Key ) const;
+
+	/**
+	* Whether any key changed since it was last sent.
+	*
+	* @return bool True if there is something to send.
+	*/
+	bool							IsDirty() const;
+
+	/**
+	* Writes the dirty keys as a JSON object.
+	*
+	* @param Writer The writer to write the object to.
+	* @return uint64 The revision to pass to ClearDirty once the object has been stored.
+	*/
+	uint64							WriteDirty( FCapsaJsonWriter& Writer ) const;
+
+	/**
+	* Marks the keys written at the given revision as sent.
+	*
+	* @param SentRevision The revision returned by WriteDirty.
+	*/
+	void							ClearDirty( uint64 SentRevision );
+
+	/**
+	* Marks every key dirty, for example to send all metadata to a new log session.
+	*/
+	void							MarkAllDirty();
+
+private:
+
+	struct FEntry
+	{
+		FCapsaMetadataValue			Value;
+		/** The revision of the last change, 0 once sent. */
+		uint64						DirtyRevision = 0;
+	};
+
+	TMap<FString, FEntry>			Entries;
+	uint64							Revision = 0;
+	int32							NumDirty = 0;
+};
@@ -0,0 +1,98 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+
+/**
+* FCapsaBufferPool keeps the byte and string buffers of finished Log chunks, so the next chunk can be
+* formatted, converted and compressed into memory that is already allocated.
+*
+* Buffers are handed out empty but keep their capacity. Buffers released while the pool already holds
+* MaxPooledBytes are freed instead. Thread safe.
+*/
+class CAPSACORE_API FCapsaBufferPool
+{
+public:
+
+	explicit FCapsaBufferPool( int64 InMaxPooledBytes = 64 * 1024 * 1024 );
+
+	/**
+	* Returns an empty byte buffer, reusing a pooled one if there is any.
+	*
+	* @param MinCapacity The number of bytes the buffer is expected to hold.
+	* @return TArray<uint8> The empty buffer.
+	*/
+	TArray<uint8>					AcquireBytes( int32 MinCapacity = 0 );
+
+	/**
+	* Returns the buffer to the pool.
+	*
+	* @param Bytes The buffer, its contents are discarded.
+	*/
+	void							ReleaseBytes( TArray<uint8>&& Bytes );
+
+	/**
+	* Returns an empty string, reusing a pooled one if there is any.
+	*
+	* @param MinCapacity The number of characters the string is expected to hold.
+	* @return FString The empty string.
+	*/
+	FString							AcquireString( int32 MinCapacity = 0 );
+
+	/**
+	* Returns the string to the pool.
+	*
+	* @param String The string, its contents are discarded.
+	*/
+	void							ReleaseString( FString&& String );
+
+	/**
+	* Frees all pooled buffers.
+	*/
+	void							Trim();
+
+	/**
+	* Returns the number of buffers handed out since the pool was created.
+	*
+	* @return uint64 The number of acquired buffers.
+	*/
+	uint64							GetNumAcquired() const;
+
+	/**
+	* Returns the number of acquired buffers that reused pooled memory.
+	*
+	* @return uint64 The number of reused buffers.
+	*/
+	uint64							GetNumReused() const;
+
+	/**
+	* Returns the memory held by the pooled buffers.
+	*
+	* @return int64 The pooled memory in bytes.
+	*/
+	int64							GetPooledBytes() const;
+
+private:
+
+	/**
+	* Returns the index of the smallest pooled buffer with at least MinCapacity, or the largest
+	* one if none is big enough or MinCapacity is 0. INDEX_NONE if Capacities is empty.
+	*/
+	static int32					FindBuffer( const TArray<int64>& Capacities, int64 MinCapacity );
+
+	const int64						MaxPooledBytes;
+
+	mutable FCriticalSection		CriticalSection;
+	TArray<TArray<uint8>>			Bytes;
+	TArray<int64>					BytesCapacities;
+	TArray<FString>					Strings;
+	TArray<int64>					StringCapacities;
+	int64							PooledBytes;
+
+	std::atomic<uint64>				NumAcquired;
+	std::atomic<uint64>				NumReused;
+};
@@ -0,0 +1,449 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CapsaCoreAsync.h"
+#include "Pipeline/CapsaBufferPool.h"
+
+#include "Containers/Ticker.h"
+#include "CoreMinimal.h"
+#include "Misc/QueuedThreadPool.h"
+#include "Tasks/Task.h"
+
+#include <atomic>
+
+
+/**
+* The stages a Log chunk passes through in FCapsaLogPipeline, in order.
+*/
+enum class ECapsaPipelineStage : uint8
+{
+	Format,
+	Compress,
+	Persist,
+	Upload,
+	Num
+};
+
+/**
+* A part of a Log chunk that is compressed and uploaded on its own. Large chunks are split into
+* sub-chunks, so they can be compressed in parallel. Each sub-chunk is a complete chunk for the Capsa Server.
+*/
+struct FCapsaPipelineSubChunk
+{
+	/**
+	* The range of lines in the chunk Buffer, set by the format stage.
+	*/
+	int32							FirstLine = 0;
+	int32							NumLines = 0;
+
+	/**
+	* The encoded Log. Uploaded when the chunk is not compressed, otherwise only kept to write to disk.
+	*/
+	FString							Log;
+
+	/**
+	* The compressed sub-chunk to upload.
+	*/
+	TArray<uint8>					Payload;
+
+	/**
+	* Set when compression failed, the sub-chunk is not uploaded.
+	*/
+	bool							bFailed = false;
+};
+
+/**
+* A single Log chunk moving through FCapsaLogPipeline.
+*/
+struct FCapsaPipelineChunk
+{
+	FCapsaPipelineChunk( TArray<FBufferedLine> InBuffer, FCapsaChunkFormatOptions InFormatOptions, FCapsaDeferredLogBuffer InDeferredLines )
+		: Builder( MoveTemp( InBuffer ), MoveTemp( InFormatOptions ), MoveTemp( InDeferredLines ) )
+	{
+	}
+
+	/**
+	* Holds the lines and builds the chunk from them.
+	*/
+	FCapsaChunkBuilder				Builder;
+
+	/**
+	* The LogID of the session, used as file name when writing to disk.
+	*/
+	FString							LogID;
+
+	/**
+	* Whether the chunk is uploaded compressed. Binary chunk formats are always compressed.
+	*/
+	bool							bCompress = false;
+
+	/**
+	* Whether the plain text Log is written to disk.
+	*/
+	bool							bWriteToDiskPlain = false;
+
+	/**
+	* Whether the compressed chunk is written to disk.
+	*/
+	bool							bWriteToDiskCompressed = false;
+
+	/**
+	* Position of the chunk in the pipeline, chunks are persisted and uploaded in this order.
+	* Set by FCapsaLogPipeline::Submit().
+	*/
+	uint64							Sequence = 0;
+
+	/**
+	* The time of the first line in the chunk, in unix seconds. Set by FCapsaLogPipeline::Submit(), before the
+	* lines are released, to report how long lines take from capture to being stored.
+	*/
+	double							FirstLineTime = 0.0;
+
+	/**
+	* Whether FCapsaTrace::BeginChunk began the timing region of the chunk, so it is only ended if it was.
+	*/
+	bool							bTraced = false;
+
+	/**
+	* The parts the chunk is compressed and uploaded in, in upload order. Set by FCapsaLogPipeline::Submit().
+	*/
+	TArray<FCapsaPipelineSubChunk>	SubChunks;
+
+	/**
+	* The number of sub-chunks that have not finished uploading. Guarded by the pipeline.
+	*/
+	int32							NumSubChunksToUpload = 0;
+};
+
+/**
+* Timing of a single pipeline stage, since the pipeline was created.
+*/
+struct FCapsaPipelineStageStats
+{
+	uint64							Count = 0;
+	double							TotalSeconds = 0.0;
+	double							MaxSeconds = 0.0;
+};
+
+/**
+* Limits of FCapsaLogPipeline, see UCapsaSettings.
+*/
+struct FCapsaLogPipelineSettings
+{
+	/**
+	* How many chunks can be between Submit() and a completed upload.
+	*/
+	int32							MaxChunksInFlight = 4;
+
+	/**
+	* How many chunks can be formatted and compressed in parallel.
+	*/
+	int32							MaxParallelEncodes = 2;
+
+	/**
+	* How many uploads can be in progress at the same time.
+	*/
+	int32							MaxConcurrentUploads = 1;
+
+	/**
+	* Chunks with more lines are split into sub-chunks that are compressed in parallel. 0 never splits chunks.
+	*/
+	int32							MaxLinesPerSubChunk = 0;
+
+	/**
+	* How many threads the pipeline creates for its stages. 0 runs the stages on the shared task workers.
+	*/
+	int32							NumThreads = 0;
+
+	/**
+	* A thread pool from FCapsaLogPipeline::CreateThreadPool() to run the stages on, shared with other pipelines.
+	* When set, the pipeline does not create threads of its own and NumThreads is ignored.
+	*/
+	TSharedPtr<FQueuedThreadPool, ESPMode::ThreadSafe> ThreadPool;
+
+	/**
+	* The priority of the pipeline threads.
+	*/
+	EThreadPriority					ThreadPriority = TPri_Lowest;
+
+	/**
+	* The CPU affinity mask of the pipeline threads, 0 does not restrict them.
+	*/
+	uint64							ThreadAffinityMask = 0;
+
+	/**
+	* How much memory the pipeline keeps in buffers of finished chunks, to reuse for the next chunks.
+	*/
+	int64							MaxPooledBufferBytes = 64 * 1024 * 1024;
+
+	/**
+	* The pooled buffers are freed once no buffer was acquired for this many seconds. 0 keeps them until the
+	* platform asks to trim memory or the pipeline shuts down.
+	*/
+	float							PooledBufferIdleSeconds = 30.f;
+
+	/**
+	* Whether the upload function is called on the game thread. Uploads queued by a pipeline task are started
+	* from a game thread task then. Disable only for upload functions that are safe to call from any thread.
+	*/
+	bool							bUploadOnGameThread = true;
+};
+
+/**
+* Starts the upload of a sub-chunk of Chunk. Returns false if the upload could not be started.
+* When it returns true, FCapsaLogPipeline::OnUploadComplete() has to be called with UploadID once the upload finished.
+* The Log and Payload of the sub-chunk may be moved into the request, they are not used by the pipeline afterwards.
+* A Payload handed back with FCapsaLogPipeline::ReleasePayload() once the request is done is reused for later chunks.
+* Called on the game thread, unless bUploadOnGameThread is disabled.
+*/
+typedef TFunction<bool( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID )> FCapsaPipelineUploadFunction;
+
+/**
+* FCapsaLogPipeline moves captured Log chunks through the format, compress, persist and upload stages on UE::Tasks.
+*
+* - Format and compress run in parallel for up to MaxParallelEncodes chunks. Chunk formats with a session
+*   dictionary (Template, Columnar) are formatted in submission order, so dictionary entries are never used
+*   before the chunk that defines them.
+* - Chunks with more than MaxLinesPerSubChunk lines are split into sub-chunks. These are compressed in
+*   parallel and uploaded one after another, in order.
+* - Persist (writing to disk) runs one chunk at a time, in submission order.
+* - Upload starts chunks in submission order, with at most MaxConcurrentUploads in progress, on the game thread.
+*
+* Submit() refuses new chunks while MaxChunksInFlight chunks have not finished uploading, so a slow disk or
+* network makes the caller keep buffering instead of queueing more tasks.
+*
+* With NumThreads or ThreadPool set, the work of each stage runs on a Capsa thread pool instead of the
+* shared task workers, so log processing never occupies the threads the engine needs. Pipelines can share
+* one pool, which is destroyed with the last pipeline that uses it.
+*
+* The format, transcode and compression buffers come from a FCapsaBufferPool and are returned to it once a
+* stage no longer needs them, so steady logging does not allocate new buffers for every chunk. The pool is
+* emptied when the pipeline is idle, on memory pressure and on Shutdown().
+*/
+class CAPSACORE_API FCapsaLogPipeline : public TSharedFromThis<FCapsaLogPipeline, ESPMode::ThreadSafe>
+{
+public:
+
+	FCapsaLogPipeline( const FCapsaLogPipelineSettings& InSettings, FCapsaPipelineUploadFunction InUploadFunction );
+	~FCapsaLogPipeline();
+
+	/**
+	* Whether Submit() would currently accept a chunk.
+	*
+	* @return bool True if there is room for another chunk.
+	*/
+	bool							CanSubmit() const;
+
+	/**
+	* Queues the chunk in the pipeline.
+	*
+	* @param Chunk The chunk to process and upload.
+	* @return bool True if the chunk was accepted, false if the pipeline is full or shut down.
+	*/
+	bool							Submit( const TSharedRef<FCapsaPipelineChunk, ESPMode::ThreadSafe>& Chunk );
+
+	/**
+	* Reports a finished upload, started by the upload function. Frees room for the next upload, and for
+	* the next chunk once all sub-chunks of the chunk are uploaded.
+	*
+	* @param UploadID The UploadID passed to the upload function.
+	* @param bSuccess Whether the sub-chunk was stored by the Capsa Server.
+	*/
+	void							OnUploadComplete( uint64 UploadID, bool bSuccess );
+
+	/**
+	* Returns a payload the upload function moved into a request to the buffer pool, once the request is done with it.
+	*
+	* @param Payload The payload, its contents are discarded.
+	*/
+	void							ReleasePayload( TArray<uint8>&& Payload );
+
+	/**
+	* Waits for the chunks that are being formatted, compressed and persisted, and starts the uploads of every chunk
+	* still waiting for one. Only chunks whose upload cannot be started are dropped. No new chunks are accepted. Releases the thread pool, which is destroyed
+	* once no other pipeline shares it, call before releasing the pipeline.
+	*/
+	void							Shutdown();
+
+	/**
+	* Returns the number of chunks between Submit() and a completed upload.
+	*
+	* @return int32 The number of chunks in flight.
+	*/
+	int32							GetNumChunksInFlight() const;
+
+	/**
+	* Returns the number of chunks refused by Submit() because the pipeline was full.
+	*
+	* @return uint64 The number of refused chunks.
+	*/
+	uint64							GetNumRejected() const;
+
+	/**
+	* Returns the number of sub-chunks that failed to compress or upload.
+	*
+	* @return uint64 The number of failed sub-chunks.
+	*/
+	uint64							GetNumFailed() const;
+
+	/**
+	* Returns the timing of the given stage.
+	*
+	* @param Stage The stage to return the timing of.
+	* @return FCapsaPipelineStageStats The stage timing.
+	*/
+	FCapsaPipelineStageStats		GetStageStats( ECapsaPipelineStage Stage ) const;
+
+	/**
+	* Returns the pool the pipeline takes its buffers from.
+	*
+	* @return const FCapsaBufferPool& The buffer pool.
+	*/
+	const FCapsaBufferPool&			GetBufferPool() const;
+
+	/**
+	* Writes the state and per-stage timing of the pipeline to the log.
+	*/
+	void							LogStats() const;
+
+	/**
+	* Returns the display name of the given stage.
+	*
+	* @param Stage The stage.
+	* @return const TCHAR* The stage name.
+	*/
+	static const TCHAR*				GetStageName( ECapsaPipelineStage Stage );
+
+	/**
+	* Creates a thread pool with the NumThreads and ThreadPriority of the settings, to share between pipelines.
+	*
+	* @param InSettings The settings of the pipelines that will use the pool.
+	* @return TSharedPtr<FQueuedThreadPool> The pool, invalid if NumThreads is 0 or the threads could not be created.
+	*/
+	static TSharedPtr<FQueuedThreadPool, ESPMode::ThreadSafe> CreateThreadPool( const FCapsaLogPipelineSettings& InSettings );
+
+private:
+
+	typedef TSharedRef<FCapsaPipelineChunk, ESPMode::ThreadSafe> FChunkRef;
+
+	/**
+	* Launches Work once the Prerequisites completed, on the thread pool if there is one.
+	*
+	* @return UE::Tasks::FTask Completes when Work has run.
+	*/
+	UE::Tasks::FTask				LaunchStage( const TCHAR* DebugName, TUniqueFunction<void()>&& Work, TConstArrayView<UE::Tasks::FTask> Prerequisites );
+
+	/**
+	* Formats every sub-chunk of the chunk, one after another. Used for chunks that update a session dictionary.
+	*/
+	void							RunFormatStage( FCapsaPipelineChunk& Chunk );
+
+	/**
+	* Formats a single sub-chunk, after PrepareSubChunks. Sub-chunks of chunks without a session dictionary
+	* only read the lines of the chunk, so they are formatted in parallel.
+	*/
+	void							RunFormatSubChunkStage( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex );
+
+	/**
+	* Formats the deferred lines of the chunk and sets the line range of every sub-chunk.
+	*/
+	void							PrepareSubChunks( FCapsaPipelineChunk& Chunk );
+	void							FormatSubChunk( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, FString& Scratch );
+
+	void							RunCompressStage( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex );
+	void							RunPersistStage( FCapsaPipelineChunk& Chunk );
+
+	/**
+	* Queues the sub-chunks of the persisted chunk for upload and starts as many uploads as allowed.
+	*/
+	void							EnqueueUpload( const FChunkRef& Chunk );
+	void							StartUploads();
+
+	/**
+	* Hands a sub-chunk to the upload function. Completes the upload as failed if it could not be started.
+	*
+	* @return bool True if the upload was started.
+	*/
+	bool							StartUpload( uint64 UploadID, const FChunkRef& Chunk, int32 SubChunkIndex );
+
+	/**
+	* Marks the chunk as done, freeing room for a new one.
+	*/
+	void							FinishChunk( const FCapsaPipelineChunk& Chunk );
+
+	void							RecordStage( ECapsaPipelineStage Stage, uint64 StartCycles );
+
+	/**
+	* Ticker callback that frees the pooled buffers once none was acquired for PooledBufferIdleSeconds.
+	*/
+	bool							TrimIdleBuffers( float DeltaTime );
+
+	/**
+	* Frees the pooled buffers when the platform is low on memory.
+	*/
+	void							OnMemoryTrim();
+
+	/**
+	* Removes the ticker and delegate registered to trim the buffer pool.
+	*/
+	void							UnregisterBufferTrim();
+
+	struct FStageCounters
+	{
+		std::atomic<uint64>			Count{ 0 };
+		std::atomic<uint64>			TotalCycles{ 0 };
+		std::atomic<uint64>			MaxCycles{ 0 };
+	};
+
+	struct FPendingUpload
+	{
+		FChunkRef					Chunk;
+		int32						SubChunkIndex;
+	};
+
+	struct FActiveUpload
+	{
+		FChunkRef					Chunk;
+		int32						SubChunkIndex;
+		uint64						StartCycles;
+	};
+
+	const FCapsaLogPipelineSettings	Settings;
+	FCapsaPipelineUploadFunction	UploadFunction;
+	FCapsaBufferPool				BufferPool;
+	TSharedPtr<FQueuedThreadPool, ESPMode::ThreadSafe> ThreadPool;
+
+	FTSTicker::FDelegateHandle		TrimTickerHandle;
+	FDelegateHandle					MemoryTrimHandle;
+
+	/**
+	* The acquired buffer count seen by the previous TrimIdleBuffers(), used to detect an idle pool.
+	*/
+	uint64							LastNumAcquired;
+
+	/**
+	* Guards the task chain below, Submit() can be called from any thread.
+	*/
+	FCriticalSection				SubmitCriticalSection;
+	uint64							NextSequence;
+	UE::Tasks::FTask				LastFormatTask;
+	UE::Tasks::FTask				LastPersistTask;
+
+	/**
+	* The encode (format and compress) tasks of the last MaxParallelEncodes chunks. A chunk only starts
+	* formatting after the chunk MaxParallelEncodes positions before it finished compressing.
+	*/
+	TArray<UE::Tasks::FTask>		EncodeTasks;
+
+	mutable FCriticalSection		UploadCriticalSection;
+	TArray<FPendingUpload>			PendingUploads;
+	TMap<uint64, FActiveUpload>		ActiveUploads;
+	uint64							NextUploadID;
+
+	std::atomic<int32>				NumChunksInFlight;
+	std::atomic<uint64>				NumRejected;
+	std::atomic<uint64>				NumFailed;
+	std::atomic<bool>				bShutdown;
+	FStageCounters					StageCounters[static_cast<int32>( ECapsaPipelineStage::Num )];
+};
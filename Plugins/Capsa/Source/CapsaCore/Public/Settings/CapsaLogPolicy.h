@@ -0,0 +1,91 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Settings/CapsaSettings.h"
+
+
+class FCapsaJsonReader;
+
+/**
+* FCapsaLogPolicy is the logging configuration the Capsa Server can push in the "policy" member of the
+* authentication and metadata responses. Every member is optional, unset members keep the Capsa Settings.
+*
+* {
+*   "revision": "raise-lognet",
+*   "verbosity": "Log",
+*   "maxTimeBetweenFlushes": 30,
+*   "maxLinesBetweenFlushes": 500,
+*   "pollInterval": 60,
+*   "defaultLimit": { "sampleRate": 0.5 },
+*   "categories": { "LogNet": { "verbosity": "VeryVerbose", "sampleRate": 1, "linesPerSecond": 100, "burstLines": 200 } }
+* }
+*/
+struct CAPSACORE_API FCapsaLogPolicy
+{
+	/**
+	* The overrides for a single Log Category, or for every category in case of DefaultLimit.
+	*/
+	struct FCategory
+	{
+		/**
+		* Sets the verbosity of the Log Category itself, so this can also raise verbosity.
+		*/
+		TOptional<ELogVerbosity::Type>	Verbosity;
+		TOptional<float>				SampleRate;
+		TOptional<float>				LinesPerSecond;
+		TOptional<int32>				BurstLines;
+
+		/**
+		* Whether any of the rate limit members are set.
+		*
+		* @return bool True if ApplyRateLimit changes a limit.
+		*/
+		bool							HasRateLimit() const;
+
+		/**
+		* Overrides the members of Limit that are set in this policy.
+		*
+		* @param Limit The configured limit to override.
+		*/
+		void							ApplyRateLimit( FCapsaCategoryRateLimit& Limit ) const;
+
+		bool							operator==( const FCategory& Other ) const;
+	};
+
+	/**
+	* Identifies the policy in the log, for example the name of the investigation. Optional.
+	*/
+	FString								Revision;
+
+	/**
+	* Lines more verbose than this are not captured by Capsa.
+	*/
+	TOptional<ELogVerbosity::Type>		Verbosity;
+	TOptional<float>					MaxTimeBetweenLogFlushes;
+	TOptional<int32>					MaxLogLinesBetweenLogFlushes;
+
+	/**
+	* How often (in seconds) to poll for a new policy, overriding LogPolicyPollInterval. 0 stops polling.
+	*/
+	TOptional<float>					PollInterval;
+
+	FCategory							DefaultLimit;
+	TMap<FName, FCategory>				Categories;
+
+	/**
+	* Reads a policy object.
+	*
+	* @param Reader The reader, positioned at the policy object.
+	* @param OutPolicy Receives the policy.
+	* @return bool True if the policy was valid JSON. Unknown members and verbosities are skipped.
+	*/
+	static bool							Read( FCapsaJsonReader& Reader, FCapsaLogPolicy& OutPolicy );
+
+	bool								operator==( const FCapsaLogPolicy& Other ) const;
+	bool								operator!=( const FCapsaLogPolicy& Other ) const
+	{
+		return ( *this == Other ) == false;
+	}
+};
@@ -3,10 +3,104 @@
 #pragma once
 
 #include "Engine/DeveloperSettings.h"
+#include "GenericPlatform/GenericPlatformAffinity.h"
 
 #include "CapsaSettings.generated.h"
 
 
+/**
+* Blueprint and config friendly mirror of ELogVerbosity::Type, the values match.
+*/
+UENUM()
+enum class ECapsaLogVerbosity : uint8
+{
+	Fatal = 1,
+	Error = 2,
+	Warning = 3,
+	Display = 4,
+	Log = 5,
+	Verbose = 6,
+	VeryVerbose = 7,
+};
+
+/**
+* The encoding used for the log chunks that are uploaded to the Capsa Server.
+*/
+UENUM()
+enum class ECapsaChunkFormat : uint8
+{
+	/** One "[Timestamp][LogVerbosity][LogCategory]: LogData" text line per log line. */
+	PlainText,
+	/** Log lines are mapped to message templates, chunks contain template IDs and params. See FCapsaTemplateMiner. */
+	Template,
+	/** Binary chunks with a column per field and a session-scoped category dictionary. Always compressed. See FCapsaColumnarEncoder. */
+	Columnar,
+};
+
+/**
+* Config friendly subset of EThreadPriority, for the threads Capsa creates.
+*/
+UENUM()
+enum class ECapsaThreadPriority : uint8
+{
+	Lowest,
+	BelowNormal,
+	SlightlyBelowNormal,
+	Normal,
+};
+
+/**
+* FCapsaCategoryRateLimit describes how many lines of a single Log Category may be captured.
+* Lines are first sampled, and the lines that survive sampling are then passed through a token bucket.
+*/
+USTRUCT()
+struct CAPSACORE_API FCapsaCategoryRateLimit
+{
+	GENERATED_BODY()
+
+public:
+
+	FCapsaCategoryRateLimit()
+		: LinesPerSecond( 0.f )
+		, BurstLines( 0 )
+		, SampleRate( 1.f ) {};
+
+	/**
+	* How many lines per second are refilled into the token bucket. 0 disables rate limiting.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|RateLimiting", meta = ( ClampMin = "0" ) )
+	float							LinesPerSecond;
+
+	/**
+	* How many lines can be captured in a single burst before the rate limit applies.
+	* Values below 1 are treated as 1.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|RateLimiting", meta = ( ClampMin = "0" ) )
+	int32							BurstLines;
+
+	/**
+	* The fraction of lines to keep, between 0 (drop everything) and 1 (keep everything).
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|RateLimiting", meta = ( ClampMin = "0", ClampMax = "1" ) )
+	float							SampleRate;
+
+	/**
+	* Returns whether this limit would ever suppress a line.
+	*
+	* @return bool True if either rate limiting or sampling is active.
+	*/
+	bool							IsLimited() const
+	{
+		return LinesPerSecond > 0.f || SampleRate < 1.f;
+	}
+
+	bool							operator==( const FCapsaCategoryRateLimit& Other ) const
+	{
+		return LinesPerSecond == Other.LinesPerSecond && BurstLines == Other.BurstLines && SampleRate == Other.SampleRate;
+	}
+};
+
+
 UCLASS( Config = Engine, defaultconfig, meta = ( DisplayName = "Capsa Settings" ) )
 class CAPSACORE_API UCapsaSettings : public UDeveloperSettings
 {
@@ -16,6 +110,12 @@ public:
 
 	UCapsaSettings();
 
+	// Begin UObject
+#if WITH_EDITOR
+	virtual void					PostEditChangeProperty( FPropertyChangedEvent& PropertyChangedEvent ) override;
+#endif
+	// End UObject
+
 #pragma region CORE_FUNCTIONS
 	/**
 	* Get the Protocol used to send Capsa requests.
@@ -95,6 +195,34 @@ public:
 	*/
 	bool							GetUseCompression() const;
 
+	/**
+	* Get the encoding to use for uploaded log chunks.
+	*
+	* @return ECapsaChunkFormat The chunk format.
+	*/
+	ECapsaChunkFormat				GetChunkFormat() const;
+
+	/**
+	* Get the fraction of tokens that must match for a line to be mapped to an existing template.
+	*
+	* @return float The template similarity threshold.
+	*/
+	float							GetTemplateSimilarityThreshold() const;
+
+	/**
+	* Get whether lines logged with CAPSA_LOG or UE_LOGFMT are formatted in the background instead of on the calling thread.
+	*
+	* @return bool Use deferred formatting (true) or not (false).
+	*/
+	bool							GetUseDeferredFormatting() const;
+
+	/**
+	* Get whether lines logged with CAPSA_LOG are only sent to Capsa when deferred formatting is used.
+	*
+	* @return bool Skip the local log for CAPSA_LOG lines (true) or not (false).
+	*/
+	bool							GetCapsaLogSkipsLocalLog() const;
+
 	/**
 	* Get whether write plain text Log to disk.
 	*
@@ -110,6 +238,204 @@ public:
 	*/
 	UFUNCTION( BlueprintPure, Category = "Capsa|Log" )
 	bool							GetWriteToDiskCompressed() const;
+
+	/**
+	* Get the rate limits and sampling rates for specific Log Categories.
+	*
+	* @return TMap<FName, FCapsaCategoryRateLimit> The per-category rate limits.
+	*/
+	const TMap<FName, FCapsaCategoryRateLimit>& GetCategoryRateLimits() const;
+
+	/**
+	* Get the rate limit applied to every Log Category not present in CategoryRateLimits.
+	*
+	* @return FCapsaCategoryRateLimit The default rate limit.
+	*/
+	const FCapsaCategoryRateLimit&	GetDefaultCategoryRateLimit() const;
+
+	/**
+	* Get whether the Flight Recorder is enabled.
+	*
+	* @return bool Use the Flight Recorder (true) or upload every line (false).
+	*/
+	bool							GetUseFlightRecorder() const;
+
+	/**
+	* Get the most verbose level that is uploaded directly when the Flight Recorder is enabled.
+	* Lines more verbose than this are only kept in memory.
+	*
+	* @return ELogVerbosity::Type The Flight Recorder threshold verbosity.
+	*/
+	ELogVerbosity::Type				GetFlightRecorderVerbosity() const;
+
+	/**
+	* Get the number of lines kept in memory by the Flight Recorder.
+	*
+	* @return int32 The Flight Recorder capacity, in lines.
+	*/
+	int32							GetFlightRecorderCapacity() const;
+
+	/**
+	* Get how many seconds of recorded lines before a trigger are uploaded.
+	*
+	* @return float The window before a trigger (in seconds).
+	*/
+	float							GetFlightRecorderSecondsBefore() const;
+
+	/**
+	* Get for how many seconds after a trigger all lines are uploaded directly.
+	*
+	* @return float The window after a trigger (in seconds).
+	*/
+	float							GetFlightRecorderSecondsAfter() const;
+
+	/**
+	* Get whether capture is throttled when Capsa uses more game thread time than FrameBudgetMilliseconds.
+	*
+	* @return bool Use the frame budget (true) or never throttle (false).
+	*/
+	bool							GetUseFrameBudget() const;
+
+	/**
+	* Get the game thread time per frame Capsa may use, averaged over a second.
+	*
+	* @return float The frame budget (in milliseconds).
+	*/
+	float							GetFrameBudgetMilliseconds() const;
+
+	/**
+	* Get the most verbose level that is still captured while throttled.
+	*
+	* @return ELogVerbosity::Type The throttle verbosity.
+	*/
+	ELogVerbosity::Type				GetFrameBudgetThrottleVerbosity() const;
+
+	/**
+	* Get the rate at which lines below Warning are sampled when throttling the filter level was not enough.
+	*
+	* @return int32 One of this many lines is captured.
+	*/
+	int32							GetFrameBudgetSampleRate() const;
+
+	/**
+	* Get how long the cost has to stay under half the budget before the throttle is lowered a step.
+	*
+	* @return float The recovery time (in seconds).
+	*/
+	float							GetFrameBudgetRecoverySeconds() const;
+
+	/**
+	* Get how often the categories that produced the most bytes are sent as metadata. 0 never sends them.
+	*
+	* @return float The top talkers interval (in seconds).
+	*/
+	float							GetTopTalkersMetadataInterval() const;
+
+	/**
+	* Get how many categories are sent as top talkers metadata.
+	*
+	* @return int32 The number of top talkers.
+	*/
+	int32							GetNumTopTalkers() const;
+
+	/**
+	* Get whether the log policy sent by the Capsa Server is applied.
+	*
+	* @return bool True if the log policy is applied.
+	*/
+	bool							GetApplyServerLogPolicy() const;
+
+	/**
+	* Get how often the log policy is polled from the Capsa Server. 0 only reads it from the authentication response.
+	*
+	* @return float The poll interval (in seconds).
+	*/
+	float							GetLogPolicyPollInterval() const;
+
+	/**
+	* Get how long linked logs are collected before they are sent to the Capsa Server together.
+	*
+	* @return float The batch window (in seconds).
+	*/
+	float							GetLinkedLogBatchSeconds() const;
+
+	/**
+	* Get how many different logs can be linked with a single log session.
+	*
+	* @return int32 The maximum number of linked logs, at least 1.
+	*/
+	int32							GetMaxLinkedLogsPerSession() const;
+
+	/**
+	* Get whether every game World logs to a log session of its own.
+	*
+	* @return bool True if the Worlds have their own log session.
+	*/
+	bool							GetUseWorldLogSessions() const;
+
+	/**
+	* Get the maximum number of log chunks between capture and a completed upload.
+	*
+	* @return int32 The maximum number of chunks in flight.
+	*/
+	int32							GetMaxChunksInFlight() const;
+
+	/**
+	* Get the maximum number of lines the Log Device buffers while the Log Pipeline is full.
+	*
+	* @return int32 The maximum number of buffered lines.
+	*/
+	int32							GetMaxBufferedLogLines() const;
+
+	/**
+	* Get the maximum number of log chunks that are formatted and compressed in parallel.
+	*
+	* @return int32 The maximum number of parallel chunk encodes.
+	*/
+	int32							GetMaxParallelChunkEncodes() const;
+
+	/**
+	* Get the maximum number of log chunk uploads that can be in progress at the same time.
+	*
+	* @return int32 The maximum number of concurrent uploads.
+	*/
+	int32							GetMaxConcurrentUploads() const;
+
+	/**
+	* Get the maximum number of lines in a compressed sub-chunk. 0 never splits log chunks.
+	*
+	* @return int32 The maximum number of lines per sub-chunk.
+	*/
+	int32							GetMaxLinesPerSubChunk() const;
+
+	/**
+	* Get the maximum memory the log pipeline keeps in buffers of finished chunks.
+	*
+	* @return int64 The maximum pooled buffer memory in bytes.
+	*/
+	int64							GetMaxPooledBufferBytes() const;
+
+	/**
+	* Get the number of threads in the Capsa thread pool. 0 runs the pipeline on the shared task workers.
+	* With PipelineThreadCount below 0, one thread per parallel chunk encode.
+	*
+	* @return int32 The number of pipeline threads.
+	*/
+	int32							GetPipelineThreadCount() const;
+
+	/**
+	* Get the priority of the threads in the Capsa thread pool.
+	*
+	* @return EThreadPriority The pipeline thread priority.
+	*/
+	EThreadPriority					GetPipelineThreadPriority() const;
+
+	/**
+	* Get the CPU affinity mask of the threads in the Capsa thread pool. 0 does not restrict the threads.
+	*
+	* @return uint64 The pipeline thread affinity mask.
+	*/
+	uint64							GetPipelineThreadAffinityMask() const;
 #pragma endregion LOG_FUNCTIONS
 
 #pragma region COMPONENT_FUNCTIONS
@@ -192,6 +518,35 @@ protected:
 	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log" )
 	bool							bUseCompression;
 
+	/**
+	* The encoding to use for uploaded log chunks. The Capsa Server needs to support the chosen format.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log" )
+	ECapsaChunkFormat				ChunkFormat;
+
+	/**
+	* The fraction of tokens that must match for a line to be mapped to an existing template.
+	* Lower values produce fewer, more generic templates.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log", meta = ( ClampMin = "0", ClampMax = "1", EditCondition = "ChunkFormat == ECapsaChunkFormat::Template" ) )
+	float							TemplateSimilarityThreshold;
+
+	/**
+	* Whether lines logged with CAPSA_LOG or UE_LOGFMT should only have their arguments captured on the calling thread,
+	* and be formatted by the background task that builds the log chunk.
+	* CAPSA_LOG lines are only deferred if bCapsaLogSkipsLocalLog is enabled as well.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log" )
+	bool							bUseDeferredFormatting;
+
+	/**
+	* Whether lines logged with CAPSA_LOG should be deferred, with bUseDeferredFormatting. Deferred CAPSA_LOG lines
+	* are only sent to Capsa, not to the console, the log file or any other Output Device.
+	* When disabled, CAPSA_LOG lines are formatted on the calling thread like UE_LOG lines.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log", meta = ( EditCondition = "bUseDeferredFormatting" ) )
+	bool							bCapsaLogSkipsLocalLog;
+
 	/**
 	* Whether we should write the plain text Log to disk.
 	*/
@@ -204,6 +559,197 @@ protected:
 	*/
 	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log" )
 	bool							bWriteToDiskCompressed;
+
+	/**
+	* Rate limits and sampling rates for specific Log Categories.
+	* The number of suppressed lines per category is reported in the uploaded log.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|RateLimiting" )
+	TMap<FName, FCapsaCategoryRateLimit>	CategoryRateLimits;
+
+	/**
+	* The rate limit applied to every Log Category that has no entry in CategoryRateLimits.
+	* Each category gets its own token bucket, so one noisy category cannot use up the budget of another.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|RateLimiting" )
+	FCapsaCategoryRateLimit			DefaultCategoryRateLimit;
+
+	/**
+	* Whether lines more verbose than FlightRecorderVerbosity should only be kept in memory, and only
+	* uploaded in a time window around an Error/Fatal line or an explicit trigger (Capsa.FlightRecorder.Trigger).
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FlightRecorder" )
+	bool							bUseFlightRecorder;
+
+	/**
+	* The most verbose level that is always uploaded when the Flight Recorder is enabled.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FlightRecorder", meta = ( EditCondition = "bUseFlightRecorder" ) )
+	ECapsaLogVerbosity				FlightRecorderVerbosity;
+
+	/**
+	* How many lines the Flight Recorder keeps in memory. When full, the oldest lines are discarded.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FlightRecorder", meta = ( EditCondition = "bUseFlightRecorder", ClampMin = "1" ) )
+	int32							FlightRecorderCapacity;
+
+	/**
+	* How many seconds of recorded lines before a trigger are uploaded.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FlightRecorder", meta = ( EditCondition = "bUseFlightRecorder", Units = "Seconds" ) )
+	float							FlightRecorderSecondsBefore;
+
+	/**
+	* For how many seconds after a trigger all lines are uploaded directly.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FlightRecorder", meta = ( EditCondition = "bUseFlightRecorder", Units = "Seconds" ) )
+	float							FlightRecorderSecondsAfter;
+
+	/**
+	* Whether capture should be throttled when Capsa uses more game thread time than FrameBudgetMilliseconds,
+	* averaged over a second. The filter level is raised first, then lines below Warning are sampled.
+	* Every throttle change is reported in the uploaded log. Disabled by default.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FrameBudget" )
+	bool							bUseFrameBudget;
+
+	/**
+	* The game thread time per frame Capsa may use for capturing lines, flushing them and handling responses.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FrameBudget", meta = ( EditCondition = "bUseFrameBudget", ClampMin = "0", Units = "Milliseconds" ) )
+	float							FrameBudgetMilliseconds;
+
+	/**
+	* The most verbose level that is still captured while throttled.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FrameBudget", meta = ( EditCondition = "bUseFrameBudget" ) )
+	ECapsaLogVerbosity				FrameBudgetThrottleVerbosity;
+
+	/**
+	* When raising the filter level is not enough, only one of this many lines below Warning is captured.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FrameBudget", meta = ( EditCondition = "bUseFrameBudget", ClampMin = "1" ) )
+	int32							FrameBudgetSampleRate;
+
+	/**
+	* How long the cost has to stay under half the budget before the throttle is lowered a step.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|FrameBudget", meta = ( EditCondition = "bUseFrameBudget", Units = "Seconds" ) )
+	float							FrameBudgetRecoverySeconds;
+
+	/**
+	* How often the Log Categories that produced the most bytes since startup are sent to the Capsa Server as
+	* metadata ("topTalkers"), on the first flush after the interval. 0 never sends them. Capsa.TopTalkers logs
+	* the same counts on demand.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|TopTalkers", meta = ( ClampMin = "0", Units = "Seconds" ) )
+	float							TopTalkersMetadataInterval;
+
+	/**
+	* How many Log Categories are sent as top talkers metadata.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|TopTalkers", meta = ( ClampMin = "1" ) )
+	int32							NumTopTalkers;
+
+	/**
+	* Whether to apply the log policy the Capsa Server can send with the authentication and metadata responses.
+	* The policy overrides per-category verbosity, sampling and rate limits and the flush intervals at runtime.
+	* The Capsa.Log.* console variables still take precedence.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Policy" )
+	bool							bApplyServerLogPolicy;
+
+	/**
+	* How often to poll the Capsa Server for a new log policy, with an empty metadata request.
+	* 0 only reads the policy from the authentication response and the metadata sent by the game.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Policy", meta = ( EditCondition = "bApplyServerLogPolicy", ClampMin = "0", Units = "Seconds" ) )
+	float							LogPolicyPollInterval;
+
+	/**
+	* How long linked logs are collected before they are sent to the Capsa Server in a single metadata request.
+	* A server links the log of every client that joins, so a join wave becomes one request instead of one per
+	* player. 0 sends every new linked log right away.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|LinkedLogs", meta = ( ClampMin = "0", Units = "Seconds" ) )
+	float							LinkedLogBatchSeconds;
+
+	/**
+	* How many different logs can be linked with a single log session. Clients link their log with an unvalidated RPC,
+	* and a client that reconnects gets a new Capsa Component, so the session bounds the links it sends and remembers.
+	* Further links are ignored.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|LinkedLogs", meta = ( ClampMin = "1" ) )
+	int32							MaxLinkedLogsPerSession;
+
+	/**
+	* Whether every game and PIE World logs to a log session of its own, linked with the log of the process.
+	* Lines logged on the game thread while a World ticks go to its session, all other lines to the log of
+	* the process. For processes that host several Worlds, such as multi-instance PIE or multi-match servers.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Sessions" )
+	bool							bUseWorldLogSessions;
+
+	/**
+	* How many log chunks can be between capture and a completed upload. When reached, the Log Device keeps
+	* buffering lines until a chunk has been uploaded, instead of queueing more work.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( ClampMin = "1" ) )
+	int32							MaxChunksInFlight;
+
+	/**
+	* How many lines the Log Device keeps buffered while the Log Pipeline is full. Beyond this, the oldest
+	* lines are dropped, so a stalled upload does not grow the buffer without limit.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( ClampMin = "1" ) )
+	int32							MaxBufferedLogLines;
+
+	/**
+	* How many log chunks can be formatted and compressed in parallel.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( ClampMin = "1" ) )
+	int32							MaxParallelChunkEncodes;
+
+	/**
+	* How many log chunk uploads can be in progress at the same time. With more than one, the Capsa Server
+	* may receive chunks out of order.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( ClampMin = "1" ) )
+	int32							MaxConcurrentUploads;
+
+	/**
+	* Log chunks with more lines are split into sub-chunks of at most this many lines, which are compressed
+	* in parallel and uploaded in order. 0 never splits log chunks.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( ClampMin = "0" ) )
+	int32							MaxLinesPerSubChunk;
+
+	/**
+	* How many megabytes of format and compression buffers the log pipeline keeps to reuse for the next chunks.
+	* 0 frees every buffer once a stage is done with it.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( ClampMin = "0" ) )
+	int32							MaxPooledBufferMegabytes;
+
+	/**
+	* How many threads Capsa creates for formatting, compressing and writing log chunks, so this work does not
+	* compete with the engine's task workers. -1 creates one thread per MaxParallelChunkEncodes, so every parallel
+	* encode has a thread. 0 runs the pipeline on the shared task workers instead.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( ClampMin = "-1" ) )
+	int32							PipelineThreadCount;
+
+	/**
+	* The priority of the Capsa pipeline threads.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( EditCondition = "PipelineThreadCount != 0" ) )
+	ECapsaThreadPriority			PipelineThreadPriority;
+
+	/**
+	* The CPU affinity mask of the Capsa pipeline threads, one bit per core. 0 lets them run on any core.
+	*/
+	UPROPERTY( config, EditAnywhere, Category = "Capsa|Log|Pipeline", meta = ( EditCondition = "PipelineThreadCount != 0" ) )
+	int64							PipelineThreadAffinityMask;
 #pragma endregion LOG_PROPERTIES
 
 #pragma region COMPONENT_PROPERTIES
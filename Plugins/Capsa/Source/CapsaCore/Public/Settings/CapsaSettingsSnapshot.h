@@ -0,0 +1,85 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Settings/CapsaSettings.h"
+#include "Templates/SubclassOf.h"
+
+
+struct FCapsaLogPolicy;
+
+/**
+* FCapsaSettingsSnapshot is an immutable copy of the UCapsaSettings Capsa reads at runtime, with the endpoint URLs
+* precomputed, the log policy pushed by the Capsa Server applied on top of the config, and the Capsa.Log.* console
+* variables applied on top of that.
+*
+* The current snapshot is swapped atomically whenever a Capsa.Log.* console variable, the policy or the settings change, so
+* it can be read from any thread: keep the returned reference for as long as consistent values are needed.
+*
+* Console variables, negative or empty values use the config:
+*   Capsa.Log.TickRate                  LogTickRate
+*   Capsa.Log.MaxTimeBetweenFlushes     MaxTimeBetweenLogFlushes
+*   Capsa.Log.MaxLinesBetweenFlushes    MaxLogLinesBetweenLogFlushes
+*   Capsa.Log.UseCompression            bUseCompression (0 or 1)
+*   Capsa.Log.ChunkFormat               ChunkFormat (PlainText, Template or Columnar)
+*   Capsa.Log.Verbosity                 Lines more verbose than this are not captured (for example Log)
+*/
+struct CAPSACORE_API FCapsaSettingsSnapshot
+{
+	typedef TSharedRef<const FCapsaSettingsSnapshot, ESPMode::ThreadSafe> FRef;
+
+	/**
+	* Returns the current snapshot. Can be called from any thread.
+	*
+	* @return FRef The current snapshot.
+	*/
+	static FRef						Get();
+
+	/**
+	* Builds a new snapshot from UCapsaSettings and the console variables and makes it current.
+	* Called automatically, call on the game thread after changing UCapsaSettings from code.
+	*/
+	static void						Update();
+
+	/**
+	* Replaces the log policy pushed by the Capsa Server and updates the snapshot.
+	*
+	* @param Policy The policy to apply on top of UCapsaSettings.
+	*/
+	static void						SetLogPolicy( const FCapsaLogPolicy& Policy );
+
+	/**
+	* Incremented by every Update, to detect changes without comparing every value.
+	*/
+	uint32							Revision = 0;
+
+	FString							EnvironmentKey;
+	bool							bHasServerURL = false;
+	FString							ClientAuthURL;
+	FString							ClientLogChunkURL;
+	FString							ClientLogMetadataURL;
+
+	float							LogTickRate = 1.f;
+	float							MaxTimeBetweenLogFlushes = 300.f;
+	int32							MaxLogLinesBetweenLogFlushes = 1000;
+	ELogVerbosity::Type				Verbosity = ELogVerbosity::All;
+	TMap<FName, FCapsaCategoryRateLimit> CategoryRateLimits;
+	FCapsaCategoryRateLimit			DefaultCategoryRateLimit;
+
+	/**
+	* The Revision of the log policy applied, empty if there is none.
+	*/
+	FString							PolicyRevision;
+
+	bool							bUseCompression = true;
+	ECapsaChunkFormat				ChunkFormat;
+	float							TemplateSimilarityThreshold = 0.5f;
+	bool							bWriteToDiskPlain = true;
+	bool							bWriteToDiskCompressed = false;
+
+	bool							bAutoAddCapsaComponent = true;
+	TSubclassOf<AActor>				AutoAddClass;
+
+	FCapsaSettingsSnapshot();
+};
@@ -0,0 +1,139 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+
+/**
+* How far Capsa currently reduces what it captures to stay within its game thread budget.
+*/
+enum class ECapsaThrottleLevel : uint8
+{
+	/** Every line is captured. */
+	None,
+	/** Lines more verbose than the throttle verbosity are not captured. */
+	Filter,
+	/** As Filter, and only one of every SampleRate lines below Warning is captured. */
+	Sample,
+};
+
+/**
+* FCapsaFrameBudget measures the game thread time spent inside Capsa every frame, and throttles capture when
+* the average over a window exceeds the budget: first by raising the filter level, then by sampling.
+* The throttle is lowered again, one step at a time, once the cost stayed under half the budget for
+* RecoverySeconds. Every change is logged as a Warning, which is never throttled, so it shows up in the uploaded log.
+*
+* Game thread work is measured with FCapsaFrameBudget::FScope, scopes on other threads cost nothing.
+*/
+class CAPSACORE_API FCapsaFrameBudget
+{
+public:
+
+	/**
+	* Adds the time until it goes out of scope to the cost of the current frame, when constructed on the game thread.
+	* Nested scopes are only counted once.
+	*/
+	struct FScope
+	{
+		FScope();
+		~FScope();
+
+	private:
+
+		bool						bGameThread;
+		uint64						StartCycles;
+	};
+
+	static FCapsaFrameBudget&		Get();
+
+	/**
+	* Applies the settings and starts measuring frames. Call on the game thread.
+	*
+	* @param BudgetMilliseconds The game thread time per frame Capsa may use, averaged over a second.
+	* @param InThrottleVerbosity The most verbose level still captured while throttled.
+	* @param InSampleRate One of this many lines below Warning is captured at ECapsaThrottleLevel::Sample.
+	* @param InRecoverySeconds How long the cost has to stay under half the budget to lower the throttle one step.
+	*/
+	void							Start( float BudgetMilliseconds, ELogVerbosity::Type InThrottleVerbosity, int32 InSampleRate, float InRecoverySeconds );
+
+	/**
+	* Stops measuring frames and removes the throttle.
+	*/
+	void							Stop();
+
+	/**
+	* Applies the current throttle to a line that is about to be captured. Can be called from any thread.
+	*
+	* @param Verbosity The verbosity of the line.
+	* @return bool True if the line should be captured.
+	*/
+	FORCEINLINE bool				ShouldCapture( ELogVerbosity::Type Verbosity )
+	{
+		const ECapsaThrottleLevel Level = ThrottleLevel.load( std::memory_order_relaxed );
+		if( Level == ECapsaThrottleLevel::None || Verbosity <= ELogVerbosity::Warning )
+		{
+			return true;
+		}
+
+		return ShouldCaptureThrottled( Level, Verbosity );
+	}
+
+	ECapsaThrottleLevel				GetThrottleLevel() const;
+
+	/**
+	* Returns the average game thread cost of the last window.
+	*
+	* @return double Milliseconds per frame.
+	*/
+	double							GetMillisecondsPerFrame() const;
+
+	/**
+	* The length of the window the cost per frame is averaged over.
+	*/
+	static constexpr double			WindowSeconds = 1.0;
+
+private:
+
+	FCapsaFrameBudget();
+
+	bool							ShouldCaptureThrottled( ECapsaThrottleLevel Level, ELogVerbosity::Type Verbosity );
+
+	void							OnEndFrame();
+
+	/**
+	* Raises or lowers the throttle based on the cost of the last window.
+	*/
+	void							UpdateThrottle( double Now, double MillisecondsPerFrame );
+
+	void							SetThrottleLevel( ECapsaThrottleLevel Level, double MillisecondsPerFrame );
+
+	static const TCHAR*				GetThrottleLevelName( ECapsaThrottleLevel Level );
+
+	FDelegateHandle					OnEndFrameHandle;
+
+	std::atomic<ECapsaThrottleLevel> ThrottleLevel;
+	std::atomic<uint32>				SampleCounter;
+	std::atomic<uint64>				NumThrottledLines;
+
+	/**
+	* Set by Start, read from any thread while throttled.
+	*/
+	ELogVerbosity::Type				ThrottleVerbosity;
+	int32							SampleRate;
+
+	/**
+	* Only used on the game thread.
+	*/
+	double							BudgetMilliseconds;
+	double							RecoverySeconds;
+	int32							ScopeDepth;
+	uint64							FrameCycles;
+	uint64							WindowCycles;
+	int32							WindowFrames;
+	double							WindowStartTime;
+	double							RecoveryStartTime;
+	double							MillisecondsPerFrame;
+};
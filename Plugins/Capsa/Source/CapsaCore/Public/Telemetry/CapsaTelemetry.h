@@ -0,0 +1,261 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Stats/Stats.h"
+
+#include <atomic>
+
+
+DECLARE_STATS_GROUP( TEXT( "Capsa" ), STATGROUP_Capsa, STATCAT_Advanced );
+
+/**
+* The values FCapsaTelemetry publishes, averaged over the last window.
+*/
+struct FCapsaTelemetrySnapshot
+{
+	double							LinesCapturedPerSecond = 0.0;
+	double							LinesFilteredPerSecond = 0.0;
+	double							LinesDroppedPerSecond = 0.0;
+	int64							BufferedBytes = 0;
+	double							FormatMillisecondsPerChunk = 0.0;
+	double							CompressMillisecondsPerChunk = 0.0;
+	double							CompressionRatio = 0.0;
+	int32							UploadQueueDepth = 0;
+	double							UploadLatencyP50Milliseconds = 0.0;
+	double							UploadLatencyP95Milliseconds = 0.0;
+	double							UploadLatencyP99Milliseconds = 0.0;
+	uint64							UploadFailures = 0;
+	uint64							AuthRetries = 0;
+	double							DeliveryLatencyP50Milliseconds = 0.0;
+	double							DeliveryLatencyP95Milliseconds = 0.0;
+	double							DeliveryLatencyP99Milliseconds = 0.0;
+};
+
+/**
+* The counters of FCapsaTelemetry since the process started, for soak tests and reports that need
+* totals over a period instead of the rates of the last window.
+*/
+struct FCapsaTelemetryTotals
+{
+	uint64							LinesCaptured = 0;
+	uint64							LinesFiltered = 0;
+	uint64							LinesDropped = 0;
+	uint64							LinesDelivered = 0;
+	double							FormatSeconds = 0.0;
+	double							CompressSeconds = 0.0;
+	uint64							UncompressedBytes = 0;
+	uint64							CompressedBytes = 0;
+	uint64							Uploads = 0;
+	uint64							UploadFailures = 0;
+	uint64							AuthRetries = 0;
+	uint64							LinkedLogRegistrations = 0;
+	uint64							MetadataRequests = 0;
+};
+
+/**
+* FCapsaTelemetry collects the cost of Capsa itself and publishes it every frame to STATGROUP_Capsa
+* (stat Capsa) and the Capsa CSV profiler category, so it also shows up in CSV captures of servers.
+*
+* The counters are fed from the output device, the Log Pipeline and the Core Subsystem, and can be
+* updated from any thread. Rates and averages are recalculated once per WindowSeconds, per chunk values
+* keep their last value through windows without chunks.
+*/
+class CAPSACORE_API FCapsaTelemetry
+{
+public:
+
+	static FCapsaTelemetry&			Get();
+
+	/**
+	* Starts publishing the stats every frame. Called by the CapsaCore module.
+	*/
+	void							Start();
+
+	/**
+	* Stops publishing the stats.
+	*/
+	void							Stop();
+
+	/**
+	* Counts lines captured by the output device.
+	*
+	* @param NumLines The number of captured lines.
+	*/
+	void							AddCapturedLines( int32 NumLines = 1 );
+
+	/**
+	* Counts lines rejected by the verbosity filter, the frame budget, rate limiting or sampling.
+	*
+	* @param NumLines The number of suppressed lines.
+	*/
+	void							AddFilteredLines( int32 NumLines = 1 );
+
+	/**
+	* Counts captured lines that were never uploaded.
+	*
+	* @param NumLines The number of dropped lines.
+	*/
+	void							AddDroppedLines( int32 NumLines );
+
+	/**
+	* Sets the memory held by lines waiting for the next flush.
+	*
+	* @param Bytes The buffered memory in bytes.
+	*/
+	void							SetBufferedBytes( int64 Bytes );
+
+	/**
+	* Records the time it took to format a chunk.
+	*
+	* @param Seconds The format time.
+	*/
+	void							RecordFormat( double Seconds );
+
+	/**
+	* Records the time it took to compress a (sub-)chunk, and its size before and after.
+	*
+	* @param Seconds The compress time.
+	* @param UncompressedBytes The size before compression.
+	* @param CompressedBytes The size after compression.
+	*/
+	void							RecordCompress( double Seconds, int64 UncompressedBytes, int64 CompressedBytes );
+
+	/**
+	* Sets the number of (sub-)chunks waiting for or in the middle of an upload.
+	*
+	* @param Depth The upload queue depth.
+	*/
+	void							SetUploadQueueDepth( int32 Depth );
+
+	/**
+	* Records a finished log chunk HTTP request.
+	*
+	* @param LatencySeconds The time between sending the request and receiving the response.
+	* @param bSuccess Whether the chunk was stored by the Capsa Server.
+	*/
+	void							RecordUpload( double LatencySeconds, bool bSuccess );
+
+	/**
+	* Counts authentication requests made because earlier ones did not succeed.
+	*/
+	void							AddAuthRetry();
+
+	/**
+	* Counts requests to link another log, including the ones for logs that were already linked.
+	*/
+	void							AddLinkedLogRegistration();
+
+	/**
+	* Counts metadata HTTP requests sent to the Capsa Server.
+	*/
+	void							AddMetadataRequest();
+
+	/**
+	* Records lines that were stored by the Capsa Server.
+	*
+	* @param LatencySeconds The time between capturing the oldest of the lines and the server storing them.
+	* @param NumLines The number of lines.
+	*/
+	void							RecordDelivery( double LatencySeconds, int32 NumLines );
+
+	/**
+	* Returns the values of the last window.
+	*
+	* @return FCapsaTelemetrySnapshot The published values.
+	*/
+	FCapsaTelemetrySnapshot			GetSnapshot() const;
+
+	/**
+	* Returns the counters since the process started.
+	*
+	* @return FCapsaTelemetryTotals The totals.
+	*/
+	FCapsaTelemetryTotals			GetTotals() const;
+
+	/**
+	* The length of the window rates and averages are calculated over.
+	*/
+	static constexpr double			WindowSeconds = 1.0;
+
+	/**
+	* The number of most recent uploads the latency percentiles are calculated from.
+	*/
+	static constexpr int32			NumLatencySamples = 256;
+
+private:
+
+	/**
+	* Ring of the most recent latencies, guarded by LatencyCriticalSection.
+	*/
+	struct FLatencySamples
+	{
+		TArray<float>				Samples;
+		int32						NextSample = 0;
+		bool						bNewSamples = false;
+
+		void						Add( double LatencySeconds );
+
+		/**
+		* Copies the samples, sorted, if there were new ones since the last call.
+		*/
+		bool						TakeSorted( TArray<float, TInlineAllocator<NumLatencySamples>>& OutSorted );
+	};
+
+	FCapsaTelemetry();
+
+	bool							Tick( float DeltaTime );
+
+	/**
+	* Recalculates the rates, averages and percentiles from the counters of the last window.
+	*/
+	void							UpdateSnapshot( double Now );
+
+	/**
+	* Publishes the snapshot to the stats system and the CSV profiler.
+	*/
+	void							Publish() const;
+
+	FTSTicker::FDelegateHandle		TickerHandle;
+
+	std::atomic<uint64>				LinesCaptured;
+	std::atomic<uint64>				LinesFiltered;
+	std::atomic<uint64>				LinesDropped;
+	std::atomic<int64>				BufferedBytes;
+	std::atomic<uint64>				NumFormats;
+	std::atomic<uint64>				FormatNanoseconds;
+	std::atomic<uint64>				NumCompresses;
+	std::atomic<uint64>				CompressNanoseconds;
+	std::atomic<uint64>				UncompressedBytes;
+	std::atomic<uint64>				CompressedBytes;
+	std::atomic<int32>				UploadQueueDepth;
+	std::atomic<uint64>				NumUploads;
+	std::atomic<uint64>				UploadFailures;
+	std::atomic<uint64>				AuthRetries;
+	std::atomic<uint64>				LinesDelivered;
+	std::atomic<uint64>				LinkedLogRegistrations;
+	std::atomic<uint64>				MetadataRequests;
+
+	mutable FCriticalSection		LatencyCriticalSection;
+	FLatencySamples					UploadLatencies;
+	FLatencySamples					DeliveryLatencies;
+
+	/**
+	* The counter values at the start of the current window, only used on the game thread.
+	*/
+	double							WindowStartTime;
+	uint64							WindowLinesCaptured;
+	uint64							WindowLinesFiltered;
+	uint64							WindowLinesDropped;
+	uint64							WindowNumFormats;
+	uint64							WindowFormatNanoseconds;
+	uint64							WindowNumCompresses;
+	uint64							WindowCompressNanoseconds;
+	uint64							WindowUncompressedBytes;
+	uint64							WindowCompressedBytes;
+
+	mutable FCriticalSection		SnapshotCriticalSection;
+	FCapsaTelemetrySnapshot			Snapshot;
+};
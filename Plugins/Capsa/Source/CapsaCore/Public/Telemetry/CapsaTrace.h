@@ -0,0 +1,77 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Trace/Trace.h"
+
+
+#define CAPSA_TRACE_ENABLED UE_TRACE_ENABLED
+
+#if CAPSA_TRACE_ENABLED
+UE_TRACE_CHANNEL_EXTERN( CapsaChannel, CAPSACORE_API );
+#endif
+
+/**
+* The steps of a Log chunk in FCapsaLogPipeline, as traced by FCapsaTrace.
+*/
+enum class ECapsaTraceChunkEvent : uint8
+{
+	Captured,
+	Formatted,
+	Compressed,
+	Persisted,
+	UploadStarted,
+	Acked,
+	Failed
+};
+
+/**
+* Emits the lifecycle of Log chunks on the Capsa trace channel, enable it with -trace=default,capsa.
+*
+* Every step is written as a Capsa.ChunkEvent with the chunk ID (the pipeline Sequence), sub-chunk index,
+* line count and size. Each chunk is also a timing region named "Capsa Chunk <ID>", from the moment it is
+* captured until its last sub-chunk is acknowledged, so its end-to-end latency lines up with the frames
+* in the Unreal Insights timing view.
+*
+* Unreal Insights shows the regions, but has no analyzer for Capsa.ChunkEvent. The events are in the .utrace
+* file and can be read with a TraceAnalysis IAnalyzer subscribed to Capsa.ChunkEvent.
+*/
+struct CAPSACORE_API FCapsaTrace
+{
+	/**
+	* Traces a step of a chunk.
+	*
+	* @param Event The step.
+	* @param ChunkID The Sequence of the chunk.
+	* @param SubChunkIndex The sub-chunk the step applies to, INDEX_NONE for the whole chunk.
+	* @param NumLines The number of lines involved.
+	* @param Bytes The size of the data after the step, 0 if not applicable.
+	*/
+	static void						ChunkEvent( ECapsaTraceChunkEvent Event, uint64 ChunkID, int32 SubChunkIndex, int32 NumLines, int64 Bytes );
+
+	/**
+	* Begins the timing region of a chunk and traces it as captured, if the Capsa channel is enabled.
+	*
+	* @param ChunkID The Sequence of the chunk.
+	* @param NumLines The number of lines in the chunk.
+	* @return bool True if the region was begun, pass it to EndChunk.
+	*/
+	static bool						BeginChunk( uint64 ChunkID, int32 NumLines );
+
+	/**
+	* Ends the timing region of a chunk. Does nothing if BeginChunk did not begin it, so toggling the channel
+	* while chunks are in flight never leaves regions open or ends regions that were never begun.
+	*
+	* @param ChunkID The Sequence of the chunk.
+	* @param bBegun The result of BeginChunk for the chunk.
+	*/
+	static void						EndChunk( uint64 ChunkID, bool bBegun );
+
+	/**
+	* Whether the Capsa trace channel is enabled, to skip collecting data for the events.
+	*
+	* @return bool True if the channel is enabled.
+	*/
+	static bool						IsEnabled();
+};
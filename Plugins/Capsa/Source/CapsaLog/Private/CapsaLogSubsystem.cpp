@@ -21,3 +21,150 @@ void UCapsaLogSubsystem::Deinitialize()
 	Super::Deinitialize();
 }
 
+void UCapsaLogSubsystem::TriggerFlightRecorder()
+{
+#if WITH_CAPSA_LOG_ENABLED
+	if( CapsaLogOutputDevice.IsValid() == false )
+	{
+		UE_LOG( LogCapsaLog, Warning, TEXT( "UCapsaLogSubsystem::TriggerFlightRecorder | No valid CapsaLogOutputDevice" ) );
+		return;
+	}
+
+	CapsaLogOutputDevice->TriggerFlightRecorder();
+#endif
+}
+
+void UCapsaLogSubsystem::TriggerFlightRecorderCommand()
+{
+	UCapsaLogSubsystem* CapsaLog = GEngine != nullptr ? GEngine->GetEngineSubsystem<UCapsaLogSubsystem>() : nullptr;
+	if( CapsaLog == nullptr || CapsaLog->IsValidLowLevelFast() == false )
+	{
+		UE_LOG( LogCapsaLog, Error, TEXT( "Unable to trigger Flight Recorder: CapsaLog Subsystem is invalid." ) );
+		return;
+	}
+
+	CapsaLog->TriggerFlightRecorder();
+}
+
+bool UCapsaLogSubsystem::StartRecording( const FString& FilePath )
+{
+#if WITH_CAPSA_LOG_ENABLED
+	if( CapsaLogOutputDevice.IsValid() == false )
+	{
+		UE_LOG( LogCapsaLog, Warning, TEXT( "UCapsaLogSubsystem::StartRecording | No valid CapsaLogOutputDevice" ) );
+		return false;
+	}
+
+	return CapsaLogOutputDevice->StartRecording( FilePath );
+#else
+	return false;
+#endif
+}
+
+void UCapsaLogSubsystem::StopRecording()
+{
+#if WITH_CAPSA_LOG_ENABLED
+	if( CapsaLogOutputDevice.IsValid() == true )
+	{
+		CapsaLogOutputDevice->StopRecording();
+	}
+#endif
+}
+
+void UCapsaLogSubsystem::RecordCommand( const TArray<FString>& Args )
+{
+	UCapsaLogSubsystem* CapsaLog = GEngine != nullptr ? GEngine->GetEngineSubsystem<UCapsaLogSubsystem>() : nullptr;
+	if( CapsaLog == nullptr || CapsaLog->IsValidLowLevelFast() == false )
+	{
+		UE_LOG( LogCapsaLog, Error, TEXT( "Unable to record: CapsaLog Subsystem is invalid." ) );
+		return;
+	}
+
+	if( Args.Num() > 0 && Args[0].Equals( TEXT( "stop" ), ESearchCase::IgnoreCase ) == true )
+	{
+		CapsaLog->StopRecording();
+		return;
+	}
+
+	CapsaLog->StartRecording( Args.Num() > 0 ? Args[0] : FString() );
+}
+
+void UCapsaLogSubsystem::LogTopTalkers( int32 MaxCategories )
+{
+#if WITH_CAPSA_LOG_ENABLED
+	if( CapsaLogOutputDevice.IsValid() == false )
+	{
+		UE_LOG( LogCapsaLog, Warning, TEXT( "UCapsaLogSubsystem::LogTopTalkers | No valid CapsaLogOutputDevice" ) );
+		return;
+	}
+
+	TArray<FCapsaCategoryVolume> Volumes;
+	const uint64 TotalBytes = CapsaLogOutputDevice->GetCategoryProfiler().GetTopTalkers( MaxCategories, Volumes );
+
+	UE_LOG( LogCapsaLog, Display, TEXT( "UCapsaLogSubsystem::LogTopTalkers | Top %d of %llu bytes:" ), Volumes.Num(), TotalBytes );
+	for( const FCapsaCategoryVolume& Volume : Volumes )
+	{
+		FString ByVerbosity;
+		for( int32 Verbosity = ELogVerbosity::Fatal; Verbosity < ELogVerbosity::NumVerbosity; ++Verbosity )
+		{
+			if( Volume.LinesByVerbosity[Verbosity] > 0 )
+			{
+				ByVerbosity += FString::Printf( TEXT( " %s %llu" ), ToString( static_cast<ELogVerbosity::Type>( Verbosity ) ), Volume.LinesByVerbosity[Verbosity] );
+			}
+		}
+
+		UE_LOG( LogCapsaLog, Display, TEXT( "    %-32s %12llu bytes %5.1f%% %10llu lines |%s" ),
+			Volume.Category.IsNone() == true ? TEXT( "<Overflow>" ) : *Volume.Category.ToString(), Volume.Bytes,
+			TotalBytes > 0 ? 100.0 * Volume.Bytes / TotalBytes : 0.0, Volume.Lines, *ByVerbosity );
+	}
+#endif
+}
+
+void UCapsaLogSubsystem::ResetTopTalkers()
+{
+#if WITH_CAPSA_LOG_ENABLED
+	if( CapsaLogOutputDevice.IsValid() == true )
+	{
+		CapsaLogOutputDevice->GetCategoryProfiler().Reset();
+	}
+#endif
+}
+
+void UCapsaLogSubsystem::TopTalkersCommand( const TArray<FString>& Args )
+{
+	UCapsaLogSubsystem* CapsaLog = GEngine != nullptr ? GEngine->GetEngineSubsystem<UCapsaLogSubsystem>() : nullptr;
+	if( CapsaLog == nullptr || CapsaLog->IsValidLowLevelFast() == false )
+	{
+		UE_LOG( LogCapsaLog, Error, TEXT( "Unable to log top talkers: CapsaLog Subsystem is invalid." ) );
+		return;
+	}
+
+	if( Args.Num() > 0 && Args[0].Equals( TEXT( "reset" ), ESearchCase::IgnoreCase ) == true )
+	{
+		CapsaLog->ResetTopTalkers();
+		return;
+	}
+
+	CapsaLog->LogTopTalkers( Args.Num() > 0 ? FCString::Atoi( *Args[0] ) : 20 );
+}
+
+static FAutoConsoleCommand CVarCapsaTopTalkers(
+	TEXT( "Capsa.TopTalkers" ),
+	TEXT( "Logs the Log Categories that produced the most bytes, with their line counts per verbosity. " )
+	TEXT( "Usage: Capsa.TopTalkers [Count] | reset" ),
+	FConsoleCommandWithArgsDelegate::CreateStatic( UCapsaLogSubsystem::TopTalkersCommand ),
+	ECVF_Cheat );
+
+static FAutoConsoleCommand CVarCapsaRecord(
+	TEXT( "Capsa.Record" ),
+	TEXT( "Records the lines Capsa captures, for the CapsaReplay commandlet. " )
+	TEXT( "Usage: Capsa.Record [File] | stop" ),
+	FConsoleCommandWithArgsDelegate::CreateStatic( UCapsaLogSubsystem::RecordCommand ),
+	ECVF_Cheat );
+
+static FAutoConsoleCommand CVarCapsaFlightRecorderTrigger(
+	TEXT( "Capsa.FlightRecorder.Trigger" ),
+	TEXT( "Uploads the verbose lines held in memory by the Capsa Flight Recorder " )
+	TEXT( "around the current time, as if an Error was logged." ),
+	FConsoleCommandDelegate::CreateStatic( UCapsaLogSubsystem::TriggerFlightRecorderCommand ),
+	ECVF_Cheat );
@@ -0,0 +1,135 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Misc/CapsaCategoryLimiter.h"
+
+#include "HAL/PlatformTLS.h"
+
+
+FCapsaCategoryLimiter::FCapsaCategoryLimiter()
+	: bEnabled( false )
+	, bHasSuppressedLines( false )
+{
+}
+
+void FCapsaCategoryLimiter::Configure( const TMap<FName, FCapsaCategoryRateLimit>& InCategoryLimits, const FCapsaCategoryRateLimit& InDefaultLimit )
+{
+	CategoryLimits = InCategoryLimits;
+	DefaultLimit = InDefaultLimit;
+
+	bEnabled = DefaultLimit.IsLimited();
+	for( const TPair<FName, FCapsaCategoryRateLimit>& Pair : CategoryLimits )
+	{
+		bEnabled |= Pair.Value.IsLimited();
+	}
+
+	FSlot& OverflowSlot = Slots.GetOverflowSlot();
+	ApplyLimit( OverflowSlot, DefaultLimit );
+	OverflowSlot.bReady.store( true, std::memory_order_release );
+}
+
+bool FCapsaCategoryLimiter::IsEnabled() const
+{
+	return bEnabled;
+}
+
+ECapsaLimiterResult FCapsaCategoryLimiter::TryAcquire( const FName& Category )
+{
+	FSlot& Slot = FindOrAddSlot( Category );
+	if( Slot.bReady.load( std::memory_order_acquire ) == false )
+	{
+		// Another thread is still filling in this slot, let the line through.
+		return ECapsaLimiterResult::Accepted;
+	}
+
+	if( Slot.bSample == true && NextRandom() >= Slot.SampleThreshold )
+	{
+		Slot.SampledOut.fetch_add( 1, std::memory_order_relaxed );
+		bHasSuppressedLines.store( true, std::memory_order_relaxed );
+		return ECapsaLimiterResult::SampledOut;
+	}
+
+	if( Slot.IntervalCycles > 0 )
+	{
+		// GCRA: a line conforms if it does not arrive earlier than its theoretical arrival time minus the burst tolerance.
+		const int64 Now = static_cast<int64>( FPlatformTime::Cycles64() );
+		int64 TheoreticalArrival = Slot.TheoreticalArrival.load( std::memory_order_relaxed );
+		for( ;; )
+		{
+			const int64 Base = FMath::Max( TheoreticalArrival, Now );
+			if( Base - Now > Slot.BurstToleranceCycles )
+			{
+				Slot.RateLimited.fetch_add( 1, std::memory_order_relaxed );
+				bHasSuppressedLines.store( true, std::memory_order_relaxed );
+				return ECapsaLimiterResult::RateLimited;
+			}
+
+			if( Slot.TheoreticalArrival.compare_exchange_weak( TheoreticalArrival, Base + Slot.IntervalCycles, std::memory_order_relaxed ) == true )
+			{
+				break;
+			}
+		}
+	}
+
+	return ECapsaLimiterResult::Accepted;
+}
+
+bool FCapsaCategoryLimiter::HasSuppressedLines() const
+{
+	return bHasSuppressedLines.load( std::memory_order_relaxed );
+}
+
+void FCapsaCategoryLimiter::ConsumeSuppressedCounts( TFunctionRef<void( const FName& Category, uint32 RateLimited, uint32 SampledOut )> Visitor )
+{
+	if( bHasSuppressedLines.exchange( false, std::memory_order_relaxed ) == false )
+	{
+		return;
+	}
+
+	Slots.ForEachReadySlot( [&Visitor]( FSlot& Slot )
+		{
+			const uint32 RateLimited = Slot.RateLimited.exchange( 0, std::memory_order_relaxed );
+			const uint32 SampledOut = Slot.SampledOut.exchange( 0, std::memory_order_relaxed );
+			if( RateLimited > 0 || SampledOut > 0 )
+			{
+				Visitor( Slot.Category, RateLimited, SampledOut );
+			}
+		} );
+}
+
+FCapsaCategoryLimiter::FSlot& FCapsaCategoryLimiter::FindOrAddSlot( const FName& Category )
+{
+	return Slots.FindOrAdd( Category, [this, &Category]( FSlot& Slot )
+		{
+			const FCapsaCategoryRateLimit* Limit = CategoryLimits.Find( Category );
+			ApplyLimit( Slot, Limit != nullptr ? *Limit : DefaultLimit );
+		} );
+}
+
+void FCapsaCategoryLimiter::ApplyLimit( FSlot& Slot, const FCapsaCategoryRateLimit& Limit )
+{
+	const float SampleRate = FMath::Clamp( Limit.SampleRate, 0.f, 1.f );
+	Slot.bSample = SampleRate < 1.f;
+	Slot.SampleThreshold = static_cast<uint64>( static_cast<double>( SampleRate ) * 4294967296.0 );
+
+	if( Limit.LinesPerSecond > 0.f )
+	{
+		const double IntervalSeconds = 1.0 / Limit.LinesPerSecond;
+		Slot.IntervalCycles = FMath::Max<int64>( 1, static_cast<int64>( IntervalSeconds / FPlatformTime::GetSecondsPerCycle64() ) );
+		Slot.BurstToleranceCycles = Slot.IntervalCycles * ( FMath::Max( Limit.BurstLines, 1 ) - 1 );
+	} else
+	{
+		Slot.IntervalCycles = 0;
+		Slot.BurstToleranceCycles = 0;
+	}
+}
+
+uint32 FCapsaCategoryLimiter::NextRandom()
+{
+	static thread_local uint32 State = ( FPlatformTLS::GetCurrentThreadId() * 2654435761u ) | 1u;
+
+	// xorshift32
+	State ^= State << 13;
+	State ^= State >> 17;
+	State ^= State << 5;
+	return State;
+}
@@ -0,0 +1,73 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Misc/CapsaCategoryProfiler.h"
+
+
+FCapsaCategoryProfiler::FSlot::FSlot()
+{
+	for( std::atomic<uint64>& VerbosityLines : Lines )
+	{
+		VerbosityLines.store( 0, std::memory_order_relaxed );
+	}
+}
+
+FCapsaCategoryProfiler::FCapsaCategoryProfiler()
+{
+	Slots.GetOverflowSlot().bReady.store( true, std::memory_order_release );
+}
+
+void FCapsaCategoryProfiler::Record( const FName& Category, ELogVerbosity::Type Verbosity, int64 Bytes )
+{
+	FSlot& Slot = Slots.FindOrAdd( Category, []( FSlot& ) {} );
+	Slot.Lines[Verbosity & ELogVerbosity::VerbosityMask].fetch_add( 1, std::memory_order_relaxed );
+	Slot.Bytes.fetch_add( Bytes, std::memory_order_relaxed );
+}
+
+uint64 FCapsaCategoryProfiler::GetTopTalkers( int32 MaxCategories, TArray<FCapsaCategoryVolume>& OutVolumes ) const
+{
+	TArray<FCapsaCategoryVolume> Volumes;
+	uint64 TotalBytes = 0;
+
+	Slots.ForEachReadySlot( [&Volumes, &TotalBytes]( const FSlot& Slot )
+		{
+			FCapsaCategoryVolume Volume;
+			Volume.Category = Slot.Category;
+			Volume.Bytes = Slot.Bytes.load( std::memory_order_relaxed );
+			for( int32 Verbosity = 0; Verbosity < ELogVerbosity::NumVerbosity; ++Verbosity )
+			{
+				Volume.LinesByVerbosity[Verbosity] = Slot.Lines[Verbosity].load( std::memory_order_relaxed );
+				Volume.Lines += Volume.LinesByVerbosity[Verbosity];
+			}
+
+			if( Volume.Lines > 0 )
+			{
+				TotalBytes += Volume.Bytes;
+				Volumes.Add( Volume );
+			}
+		} );
+
+	Volumes.Sort( []( const FCapsaCategoryVolume& A, const FCapsaCategoryVolume& B )
+		{
+			return A.Bytes > B.Bytes;
+		} );
+	if( Volumes.Num() > MaxCategories )
+	{
+		Volumes.SetNum( FMath::Max( MaxCategories, 0 ) );
+	}
+
+	OutVolumes = MoveTemp( Volumes );
+	return TotalBytes;
+}
+
+void FCapsaCategoryProfiler::Reset()
+{
+	Slots.ForEachReadySlot( []( FSlot& Slot )
+		{
+			Slot.Bytes.store( 0, std::memory_order_relaxed );
+			for( std::atomic<uint64>& VerbosityLines : Slot.Lines )
+			{
+				VerbosityLines.store( 0, std::memory_order_relaxed );
+			}
+		} );
+}
+
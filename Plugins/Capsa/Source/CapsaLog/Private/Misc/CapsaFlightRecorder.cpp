@@ -0,0 +1,110 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Misc/CapsaFlightRecorder.h"
+
+
+FCapsaFlightRecorder::FCapsaFlightRecorder()
+	: Head( 0 )
+	, Count( 0 )
+	, SecondsBefore( 0.0 )
+	, SecondsAfter( 0.0 )
+	, WindowEndTime( 0.0 )
+{
+}
+
+void FCapsaFlightRecorder::Configure( int32 InCapacity, double InSecondsBefore, double InSecondsAfter )
+{
+	Ring.Reset();
+	Ring.SetNum( FMath::Max( InCapacity, 1 ) );
+	Head = 0;
+	Count = 0;
+	SecondsBefore = FMath::Max( InSecondsBefore, 0.0 );
+	SecondsAfter = FMath::Max( InSecondsAfter, 0.0 );
+	WindowEndTime = 0.0;
+}
+
+bool FCapsaFlightRecorder::IsWindowOpen( double Time ) const
+{
+	return Time <= WindowEndTime;
+}
+
+void FCapsaFlightRecorder::Record( const TCHAR* Data, const FName& Category, ELogVerbosity::Type Verbosity, double Time )
+{
+	if( Ring.IsEmpty() == true )
+	{
+		return;
+	}
+
+	int32 Index;
+	if( Count < Ring.Num() )
+	{
+		Index = ( Head + Count ) % Ring.Num();
+		++Count;
+	} else // Full, overwrite the oldest line
+	{
+		Index = Head;
+		Head = ( Head + 1 ) % Ring.Num();
+	}
+
+	FRecordedLine& Line = Ring[Index];
+	Line.Data = Data;
+	Line.Category = Category;
+	Line.Verbosity = Verbosity;
+	Line.Time = Time;
+}
+
+int32 FCapsaFlightRecorder::Trigger( double Time, TArray<FBufferedLine>& OutLines )
+{
+	WindowEndTime = FMath::Max( WindowEndTime, Time + SecondsAfter );
+
+	// Skip the recorded lines that are older than the window
+	const double WindowStartTime = Time - SecondsBefore;
+	int32 First = 0;
+	while( First < Count && Ring[( Head + First ) % Ring.Num()].Time < WindowStartTime )
+	{
+		++First;
+	}
+
+	const int32 NumRecorded = Count - First;
+	if( NumRecorded <= 0 )
+	{
+		Head = 0;
+		Count = 0;
+		return 0;
+	}
+
+	// Only the buffered lines newer than the oldest recorded line need to be interleaved
+	const double OldestRecordedTime = Ring[( Head + First ) % Ring.Num()].Time;
+	int32 Split = OutLines.Num();
+	while( Split > 0 && OutLines[Split - 1].Time > OldestRecordedTime )
+	{
+		--Split;
+	}
+
+	TArray<FBufferedLine> Merged;
+	Merged.Reserve( NumRecorded + OutLines.Num() - Split );
+
+	int32 BufferedIndex = Split;
+	for( int32 Offset = First; Offset < Count; ++Offset )
+	{
+		const FRecordedLine& Recorded = Ring[( Head + Offset ) % Ring.Num()];
+		while( BufferedIndex < OutLines.Num() && OutLines[BufferedIndex].Time <= Recorded.Time )
+		{
+			const FBufferedLine& Buffered = OutLines[BufferedIndex++];
+			Merged.Emplace( Buffered.Data.Get(), Buffered.Category.Resolve(), Buffered.Verbosity, Buffered.Time );
+		}
+		Merged.Emplace( *Recorded.Data, Recorded.Category, Recorded.Verbosity, Recorded.Time );
+	}
+	for( ; BufferedIndex < OutLines.Num(); ++BufferedIndex )
+	{
+		const FBufferedLine& Buffered = OutLines[BufferedIndex];
+		Merged.Emplace( Buffered.Data.Get(), Buffered.Category.Resolve(), Buffered.Verbosity, Buffered.Time );
+	}
+
+	OutLines.RemoveAt( Split, OutLines.Num() - Split, EAllowShrinking::No );
+	OutLines.Append( MoveTemp( Merged ) );
+
+	Head = 0;
+	Count = 0;
+	return NumRecorded;
+}
@@ -2,17 +2,68 @@
 
 #include "Misc/CapsaOutputDevice.h"
 
+#include "CapsaLog.h"
+#include "CapsaCore.h"
 #include "Settings/CapsaSettings.h"
+#include "Settings/CapsaSettingsSnapshot.h"
 #include "CapsaCoreSubsystem.h"
+#include "Encoding/CapsaJsonWriter.h"
+#include "Logging/CapsaLogSession.h"
+#include "Telemetry/CapsaFrameBudget.h"
+#include "Telemetry/CapsaTelemetry.h"
 
+#include "Misc/CommandLine.h"
+#include "Misc/Paths.h"
 
-FCapsaOutputDevice::FCapsaOutputDevice()
+
+namespace CapsaOutputDevice
+{
+	/**
+	* The ref-counted deferred log sink of a FCapsaOutputDevice.
+	*/
+	class FDeferredLogSink : public ICapsaDeferredLogSink
+	{
+	public:
+
+		explicit FDeferredLogSink( FCapsaOutputDevice& InOutputDevice )
+			: OutputDevice( InOutputDevice )
+		{
+		}
+
+		virtual void				SerializeDeferred( const FCapsaLogFormatSite& Site, TConstArrayView<uint8> Args ) override
+		{
+			OutputDevice.SerializeDeferred( Site, Args );
+		}
+
+	private:
+
+		FCapsaOutputDevice&			OutputDevice;
+	};
+}
+
+
+FCapsaOutputDevice::FCapsaOutputDevice( bool bInAttach )
 	: TickRate( 1.f )
 	, UpdateRate( 0.f )
 	, MaxLogLines( 100 )
+	, MaxBufferedLogLines( 200000 )
+	, CategoryLimiter( nullptr )
+	, NumCategoryLimiterUsers( 0 )
+	, bUseFlightRecorder( false )
+	, FlightRecorderVerbosity( ELogVerbosity::Log )
+	, bUseDeferredFormatting( false )
+	, BufferedTextBytes( 0 )
+	, NumSessionLines( 0 )
+	, NumUnreportedCapturedLines( 0 )
+	, TopTalkersMetadataInterval( 0.f )
+	, NumTopTalkers( 10 )
+	, LastTopTalkersTime( 0.0 )
+	, bAttach( bInAttach )
 	, LastUpdateTime( 0 )
+	, SettingsRevision( 0 )
+	, SnapshotVerbosity( ELogVerbosity::NumVerbosity )
+	, RecordingPipe( TEXT( "CapsaRecordingPipe" ) )
 {
-	// TODO: Make this a config option
 	FilterLevel = ELogVerbosity::All;
 	Initialize();
 }
@@ -21,41 +72,312 @@ FCapsaOutputDevice::~FCapsaOutputDevice()
 {
 	if( TickerHandle.IsValid() == true )
 	{
+		if( DeferredLogSink.IsValid() == true && FCapsaDeferredLog::GetSink() == DeferredLogSink )
+		{
+			FCapsaDeferredLog::SetSink( nullptr );
+		}
 		GLog->RemoveOutputDevice( this );
 		FTSTicker::GetCoreTicker().RemoveTicker( TickerHandle );
 	}
+
+	// Lines dispatched before the sink was removed may still be forwarding to this device
+	while( DeferredLogSink.IsValid() == true && DeferredLogSink.GetSharedReferenceCount() > 1 )
+	{
+		FPlatformProcess::Yield();
+	}
+
+	// The recording tasks reference this output device
+	StopRecording();
 }
 
 void FCapsaOutputDevice::Serialize( const TCHAR* InData, ELogVerbosity::Type Verbosity, const FName& Category )
 {
-	if( Verbosity > FilterLevel )
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
+	if( ShouldCapture( Verbosity, Category ) == false )
+	{
+		return;
+	}
+
+	const int64 TextBytes = FCString::Strlen( InData ) * sizeof( TCHAR );
+	CategoryProfiler.Record( Category, Verbosity, TextBytes );
+
+	const double Time = FDateTime::Now().ToUnixTimestampDecimal();
+	const uint32 SessionID = FCapsaLogSession::GetCurrentID();
+
+	FScopeLock ScopeLock( &SynchronizationObject );
+	++NumUnreportedCapturedLines;
+	if( SessionID != 0 )
+	{
+		FSessionBuffer& SessionBuffer = SessionBuffers.FindOrAdd( SessionID );
+		SessionBuffer.Lines.Emplace( InData, Category, Verbosity, Time );
+		SessionBuffer.TextBytes += TextBytes;
+		++NumSessionLines;
+		UpdateBufferedBytes();
+		return;
+	}
+
+	if( bUseFlightRecorder == true )
+	{
+		// Trigger first, an Error line must open the window even if FlightRecorderVerbosity would record it
+		if( Verbosity <= ELogVerbosity::Error )
+		{
+			FlightRecorder.Trigger( Time, BufferedLines );
+		} else if( Verbosity > FlightRecorderVerbosity && FlightRecorder.IsWindowOpen( Time ) == false )
+		{
+			FlightRecorder.Record( InData, Category, Verbosity, Time );
+			return;
+		}
+	}
+
+	BufferedLines.Emplace( InData, Category, Verbosity, Time );
+	BufferedTextBytes += TextBytes;
+	UpdateBufferedBytes();
+}
+
+void FCapsaOutputDevice::SerializeRecord( const UE::FLogRecord& Record )
+{
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
+	// The Flight Recorder and World log sessions keep formatted lines, and a Fatal line should not depend on the background task
+	if( bUseDeferredFormatting == false || bUseFlightRecorder == true || Record.GetVerbosity() == ELogVerbosity::Fatal || FCapsaLogSession::GetCurrentID() != 0 )
+	{
+		FBufferedOutputDevice::SerializeRecord( Record );
+		return;
+	}
+
+	if( ShouldCapture( Record.GetVerbosity(), Record.GetCategory() ) == false )
+	{
+		return;
+	}
+
+	// The size of the format string and the fields, the line is only formatted later
+	const int64 RecordBytes = FCString::Strlen( Record.GetFormat() ) * sizeof( TCHAR ) + Record.GetFields().GetSize();
+	CategoryProfiler.Record( Record.GetCategory(), Record.GetVerbosity(), RecordBytes );
+
+	const double Time = FDateTime::Now().ToUnixTimestampDecimal();
+
+	FScopeLock ScopeLock( &SynchronizationObject );
+	++NumUnreportedCapturedLines;
+	DeferredLines.AddRecord( Record, Time );
+	UpdateBufferedBytes();
+}
+
+void FCapsaOutputDevice::SerializeDeferred( const FCapsaLogFormatSite& Site, TConstArrayView<uint8> Args )
+{
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
+	// The Flight Recorder and World log sessions keep formatted lines
+	if( bUseFlightRecorder == true || FCapsaLogSession::GetCurrentID() != 0 )
+	{
+		FString Line;
+		FCapsaDeferredLog::FormatArgs( Site.Format, Args, Line );
+		Serialize( *Line, Site.Verbosity, Site.Category );
+		return;
+	}
+
+	if( ShouldCapture( Site.Verbosity, Site.Category ) == false )
 	{
 		return;
 	}
 
+	// The size of the format string and the captured arguments, the line is only formatted later
+	const int64 SiteBytes = FCString::Strlen( Site.Format ) * sizeof( TCHAR ) + Args.Num();
+	CategoryProfiler.Record( Site.Category, Site.Verbosity, SiteBytes );
+
+	const double Time = FDateTime::Now().ToUnixTimestampDecimal();
+
 	FScopeLock ScopeLock( &SynchronizationObject );
-	BufferedLines.Emplace( InData, Category, Verbosity, FDateTime::Now().ToUnixTimestampDecimal() );
+	++NumUnreportedCapturedLines;
+	DeferredLines.AddLine( Site.ID, Time, Args );
+	UpdateBufferedBytes();
+}
+
+void FCapsaOutputDevice::TriggerFlightRecorder()
+{
+	if( bUseFlightRecorder == false )
+	{
+		UE_LOG( LogCapsaLog, Warning, TEXT( "FCapsaOutputDevice::TriggerFlightRecorder | Flight Recorder is not enabled" ) );
+		return;
+	}
+
+	int32 NumRecorded = 0;
+	{
+		FScopeLock ScopeLock( &SynchronizationObject );
+		NumRecorded = FlightRecorder.Trigger( FDateTime::Now().ToUnixTimestampDecimal(), BufferedLines );
+	}
+
+	UE_LOG( LogCapsaLog, Log, TEXT( "FCapsaOutputDevice::TriggerFlightRecorder | Flight Recorder triggered, uploading %d recorded lines" ), NumRecorded );
+}
+
+bool FCapsaOutputDevice::StartRecording( const FString& FilePath )
+{
+	StopRecording();
+
+	const FString RecordingPath = FilePath.IsEmpty() == true ? GetDefaultRecordingPath() : FilePath;
+	if( Recording.Open( RecordingPath ) == false )
+	{
+		return false;
+	}
+
+	UE_LOG( LogCapsaLog, Log, TEXT( "FCapsaOutputDevice::StartRecording | Recording captured lines to %s" ), *RecordingPath );
+	return true;
+}
+
+void FCapsaOutputDevice::StopRecording()
+{
+	if( Recording.IsOpen() == false )
+	{
+		return;
+	}
+
+	RecordingPipe.WaitUntilEmpty();
+	Recording.Close();
+	UE_LOG( LogCapsaLog, Log, TEXT( "FCapsaOutputDevice::StopRecording | Recorded %lld lines" ), Recording.GetNumLines() );
+}
+
+bool FCapsaOutputDevice::IsRecording() const
+{
+	return Recording.IsOpen() == true;
+}
+
+FCapsaCategoryProfiler& FCapsaOutputDevice::GetCategoryProfiler()
+{
+	return CategoryProfiler;
+}
+
+FString FCapsaOutputDevice::GetDefaultRecordingPath()
+{
+	return FPaths::ProjectLogDir() / FString::Printf( TEXT( "Capsa-%s%s" ), *FDateTime::Now().ToString(), CapsaLogRecording::Extension );
 }
 
 void FCapsaOutputDevice::Initialize()
 {
+	const FCapsaSettingsSnapshot::FRef Snapshot = FCapsaSettingsSnapshot::Get();
+	TickRate = Snapshot->LogTickRate;
+	ApplySettingsSnapshot( *Snapshot );
+
 	UCapsaSettings* CapsaSettings = GetMutableDefault<UCapsaSettings>();
-	TickRate = CapsaSettings->GetLogTickRate();
-	UpdateRate = CapsaSettings->GetMaxTimeBetweenLogFlushes();
-	MaxLogLines = CapsaSettings->GetMaxLogLinesBetweenLogFlushes();
+
+	bUseFlightRecorder = CapsaSettings->GetUseFlightRecorder();
+	FlightRecorderVerbosity = CapsaSettings->GetFlightRecorderVerbosity();
+	if( bUseFlightRecorder == true )
+	{
+		FlightRecorder.Configure( CapsaSettings->GetFlightRecorderCapacity(), CapsaSettings->GetFlightRecorderSecondsBefore(), CapsaSettings->GetFlightRecorderSecondsAfter() );
+	}
+
+	bUseDeferredFormatting = CapsaSettings->GetUseDeferredFormatting();
+	MaxBufferedLogLines = CapsaSettings->GetMaxBufferedLogLines();
+
+	TopTalkersMetadataInterval = CapsaSettings->GetTopTalkersMetadataInterval();
+	NumTopTalkers = CapsaSettings->GetNumTopTalkers();
 
 	LastUpdateTime = FPlatformTime::Seconds();
+	LastTopTalkersTime = LastUpdateTime;
 
-	if( TickRate > 0.0f )
+	if( bAttach == true && TickRate > 0.0f )
 	{
 		TickerHandle = FTSTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateRaw( this, &FCapsaOutputDevice::Tick ), TickRate );
 		GLog->AddOutputDevice( this );
+		// CAPSA_LOG lines only skip the local log when that is asked for explicitly
+		if( bUseDeferredFormatting == true && CapsaSettings->GetCapsaLogSkipsLocalLog() == true )
+		{
+			DeferredLogSink = MakeShared<CapsaOutputDevice::FDeferredLogSink, ESPMode::ThreadSafe>( *this );
+			FCapsaDeferredLog::SetSink( DeferredLogSink );
+		}
+
+		// -CapsaRecord records from startup, -CapsaRecord=<File> picks the file
+		FString RecordingPath;
+		if( FParse::Value( FCommandLine::Get(), TEXT( "CapsaRecord=" ), RecordingPath ) == true || FParse::Param( FCommandLine::Get(), TEXT( "CapsaRecord" ) ) == true )
+		{
+			StartRecording( RecordingPath );
+		}
+	}
+}
+
+void FCapsaOutputDevice::ApplySettingsSnapshot( const FCapsaSettingsSnapshot& Snapshot )
+{
+	UpdateRate = Snapshot.MaxTimeBetweenLogFlushes;
+	MaxLogLines = Snapshot.MaxLogLinesBetweenLogFlushes;
+	if( Snapshot.Verbosity != SnapshotVerbosity )
+	{
+		SnapshotVerbosity = Snapshot.Verbosity;
+		SetVerbosity( Snapshot.Verbosity );
+	}
+	SettingsRevision = Snapshot.Revision;
+
+	if( CategoryLimiters.IsEmpty() == true || ( DefaultCategoryRateLimit == Snapshot.DefaultCategoryRateLimit ) == false
+		|| CategoryRateLimits.OrderIndependentCompareEqual( Snapshot.CategoryRateLimits ) == false )
+	{
+		CategoryRateLimits = Snapshot.CategoryRateLimits;
+		DefaultCategoryRateLimit = Snapshot.DefaultCategoryRateLimit;
+
+		TUniquePtr<FCapsaCategoryLimiter> Limiter = MakeUnique<FCapsaCategoryLimiter>();
+		Limiter->Configure( CategoryRateLimits, DefaultCategoryRateLimit );
+		CategoryLimiter.store( Limiter.Get(), std::memory_order_seq_cst );
+		CategoryLimiters.Add( MoveTemp( Limiter ) );
+	}
+}
+
+void FCapsaOutputDevice::FreeRetiredCategoryLimiters()
+{
+	if( CategoryLimiters.Num() <= 1 )
+	{
+		return;
+	}
+
+	// ShouldCapture counts itself as a user before it loads CategoryLimiter. With no users after the limiter was replaced,
+	// no thread still holds an earlier one and every later call loads the current one.
+	if( NumCategoryLimiterUsers.load( std::memory_order_seq_cst ) != 0 )
+	{
+		return;
+	}
+
+	while( CategoryLimiters.Num() > 1 && CategoryLimiters[0]->HasSuppressedLines() == false )
+	{
+		CategoryLimiters.RemoveAt( 0 );
 	}
 }
 
 bool FCapsaOutputDevice::Tick( float Seconds )
 {
-	if( BufferedLines.IsEmpty() == true )
+	FCapsaFrameBudget::FScope FrameBudgetScope;
+
+	// Pick up Capsa.Log.* console variable changes
+	const FCapsaSettingsSnapshot::FRef Snapshot = FCapsaSettingsSnapshot::Get();
+	if( Snapshot->Revision != SettingsRevision )
+	{
+		ApplySettingsSnapshot( *Snapshot );
+		if( Snapshot->LogTickRate > 0.f && Snapshot->LogTickRate != TickRate )
+		{
+			// Replace this ticker, returning false below removes the current one
+			TickRate = Snapshot->LogTickRate;
+			TickerHandle = FTSTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateRaw( this, &FCapsaOutputDevice::Tick ), TickRate );
+			return false;
+		}
+	}
+
+	FreeRetiredCategoryLimiters();
+
+	// Serialize only counts under the lock it already holds, report the lines captured since the last Tick in one go
+	int32 NumCapturedLines = 0;
+	{
+		FScopeLock ScopeLock( &SynchronizationObject );
+		NumCapturedLines = NumUnreportedCapturedLines;
+		NumUnreportedCapturedLines = 0;
+	}
+	if( NumCapturedLines > 0 )
+	{
+		FCapsaTelemetry::Get().AddCapturedLines( NumCapturedLines );
+	}
+
+	bool bHasSuppressedLines = false;
+	for( const TUniquePtr<FCapsaCategoryLimiter>& Limiter : CategoryLimiters )
+	{
+		bHasSuppressedLines |= Limiter->HasSuppressedLines();
+	}
+
+	if( BufferedLines.IsEmpty() == true && DeferredLines.IsEmpty() == true && NumSessionLines == 0 && bHasSuppressedLines == false )
 	{
 		return true;
 	}
@@ -69,7 +391,7 @@ bool FCapsaOutputDevice::Tick( float Seconds )
 		bExceedTime = true;
 	}
 
-	if( BufferedLines.Num() >= MaxLogLines )
+	if( BufferedLines.Num() + DeferredLines.Num() + NumSessionLines >= MaxLogLines )
 	{
 		bExceedLines = true;
 	}
@@ -80,23 +402,295 @@ bool FCapsaOutputDevice::Tick( float Seconds )
 	}
 
 	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>();
-	if( CapsaCoreSubsystem != nullptr &&
-		CapsaCoreSubsystem->IsValidLowLevelFast() == true)
+	if( CapsaCoreSubsystem != nullptr && CapsaCoreSubsystem->IsValidLowLevelFast() == false )
+	{
+		CapsaCoreSubsystem = nullptr;
+	}
+
+	// The World log sessions are independent of the log of the process
+	FlushSessionBuffers( CapsaCoreSubsystem );
+
+	if( CapsaCoreSubsystem != nullptr )
 	{
 		if( CapsaCoreSubsystem->IsAuthenticated() == true )
 		{
+			UpdateTopTalkersMetadata( CapsaCoreSubsystem );
+
+			if( CapsaCoreSubsystem->CanSendLog() == false )
+			{
+				// The Log Pipeline is still busy with earlier chunks, keep buffering and try again on the next Tick
+				FScopeLock ScopeLock( &SynchronizationObject );
+				DropOldestLines();
+				return true;
+			}
+
+			AppendSuppressedLinesSummary();
+
+			// Take the lines in one go, lines logged from other threads in between would otherwise be lost
 			TArray<FBufferedLine> BufferToSend;
-			GetContents( BufferToSend );
-			CapsaCoreSubsystem->SendLog( BufferToSend );
+			FCapsaDeferredLogBuffer DeferredToSend;
+			{
+				FScopeLock ScopeLock( &SynchronizationObject );
+				BufferToSend = MoveTemp( BufferedLines );
+				BufferedLines.Reset();
+				DeferredToSend = MoveTemp( DeferredLines );
+				DeferredLines.Reset();
+				BufferedTextBytes = 0;
+				UpdateBufferedBytes();
+			}
+			RecordLineCopies( BufferToSend, DeferredToSend );
+			CapsaCoreSubsystem->SendLog( BufferToSend, MoveTemp( DeferredToSend ) );
+
+			LastUpdateTime = Now;
+			return true;
 		} else // Trigger authentication attempt
 		{
+			FCapsaTelemetry::Get().AddAuthRetry();
 			CapsaCoreSubsystem->RequestClientAuth();
 		}
 	}
 
 	LastUpdateTime = Now;
-	FScopeLock ScopeLock( &SynchronizationObject );
-	BufferedLines.Empty();
+	TArray<FBufferedLine> DroppedLines;
+	FCapsaDeferredLogBuffer DroppedDeferredLines;
+	{
+		FScopeLock ScopeLock( &SynchronizationObject );
+		FCapsaTelemetry::Get().AddDroppedLines( BufferedLines.Num() + DeferredLines.Num() );
+		DroppedLines = MoveTemp( BufferedLines );
+		BufferedLines.Empty();
+		DroppedDeferredLines = MoveTemp( DeferredLines );
+		DeferredLines.Reset();
+		BufferedTextBytes = 0;
+		UpdateBufferedBytes();
+	}
+
+	// Replays should see the same load, whether the lines reached the Capsa Server or not
+	RecordLines( MoveTemp( DroppedLines ), MoveTemp( DroppedDeferredLines ) );
+
+	return true;
+}
+
+bool FCapsaOutputDevice::ShouldCapture( ELogVerbosity::Type Verbosity, const FName& Category )
+{
+	if( Verbosity > FilterLevel )
+	{
+		FCapsaTelemetry::Get().AddFilteredLines();
+		return false;
+	}
+
+	// Throttle changes explain the gaps in the log, they must never be suppressed themselves
+	if( Category == LogCapsaThrottle.GetCategoryName() )
+	{
+		return true;
+	}
+
+	if( FCapsaFrameBudget::Get().ShouldCapture( Verbosity ) == false )
+	{
+		FCapsaTelemetry::Get().AddFilteredLines();
+		return false;
+	}
+
+	// Fatal lines are never suppressed, they are the last thing we will get from this process.
+	if( Verbosity == ELogVerbosity::Fatal )
+	{
+		return true;
+	}
+
+	// Keeps the limiter alive until this call is done with it, see FreeRetiredCategoryLimiters
+	NumCategoryLimiterUsers.fetch_add( 1, std::memory_order_seq_cst );
+	FCapsaCategoryLimiter* Limiter = CategoryLimiter.load( std::memory_order_seq_cst );
+	const bool bAccepted = Limiter->IsEnabled() == false || Limiter->TryAcquire( Category ) == ECapsaLimiterResult::Accepted;
+	NumCategoryLimiterUsers.fetch_sub( 1, std::memory_order_release );
+
+	if( bAccepted == false )
+	{
+		FCapsaTelemetry::Get().AddFilteredLines();
+		return false;
+	}
 
 	return true;
 }
+
+void FCapsaOutputDevice::UpdateTopTalkersMetadata( UCapsaCoreSubsystem* CapsaCoreSubsystem )
+{
+	const double Now = FPlatformTime::Seconds();
+	if( TopTalkersMetadataInterval <= 0.f || Now - LastTopTalkersTime < TopTalkersMetadataInterval )
+	{
+		return;
+	}
+	LastTopTalkersTime = Now;
+
+	TArray<FCapsaCategoryVolume> Volumes;
+	const uint64 TotalBytes = CategoryProfiler.GetTopTalkers( NumTopTalkers, Volumes );
+	if( Volumes.IsEmpty() == true )
+	{
+		return;
+	}
+
+	TArray<uint8> Json;
+	FCapsaJsonWriter Writer( Json );
+	Writer.BeginObject();
+	Writer.WriteUnsigned( TEXT( "totalBytes" ), TotalBytes );
+	Writer.WriteKey( TEXT( "categories" ) );
+	Writer.BeginArray();
+	for( const FCapsaCategoryVolume& Volume : Volumes )
+	{
+		Writer.BeginObject();
+		Writer.WriteString( TEXT( "category" ), Volume.Category.IsNone() == true ? TEXT( "<Overflow>" ) : Volume.Category.ToString() );
+		Writer.WriteUnsigned( TEXT( "lines" ), Volume.Lines );
+		Writer.WriteUnsigned( TEXT( "bytes" ), Volume.Bytes );
+		Writer.WriteDouble( TEXT( "share" ), TotalBytes > 0 ? static_cast<double>( Volume.Bytes ) / TotalBytes : 0.0 );
+		Writer.EndObject();
+	}
+	Writer.EndArray();
+	Writer.EndObject();
+
+	CapsaCoreSubsystem->SetMetadata( TEXT( "topTalkers" ), FCapsaMetadataValue::FromJson( MoveTemp( Json ) ) );
+}
+
+void FCapsaOutputDevice::FlushSessionBuffers( UCapsaCoreSubsystem* CapsaCoreSubsystem )
+{
+	TMap<uint32, FSessionBuffer> BuffersToSend;
+	{
+		FScopeLock ScopeLock( &SynchronizationObject );
+		if( NumSessionLines == 0 )
+		{
+			return;
+		}
+		BuffersToSend = MoveTemp( SessionBuffers );
+		SessionBuffers.Reset();
+		NumSessionLines = 0;
+		UpdateBufferedBytes();
+	}
+
+	for( TPair<uint32, FSessionBuffer>& SessionBuffer : BuffersToSend )
+	{
+		FCapsaLogSession* Session = CapsaCoreSubsystem != nullptr ? &CapsaCoreSubsystem->FindLogSession( SessionBuffer.Key ) : nullptr;
+		if( Session != nullptr && Session->IsAuthenticated() == true )
+		{
+			if( Session->CanSendLog() == false )
+			{
+				// The Log Pipeline of the session is still busy, put the lines back in front of the ones logged since
+				FScopeLock ScopeLock( &SynchronizationObject );
+				FSessionBuffer& Buffer = SessionBuffers.FindOrAdd( SessionBuffer.Key );
+				NumSessionLines += SessionBuffer.Value.Lines.Num();
+				Buffer.TextBytes += SessionBuffer.Value.TextBytes;
+				Buffer.Lines.Insert( MoveTemp( SessionBuffer.Value.Lines ), 0 );
+
+				const int32 NumToDrop = Buffer.Lines.Num() - MaxBufferedLogLines;
+				if( NumToDrop > 0 )
+				{
+					for( int32 Index = 0; Index < NumToDrop; ++Index )
+					{
+						Buffer.TextBytes -= FCString::Strlen( Buffer.Lines[Index].Data.Get() ) * sizeof( TCHAR );
+					}
+					Buffer.Lines.RemoveAt( 0, NumToDrop, EAllowShrinking::No );
+					NumSessionLines -= NumToDrop;
+					FCapsaTelemetry::Get().AddDroppedLines( NumToDrop );
+				}
+				UpdateBufferedBytes();
+				continue;
+			}
+
+			RecordLineCopies( SessionBuffer.Value.Lines, FCapsaDeferredLogBuffer() );
+			Session->SendLog( SessionBuffer.Value.Lines );
+			continue;
+		}
+
+		FCapsaTelemetry::Get().AddDroppedLines( SessionBuffer.Value.Lines.Num() );
+		RecordLines( MoveTemp( SessionBuffer.Value.Lines ), FCapsaDeferredLogBuffer() );
+
+		// The log of the process retries its authentication in Tick
+		if( Session != nullptr && Session->GetID() != 0 )
+		{
+			FCapsaTelemetry::Get().AddAuthRetry();
+			Session->RequestClientAuth();
+		}
+	}
+}
+
+void FCapsaOutputDevice::AppendSuppressedLinesSummary()
+{
+	const double Now = FDateTime::Now().ToUnixTimestampDecimal();
+	const FName SummaryCategory = LogCapsaLog.GetCategoryName();
+
+	FScopeLock ScopeLock( &SynchronizationObject );
+	for( const TUniquePtr<FCapsaCategoryLimiter>& Limiter : CategoryLimiters )
+	{
+		Limiter->ConsumeSuppressedCounts( [this, Now, &SummaryCategory]( const FName& Category, uint32 RateLimited, uint32 SampledOut )
+			{
+				const FString Summary = FString::Printf( TEXT( "FCapsaOutputDevice | Suppressed %u lines in category %s (rate limited: %u, sampled out: %u)" ),
+					RateLimited + SampledOut, Category.IsNone() == true ? TEXT( "<Overflow>" ) : *Category.ToString(), RateLimited, SampledOut );
+				BufferedLines.Emplace( *Summary, SummaryCategory, ELogVerbosity::Warning, Now );
+			} );
+	}
+}
+
+void FCapsaOutputDevice::RecordLines( TArray<FBufferedLine>&& Lines, FCapsaDeferredLogBuffer&& Deferred )
+{
+	if( Recording.IsOpen() == false || ( Lines.IsEmpty() == true && Deferred.IsEmpty() == true ) )
+	{
+		return;
+	}
+
+	// Formatting, encoding, compressing and writing the lines would otherwise stall the game thread
+	RecordingPipe.Launch( TEXT( "CapsaRecordLines" ), [this, Lines = MoveTemp( Lines ), Deferred = MoveTemp( Deferred )]() mutable
+		{
+			TRACE_CPUPROFILER_EVENT_SCOPE(FCapsaOutputDevice::RecordLines);
+
+			Deferred.FormatInto( Lines );
+			Recording.AddLines( Lines );
+		} );
+}
+
+void FCapsaOutputDevice::RecordLineCopies( const TArray<FBufferedLine>& Lines, const FCapsaDeferredLogBuffer& Deferred )
+{
+	if( Recording.IsOpen() == false || ( Lines.IsEmpty() == true && Deferred.IsEmpty() == true ) )
+	{
+		return;
+	}
+
+	TArray<FBufferedLine> LineCopies;
+	LineCopies.Reserve( Lines.Num() + Deferred.Num() );
+	for( const FBufferedLine& Line : Lines )
+	{
+		LineCopies.Emplace( Line.Data.Get(), Line.Category.Resolve(), Line.Verbosity, Line.Time );
+	}
+	RecordLines( MoveTemp( LineCopies ), CopyTemp( Deferred ) );
+}
+
+void FCapsaOutputDevice::DropOldestLines()
+{
+	int32 NumToDrop = BufferedLines.Num() + DeferredLines.Num() - MaxBufferedLogLines;
+	if( NumToDrop <= 0 )
+	{
+		return;
+	}
+
+	// Deferred lines can not be dropped one by one, they go once the formatted lines are not enough
+	if( NumToDrop > BufferedLines.Num() )
+	{
+		NumToDrop -= DeferredLines.Num();
+		FCapsaTelemetry::Get().AddDroppedLines( DeferredLines.Num() );
+		DeferredLines.Reset();
+	}
+
+	NumToDrop = FMath::Clamp( NumToDrop, 0, BufferedLines.Num() );
+	for( int32 Index = 0; Index < NumToDrop; ++Index )
+	{
+		BufferedTextBytes -= FCString::Strlen( BufferedLines[Index].Data.Get() ) * sizeof( TCHAR );
+	}
+	BufferedLines.RemoveAt( 0, NumToDrop, EAllowShrinking::No );
+	FCapsaTelemetry::Get().AddDroppedLines( NumToDrop );
+	UpdateBufferedBytes();
+}
+
+void FCapsaOutputDevice::UpdateBufferedBytes()
+{
+	int64 SessionBytes = 0;
+	for( const TPair<uint32, FSessionBuffer>& SessionBuffer : SessionBuffers )
+	{
+		SessionBytes += SessionBuffer.Value.Lines.GetAllocatedSize() + SessionBuffer.Value.TextBytes;
+	}
+	FCapsaTelemetry::Get().SetBufferedBytes( BufferedLines.GetAllocatedSize() + BufferedTextBytes + DeferredLines.GetAllocatedSize() + SessionBytes );
+}
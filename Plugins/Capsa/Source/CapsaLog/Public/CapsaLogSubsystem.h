@@ -29,6 +29,63 @@ public:
 	virtual void						Deinitialize() override;
 	// End USubsystem
 
+	/**
+	* Uploads the verbose lines held in memory by the Flight Recorder from the configured window
+	* before now, and uploads all lines directly for the configured window after now.
+	* Does nothing if the Flight Recorder is disabled in CapsaSettings.
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaLogSubsystem" )
+	void								TriggerFlightRecorder();
+
+	/**
+	* Console command handler for Capsa.FlightRecorder.Trigger.
+	*/
+	static void							TriggerFlightRecorderCommand();
+
+	/**
+	* Starts recording the captured lines to a Capsa log recording, for the CapsaReplay commandlet.
+	*
+	* @param FilePath The recording to write, a file in the project log directory if empty.
+	* @return bool True if the recording was started.
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaLogSubsystem" )
+	bool								StartRecording( const FString& FilePath );
+
+	/**
+	* Stops the running recording, if any.
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaLogSubsystem" )
+	void								StopRecording();
+
+	/**
+	* Console command handler for Capsa.Record.
+	*
+	* @param Args Either a file path, "stop", or nothing to record to the default file.
+	*/
+	static void							RecordCommand( const TArray<FString>& Args );
+
+	/**
+	* Logs the Log Categories that produced the most bytes since startup or the last reset,
+	* with their line counts per verbosity.
+	*
+	* @param MaxCategories The number of categories to log.
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaLogSubsystem" )
+	void								LogTopTalkers( int32 MaxCategories = 20 );
+
+	/**
+	* Sets the top talkers counts back to zero.
+	*/
+	UFUNCTION( BlueprintCallable, Category = "Capsa|Log|CapsaLogSubsystem" )
+	void								ResetTopTalkers();
+
+	/**
+	* Console command handler for Capsa.TopTalkers.
+	*
+	* @param Args Either the number of categories, "reset", or nothing.
+	*/
+	static void							TopTalkersCommand( const TArray<FString>& Args );
+
 protected:
 
 	/**
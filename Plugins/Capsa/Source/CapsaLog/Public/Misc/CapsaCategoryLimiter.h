@@ -0,0 +1,109 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/CapsaCategoryTable.h"
+#include "Settings/CapsaSettings.h"
+
+#include <atomic>
+
+
+/**
+* The outcome of asking the FCapsaCategoryLimiter whether a line may be captured.
+*/
+enum class ECapsaLimiterResult : uint8
+{
+	Accepted,
+	RateLimited,
+	SampledOut,
+};
+
+/**
+* FCapsaCategoryLimiter applies per-category token-bucket rate limits and probabilistic sampling.
+*
+* Categories are stored in a TCapsaCategoryTable and the token bucket is a single atomic (GCRA), so
+* TryAcquire never takes a lock and can be called from any thread inside FCapsaOutputDevice::Serialize.
+*/
+class CAPSALOG_API FCapsaCategoryLimiter
+{
+public:
+
+	FCapsaCategoryLimiter();
+
+	/**
+	* Sets the limits to apply. Must be called before the limiter is used from multiple threads.
+	*
+	* @param InCategoryLimits The limits for specific categories.
+	* @param InDefaultLimit The limit for every category not present in InCategoryLimits.
+	*/
+	void						Configure( const TMap<FName, FCapsaCategoryRateLimit>& InCategoryLimits, const FCapsaCategoryRateLimit& InDefaultLimit );
+
+	/**
+	* Whether any limit is configured. When false, TryAcquire always accepts and can be skipped.
+	*
+	* @return bool True if at least one category is limited.
+	*/
+	bool						IsEnabled() const;
+
+	/**
+	* Attempts to take a token for a line in the given Category.
+	*
+	* @param Category The Log Category of the line.
+	* @return ECapsaLimiterResult Whether the line should be captured or why it was suppressed.
+	*/
+	ECapsaLimiterResult			TryAcquire( const FName& Category );
+
+	/**
+	* Whether any line has been suppressed since the last call to ConsumeSuppressedCounts.
+	*
+	* @return bool True if there are suppressed lines to report.
+	*/
+	bool						HasSuppressedLines() const;
+
+	/**
+	* Calls Visitor for every category that suppressed lines since the last call, and resets the counts.
+	*
+	* @param Visitor Receives the Category, the number of rate limited lines and the number of sampled out lines.
+	*/
+	void						ConsumeSuppressedCounts( TFunctionRef<void( const FName& Category, uint32 RateLimited, uint32 SampledOut )> Visitor );
+
+private:
+
+	struct FSlot : public FCapsaCategorySlot
+	{
+		/** GCRA theoretical arrival time, in cycles. */
+		std::atomic<int64>		TheoreticalArrival{ 0 };
+		std::atomic<uint32>		RateLimited{ 0 };
+		std::atomic<uint32>		SampledOut{ 0 };
+
+		int64					IntervalCycles = 0;
+		int64					BurstToleranceCycles = 0;
+		uint64					SampleThreshold = 0;
+		bool					bSample = false;
+	};
+
+	/**
+	* Finds or claims the slot for the given Category.
+	* Falls back to the overflow slot when the table is full.
+	*/
+	FSlot&						FindOrAddSlot( const FName& Category );
+
+	/**
+	* Writes the limit into the slot's configuration fields.
+	*/
+	static void					ApplyLimit( FSlot& Slot, const FCapsaCategoryRateLimit& Limit );
+
+	/**
+	* Per-thread xorshift random number, used for sampling.
+	*/
+	static uint32				NextRandom();
+
+	TCapsaCategoryTable<FSlot>	Slots;
+
+	TMap<FName, FCapsaCategoryRateLimit> CategoryLimits;
+	FCapsaCategoryRateLimit		DefaultLimit;
+	bool						bEnabled;
+
+	std::atomic<bool>			bHasSuppressedLines;
+};
@@ -0,0 +1,69 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/CapsaCategoryTable.h"
+
+#include <atomic>
+
+
+/**
+* The volume a single Log Category produced since the profiler was last reset.
+*/
+struct CAPSALOG_API FCapsaCategoryVolume
+{
+	FName							Category;
+	uint64							Lines = 0;
+	uint64							Bytes = 0;
+	uint64							LinesByVerbosity[ELogVerbosity::NumVerbosity] = {};
+};
+
+/**
+* FCapsaCategoryProfiler counts the lines and bytes captured per Log Category, to find the categories
+* worth filtering or rate limiting ("top talkers").
+*
+* Uses the same TCapsaCategoryTable as FCapsaCategoryLimiter and the counters are relaxed atomics, so Record
+* never takes a lock and can be called from any thread inside FCapsaOutputDevice::Serialize.
+*/
+class CAPSALOG_API FCapsaCategoryProfiler
+{
+public:
+
+	FCapsaCategoryProfiler();
+
+	/**
+	* Counts a line.
+	*
+	* @param Category The Log Category of the line.
+	* @param Verbosity The verbosity of the line.
+	* @param Bytes The size of the text of the line.
+	*/
+	void							Record( const FName& Category, ELogVerbosity::Type Verbosity, int64 Bytes );
+
+	/**
+	* Returns the categories that produced the most bytes.
+	*
+	* @param MaxCategories The maximum number of categories to return.
+	* @param OutVolumes Receives the volumes, largest first.
+	* @return uint64 The bytes produced by all categories.
+	*/
+	uint64							GetTopTalkers( int32 MaxCategories, TArray<FCapsaCategoryVolume>& OutVolumes ) const;
+
+	/**
+	* Sets every counter back to zero. Lines recorded at the same time may be lost or counted.
+	*/
+	void							Reset();
+
+private:
+
+	struct FSlot : public FCapsaCategorySlot
+	{
+		std::atomic<uint64>			Bytes{ 0 };
+		std::atomic<uint64>			Lines[ELogVerbosity::NumVerbosity];
+
+		FSlot();
+	};
+
+	TCapsaCategoryTable<FSlot>		Slots;
+};
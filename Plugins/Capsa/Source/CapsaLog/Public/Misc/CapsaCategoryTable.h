@@ -0,0 +1,132 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+
+/**
+* The fields every slot of a TCapsaCategoryTable needs. Slot types derive from it and add their own atomics.
+*/
+struct FCapsaCategorySlot
+{
+	/** FName comparison index + 1 of the owning category, 0 if the slot is free. */
+	std::atomic<uint32>				Key{ 0 };
+	/** Set once Category and the fields of the derived slot have been written by the thread that claimed the slot. */
+	std::atomic<bool>				bReady{ false };
+
+	FName							Category;
+};
+
+/**
+* TCapsaCategoryTable is a fixed-size, append-only open addressing table of per-category slots, shared by
+* FCapsaCategoryLimiter and FCapsaCategoryProfiler.
+*
+* Slots are claimed with a compare-and-swap and never released, so FindOrAdd never takes a lock and can be called
+* from any thread inside FCapsaOutputDevice::Serialize. Categories beyond NumSlots share the overflow slot.
+*/
+template<typename SlotType, int32 NumSlots = 1024>
+class TCapsaCategoryTable
+{
+	static_assert( TIsDerivedFrom<SlotType, FCapsaCategorySlot>::Value, "Slots must derive from FCapsaCategorySlot" );
+	static_assert( FMath::IsPowerOfTwo( NumSlots ), "NumSlots must be a power of two" );
+
+public:
+
+	TCapsaCategoryTable()
+		: Slots( MakeUnique<SlotType[]>( NumSlots ) )
+	{
+		OverflowSlot.Category = NAME_None;
+	}
+
+	/**
+	* Finds or claims the slot for the given Category. Falls back to the overflow slot when the table is full.
+	*
+	* @param Category The Log Category.
+	* @param InitSlot Called by the thread that claims the slot, before it is marked ready.
+	* @return SlotType& The slot, check bReady before reading the fields written by InitSlot.
+	*/
+	template<typename InitSlotType>
+	SlotType&						FindOrAdd( const FName& Category, InitSlotType&& InitSlot )
+	{
+		const uint32 Key = Category.GetComparisonIndex().ToUnstableInt() + 1;
+		uint32 Index = GetTypeHash( Key ) & ( NumSlots - 1 );
+
+		for( int32 Probe = 0; Probe < NumSlots; ++Probe, Index = ( Index + 1 ) & ( NumSlots - 1 ) )
+		{
+			SlotType& Slot = Slots[Index];
+			uint32 SlotKey = Slot.Key.load( std::memory_order_acquire );
+			if( SlotKey == Key )
+			{
+				return Slot;
+			}
+
+			if( SlotKey == 0 )
+			{
+				if( Slot.Key.compare_exchange_strong( SlotKey, Key, std::memory_order_acq_rel ) == true )
+				{
+					// We own the slot, publish its fields.
+					Slot.Category = Category;
+					InitSlot( Slot );
+					Slot.bReady.store( true, std::memory_order_release );
+					return Slot;
+				}
+
+				// Another thread claimed it first, it may have been for the same category.
+				if( SlotKey == Key )
+				{
+					return Slot;
+				}
+			}
+		}
+
+		return OverflowSlot;
+	}
+
+	/**
+	* Calls Visitor for every ready slot, including the overflow slot.
+	*
+	* @param Visitor Receives the slot.
+	*/
+	template<typename VisitorType>
+	void							ForEachReadySlot( VisitorType&& Visitor )
+	{
+		for( int32 Index = 0; Index < NumSlots; ++Index )
+		{
+			if( Slots[Index].bReady.load( std::memory_order_acquire ) == true )
+			{
+				Visitor( Slots[Index] );
+			}
+		}
+		if( OverflowSlot.bReady.load( std::memory_order_acquire ) == true )
+		{
+			Visitor( OverflowSlot );
+		}
+	}
+
+	template<typename VisitorType>
+	void							ForEachReadySlot( VisitorType&& Visitor ) const
+	{
+		const_cast<TCapsaCategoryTable*>( this )->ForEachReadySlot( [&Visitor]( const SlotType& Slot )
+			{
+				Visitor( Slot );
+			} );
+	}
+
+	/**
+	* Returns the slot shared by the categories that did not fit. Its owner fills it in and marks it ready.
+	*
+	* @return SlotType& The overflow slot.
+	*/
+	SlotType&						GetOverflowSlot()
+	{
+		return OverflowSlot;
+	}
+
+private:
+
+	TUniquePtr<SlotType[]>			Slots;
+	SlotType						OverflowSlot;
+};
@@ -0,0 +1,79 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/OutputDevice.h"
+
+
+/**
+* FCapsaFlightRecorder keeps the most recent verbose lines in a fixed-size in-memory ring, so they
+* can be uploaded in a time window around an incident instead of during normal operation.
+*
+* The Flight Recorder is not thread-safe, the owning FCapsaOutputDevice guards it with its lock.
+*/
+class CAPSALOG_API FCapsaFlightRecorder
+{
+public:
+
+	FCapsaFlightRecorder();
+
+	/**
+	* Sets up the ring. Discards any recorded lines.
+	*
+	* @param InCapacity The maximum number of lines to keep in memory.
+	* @param InSecondsBefore How many seconds of recorded lines before a trigger to upload.
+	* @param InSecondsAfter For how many seconds after a trigger lines should be uploaded directly.
+	*/
+	void						Configure( int32 InCapacity, double InSecondsBefore, double InSecondsAfter );
+
+	/**
+	* Whether lines with the given Time fall within the window after the last trigger,
+	* in which case they should be uploaded directly instead of recorded.
+	*
+	* @param Time The Unix timestamp of the line.
+	* @return bool True if the upload window is open.
+	*/
+	bool						IsWindowOpen( double Time ) const;
+
+	/**
+	* Stores a line in the ring, overwriting the oldest line if the ring is full.
+	*
+	* @param Data The line to record.
+	* @param Category The Log Category of the line.
+	* @param Verbosity The Verbosity of the line.
+	* @param Time The Unix timestamp of the line.
+	*/
+	void						Record( const TCHAR* Data, const FName& Category, ELogVerbosity::Type Verbosity, double Time );
+
+	/**
+	* Opens the upload window and merges the recorded lines from the window before Time into
+	* OutLines, keeping OutLines ordered by time. The ring is emptied.
+	*
+	* @param Time The Unix timestamp of the trigger.
+	* @param OutLines The (time ordered) buffer to merge the recorded lines into.
+	* @return int32 The number of recorded lines added to OutLines.
+	*/
+	int32						Trigger( double Time, TArray<FBufferedLine>& OutLines );
+
+private:
+
+	struct FRecordedLine
+	{
+		FString					Data;
+		FName					Category;
+		ELogVerbosity::Type		Verbosity = ELogVerbosity::Log;
+		double					Time = 0.0;
+	};
+
+	/** Ring storage. Entries are reused so FString allocations are recycled once the ring is full. */
+	TArray<FRecordedLine>		Ring;
+	/** Index of the oldest recorded line. */
+	int32						Head;
+	/** Number of recorded lines. */
+	int32						Count;
+
+	double						SecondsBefore;
+	double						SecondsAfter;
+	double						WindowEndTime;
+};
@@ -4,20 +4,73 @@
 
 #include "Engine.h"
 #include "Misc/BufferedOutputDevice.h"
+#include "Misc/CapsaCategoryLimiter.h"
+#include "Misc/CapsaCategoryProfiler.h"
+#include "Misc/CapsaFlightRecorder.h"
+#include "Logging/CapsaDeferredLog.h"
+#include "Logging/CapsaLogRecording.h"
+#include "Tasks/Pipe.h"
 
 
+class UCapsaCoreSubsystem;
+struct FCapsaSettingsSnapshot;
 
-struct FCapsaOutputDevice : public FBufferedOutputDevice
+struct CAPSALOG_API FCapsaOutputDevice : public FBufferedOutputDevice, public ICapsaDeferredLogSink
 {
 public:
 
-	FCapsaOutputDevice();
+	/**
+	* @param bInAttach Whether to capture GLog and flush on a ticker. Detached devices only buffer the lines passed
+	* to them directly, which is what the capture path benchmarks use.
+	*/
+	explicit FCapsaOutputDevice( bool bInAttach = true );
 	~FCapsaOutputDevice();
 
 	// FBufferedOutputDevice
 	virtual void				Serialize( const TCHAR* InData, ELogVerbosity::Type Verbosity, const FName& Category ) override;
+	virtual void				SerializeRecord( const UE::FLogRecord& Record ) override;
 	// ~FBufferedOutputDevice
 
+	// ICapsaDeferredLogSink
+	virtual void				SerializeDeferred( const FCapsaLogFormatSite& Site, TConstArrayView<uint8> Args ) override;
+	// ~ICapsaDeferredLogSink
+
+	/**
+	* Uploads the lines held by the Flight Recorder from the window before now, and uploads all
+	* lines directly for the window after now. Does nothing if the Flight Recorder is disabled.
+	*/
+	void						TriggerFlightRecorder();
+
+	/**
+	* Starts recording every line handed to the Log Pipeline, or dropped in its place, to a Capsa log recording.
+	* Replaces a running recording. Call on the game thread.
+	*
+	* @param FilePath The recording to write, uses GetDefaultRecordingPath if empty.
+	* @return bool True if the recording was started.
+	*/
+	bool						StartRecording( const FString& FilePath );
+
+	/**
+	* Stops the running recording, if any. Call on the game thread.
+	*/
+	void						StopRecording();
+
+	bool						IsRecording() const;
+
+	/**
+	* Returns the path of a new recording in the project log directory.
+	*
+	* @return FString The path, named after the current time.
+	*/
+	static FString				GetDefaultRecordingPath();
+
+	/**
+	* Returns the per-category line and byte counts, see FCapsaCategoryProfiler.
+	*
+	* @return FCapsaCategoryProfiler The profiler of this output device.
+	*/
+	FCapsaCategoryProfiler&		GetCategoryProfiler();
+
 protected:
 
 	/**
@@ -33,6 +86,77 @@ protected:
 	*/
 	bool						Tick( float Seconds );
 
+	/**
+	* Adds a line to the buffer for every Log Category that had lines suppressed by the
+	* CategoryLimiter since the last flush, so the data loss is visible in the uploaded log.
+	*/
+	void						AppendSuppressedLinesSummary();
+
+	/**
+	* Reports the memory held by the buffered lines to FCapsaTelemetry. Call with SynchronizationObject held.
+	*/
+	void						UpdateBufferedBytes();
+
+	/**
+	* Drops the oldest buffered lines beyond MaxBufferedLogLines, while the Log Pipeline can not take them.
+	* Call with SynchronizationObject held.
+	*/
+	void						DropOldestLines();
+
+	/**
+	* Appends lines that leave the output device to the running recording. The deferred lines are formatted, and
+	* the lines are encoded and written, by a task on RecordingPipe.
+	*
+	* @param Lines The formatted lines, taken by the recording.
+	* @param Deferred The lines that were captured unformatted, taken by the recording.
+	*/
+	void						RecordLines( TArray<FBufferedLine>&& Lines, FCapsaDeferredLogBuffer&& Deferred );
+
+	/**
+	* Like RecordLines, for lines that are still sent to the Capsa Server. Copies the lines if a recording is running.
+	*/
+	void						RecordLineCopies( const TArray<FBufferedLine>& Lines, const FCapsaDeferredLogBuffer& Deferred );
+
+	/**
+	* Applies the filter level, the frame budget and the CategoryLimiter to a line that is about to be captured.
+	* The caller counts accepted lines in the CategoryProfiler, so filtered lines are never measured.
+	*
+	* @param Verbosity The verbosity of the line.
+	* @param Category The Log Category of the line.
+	* @return bool True if the line should be captured.
+	*/
+	bool						ShouldCapture( ELogVerbosity::Type Verbosity, const FName& Category );
+
+	/**
+	* Sends the categories that produced the most bytes to the Capsa Server as metadata, once per
+	* TopTalkersMetadataInterval.
+	*
+	* @param CapsaCoreSubsystem The authenticated Core Subsystem.
+	*/
+	void						UpdateTopTalkersMetadata( UCapsaCoreSubsystem* CapsaCoreSubsystem );
+
+	/**
+	* Sends the lines logged under World log sessions to their session. Lines of a session that is busy stay buffered,
+	* lines of a session that is not authenticated yet are dropped.
+	*
+	* @param CapsaCoreSubsystem The Core Subsystem, the lines are dropped if null.
+	*/
+	void						FlushSessionBuffers( UCapsaCoreSubsystem* CapsaCoreSubsystem );
+
+	/**
+	* Applies the flush rates, verbosity and rate limits of a settings snapshot. The TickRate is applied by Tick.
+	* Like the rate limits, the verbosity is only applied when it differs from the previous snapshot.
+	*
+	* @param Snapshot The snapshot to apply.
+	*/
+	void						ApplySettingsSnapshot( const FCapsaSettingsSnapshot& Snapshot );
+
+	/**
+	* Frees the limiters replaced by ApplySettingsSnapshot once no thread can still be using them
+	* and their suppressed line counts have been reported.
+	*/
+	void						FreeRetiredCategoryLimiters();
+
 	/**
 	* How fast, in seconds, to update this Output Device.
 	*/
@@ -48,8 +172,116 @@ protected:
 	*/
 	int32						MaxLogLines;
 
+	/**
+	* How many log lines are kept while the Log Pipeline is full, see DropOldestLines.
+	*/
+	int32						MaxBufferedLogLines;
+
+	/**
+	* Applies per-category rate limits and sampling to captured lines. Replaced by ApplySettingsSnapshot when the
+	* limits change, the earlier limiters are kept in CategoryLimiters while other threads may still be using them.
+	* The last entry of CategoryLimiters is the current limiter. NumCategoryLimiterUsers counts the ShouldCapture calls
+	* that hold a limiter, the earlier limiters are only freed while it is 0.
+	*/
+	std::atomic<FCapsaCategoryLimiter*>	CategoryLimiter;
+	std::atomic<int32>			NumCategoryLimiterUsers;
+	TArray<TUniquePtr<FCapsaCategoryLimiter>> CategoryLimiters;
+	TMap<FName, FCapsaCategoryRateLimit> CategoryRateLimits;
+	FCapsaCategoryRateLimit		DefaultCategoryRateLimit;
+
+	/**
+	* Counts the lines and bytes per Log Category.
+	*/
+	FCapsaCategoryProfiler		CategoryProfiler;
+
+	/**
+	* How often the top talkers are sent as metadata, 0 to never send them.
+	*/
+	float						TopTalkersMetadataInterval;
+
+	/**
+	* How many categories are sent as metadata.
+	*/
+	int32						NumTopTalkers;
+
+	double						LastTopTalkersTime;
+
+	/**
+	* Keeps lines more verbose than FlightRecorderVerbosity in memory until an incident occurs.
+	* Guarded by SynchronizationObject.
+	*/
+	FCapsaFlightRecorder		FlightRecorder;
+
+	/**
+	* Whether lines more verbose than FlightRecorderVerbosity go to the FlightRecorder.
+	*/
+	bool						bUseFlightRecorder;
+
+	/**
+	* The most verbose level that is buffered directly when the Flight Recorder is enabled.
+	*/
+	ELogVerbosity::Type			FlightRecorderVerbosity;
+
+	/**
+	* Lines captured by CAPSA_LOG and UE_LOGFMT that are formatted by the background task.
+	* Guarded by SynchronizationObject.
+	*/
+	FCapsaDeferredLogBuffer		DeferredLines;
+
+	/**
+	* Whether CAPSA_LOG and UE_LOGFMT lines are captured unformatted.
+	*/
+	bool						bUseDeferredFormatting;
+
+	/**
+	* Forwards CAPSA_LOG lines to this device while it is the deferred log sink. Shared with FCapsaDeferredLog,
+	* the destructor waits until no line holds a reference.
+	*/
+	TSharedPtr<ICapsaDeferredLogSink, ESPMode::ThreadSafe> DeferredLogSink;
+
+	/**
+	* The size of the text of the lines in BufferedLines, in bytes. Guarded by SynchronizationObject.
+	*/
+	int64						BufferedTextBytes;
+
+	/**
+	* The lines logged under a World log session, see FCapsaLogSession::GetCurrentID(). They are formatted when captured,
+	* and skip the Flight Recorder. Guarded by SynchronizationObject.
+	*/
+	struct FSessionBuffer
+	{
+		TArray<FBufferedLine>	Lines;
+		int64					TextBytes = 0;
+	};
+	TMap<uint32, FSessionBuffer> SessionBuffers;
+	int32						NumSessionLines;
+
+	/**
+	* The lines captured since the last Tick, reported to FCapsaTelemetry by Tick. Guarded by SynchronizationObject.
+	*/
+	int32						NumUnreportedCapturedLines;
+
+	/**
+	* Writes the lines taken by Tick when a recording is running. Opened and closed on the game thread while
+	* RecordingPipe is empty, lines are only added by RecordingPipe tasks.
+	*/
+	FCapsaLogRecordingWriter	Recording;
+
+	/**
+	* Runs the recording tasks one after another, so lines are written in the order they were taken.
+	*/
+	UE::Tasks::FPipe			RecordingPipe;
+
 private:
 
+	bool						bAttach;
 	FTSTicker::FDelegateHandle	TickerHandle;
 	double						LastUpdateTime;
+	uint32						SettingsRevision;
+
+	/**
+	* The verbosity of the last applied settings snapshot. FilterLevel is only replaced when the snapshot verbosity
+	* changes, so a verbosity set on the output device is kept across unrelated settings changes.
+	*/
+	ELogVerbosity::Type			SnapshotVerbosity;
 };
@@ -0,0 +1,54 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+using UnrealBuildTool;
+
+public class CapsaTools : ModuleRules
+{
+	public CapsaTools(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+		
+		PublicIncludePaths.AddRange(
+			new string[]
+			{
+			}
+			);
+				
+		
+		PrivateIncludePaths.AddRange(
+			new string[]
+			{
+			}
+			);
+			
+		
+		PublicDependencyModuleNames.AddRange(
+			new string[]
+			{
+				"Core",
+			}
+			);
+			
+		
+		PrivateDependencyModuleNames.AddRange(
+			new string[]
+			{
+				"CapsaCore",
+				"CapsaLog",
+				"CoreUObject",
+				"DeveloperSettings",
+				"Engine",
+				"HTTPServer",
+				"Json",
+				"JsonUtilities",
+			}
+			);
+		
+		
+		DynamicallyLoadedModuleNames.AddRange(
+			new string[]
+			{
+			}
+			);
+	}
+}
@@ -0,0 +1,158 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaAllocationCounter.h"
+
+#include "CapsaTools.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/CommandLine.h"
+
+
+namespace CapsaAllocationCounter
+{
+	static thread_local uint64 ThreadAllocations = 0;
+
+	/**
+	* Forwards everything to the allocator it replaced, counting Malloc and Realloc per thread.
+	*/
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+
+		virtual void*			Malloc( SIZE_T Count, uint32 Alignment ) override
+		{
+			++ThreadAllocations;
+			return Inner->Malloc( Count, Alignment );
+		}
+
+		virtual void*			TryMalloc( SIZE_T Count, uint32 Alignment ) override
+		{
+			++ThreadAllocations;
+			return Inner->TryMalloc( Count, Alignment );
+		}
+
+		virtual void*			Realloc( void* Original, SIZE_T Count, uint32 Alignment ) override
+		{
+			++ThreadAllocations;
+			return Inner->Realloc( Original, Count, Alignment );
+		}
+
+		virtual void*			TryRealloc( void* Original, SIZE_T Count, uint32 Alignment ) override
+		{
+			++ThreadAllocations;
+			return Inner->TryRealloc( Original, Count, Alignment );
+		}
+
+		virtual void			Free( void* Original ) override
+		{
+			Inner->Free( Original );
+		}
+
+		virtual SIZE_T			QuantizeSize( SIZE_T Count, uint32 Alignment ) override
+		{
+			return Inner->QuantizeSize( Count, Alignment );
+		}
+
+		virtual bool			GetAllocationSize( void* Original, SIZE_T& SizeOut ) override
+		{
+			return Inner->GetAllocationSize( Original, SizeOut );
+		}
+
+		virtual void			Trim( bool bTrimThreadCaches ) override
+		{
+			Inner->Trim( bTrimThreadCaches );
+		}
+
+		virtual void			SetupTLSCachesOnCurrentThread() override
+		{
+			Inner->SetupTLSCachesOnCurrentThread();
+		}
+
+		virtual void			ClearAndDisableTLSCachesOnCurrentThread() override
+		{
+			Inner->ClearAndDisableTLSCachesOnCurrentThread();
+		}
+
+		virtual void			MarkTLSCachesAsUsedOnCurrentThread() override
+		{
+			Inner->MarkTLSCachesAsUsedOnCurrentThread();
+		}
+
+		virtual void			MarkTLSCachesAsUnusedOnCurrentThread() override
+		{
+			Inner->MarkTLSCachesAsUnusedOnCurrentThread();
+		}
+
+		virtual void			UpdateStats() override
+		{
+			Inner->UpdateStats();
+		}
+
+		virtual void			GetAllocatorStats( FGenericMemoryStats& OutStats ) override
+		{
+			Inner->GetAllocatorStats( OutStats );
+		}
+
+		virtual void			DumpAllocatorStats( FOutputDevice& Ar ) override
+		{
+			Inner->DumpAllocatorStats( Ar );
+		}
+
+		virtual bool			IsInternallyThreadSafe() const override
+		{
+			return Inner->IsInternallyThreadSafe();
+		}
+
+		virtual bool			ValidateHeap() override
+		{
+			return Inner->ValidateHeap();
+		}
+
+		virtual const TCHAR*	GetDescriptiveName() override
+		{
+			return Inner->GetDescriptiveName();
+		}
+
+		FMalloc*				Inner = nullptr;
+	};
+
+	/**
+	* Never destroyed, allocations made through it may be freed until the process exits.
+	*/
+	static FCountingMalloc& GetProxy()
+	{
+		static FCountingMalloc* Proxy = new FCountingMalloc();
+		return *Proxy;
+	}
+}
+
+void FCapsaAllocationCounter::InstallAtStartup()
+{
+	if( IsInstalled() == true || GMalloc == nullptr )
+	{
+		return;
+	}
+
+	FString Commandlet;
+	const bool bPerfCommandlet = FParse::Value( FCommandLine::Get(), TEXT( "run=" ), Commandlet ) == true && Commandlet.Equals( TEXT( "CapsaPerf" ), ESearchCase::IgnoreCase ) == true;
+	if( bPerfCommandlet == false && FParse::Param( FCommandLine::Get(), TEXT( "CapsaCountAllocations" ) ) == false )
+	{
+		return;
+	}
+
+	CapsaAllocationCounter::FCountingMalloc& Proxy = CapsaAllocationCounter::GetProxy();
+	Proxy.Inner = GMalloc;
+	FPlatformMisc::MemoryBarrier();
+	GMalloc = &Proxy;
+
+	UE_LOG( LogCapsaTools, Log, TEXT( "FCapsaAllocationCounter::Install | Counting allocations of %s" ), Proxy.Inner->GetDescriptiveName() );
+}
+
+bool FCapsaAllocationCounter::IsInstalled()
+{
+	return GMalloc == &CapsaAllocationCounter::GetProxy();
+}
+
+uint64 FCapsaAllocationCounter::GetThreadAllocations()
+{
+	return CapsaAllocationCounter::ThreadAllocations;
+}
@@ -0,0 +1,240 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaBenchmark.h"
+
+#include "CapsaTools.h"
+#include "Dom/JsonObject.h"
+#include "HAL/PlatformOutputDevices.h"
+#include "Misc/FileHelper.h"
+#include "Policies/PrettyJsonPrintPolicy.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+
+namespace CapsaBenchmark
+{
+	/**
+	* Flattens results JSON into "Result.Metric" -> value.
+	*/
+	static bool ParseResults( const FString& Json, TMap<FString, double>& OutMetrics )
+	{
+		TSharedPtr<FJsonObject> Root;
+		if( FJsonSerializer::Deserialize( TJsonReaderFactory<>::Create( Json ), Root ) == false || Root.IsValid() == false )
+		{
+			return false;
+		}
+
+		const TArray<TSharedPtr<FJsonValue>>* Results = nullptr;
+		if( Root->TryGetArrayField( TEXT( "Results" ), Results ) == false )
+		{
+			return false;
+		}
+
+		for( const TSharedPtr<FJsonValue>& ResultValue : *Results )
+		{
+			const TSharedPtr<FJsonObject>* Result = nullptr;
+			const TSharedPtr<FJsonObject>* Metrics = nullptr;
+			FString Name;
+			if( ResultValue->TryGetObject( Result ) == false
+				|| ( *Result )->TryGetStringField( TEXT( "Name" ), Name ) == false
+				|| ( *Result )->TryGetObjectField( TEXT( "Metrics" ), Metrics ) == false )
+			{
+				continue;
+			}
+
+			for( const TPair<FString, TSharedPtr<FJsonValue>>& Metric : ( *Metrics )->Values )
+			{
+				double Value = 0.0;
+				if( Metric.Value->TryGetNumber( Value ) == true )
+				{
+					OutMetrics.Add( Name + TEXT( "." ) + Metric.Key, Value );
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	* Returns +1 if higher values of the metric are better, -1 if lower values are better, 0 if unknown.
+	*/
+	static int32 GetMetricDirection( const FString& MetricName )
+	{
+		if( MetricName.EndsWith( TEXT( "PerSecond" ) ) == true || MetricName.EndsWith( TEXT( "Ratio" ) ) == true )
+		{
+			return 1;
+		}
+		if( MetricName.EndsWith( TEXT( "Seconds" ) ) == true || MetricName.EndsWith( TEXT( "PerLine" ) ) == true || MetricName.EndsWith( TEXT( "PerChunk" ) ) == true )
+		{
+			return -1;
+		}
+		return 0;
+	}
+}
+
+
+void FCapsaBenchmarkResult::AddMetric( const FString& MetricName, double Value )
+{
+	Metrics.Emplace( MetricName, Value );
+}
+
+FString FCapsaBenchmarkResult::ToString() const
+{
+	FString Result = Name;
+	for( const TPair<FString, double>& Metric : Metrics )
+	{
+		Result += FString::Printf( TEXT( " | %s: %.4f" ), *Metric.Key, Metric.Value );
+	}
+
+	return Result;
+}
+
+FCapsaBenchmarkContext::FCapsaBenchmarkContext( double InScale )
+	: Scale( FMath::Max( InScale, 0.0 ) )
+{
+}
+
+FCapsaBenchmarkResult& FCapsaBenchmarkContext::AddResult( const FString& Name )
+{
+	FCapsaBenchmarkResult& Result = Results.AddDefaulted_GetRef();
+	Result.Name = Name;
+	return Result;
+}
+
+int32 FCapsaBenchmarkContext::Scaled( int32 Count ) const
+{
+	return FMath::Max( 1, FMath::RoundToInt( Count * Scale ) );
+}
+
+const TArray<FCapsaBenchmarkResult>& FCapsaBenchmarkContext::GetResults() const
+{
+	return Results;
+}
+
+void FCapsaBenchmarkContext::SetRecordedLogPath( const FString& InRecordedLogPath )
+{
+	RecordedLogPath = InRecordedLogPath;
+}
+
+FString FCapsaBenchmarkContext::GetRecordedLogPath() const
+{
+	return RecordedLogPath.IsEmpty() == true ? FPlatformOutputDevices::GetAbsoluteLogFilename() : RecordedLogPath;
+}
+
+FString FCapsaBenchmarkContext::ToJson() const
+{
+	FString Json;
+	TSharedRef<TJsonWriter<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>> Writer = TJsonWriterFactory<TCHAR, TPrettyJsonPrintPolicy<TCHAR>>::Create( &Json );
+
+	Writer->WriteObjectStart();
+	Writer->WriteValue( TEXT( "Scale" ), Scale );
+	Writer->WriteArrayStart( TEXT( "Results" ) );
+	for( const FCapsaBenchmarkResult& Result : Results )
+	{
+		Writer->WriteObjectStart();
+		Writer->WriteValue( TEXT( "Name" ), Result.Name );
+		Writer->WriteObjectStart( TEXT( "Metrics" ) );
+		for( const TPair<FString, double>& Metric : Result.Metrics )
+		{
+			Writer->WriteValue( Metric.Key, Metric.Value );
+		}
+		Writer->WriteObjectEnd();
+		Writer->WriteObjectEnd();
+	}
+	Writer->WriteArrayEnd();
+	Writer->WriteObjectEnd();
+	Writer->Close();
+
+	return Json;
+}
+
+int32 FCapsaBenchmarkContext::CompareToBaseline( const FString& BaselinePath, double MaxRegression ) const
+{
+	FString BaselineJson;
+	TMap<FString, double> Baseline;
+	if( FFileHelper::LoadFileToString( BaselineJson, *BaselinePath ) == false || CapsaBenchmark::ParseResults( BaselineJson, Baseline ) == false )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "FCapsaBenchmarkContext::CompareToBaseline | Failed to read baseline %s" ), *BaselinePath );
+		return -1;
+	}
+
+	int32 NumRegressions = 0;
+	for( const FCapsaBenchmarkResult& Result : Results )
+	{
+		for( const TPair<FString, double>& Metric : Result.Metrics )
+		{
+			const FString MetricName = Result.Name + TEXT( "." ) + Metric.Key;
+			const int32 Direction = CapsaBenchmark::GetMetricDirection( MetricName );
+			const double* BaselineValue = Baseline.Find( MetricName );
+			if( Direction == 0 || BaselineValue == nullptr || *BaselineValue <= 0.0 )
+			{
+				continue;
+			}
+
+			// Positive when the metric got worse
+			const double Change = ( *BaselineValue - Metric.Value ) / *BaselineValue * Direction;
+			if( Change > MaxRegression )
+			{
+				UE_LOG( LogCapsaTools, Error, TEXT( "FCapsaBenchmarkContext::CompareToBaseline | %s regressed by %.1f%%: %.4f, baseline %.4f" ), *MetricName, Change * 100.0, Metric.Value, *BaselineValue );
+				++NumRegressions;
+			}
+		}
+	}
+
+	return NumRegressions;
+}
+
+FCapsaBenchmarkRegistry& FCapsaBenchmarkRegistry::Get()
+{
+	static FCapsaBenchmarkRegistry Registry;
+	return Registry;
+}
+
+void FCapsaBenchmarkRegistry::Register( const FString& Name, FCapsaBenchmarkFunction Function )
+{
+	Benchmarks.Emplace( Name, MoveTemp( Function ) );
+}
+
+int32 FCapsaBenchmarkRegistry::Run( const FString& Filter, FCapsaBenchmarkContext& Context ) const
+{
+	int32 NumRun = 0;
+	for( const TPair<FString, FCapsaBenchmarkFunction>& Benchmark : Benchmarks )
+	{
+		if( Filter.IsEmpty() == false && Benchmark.Key.Contains( Filter ) == false )
+		{
+			continue;
+		}
+
+		UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaBenchmarkRegistry::Run | Running %s" ), *Benchmark.Key );
+
+		const int32 FirstResult = Context.GetResults().Num();
+		Benchmark.Value( Context );
+		++NumRun;
+
+		for( int32 Index = FirstResult; Index < Context.GetResults().Num(); ++Index )
+		{
+			UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaBenchmarkRegistry::Run | %s" ), *Context.GetResults()[Index].ToString() );
+		}
+	}
+
+	return NumRun;
+}
+
+static void RunBenchmarksCommand( const TArray<FString>& Args )
+{
+	const FString Filter = Args.Num() > 0 ? Args[0] : FString();
+	const double Scale = Args.Num() > 1 ? FCString::Atod( *Args[1] ) : 1.0;
+
+	FCapsaBenchmarkContext Context( Scale );
+	const int32 NumRun = FCapsaBenchmarkRegistry::Get().Run( Filter, Context );
+
+	UE_LOG( LogCapsaTools, Display, TEXT( "Capsa.Bench | Ran %d benchmarks, %d results" ), NumRun, Context.GetResults().Num() );
+}
+
+static FAutoConsoleCommand CVarCapsaBench(
+	TEXT( "Capsa.Bench" ),
+	TEXT( "Runs the Capsa benchmarks and logs the results. " )
+	TEXT( "Usage: Capsa.Bench [NameFilter] [Scale]" ),
+	FConsoleCommandWithArgsDelegate::CreateStatic( RunBenchmarksCommand ),
+	ECVF_Default );
@@ -0,0 +1,268 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaAllocationCounter.h"
+#include "Benchmark/CapsaBenchmark.h"
+#include "Benchmark/CapsaSyntheticLog.h"
+
+#include "Async/Async.h"
+#include "CapsaCoreAsync.h"
+#include "CapsaTools.h"
+#include "HAL/PlatformMisc.h"
+#include "Logging/CapsaLogRecording.h"
+#include "Misc/CapsaOutputDevice.h"
+#include "Misc/FileHelper.h"
+
+#include <atomic>
+
+
+namespace CapsaCapturePathBenchmark
+{
+	/**
+	* The number of lines per chunk for the encode benchmarks, a busy server flushes about this many.
+	*/
+	static constexpr int32 LinesPerChunk = 2000;
+
+	/**
+	* Parses a log file written by Unreal into lines, "[Date][Frame]Category: Verbosity: Message".
+	* Lines without a category, like the log header and multi-line messages, keep their full text.
+	* Capsa log recordings, written by Capsa.Record, are read as they are.
+	*/
+	static void LoadRecordedLog( const FString& FilePath, TArray<FBufferedLine>& OutLines )
+	{
+		if( FilePath.EndsWith( CapsaLogRecording::Extension ) == true )
+		{
+			FCapsaLogRecordingReader Reader;
+			if( Reader.Open( FilePath ) == true )
+			{
+				Reader.ReadAll( OutLines );
+			}
+			return;
+		}
+
+		FString Text;
+		if( FFileHelper::LoadFileToString( Text, *FilePath, FFileHelper::EHashOptions::None, FILEREAD_AllowWrite ) == false )
+		{
+			return;
+		}
+
+		TArray<FString> TextLines;
+		Text.ParseIntoArrayLines( TextLines );
+
+		const FName UnknownCategory( TEXT( "LogRecorded" ) );
+		double Time = 1700000000.0;
+		for( const FString& TextLine : TextLines )
+		{
+			FStringView Message( TextLine );
+			for( int32 Prefix = 0; Prefix < 2 && Message.StartsWith( TEXT( '[' ) ) == true; ++Prefix )
+			{
+				int32 CloseIndex = INDEX_NONE;
+				if( Message.FindChar( TEXT( ']' ), CloseIndex ) == false )
+				{
+					break;
+				}
+				Message.RightChopInline( CloseIndex + 1 );
+			}
+
+			FName Category = UnknownCategory;
+			ELogVerbosity::Type Verbosity = ELogVerbosity::Log;
+			const int32 CategoryEnd = Message.Find( TEXT( ": " ) );
+			int32 SpaceIndex = INDEX_NONE;
+			if( CategoryEnd > 0 && Message.Left( CategoryEnd ).FindChar( TEXT( ' ' ), SpaceIndex ) == false )
+			{
+				Category = FName( Message.Left( CategoryEnd ) );
+				Message.RightChopInline( CategoryEnd + 2 );
+
+				const int32 VerbosityEnd = Message.Find( TEXT( ": " ) );
+				if( VerbosityEnd > 0 )
+				{
+					const ELogVerbosity::Type ParsedVerbosity = ParseLogVerbosityFromString( FString( Message.Left( VerbosityEnd ) ) );
+					if( ParsedVerbosity != ELogVerbosity::NoLogging && ParsedVerbosity != ELogVerbosity::All )
+					{
+						Verbosity = ParsedVerbosity;
+						Message.RightChopInline( VerbosityEnd + 2 );
+					}
+				}
+			}
+
+			OutLines.Emplace( *FString( Message ), Category, Verbosity, Time );
+			Time += 0.001;
+		}
+	}
+
+	/**
+	* Serializes Messages to a detached output device from NumThreads threads at once, like UE_LOG from
+	* several threads does, and reports the throughput of the capture path.
+	*/
+	static void RunSerialize( FCapsaBenchmarkContext& Context, const TArray<TPair<FString, FName>>& Messages, int32 NumLines, int32 NumThreads )
+	{
+		FCapsaOutputDevice OutputDevice( false );
+
+		const int32 LinesPerThread = FMath::Max( 1, NumLines / NumThreads );
+		std::atomic<int32> NumReady( 0 );
+		std::atomic<bool> bStart( false );
+
+		TArray<TFuture<uint64>> Producers;
+		for( int32 ThreadIndex = 0; ThreadIndex < NumThreads; ++ThreadIndex )
+		{
+			Producers.Add( Async( EAsyncExecution::Thread, [&OutputDevice, &Messages, &NumReady, &bStart, ThreadIndex, LinesPerThread]()
+				{
+					++NumReady;
+					while( bStart.load() == false )
+					{
+						FPlatformProcess::Yield();
+					}
+
+					const uint64 AllocationsBefore = FCapsaAllocationCounter::GetThreadAllocations();
+					for( int32 Index = 0; Index < LinesPerThread; ++Index )
+					{
+						const TPair<FString, FName>& Message = Messages[( ThreadIndex * 7919 + Index ) % Messages.Num()];
+						OutputDevice.Serialize( *Message.Key, ELogVerbosity::Log, Message.Value );
+					}
+					return FCapsaAllocationCounter::GetThreadAllocations() - AllocationsBefore;
+				} ) );
+		}
+
+		while( NumReady.load() < NumThreads )
+		{
+			FPlatformProcess::Yield();
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		bStart = true;
+		uint64 Allocations = 0;
+		for( TFuture<uint64>& Producer : Producers )
+		{
+			Allocations += Producer.Get();
+		}
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+		const int32 TotalLines = LinesPerThread * NumThreads;
+		FCapsaBenchmarkResult& Result = Context.AddResult( FString::Printf( TEXT( "CapturePath.Serialize.%dThreads" ), NumThreads ) );
+		Result.AddMetric( TEXT( "Lines" ), TotalLines );
+		Result.AddMetric( TEXT( "Seconds" ), Seconds );
+		Result.AddMetric( TEXT( "LinesPerSecond" ), Seconds > 0.0 ? TotalLines / Seconds : 0.0 );
+		Result.AddMetric( TEXT( "NanosecondsPerLine" ), Seconds * 1e9 / TotalLines );
+		if( FCapsaAllocationCounter::IsInstalled() == true )
+		{
+			Result.AddMetric( TEXT( "AllocationsPerLine" ), static_cast<double>( Allocations ) / TotalLines );
+		}
+	}
+
+	/**
+	* Formats Lines chunk by chunk into a reused string, like the Log Pipeline does, then converts and
+	* compresses every chunk.
+	*/
+	static void RunEncode( FCapsaBenchmarkContext& Context, const FString& Source, const TArray<FBufferedLine>& Lines )
+	{
+		FString Log;
+		TArray<uint8> Utf8Bytes;
+		TArray<uint8> Compressed;
+
+		int32 NumChunks = 0;
+		int64 Utf8Size = 0;
+		int64 CompressedSize = 0;
+		double FormatSeconds = 0.0;
+		double CompressSeconds = 0.0;
+		uint64 FormatAllocations = 0;
+		uint64 CompressAllocations = 0;
+
+		for( int32 FirstLine = 0; FirstLine < Lines.Num(); FirstLine += LinesPerChunk )
+		{
+			TArray<FBufferedLine> ChunkLines;
+			ChunkLines.Reserve( LinesPerChunk );
+			for( int32 Index = FirstLine; Index < FMath::Min( FirstLine + LinesPerChunk, Lines.Num() ); ++Index )
+			{
+				const FBufferedLine& Line = Lines[Index];
+				ChunkLines.Emplace( Line.Data.Get(), Line.Category.Resolve(), Line.Verbosity, Line.Time );
+			}
+			FCapsaChunkBuilder Builder( MoveTemp( ChunkLines ) );
+
+			uint64 AllocationsBefore = FCapsaAllocationCounter::GetThreadAllocations();
+			double StartTime = FPlatformTime::Seconds();
+			Builder.BuildLogString( Log );
+			FormatSeconds += FPlatformTime::Seconds() - StartTime;
+			FormatAllocations += FCapsaAllocationCounter::GetThreadAllocations() - AllocationsBefore;
+
+			AllocationsBefore = FCapsaAllocationCounter::GetThreadAllocations();
+			StartTime = FPlatformTime::Seconds();
+			FCapsaChunkBuilder::ConvertToUtf8( Log, Utf8Bytes );
+			FCapsaChunkBuilder::CompressBytes( Utf8Bytes, Compressed );
+			CompressSeconds += FPlatformTime::Seconds() - StartTime;
+			CompressAllocations += FCapsaAllocationCounter::GetThreadAllocations() - AllocationsBefore;
+
+			Utf8Size += Utf8Bytes.Num();
+			CompressedSize += Compressed.Num();
+			++NumChunks;
+		}
+
+		const double Megabytes = Utf8Size / ( 1024.0 * 1024.0 );
+
+		FCapsaBenchmarkResult& FormatResult = Context.AddResult( FString::Printf( TEXT( "CapturePath.MakeLogString.%s" ), *Source ) );
+		FormatResult.AddMetric( TEXT( "Lines" ), Lines.Num() );
+		FormatResult.AddMetric( TEXT( "Seconds" ), FormatSeconds );
+		FormatResult.AddMetric( TEXT( "LinesPerSecond" ), FormatSeconds > 0.0 ? Lines.Num() / FormatSeconds : 0.0 );
+		FormatResult.AddMetric( TEXT( "MegabytesPerSecond" ), FormatSeconds > 0.0 ? Megabytes / FormatSeconds : 0.0 );
+		if( FCapsaAllocationCounter::IsInstalled() == true )
+		{
+			FormatResult.AddMetric( TEXT( "AllocationsPerChunk" ), static_cast<double>( FormatAllocations ) / NumChunks );
+		}
+
+		FCapsaBenchmarkResult& CompressResult = Context.AddResult( FString::Printf( TEXT( "CapturePath.Compress.%s" ), *Source ) );
+		CompressResult.AddMetric( TEXT( "Lines" ), Lines.Num() );
+		CompressResult.AddMetric( TEXT( "Seconds" ), CompressSeconds );
+		CompressResult.AddMetric( TEXT( "MegabytesPerSecond" ), CompressSeconds > 0.0 ? Megabytes / CompressSeconds : 0.0 );
+		CompressResult.AddMetric( TEXT( "CompressionRatio" ), CompressedSize > 0 ? static_cast<double>( Utf8Size ) / CompressedSize : 0.0 );
+		if( FCapsaAllocationCounter::IsInstalled() == true )
+		{
+			CompressResult.AddMetric( TEXT( "AllocationsPerChunk" ), static_cast<double>( CompressAllocations ) / NumChunks );
+		}
+	}
+
+	static void Run( FCapsaBenchmarkContext& Context )
+	{
+		const int32 NumLines = Context.Scaled( 200000 );
+
+		// Serialize, with a fixed set of messages so only the capture path is measured
+		FCapsaSyntheticLog SyntheticLog;
+		TArray<TPair<FString, FName>> Messages;
+		for( int32 Index = 0; Index < 1024; ++Index )
+		{
+			FName Category;
+			ELogVerbosity::Type Verbosity;
+			FString Message = SyntheticLog.MakeLine( Category, Verbosity );
+			Messages.Emplace( MoveTemp( Message ), Category );
+		}
+
+		const int32 MaxThreads = FMath::Min( FPlatformMisc::NumberOfCoresIncludingHyperthreads(), 8 );
+		for( int32 NumThreads = 1; NumThreads <= MaxThreads; NumThreads *= 2 )
+		{
+			RunSerialize( Context, Messages, NumLines, NumThreads );
+		}
+
+		// MakeLogString and compression, on synthetic lines
+		TArray<FBufferedLine> SyntheticLines;
+		SyntheticLog.Generate( NumLines, SyntheticLines );
+		RunEncode( Context, TEXT( "Synthetic" ), SyntheticLines );
+
+		// And on a recorded log, repeated until it has as many lines as the synthetic one
+		TArray<FBufferedLine> RecordedLines;
+		const FString RecordedLogPath = Context.GetRecordedLogPath();
+		LoadRecordedLog( RecordedLogPath, RecordedLines );
+		if( RecordedLines.IsEmpty() == true )
+		{
+			UE_LOG( LogCapsaTools, Warning, TEXT( "CapsaCapturePathBenchmark::Run | No lines in recorded log %s, skipping" ), *RecordedLogPath );
+			return;
+		}
+
+		const int32 NumRecordedLines = RecordedLines.Num();
+		RecordedLines.Reserve( NumLines );
+		for( int32 Index = NumRecordedLines; Index < NumLines; ++Index )
+		{
+			const FBufferedLine& Line = RecordedLines[Index % NumRecordedLines];
+			RecordedLines.Emplace( Line.Data.Get(), Line.Category.Resolve(), Line.Verbosity, Line.Time );
+		}
+		RunEncode( Context, TEXT( "Recorded" ), RecordedLines );
+	}
+
+	static FCapsaBenchmarkRegistration Registration( TEXT( "CapturePath" ), &Run );
+}
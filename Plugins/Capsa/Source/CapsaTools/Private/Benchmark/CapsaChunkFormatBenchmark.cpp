@@ -0,0 +1,102 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaBenchmark.h"
+#include "Benchmark/CapsaSyntheticLog.h"
+
+#include "CapsaCoreAsync.h"
+#include "CapsaTools.h"
+
+
+namespace CapsaChunkFormatBenchmark
+{
+	/**
+	* Encodes and compresses a session of NumChunks chunks in the given Format, like the upload path does.
+	*/
+	static void RunSession( FCapsaBenchmarkContext& Context, ECapsaChunkFormat Format, int32 NumChunks, int32 LinesPerChunk )
+	{
+		FCapsaChunkFormatOptions FormatOptions;
+		FormatOptions.Format = Format;
+		if( Format == ECapsaChunkFormat::Template )
+		{
+			FormatOptions.TemplateMiner = MakeShared<FCapsaTemplateMiner, ESPMode::ThreadSafe>();
+		} else if( Format == ECapsaChunkFormat::Columnar )
+		{
+			FormatOptions.ColumnarEncoder = MakeShared<FCapsaColumnarEncoder, ESPMode::ThreadSafe>();
+		}
+
+		FCapsaSyntheticLog SyntheticLog;
+		TMap<uint32, FString> Dictionary;
+
+		int64 PlainBytes = 0;
+		int64 EncodedBytes = 0;
+		int64 CompressedBytes = 0;
+		double FormatSeconds = 0.0;
+		double CompressSeconds = 0.0;
+		bool bRoundTrip = true;
+
+		for( int32 ChunkIndex = 0; ChunkIndex < NumChunks; ++ChunkIndex )
+		{
+			TArray<FBufferedLine> Lines;
+			SyntheticLog.Generate( LinesPerChunk, Lines, 1700000000.0 + ChunkIndex );
+
+			// Ensure dumps and callstacks span several lines, with either line ending, and have to decode as well
+			Lines.Emplace( *FString::Printf( TEXT( "Ensure condition failed: Actor != nullptr [File:CapsaBenchmark.cpp] [Line: %d]\r\n[Callstack] 0x00007ff6 UnrealEditor-Engine.dll!AActor::Tick()\n[Callstack] 0x00007ff7 UnrealEditor-Core.dll!FTaskGraph::Run()" ), ChunkIndex ),
+				FName( TEXT( "LogOutputDevice" ) ), ELogVerbosity::Error, 1700000000.0 + ChunkIndex + 0.999 );
+			FCapsaChunkBuilder Builder( MoveTemp( Lines ), FormatOptions );
+
+			TArray<uint8> Encoded;
+			double StartTime = FPlatformTime::Seconds();
+			Builder.MakeChunkBinary( Encoded );
+			FormatSeconds += FPlatformTime::Seconds() - StartTime;
+
+			TArray<uint8> Compressed;
+			StartTime = FPlatformTime::Seconds();
+			FCapsaChunkBuilder::CompressBytes( Encoded, Compressed );
+			CompressSeconds += FPlatformTime::Seconds() - StartTime;
+
+			const FString Plain = Builder.MakeLogString();
+			PlainBytes += FTCHARToUTF8( *Plain ).Length();
+			EncodedBytes += Encoded.Num();
+			CompressedBytes += Compressed.Num();
+
+			FString Decoded;
+			if( Format == ECapsaChunkFormat::Template )
+			{
+				const FString EncodedString( FUTF8ToTCHAR( reinterpret_cast<const ANSICHAR*>( Encoded.GetData() ), Encoded.Num() ) );
+				bRoundTrip &= FCapsaTemplateMiner::DecodeChunk( EncodedString, Dictionary, Decoded ) == true && Decoded.Equals( Plain, ESearchCase::CaseSensitive ) == true;
+			} else if( Format == ECapsaChunkFormat::Columnar )
+			{
+				bRoundTrip &= FCapsaColumnarEncoder::DecodeChunk( Encoded, Dictionary, Decoded ) == true && Decoded.Equals( Plain, ESearchCase::CaseSensitive ) == true;
+			}
+		}
+
+		FCapsaBenchmarkResult& Result = Context.AddResult( FString::Printf( TEXT( "ChunkFormat.%s" ), *UEnum::GetValueAsName( Format ).ToString() ) );
+		Result.AddMetric( TEXT( "Lines" ), NumChunks * LinesPerChunk );
+		Result.AddMetric( TEXT( "PlainBytes" ), PlainBytes );
+		Result.AddMetric( TEXT( "EncodedBytes" ), EncodedBytes );
+		Result.AddMetric( TEXT( "CompressedBytes" ), CompressedBytes );
+		Result.AddMetric( TEXT( "CompressionRatio" ), CompressedBytes > 0 ? static_cast<double>( PlainBytes ) / CompressedBytes : 0.0 );
+		Result.AddMetric( TEXT( "FormatSeconds" ), FormatSeconds );
+		Result.AddMetric( TEXT( "CompressSeconds" ), CompressSeconds );
+		if( Format == ECapsaChunkFormat::Template )
+		{
+			Result.AddMetric( TEXT( "Clusters" ), FormatOptions.TemplateMiner->GetNumClusters() );
+		}
+		if( Format != ECapsaChunkFormat::PlainText )
+		{
+			Result.AddMetric( TEXT( "RoundTrip" ), bRoundTrip == true ? 1.0 : 0.0 );
+		}
+	}
+
+	static void Run( FCapsaBenchmarkContext& Context )
+	{
+		const int32 NumChunks = Context.Scaled( 20 );
+		const int32 LinesPerChunk = 2000;
+
+		RunSession( Context, ECapsaChunkFormat::PlainText, NumChunks, LinesPerChunk );
+		RunSession( Context, ECapsaChunkFormat::Template, NumChunks, LinesPerChunk );
+		RunSession( Context, ECapsaChunkFormat::Columnar, NumChunks, LinesPerChunk );
+	}
+
+	static FCapsaBenchmarkRegistration Registration( TEXT( "ChunkFormat" ), &Run );
+}
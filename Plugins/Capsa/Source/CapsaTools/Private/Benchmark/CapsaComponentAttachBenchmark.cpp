@@ -0,0 +1,166 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaBenchmark.h"
+
+#include "CapsaTools.h"
+#include "Components/CapsaActorComponent.h"
+#include "Settings/CapsaSettingsSnapshot.h"
+
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/GameSession.h"
+#include "GameFramework/OnlineReplStructs.h"
+#include "GameFramework/PlayerController.h"
+#include "Kismet/GameplayStatics.h"
+#include "UObject/Package.h"
+
+
+namespace CapsaComponentAttachBenchmark
+{
+	/**
+	* Spawns the GameMode of the project in World and starts its game, so players can log in through it.
+	*
+	* @param World The World to spawn the GameMode in.
+	* @param NumPlayers The number of players that will log in, the GameSession is opened up to this many.
+	* @return AGameModeBase* The GameMode, nullptr if it could not be spawned.
+	*/
+	static AGameModeBase* StartGame( UWorld* World, int32 NumPlayers )
+	{
+		// The World of the benchmark is not owned by a Game Instance, lend it one to create the GameMode for the URL
+		World->SetGameInstance( NewObject<UGameInstance>( GetTransientPackage() ) );
+		if( World->SetGameMode( FURL() ) == false )
+		{
+			return nullptr;
+		}
+
+		AGameModeBase* GameMode = World->GetAuthGameMode();
+		FString ErrorMessage;
+		GameMode->InitGame( World->GetMapName(), TEXT( "" ), ErrorMessage );
+		if( GameMode->GameSession != nullptr )
+		{
+			GameMode->GameSession->MaxPlayers = NumPlayers;
+			GameMode->GameSession->MaxSpectators = NumPlayers;
+		}
+		return GameMode;
+	}
+
+	/**
+	* Logs a player in through the GameMode, like a connection that finished joining does.
+	* Players join as spectators, so the benchmark doesn't depend on the PlayerStarts of a map.
+	*
+	* @param GameMode The GameMode to log in to.
+	* @return bool True if the GameMode accepted the player.
+	*/
+	static bool LoginPlayer( AGameModeBase* GameMode )
+	{
+		FString ErrorMessage;
+		APlayerController* Player = GameMode->Login( nullptr, ROLE_AutonomousProxy, TEXT( "" ), TEXT( "?SpectatorOnly=1" ), FUniqueNetIdRepl(), ErrorMessage );
+		if( Player == nullptr )
+		{
+			UE_LOG( LogCapsaTools, Warning, TEXT( "CapsaComponentAttachBenchmark | Login failed: %s" ), *ErrorMessage );
+			return false;
+		}
+
+		GameMode->PostLogin( Player );
+		return true;
+	}
+
+	/**
+	* Joins NumPlayers players, like a join wave, and adds the time per login to a new result.
+	* With bLogin, every player logs in through the GameMode of the project, otherwise an Actor of Class is spawned per player.
+	* With bScan, also does what the Capsa Subsystem used to do on every login: search the World for every Actor of
+	* Class and look for the Capsa Component on each. UCapsaWorldSubsystem adds the component from its spawn hook in all cases.
+	*/
+	static void RunJoinWave( FCapsaBenchmarkContext& Context, const FString& Name, TSubclassOf<AActor> Class, int32 NumPlayers, int32 NumOtherActors, bool bScan, bool bLogin )
+	{
+		UWorld* World = UWorld::CreateWorld( EWorldType::Game, false, FName( *FString::Printf( TEXT( "CapsaBenchmark_%s%s" ), bLogin == true ? TEXT( "Login" ) : TEXT( "" ), bScan == true ? TEXT( "Scan" ) : TEXT( "Event" ) ) ) );
+		if( World == nullptr )
+		{
+			UE_LOG( LogCapsaTools, Warning, TEXT( "CapsaComponentAttachBenchmark | Failed to create a World" ) );
+			return;
+		}
+
+		AGameModeBase* GameMode = bLogin == true ? StartGame( World, NumPlayers ) : nullptr;
+		if( bLogin == true && GameMode == nullptr )
+		{
+			UE_LOG( LogCapsaTools, Warning, TEXT( "CapsaComponentAttachBenchmark | Failed to spawn the GameMode, skipping %s" ), *Name );
+			World->DestroyWorld( false );
+			return;
+		}
+
+		// The rest of a big server, which the scan also has to go through
+		for( int32 Index = 0; Index < NumOtherActors; ++Index )
+		{
+			World->SpawnActor<AActor>();
+		}
+
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		int32 NumComponents = 0;
+		double Seconds = 0.0;
+		double LastLoginSeconds = 0.0;
+		TArray<AActor*> Actors;
+		for( int32 Player = 0; Player < NumPlayers; ++Player )
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			if( bLogin == true )
+			{
+				LoginPlayer( GameMode );
+			}
+			else
+			{
+				World->SpawnActor( Class, nullptr, nullptr, SpawnParameters );
+			}
+			if( bScan == true )
+			{
+				UGameplayStatics::GetAllActorsOfClass( World, Class, Actors );
+				for( AActor* Actor : Actors )
+				{
+					NumComponents += Actor->FindComponentByClass<UCapsaActorComponent>() != nullptr ? 1 : 0;
+				}
+			}
+			LastLoginSeconds = FPlatformTime::Seconds() - StartTime;
+			Seconds += LastLoginSeconds;
+		}
+
+		// Every player has to end up with exactly one component
+		int32 NumValid = 0;
+		UGameplayStatics::GetAllActorsOfClass( World, Class, Actors );
+		for( AActor* Actor : Actors )
+		{
+			TInlineComponentArray<UCapsaActorComponent*> Components( Actor );
+			NumValid += Components.Num() == 1 ? 1 : 0;
+		}
+
+		FCapsaBenchmarkResult& Result = Context.AddResult( Name );
+		Result.AddMetric( TEXT( "Players" ), NumPlayers );
+		Result.AddMetric( TEXT( "OtherActors" ), NumOtherActors );
+		Result.AddMetric( TEXT( "LoginSeconds" ), Seconds / NumPlayers );
+		Result.AddMetric( TEXT( "LastLoginSeconds" ), LastLoginSeconds );
+		Result.AddMetric( TEXT( "ValidRatio" ), Actors.Num() > 0 ? static_cast<double>( NumValid ) / Actors.Num() : 0.0 );
+
+		World->DestroyWorld( false );
+	}
+
+	static void Run( FCapsaBenchmarkContext& Context )
+	{
+		const FCapsaSettingsSnapshot::FRef CapsaSettings = FCapsaSettingsSnapshot::Get();
+		if( CapsaSettings->bAutoAddCapsaComponent == false || CapsaSettings->AutoAddClass == nullptr )
+		{
+			UE_LOG( LogCapsaTools, Warning, TEXT( "CapsaComponentAttachBenchmark | Skipped, bAutoAddCapsaComponent is disabled" ) );
+			return;
+		}
+
+		const int32 NumPlayers = Context.Scaled( 128 );
+		const int32 NumOtherActors = Context.Scaled( 5000 );
+		RunJoinWave( Context, TEXT( "ComponentAttach.Scan" ), CapsaSettings->AutoAddClass, NumPlayers, NumOtherActors, true, false );
+		RunJoinWave( Context, TEXT( "ComponentAttach.Event" ), CapsaSettings->AutoAddClass, NumPlayers, NumOtherActors, false, false );
+		RunJoinWave( Context, TEXT( "ComponentAttach.LoginScan" ), CapsaSettings->AutoAddClass, NumPlayers, NumOtherActors, true, true );
+		RunJoinWave( Context, TEXT( "ComponentAttach.LoginEvent" ), CapsaSettings->AutoAddClass, NumPlayers, NumOtherActors, false, true );
+	}
+
+	static FCapsaBenchmarkRegistration Registration( TEXT( "ComponentAttach" ), &Run );
+}
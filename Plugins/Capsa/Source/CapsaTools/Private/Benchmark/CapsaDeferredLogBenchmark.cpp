@@ -0,0 +1,106 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaBenchmark.h"
+
+#include "CapsaTools.h"
+#include "Logging/CapsaDeferredLog.h"
+
+#include "Misc/OutputDeviceNull.h"
+
+
+DEFINE_LOG_CATEGORY_STATIC( LogCapsaBenchmark, Log, All );
+
+#define CAPSA_BENCHMARK_FORMAT TEXT( "Spawned %s_%d at X=%.3f Y=%.3f Z=%.3f, owner %s" )
+
+namespace CapsaDeferredLogBenchmark
+{
+	/**
+	* Captures CAPSA_LOG lines the way FCapsaOutputDevice does, without filtering.
+	*/
+	class FBenchmarkSink : public ICapsaDeferredLogSink
+	{
+	public:
+
+		virtual void				SerializeDeferred( const FCapsaLogFormatSite& Site, TConstArrayView<uint8> Args ) override
+		{
+			const double Time = FDateTime::Now().ToUnixTimestampDecimal();
+
+			FScopeLock ScopeLock( &CriticalSection );
+			Lines.AddLine( Site.ID, Time, Args );
+		}
+
+		FCapsaDeferredLogBuffer		Lines;
+		FCriticalSection			CriticalSection;
+	};
+
+	static const TCHAR* const Names[] = { TEXT( "BP_Enemy_C" ), TEXT( "BP_Pickup_C" ), TEXT( "BP_Door_C" ) };
+	static const TCHAR* const Owner = TEXT( "PlayerController_0" );
+
+	static void Run( FCapsaBenchmarkContext& Context )
+	{
+		const int32 NumLines = Context.Scaled( 100000 );
+
+		// Baseline: the formatting UE_LOG does on the calling thread, into a null Output Device instead of GLog,
+		// so the console, the log file and Capsa itself do not add to the time
+		FOutputDeviceNull NullOutputDevice;
+		const FName Category = LogCapsaBenchmark.GetCategoryName();
+
+		double StartTime = FPlatformTime::Seconds();
+		for( int32 Index = 0; Index < NumLines; ++Index )
+		{
+			if( UE_LOG_ACTIVE( LogCapsaBenchmark, Log ) )
+			{
+				NullOutputDevice.CategorizedLogf( Category, ELogVerbosity::Log, CAPSA_BENCHMARK_FORMAT, Names[Index % UE_ARRAY_COUNT( Names )], Index, Index * 0.5f, Index * -0.25f, 100.f, Owner );
+			}
+		}
+		const double UELogSeconds = FPlatformTime::Seconds() - StartTime;
+
+		FCapsaBenchmarkResult& UELogResult = Context.AddResult( TEXT( "DeferredLog.UE_LOG" ) );
+		UELogResult.AddMetric( TEXT( "Lines" ), NumLines );
+		UELogResult.AddMetric( TEXT( "CallerSeconds" ), UELogSeconds );
+		UELogResult.AddMetric( TEXT( "CallerNanosecondsPerLine" ), UELogSeconds * 1e9 / NumLines );
+
+		// CAPSA_LOG, capturing the format ID and raw arguments into a benchmark sink. The active sink is left alone,
+		// so the lines of the running game are still captured while the benchmark runs.
+		static const FCapsaLogFormatSite Site( Category, ELogVerbosity::Log, CAPSA_BENCHMARK_FORMAT, __FILE__, __LINE__ );
+		FBenchmarkSink Sink;
+
+		StartTime = FPlatformTime::Seconds();
+		for( int32 Index = 0; Index < NumLines; ++Index )
+		{
+			if( UE_LOG_ACTIVE( LogCapsaBenchmark, Log ) )
+			{
+				FCapsaDeferredLog::LogTo( Sink, Site, Names[Index % UE_ARRAY_COUNT( Names )], Index, Index * 0.5f, Index * -0.25f, 100.f, Owner );
+			}
+		}
+		const double CapsaLogSeconds = FPlatformTime::Seconds() - StartTime;
+
+		FCapsaBenchmarkResult& CapsaLogResult = Context.AddResult( TEXT( "DeferredLog.CAPSA_LOG" ) );
+		CapsaLogResult.AddMetric( TEXT( "Lines" ), NumLines );
+		CapsaLogResult.AddMetric( TEXT( "CallerSeconds" ), CapsaLogSeconds );
+		CapsaLogResult.AddMetric( TEXT( "CallerNanosecondsPerLine" ), CapsaLogSeconds * 1e9 / NumLines );
+		CapsaLogResult.AddMetric( TEXT( "Speedup" ), CapsaLogSeconds > 0.0 ? UELogSeconds / CapsaLogSeconds : 0.0 );
+
+		// The formatting work moved to the background task
+		TArray<FBufferedLine> DeferredLines;
+		StartTime = FPlatformTime::Seconds();
+		Sink.Lines.FormatInto( DeferredLines );
+		const double FormatSeconds = FPlatformTime::Seconds() - StartTime;
+
+		bool bMatches = DeferredLines.Num() == NumLines;
+		for( int32 Index = 0; bMatches == true && Index < NumLines; ++Index )
+		{
+			const FString Expected = FString::Printf( CAPSA_BENCHMARK_FORMAT, Names[Index % UE_ARRAY_COUNT( Names )], Index, Index * 0.5f, Index * -0.25f, 100.f, Owner );
+			bMatches = Expected.Equals( DeferredLines[Index].Data.Get(), ESearchCase::CaseSensitive );
+		}
+
+		FCapsaBenchmarkResult& FormatResult = Context.AddResult( TEXT( "DeferredLog.BackgroundFormat" ) );
+		FormatResult.AddMetric( TEXT( "Lines" ), DeferredLines.Num() );
+		FormatResult.AddMetric( TEXT( "Seconds" ), FormatSeconds );
+		FormatResult.AddMetric( TEXT( "MatchesPrintf" ), bMatches == true ? 1.0 : 0.0 );
+	}
+
+	static FCapsaBenchmarkRegistration Registration( TEXT( "DeferredLog" ), &Run );
+}
+
+#undef CAPSA_BENCHMARK_FORMAT
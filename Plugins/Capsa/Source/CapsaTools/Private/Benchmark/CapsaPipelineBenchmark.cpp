@@ -0,0 +1,136 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaBenchmark.h"
+#include "Benchmark/CapsaSyntheticLog.h"
+
+#include "Pipeline/CapsaLogPipeline.h"
+#include "CapsaTools.h"
+
+#include "HAL/PlatformMisc.h"
+
+
+namespace CapsaPipelineBenchmark
+{
+	/**
+	* Runs a single burst of Lines through a pipeline with the given sub-chunk size and thread count.
+	* Uploads complete immediately, so only formatting and compression are measured.
+	*/
+	static double RunBurst( FCapsaBenchmarkContext& Context, const TArray<FBufferedLine>& Lines, int32 MaxLinesPerSubChunk, int32 NumThreads, double BaselineSeconds )
+	{
+		FCapsaLogPipelineSettings Settings;
+		Settings.MaxLinesPerSubChunk = MaxLinesPerSubChunk;
+		Settings.NumThreads = NumThreads;
+		Settings.ThreadPriority = TPri_Normal;
+		// The benchmark waits on the game thread, uploads complete right away from the persist task
+		Settings.bUploadOnGameThread = false;
+
+		int64 CompressedBytes = 0;
+		int32 NumSubChunks = 0;
+		FCapsaLogPipeline* Pipeline = nullptr;
+		TSharedRef<FCapsaLogPipeline, ESPMode::ThreadSafe> PipelineRef = MakeShared<FCapsaLogPipeline, ESPMode::ThreadSafe>( Settings,
+			[&Pipeline, &CompressedBytes, &NumSubChunks]( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID )
+			{
+				// Uploads start one after another, from the persist task
+				CompressedBytes += Chunk.SubChunks[SubChunkIndex].Payload.Num();
+				++NumSubChunks;
+				Pipeline->OnUploadComplete( UploadID, true );
+				return true;
+			} );
+		Pipeline = &PipelineRef.Get();
+
+		TArray<FBufferedLine> Buffer;
+		Buffer.Reserve( Lines.Num() );
+		for( const FBufferedLine& Line : Lines )
+		{
+			Buffer.Emplace( Line.Data.Get(), Line.Category.Resolve(), Line.Verbosity, Line.Time );
+		}
+
+		TSharedRef<FCapsaPipelineChunk, ESPMode::ThreadSafe> Chunk = MakeShared<FCapsaPipelineChunk, ESPMode::ThreadSafe>( MoveTemp( Buffer ), FCapsaChunkFormatOptions(), FCapsaDeferredLogBuffer() );
+		Chunk->bCompress = true;
+
+		const double StartTime = FPlatformTime::Seconds();
+		PipelineRef->Submit( Chunk );
+		// Shutdown() waits for the persist stage, which runs the (immediate) uploads
+		PipelineRef->Shutdown();
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+		FCapsaBenchmarkResult& Result = Context.AddResult( MaxLinesPerSubChunk > 0
+			? FString::Printf( TEXT( "Pipeline.Split.%dThreads" ), NumThreads )
+			: FString( TEXT( "Pipeline.Unsplit" ) ) );
+		Result.AddMetric( TEXT( "Seconds" ), Seconds );
+		Result.AddMetric( TEXT( "LinesPerSecond" ), Seconds > 0.0 ? Lines.Num() / Seconds : 0.0 );
+		Result.AddMetric( TEXT( "SubChunks" ), NumSubChunks );
+		Result.AddMetric( TEXT( "CompressedBytes" ), CompressedBytes );
+		if( BaselineSeconds > 0.0 )
+		{
+			Result.AddMetric( TEXT( "Speedup" ), Seconds > 0.0 ? BaselineSeconds / Seconds : 0.0 );
+		}
+
+		return Seconds;
+	}
+
+	static void Run( FCapsaBenchmarkContext& Context )
+	{
+		TArray<FBufferedLine> Lines;
+		FCapsaSyntheticLog SyntheticLog;
+		SyntheticLog.Generate( Context.Scaled( 400000 ), Lines );
+
+		const double BaselineSeconds = RunBurst( Context, Lines, 0, 1, 0.0 );
+
+		const int32 NumCores = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+		for( int32 NumThreads = 1; NumThreads <= FMath::Min( NumCores, 8 ); NumThreads *= 2 )
+		{
+			RunBurst( Context, Lines, 20000, NumThreads, BaselineSeconds );
+		}
+	}
+
+	/**
+	* Flushes NumChunks chunks one after another, like steady logging does, and reports how many of the
+	* pipeline buffers were reused from earlier chunks.
+	*/
+	static void RunSteadyState( FCapsaBenchmarkContext& Context )
+	{
+		const int32 NumChunks = Context.Scaled( 200 );
+		const int32 LinesPerChunk = 1000;
+
+		FCapsaLogPipelineSettings Settings;
+		Settings.bUploadOnGameThread = false;
+		FCapsaLogPipeline* Pipeline = nullptr;
+		TSharedRef<FCapsaLogPipeline, ESPMode::ThreadSafe> PipelineRef = MakeShared<FCapsaLogPipeline, ESPMode::ThreadSafe>( Settings,
+			[&Pipeline]( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID )
+			{
+				// Like the HTTP request, take ownership of the payload
+				TArray<uint8> Content = MoveTemp( Chunk.SubChunks[SubChunkIndex].Payload );
+				Pipeline->OnUploadComplete( UploadID, true );
+				return true;
+			} );
+		Pipeline = &PipelineRef.Get();
+
+		FCapsaSyntheticLog SyntheticLog;
+		const double StartTime = FPlatformTime::Seconds();
+		for( int32 ChunkIndex = 0; ChunkIndex < NumChunks; ++ChunkIndex )
+		{
+			TArray<FBufferedLine> Lines;
+			SyntheticLog.Generate( LinesPerChunk, Lines, 1700000000.0 + ChunkIndex );
+
+			TSharedRef<FCapsaPipelineChunk, ESPMode::ThreadSafe> Chunk = MakeShared<FCapsaPipelineChunk, ESPMode::ThreadSafe>( MoveTemp( Lines ), FCapsaChunkFormatOptions(), FCapsaDeferredLogBuffer() );
+			Chunk->bCompress = true;
+			while( PipelineRef->Submit( Chunk ) == false )
+			{
+				FPlatformProcess::Sleep( 0.0f );
+			}
+		}
+		PipelineRef->Shutdown();
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+		const FCapsaBufferPool& BufferPool = PipelineRef->GetBufferPool();
+		FCapsaBenchmarkResult& Result = Context.AddResult( TEXT( "Pipeline.SteadyState" ) );
+		Result.AddMetric( TEXT( "Seconds" ), Seconds );
+		Result.AddMetric( TEXT( "BuffersAcquired" ), BufferPool.GetNumAcquired() );
+		Result.AddMetric( TEXT( "BuffersReused" ), BufferPool.GetNumReused() );
+		Result.AddMetric( TEXT( "PooledBytes" ), BufferPool.GetPooledBytes() );
+	}
+
+	static FCapsaBenchmarkRegistration Registration( TEXT( "PipelineScaling" ), &Run );
+	static FCapsaBenchmarkRegistration SteadyStateRegistration( TEXT( "PipelineBuffers" ), &RunSteadyState );
+}
@@ -0,0 +1,66 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaBenchmark.h"
+
+#include "CapsaTools.h"
+#include "Components/CapsaActorComponent.h"
+
+#include "UObject/CoreNet.h"
+
+
+namespace CapsaSharedDataBenchmark
+{
+	/**
+	* Writes Data with NetSerialize and as the three strings the default property serialization sends, checks that it
+	* reads back unchanged and adds the sizes to a new result.
+	*/
+	static void Measure( FCapsaBenchmarkContext& Context, const FString& Name, const FCapsaSharedData& Data, int32 NumCalls )
+	{
+		FCapsaSharedData Copy = Data;
+		FNetBitWriter StringWriter( nullptr, 0 );
+		StringWriter << Copy.LogID;
+		StringWriter << Copy.LogURL;
+		StringWriter << Copy.Description;
+
+		int64 NumBits = 0;
+		TArray<uint8> Bytes;
+		const double StartTime = FPlatformTime::Seconds();
+		for( int32 Index = 0; Index < NumCalls; ++Index )
+		{
+			FNetBitWriter Writer( nullptr, 0 );
+			bool bSuccess = true;
+			Copy.NetSerialize( Writer, nullptr, bSuccess );
+			NumBits = Writer.GetNumBits();
+			if( Index == 0 )
+			{
+				Bytes = *Writer.GetBuffer();
+			}
+		}
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+		FCapsaSharedData Received;
+		FNetBitReader Reader( nullptr, Bytes.GetData(), NumBits );
+		bool bSuccess = true;
+		Received.NetSerialize( Reader, nullptr, bSuccess );
+
+		FCapsaBenchmarkResult& Result = Context.AddResult( Name );
+		Result.AddMetric( TEXT( "StringBytes" ), static_cast<double>( StringWriter.GetNumBytes() ) );
+		Result.AddMetric( TEXT( "NetSerializeBytes" ), static_cast<double>( ( NumBits + 7 ) / 8 ) );
+		Result.AddMetric( TEXT( "SizeRatio" ), NumBits > 0 ? StringWriter.GetNumBits() / static_cast<double>( NumBits ) : 0.0 );
+		Result.AddMetric( TEXT( "NanosecondsPerWrite" ), Seconds * 1e9 / NumCalls );
+		Result.AddMetric( TEXT( "ValidRatio" ), bSuccess == true && Reader.IsError() == false && Received == Data ? 1.0 : 0.0 );
+	}
+
+	static void Run( FCapsaBenchmarkContext& Context )
+	{
+		const int32 NumCalls = Context.Scaled( 20000 );
+		const FString LogID = TEXT( "3f2b8c1e-6d4a-4f7b-9c0e-5a1d2e3f4b6c" );
+
+		// What a dedicated server replicates to every client, and a client sends back for its own log
+		Measure( Context, TEXT( "SharedData.Server" ), FCapsaSharedData( LogID, TEXT( "https://capsa.example.com/log/" ) + LogID, TEXT( "DedicatedServer" ) ), NumCalls );
+		Measure( Context, TEXT( "SharedData.Custom" ), FCapsaSharedData( LogID, TEXT( "https://capsa.example.com/log/" ) + LogID, TEXT( "Bot 17, EU West" ) ), NumCalls );
+		Measure( Context, TEXT( "SharedData.NotUUID" ), FCapsaSharedData( TEXT( "01HZX3KQ7M2V9T4R8N6B5C1D0E" ), TEXT( "https://capsa.example.com/view?log=01HZX3KQ7M2V9T4R8N6B5C1D0E&tab=lines" ), TEXT( "Player" ) ), NumCalls );
+	}
+
+	static FCapsaBenchmarkRegistration Registration( TEXT( "SharedData" ), &Run );
+}
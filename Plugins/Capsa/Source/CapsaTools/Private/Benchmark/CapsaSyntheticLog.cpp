@@ -0,0 +1,85 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Benchmark/CapsaSyntheticLog.h"
+
+
+FCapsaSyntheticLog::FCapsaSyntheticLog( int32 Seed )
+	: Stream( Seed )
+{
+}
+
+void FCapsaSyntheticLog::Generate( int32 NumLines, TArray<FBufferedLine>& OutLines, double StartTime, double StepSeconds )
+{
+	OutLines.Reserve( OutLines.Num() + NumLines );
+
+	FName Category;
+	ELogVerbosity::Type Verbosity;
+	for( int32 Index = 0; Index < NumLines; ++Index )
+	{
+		const FString Line = MakeLine( Category, Verbosity );
+		OutLines.Emplace( *Line, Category, Verbosity, StartTime + Index * StepSeconds );
+	}
+}
+
+FString FCapsaSyntheticLog::MakeLine( FName& OutCategory, ELogVerbosity::Type& OutVerbosity )
+{
+	static const TCHAR* const Names[] = { TEXT( "BP_Enemy_C" ), TEXT( "BP_Pickup_C" ), TEXT( "BP_Door_C" ), TEXT( "BP_Projectile_C" ), TEXT( "BP_PlayerCharacter_C" ) };
+	static const TCHAR* const Maps[] = { TEXT( "/Game/Maps/Lobby" ), TEXT( "/Game/Maps/Arena" ), TEXT( "/Game/Maps/Forest" ) };
+
+	const TCHAR* const Name = Names[Stream.RandHelper( UE_ARRAY_COUNT( Names ) )];
+	const int32 Roll = Stream.RandHelper( 100 );
+
+	OutVerbosity = ELogVerbosity::Log;
+	if( Roll < 30 )
+	{
+		OutCategory = TEXT( "LogNet" );
+		OutVerbosity = ELogVerbosity::Verbose;
+		return FString::Printf( TEXT( "UNetConnection::ReceivedPacket: Channel %d received bunch %d, %d bytes from %d.%d.%d.%d:%d" ),
+			Stream.RandRange( 0, 63 ), Stream.RandRange( 1, 100000 ), Stream.RandRange( 8, 1200 ),
+			Stream.RandRange( 10, 192 ), Stream.RandRange( 0, 255 ), Stream.RandRange( 0, 255 ), Stream.RandRange( 1, 254 ), Stream.RandRange( 7777, 7790 ) );
+	}
+	if( Roll < 50 )
+	{
+		OutCategory = TEXT( "LogTemp" );
+		return FString::Printf( TEXT( "Spawned %s_%d at X=%.3f Y=%.3f Z=%.3f" ),
+			Name, Stream.RandRange( 0, 5000 ), Stream.FRandRange( -50000.f, 50000.f ), Stream.FRandRange( -50000.f, 50000.f ), Stream.FRandRange( 0.f, 3000.f ) );
+	}
+	if( Roll < 65 )
+	{
+		OutCategory = TEXT( "LogAbilitySystem" );
+		OutVerbosity = ELogVerbosity::Verbose;
+		return FString::Printf( TEXT( "Ability GA_Fire activated on %s_%d, cooldown %.2f seconds, cost %d mana" ),
+			Name, Stream.RandRange( 0, 5000 ), Stream.FRandRange( 0.1f, 10.f ), Stream.RandRange( 0, 100 ) );
+	}
+	if( Roll < 75 )
+	{
+		OutCategory = TEXT( "LogStreaming" );
+		return FString::Printf( TEXT( "Loaded package %s_%d in %.3f ms, %d exports" ),
+			Maps[Stream.RandHelper( UE_ARRAY_COUNT( Maps ) )], Stream.RandRange( 0, 200 ), Stream.FRandRange( 0.1f, 80.f ), Stream.RandRange( 1, 4000 ) );
+	}
+	if( Roll < 85 )
+	{
+		OutCategory = TEXT( "LogAI" );
+		return FString::Printf( TEXT( "%s_%d moving to target, path length %d points, distance %.1f" ),
+			Name, Stream.RandRange( 0, 5000 ), Stream.RandRange( 2, 64 ), Stream.FRandRange( 10.f, 20000.f ) );
+	}
+	if( Roll < 92 )
+	{
+		OutCategory = TEXT( "LogGameMode" );
+		return FString::Printf( TEXT( "Player %s joined the match, %d players in session %s" ),
+			*FGuid( Stream.RandHelper( MAX_int32 ), Stream.RandHelper( MAX_int32 ), 0, 0 ).ToString( EGuidFormats::Short ), Stream.RandRange( 1, 64 ),
+			*FGuid( Stream.RandHelper( MAX_int32 ), 0, 0, 1 ).ToString( EGuidFormats::Short ) );
+	}
+	if( Roll < 97 )
+	{
+		OutCategory = TEXT( "LogPhysics" );
+		OutVerbosity = ELogVerbosity::Warning;
+		return FString::Printf( TEXT( "Penetration detected on %s_%d, depth %.4f, resolving" ),
+			Name, Stream.RandRange( 0, 5000 ), Stream.FRandRange( 0.f, 5.f ) );
+	}
+
+	OutCategory = TEXT( "LogScript" );
+	OutVerbosity = ELogVerbosity::Error;
+	return FString::Printf( TEXT( "Script Msg: Accessed None trying to read property CallFunc_GetOwner_ReturnValue in %s_%d" ),
+		Name, Stream.RandRange( 0, 5000 ) );
+}
@@ -0,0 +1,46 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "CapsaTools.h"
+
+#include "Benchmark/CapsaAllocationCounter.h"
+#include "LoadGen/CapsaLoadGenerator.h"
+#include "LoadGen/CapsaStandInServer.h"
+
+#include "Misc/FileHelper.h"
+
+#define LOCTEXT_NAMESPACE "FCapsaToolsModule"
+
+void FCapsaToolsModule::StartupModule()
+{
+	// Wrap the allocator once, before any benchmark runs, instead of swapping it while threads allocate
+	FCapsaAllocationCounter::InstallAtStartup();
+
+	// Start before the Core Subsystem authenticates, so the session is created on the stand-in
+	uint32 StandInPort = FCapsaStandInServer::DefaultPort;
+	if( FParse::Value( FCommandLine::Get(), TEXT( "CapsaStandIn=" ), StandInPort ) == true || FParse::Param( FCommandLine::Get(), TEXT( "CapsaStandIn" ) ) == true )
+	{
+		double LatencyMilliseconds = 0.0;
+		float FailureRate = 0.f;
+		FParse::Value( FCommandLine::Get(), TEXT( "CapsaStandInLatencyMs=" ), LatencyMilliseconds );
+		FParse::Value( FCommandLine::Get(), TEXT( "CapsaStandInFailureRate=" ), FailureRate );
+		FCapsaStandInServer::Get().Start( StandInPort, LatencyMilliseconds / 1000.0, FailureRate );
+
+		FString PolicyPath;
+		FString PolicyJson;
+		if( FParse::Value( FCommandLine::Get(), TEXT( "CapsaStandInPolicy=" ), PolicyPath ) == true && FFileHelper::LoadFileToString( PolicyJson, *PolicyPath ) == true )
+		{
+			FCapsaStandInServer::Get().SetLogPolicy( PolicyJson.TrimStartAndEnd() );
+		}
+	}
+}
+
+void FCapsaToolsModule::ShutdownModule()
+{
+	FCapsaLoadGenerator::Get().Stop();
+	FCapsaStandInServer::Get().Stop();
+}
+
+#undef LOCTEXT_NAMESPACE
+
+IMPLEMENT_MODULE( FCapsaToolsModule, CapsaTools )
+DEFINE_LOG_CATEGORY( LogCapsaTools );
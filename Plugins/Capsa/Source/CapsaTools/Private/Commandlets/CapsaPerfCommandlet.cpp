@@ -0,0 +1,77 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Commandlets/CapsaPerfCommandlet.h"
+
+#include "Benchmark/CapsaAllocationCounter.h"
+#include "Benchmark/CapsaBenchmark.h"
+#include "CapsaTools.h"
+
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+
+UCapsaPerfCommandlet::UCapsaPerfCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 UCapsaPerfCommandlet::Main( const FString& Params )
+{
+	FString Filter;
+	FParse::Value( *Params, TEXT( "Filter=" ), Filter );
+
+	double Scale = 1.0;
+	FParse::Value( *Params, TEXT( "Scale=" ), Scale );
+
+	FString OutputPath = FPaths::Combine( FPaths::ProjectSavedDir(), TEXT( "Capsa" ), TEXT( "Perf" ), FString::Printf( TEXT( "CapsaPerf-%s.json" ), *FDateTime::Now().ToString() ) );
+	FParse::Value( *Params, TEXT( "Output=" ), OutputPath );
+
+	FString RecordedLogPath;
+	FParse::Value( *Params, TEXT( "RecordedLog=" ), RecordedLogPath );
+
+	FCapsaBenchmarkContext Context( Scale );
+	Context.SetRecordedLogPath( RecordedLogPath );
+
+	if( FCapsaAllocationCounter::IsInstalled() == false )
+	{
+		UE_LOG( LogCapsaTools, Warning, TEXT( "UCapsaPerfCommandlet::Main | Allocation counter is not installed, allocations are not reported" ) );
+	}
+	const int32 NumRun = FCapsaBenchmarkRegistry::Get().Run( Filter, Context );
+
+	if( NumRun == 0 )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "UCapsaPerfCommandlet::Main | No benchmarks match filter '%s'" ), *Filter );
+		return 1;
+	}
+
+	const FString Json = Context.ToJson();
+	if( FFileHelper::SaveStringToFile( Json, *OutputPath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM ) == false )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "UCapsaPerfCommandlet::Main | Failed to write results to %s" ), *OutputPath );
+		return 1;
+	}
+	UE_LOG( LogCapsaTools, Display, TEXT( "UCapsaPerfCommandlet::Main | Ran %d benchmarks, %d results written to %s" ), NumRun, Context.GetResults().Num(), *FPaths::ConvertRelativePathToFull( OutputPath ) );
+
+	FString BaselinePath;
+	if( FParse::Value( *Params, TEXT( "Baseline=" ), BaselinePath ) == false )
+	{
+		return 0;
+	}
+
+	double MaxRegression = 0.25;
+	FParse::Value( *Params, TEXT( "MaxRegression=" ), MaxRegression );
+
+	const int32 NumRegressions = Context.CompareToBaseline( BaselinePath, MaxRegression );
+	if( NumRegressions != 0 )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "UCapsaPerfCommandlet::Main | %d regressions against baseline %s" ), NumRegressions, *BaselinePath );
+		return 1;
+	}
+
+	UE_LOG( LogCapsaTools, Display, TEXT( "UCapsaPerfCommandlet::Main | No regressions against baseline %s" ), *BaselinePath );
+	return 0;
+}
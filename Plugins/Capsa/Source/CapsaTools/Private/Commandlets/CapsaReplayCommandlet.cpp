@@ -0,0 +1,250 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "Commandlets/CapsaReplayCommandlet.h"
+
+#include "Benchmark/CapsaBenchmark.h"
+#include "CapsaCoreAsync.h"
+#include "CapsaTools.h"
+#include "Encoding/CapsaColumnarEncoder.h"
+#include "Encoding/CapsaTemplateMiner.h"
+#include "Logging/CapsaLogRecording.h"
+#include "Pipeline/CapsaLogPipeline.h"
+#include "Settings/CapsaSettings.h"
+#include "Telemetry/CapsaTelemetry.h"
+
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+#include <atomic>
+
+
+namespace CapsaReplayCommandlet
+{
+	/**
+	* A chunk as FCapsaOutputDevice would have flushed it, with the recorded time of its last line.
+	*/
+	struct FReplayChunk
+	{
+		TArray<FBufferedLine>			Lines;
+		double							FlushTime = 0.0;
+	};
+
+	/**
+	* Reads the recording and cuts it into chunks: a chunk is flushed once it holds MaxLines lines,
+	* or when a line is captured more than MaxSeconds after its first line.
+	*/
+	static bool LoadChunks( const FString& FilePath, int32 MaxLines, double MaxSeconds, TArray<FReplayChunk>& OutChunks, int64& OutNumLines )
+	{
+		FCapsaLogRecordingReader Reader;
+		if( Reader.Open( FilePath ) == false )
+		{
+			return false;
+		}
+
+		OutNumLines = 0;
+		double ChunkStartTime = 0.0;
+		TArray<FBufferedLine> Block;
+		while( Reader.ReadBlock( Block ) == true )
+		{
+			for( const FBufferedLine& Line : Block )
+			{
+				if( OutChunks.IsEmpty() == true || OutChunks.Last().Lines.Num() >= MaxLines || Line.Time - ChunkStartTime > MaxSeconds )
+				{
+					OutChunks.AddDefaulted();
+					ChunkStartTime = Line.Time;
+				}
+
+				FReplayChunk& Chunk = OutChunks.Last();
+				Chunk.Lines.Emplace( Line.Data.Get(), Line.Category.Resolve(), Line.Verbosity, Line.Time );
+				Chunk.FlushTime = Line.Time;
+				++OutNumLines;
+			}
+			Block.Reset();
+		}
+
+		return OutNumLines > 0;
+	}
+}
+
+UCapsaReplayCommandlet::UCapsaReplayCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 UCapsaReplayCommandlet::Main( const FString& Params )
+{
+	using namespace CapsaReplayCommandlet;
+
+	FString FilePath;
+	if( FParse::Value( *Params, TEXT( "File=" ), FilePath ) == false )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "UCapsaReplayCommandlet::Main | Missing -File=<File%s>" ), CapsaLogRecording::Extension );
+		return 1;
+	}
+
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+
+	double Speed = 0.0;
+	FParse::Value( *Params, TEXT( "Speed=" ), Speed );
+
+	FCapsaLogPipelineSettings PipelineSettings;
+	PipelineSettings.MaxChunksInFlight = CapsaSettings->GetMaxChunksInFlight();
+	PipelineSettings.MaxParallelEncodes = CapsaSettings->GetMaxParallelChunkEncodes();
+	PipelineSettings.MaxConcurrentUploads = CapsaSettings->GetMaxConcurrentUploads();
+	PipelineSettings.MaxLinesPerSubChunk = CapsaSettings->GetMaxLinesPerSubChunk();
+	PipelineSettings.NumThreads = CapsaSettings->GetPipelineThreadCount();
+	PipelineSettings.ThreadPriority = CapsaSettings->GetPipelineThreadPriority();
+	PipelineSettings.ThreadAffinityMask = CapsaSettings->GetPipelineThreadAffinityMask();
+	// The commandlet waits for the pipeline on the game thread, the uploads only count the bytes
+	PipelineSettings.bUploadOnGameThread = false;
+	FParse::Value( *Params, TEXT( "MaxLinesPerSubChunk=" ), PipelineSettings.MaxLinesPerSubChunk );
+	FParse::Value( *Params, TEXT( "Threads=" ), PipelineSettings.NumThreads );
+	FParse::Value( *Params, TEXT( "MaxChunksInFlight=" ), PipelineSettings.MaxChunksInFlight );
+
+	ECapsaChunkFormat Format = CapsaSettings->GetChunkFormat();
+	FString FormatName;
+	if( FParse::Value( *Params, TEXT( "Format=" ), FormatName ) == true )
+	{
+		const int64 FormatValue = StaticEnum<ECapsaChunkFormat>()->GetValueByNameString( FormatName );
+		if( FormatValue == INDEX_NONE )
+		{
+			UE_LOG( LogCapsaTools, Error, TEXT( "UCapsaReplayCommandlet::Main | Unknown chunk format '%s'" ), *FormatName );
+			return 1;
+		}
+		Format = static_cast<ECapsaChunkFormat>( FormatValue );
+	}
+	FormatName = StaticEnum<ECapsaChunkFormat>()->GetNameStringByValue( static_cast<int64>( Format ) );
+
+	bool bCompress = CapsaSettings->GetUseCompression();
+	FParse::Bool( *Params, TEXT( "Compress=" ), bCompress );
+	// Binary chunks can not be sent as a string, they are always compressed
+	bCompress = bCompress == true || Format == ECapsaChunkFormat::Columnar;
+
+	TArray<FReplayChunk> Chunks;
+	int64 NumLines = 0;
+	if( LoadChunks( FilePath, FMath::Max( CapsaSettings->GetMaxLogLinesBetweenLogFlushes(), 1 ), CapsaSettings->GetMaxTimeBetweenLogFlushes(), Chunks, NumLines ) == false )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "UCapsaReplayCommandlet::Main | No lines in recording %s" ), *FilePath );
+		return 1;
+	}
+	UE_LOG( LogCapsaTools, Display, TEXT( "UCapsaReplayCommandlet::Main | Replaying %lld lines in %d chunks as %s, speed %.1f" ), NumLines, Chunks.Num(), *FormatName, Speed );
+
+	FCapsaChunkFormatOptions FormatOptions;
+	FormatOptions.Format = Format;
+	if( Format == ECapsaChunkFormat::Template )
+	{
+		FormatOptions.TemplateMiner = MakeShared<FCapsaTemplateMiner, ESPMode::ThreadSafe>( CapsaSettings->GetTemplateSimilarityThreshold() );
+	} else if( Format == ECapsaChunkFormat::Columnar )
+	{
+		FormatOptions.ColumnarEncoder = MakeShared<FCapsaColumnarEncoder, ESPMode::ThreadSafe>();
+	}
+
+	std::atomic<int64> UploadedBytes{ 0 };
+	FCapsaLogPipeline* Pipeline = nullptr;
+	TSharedRef<FCapsaLogPipeline, ESPMode::ThreadSafe> PipelineRef = MakeShared<FCapsaLogPipeline, ESPMode::ThreadSafe>( PipelineSettings,
+		[&Pipeline, &UploadedBytes]( FCapsaPipelineChunk& Chunk, int32 SubChunkIndex, uint64 UploadID )
+		{
+			const FCapsaPipelineSubChunk& SubChunk = Chunk.SubChunks[SubChunkIndex];
+			UploadedBytes += SubChunk.Payload.IsEmpty() == true ? SubChunk.Log.Len() : SubChunk.Payload.Num();
+			Pipeline->OnUploadComplete( UploadID, true );
+			return true;
+		} );
+	Pipeline = &PipelineRef.Get();
+
+	const FCapsaTelemetryTotals StartTotals = FCapsaTelemetry::Get().GetTotals();
+	const double FirstLineTime = Chunks[0].Lines[0].Time;
+	const double StartTime = FPlatformTime::Seconds();
+	double StallSeconds = 0.0;
+	for( FReplayChunk& ReplayChunk : Chunks )
+	{
+		if( Speed > 0.0 )
+		{
+			const double SubmitTime = StartTime + ( ReplayChunk.FlushTime - FirstLineTime ) / Speed;
+			const double WaitSeconds = SubmitTime - FPlatformTime::Seconds();
+			if( WaitSeconds > 0.0 )
+			{
+				FPlatformProcess::Sleep( static_cast<float>( WaitSeconds ) );
+			}
+		}
+
+		// The output device keeps buffering while the pipeline is full, here the replay waits for it
+		const double StallStartTime = FPlatformTime::Seconds();
+		while( PipelineRef->CanSubmit() == false )
+		{
+			FPlatformProcess::Sleep( 0.001f );
+		}
+		StallSeconds += FPlatformTime::Seconds() - StallStartTime;
+
+		TSharedRef<FCapsaPipelineChunk, ESPMode::ThreadSafe> Chunk = MakeShared<FCapsaPipelineChunk, ESPMode::ThreadSafe>( MoveTemp( ReplayChunk.Lines ), FCapsaChunkFormatOptions( FormatOptions ), FCapsaDeferredLogBuffer() );
+		Chunk->bCompress = bCompress;
+		PipelineRef->Submit( Chunk );
+	}
+	PipelineRef->Shutdown();
+	const double Seconds = FPlatformTime::Seconds() - StartTime;
+	const FCapsaTelemetryTotals EndTotals = FCapsaTelemetry::Get().GetTotals();
+
+	FCapsaBenchmarkContext Context;
+	FCapsaBenchmarkResult& Result = Context.AddResult( FString::Printf( TEXT( "Replay.%s%s" ), *FormatName, bCompress == true ? TEXT( ".Compressed" ) : TEXT( "" ) ) );
+	Result.AddMetric( TEXT( "Lines" ), NumLines );
+	Result.AddMetric( TEXT( "Chunks" ), Chunks.Num() );
+	Result.AddMetric( TEXT( "Speed" ), Speed );
+	Result.AddMetric( TEXT( "Seconds" ), Seconds );
+	Result.AddMetric( TEXT( "LinesPerSecond" ), Seconds > 0.0 ? NumLines / Seconds : 0.0 );
+	Result.AddMetric( TEXT( "StallSeconds" ), StallSeconds );
+	Result.AddMetric( TEXT( "UploadedBytes" ), UploadedBytes );
+	Result.AddMetric( TEXT( "UploadedBytesPerLine" ), static_cast<double>( UploadedBytes ) / NumLines );
+
+	const uint64 UncompressedBytes = EndTotals.UncompressedBytes - StartTotals.UncompressedBytes;
+	const uint64 CompressedBytes = EndTotals.CompressedBytes - StartTotals.CompressedBytes;
+	if( CompressedBytes > 0 )
+	{
+		Result.AddMetric( TEXT( "CompressionRatio" ), static_cast<double>( UncompressedBytes ) / CompressedBytes );
+	}
+
+	for( int32 StageIndex = 0; StageIndex < static_cast<int32>( ECapsaPipelineStage::Num ); ++StageIndex )
+	{
+		const ECapsaPipelineStage Stage = static_cast<ECapsaPipelineStage>( StageIndex );
+		const FCapsaPipelineStageStats Stats = PipelineRef->GetStageStats( Stage );
+		Result.AddMetric( FString::Printf( TEXT( "%sSeconds" ), FCapsaLogPipeline::GetStageName( Stage ) ), Stats.TotalSeconds );
+		Result.AddMetric( FString::Printf( TEXT( "%sMaxSeconds" ), FCapsaLogPipeline::GetStageName( Stage ) ), Stats.MaxSeconds );
+	}
+
+	const FCapsaBufferPool& BufferPool = PipelineRef->GetBufferPool();
+	Result.AddMetric( TEXT( "BuffersAcquired" ), BufferPool.GetNumAcquired() );
+	Result.AddMetric( TEXT( "BuffersReused" ), BufferPool.GetNumReused() );
+	Result.AddMetric( TEXT( "Rejected" ), PipelineRef->GetNumRejected() );
+
+	UE_LOG( LogCapsaTools, Display, TEXT( "%s" ), *Result.ToString() );
+
+	FString OutputPath = FPaths::Combine( FPaths::ProjectSavedDir(), TEXT( "Capsa" ), TEXT( "Replay" ), FString::Printf( TEXT( "CapsaReplay-%s.json" ), *FDateTime::Now().ToString() ) );
+	FParse::Value( *Params, TEXT( "Output=" ), OutputPath );
+	if( FFileHelper::SaveStringToFile( Context.ToJson(), *OutputPath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM ) == false )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "UCapsaReplayCommandlet::Main | Failed to write results to %s" ), *OutputPath );
+		return 1;
+	}
+	UE_LOG( LogCapsaTools, Display, TEXT( "UCapsaReplayCommandlet::Main | Results written to %s" ), *FPaths::ConvertRelativePathToFull( OutputPath ) );
+
+	FString BaselinePath;
+	if( FParse::Value( *Params, TEXT( "Baseline=" ), BaselinePath ) == false )
+	{
+		return 0;
+	}
+
+	double MaxRegression = 0.25;
+	FParse::Value( *Params, TEXT( "MaxRegression=" ), MaxRegression );
+
+	const int32 NumRegressions = Context.CompareToBaseline( BaselinePath, MaxRegression );
+	if( NumRegressions != 0 )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "UCapsaReplayCommandlet::Main | %d regressions against baseline %s" ), NumRegressions, *BaselinePath );
+		return 1;
+	}
+
+	UE_LOG( LogCapsaTools, Display, TEXT( "UCapsaReplayCommandlet::Main | No regressions against baseline %s" ), *BaselinePath );
+	return 0;
+}
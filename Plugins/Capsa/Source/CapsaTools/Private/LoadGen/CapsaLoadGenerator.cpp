@@ -0,0 +1,421 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "LoadGen/CapsaLoadGenerator.h"
+
+#include "Benchmark/CapsaBenchmark.h"
+#include "Benchmark/CapsaSyntheticLog.h"
+#include "CapsaCoreSubsystem.h"
+#include "CapsaTools.h"
+#include "Components/CapsaActorComponent.h"
+#include "LoadGen/CapsaStandInServer.h"
+#include "Settings/CapsaSettings.h"
+
+#include "Engine/Engine.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/Package.h"
+
+
+/**
+* Logs its share of the lines at an even pace until the run ends.
+*/
+class FCapsaLoadGenerator::FProducer : public FRunnable
+{
+public:
+
+	FProducer( FCapsaLoadGenerator& InGenerator, int32 InIndex )
+		: Generator( InGenerator )
+		, SyntheticLog( 1337 + InIndex )
+		, Stream( 7919 + InIndex )
+	{
+	}
+
+	virtual uint32					Run() override
+	{
+		const FCapsaLoadSettings& Settings = Generator.Settings;
+		const double LinesPerSecond = Settings.LinesPerSecond / Settings.NumThreads;
+		const double StartTime = FPlatformTime::Seconds();
+		const double EndTime = StartTime + Settings.DurationSeconds;
+		// Catch up on at most a tenth of a second of lines at once, after the thread was not scheduled for a while
+		const int64 MaxBurst = FMath::Max<int64>( 1, FMath::CeilToInt64( LinesPerSecond * 0.1 ) );
+		int64 NumEmitted = 0;
+
+		double Now = StartTime;
+		while( Now < EndTime && Generator.bStopProducers.load() == false )
+		{
+			const int64 NumDue = FMath::Min( static_cast<int64>( ( Now - StartTime ) * LinesPerSecond ) - NumEmitted, MaxBurst );
+			for( int64 Index = 0; Index < NumDue; ++Index )
+			{
+				FName Category;
+				ELogVerbosity::Type Verbosity;
+				const FString Line = MakeLine( Settings.Size, Category, Verbosity );
+				GLog->Serialize( *Line, Verbosity, Category );
+			}
+
+			if( NumDue > 0 )
+			{
+				NumEmitted += NumDue;
+				Generator.LinesEmitted.fetch_add( NumDue, std::memory_order_relaxed );
+			}
+
+			FPlatformProcess::SleepNoStats( 0.001f );
+			Now = FPlatformTime::Seconds();
+		}
+
+		return 0;
+	}
+
+private:
+
+	/**
+	* Makes a line, padded with more synthetic lines to the length the size mix asks for.
+	*/
+	FString							MakeLine( ECapsaLoadSize Size, FName& OutCategory, ELogVerbosity::Type& OutVerbosity )
+	{
+		FString Line = SyntheticLog.MakeLine( OutCategory, OutVerbosity );
+
+		int32 TargetLength = 0;
+		const float Roll = Stream.FRand();
+		if( Size == ECapsaLoadSize::Large )
+		{
+			TargetLength = Stream.RandRange( 512, 4096 );
+		} else if( Size == ECapsaLoadSize::Mixed )
+		{
+			if( Roll < 0.01f )
+			{
+				TargetLength = Stream.RandRange( 2048, 8192 );
+			} else if( Roll < 0.1f )
+			{
+				TargetLength = Stream.RandRange( 256, 1024 );
+			}
+		}
+
+		while( Line.Len() < TargetLength )
+		{
+			FName PaddingCategory;
+			ELogVerbosity::Type PaddingVerbosity;
+			Line += TEXT( " | " );
+			Line += SyntheticLog.MakeLine( PaddingCategory, PaddingVerbosity );
+		}
+
+		return Line;
+	}
+
+	FCapsaLoadGenerator&			Generator;
+	FCapsaSyntheticLog				SyntheticLog;
+	FRandomStream					Stream;
+};
+
+FCapsaLoadGenerator& FCapsaLoadGenerator::Get()
+{
+	static FCapsaLoadGenerator Generator;
+	return Generator;
+}
+
+bool FCapsaLoadGenerator::Start( const FCapsaLoadSettings& InSettings )
+{
+	if( IsRunning() == true )
+	{
+		UE_LOG( LogCapsaTools, Warning, TEXT( "FCapsaLoadGenerator::Start | A run is already in progress" ) );
+		return false;
+	}
+
+	Settings = InSettings;
+	Settings.NumThreads = FMath::Clamp( Settings.NumThreads, 1, 64 );
+	Settings.LinesPerSecond = FMath::Max( Settings.LinesPerSecond, 1.0 );
+	Settings.DurationSeconds = FMath::Max( Settings.DurationSeconds, 1.0 );
+	Settings.NumBots = FMath::Max( Settings.NumBots, 0 );
+	Settings.BotReconnectSeconds = FMath::Max( Settings.BotReconnectSeconds, 1.0 );
+
+	const UCapsaSettings* CapsaSettings = GetDefault<UCapsaSettings>();
+	UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaLoadGenerator::Start | %.0f lines/s on %d threads for %.0f s, sending to %s" ),
+		Settings.LinesPerSecond, Settings.NumThreads, Settings.DurationSeconds, *CapsaSettings->GetCapsaServerURL() );
+	if( FCapsaStandInServer::Get().IsRunning() == false )
+	{
+		UE_LOG( LogCapsaTools, Warning, TEXT( "FCapsaLoadGenerator::Start | The stand-in server is not running, the load goes to the configured Capsa Server" ) );
+	}
+
+	StartTime = FPlatformTime::Seconds();
+	LoadEndTime = StartTime + Settings.DurationSeconds;
+	StartTotals = FCapsaTelemetry::Get().GetTotals();
+	CPUPercentSum = 0.0;
+	NumCPUSamples = 0;
+	StartUsedPhysical = FPlatformMemory::GetStats().UsedPhysical;
+	PeakUsedPhysical = StartUsedPhysical;
+	PeakBufferedBytes = 0;
+	PeakUploadQueueDepth = 0;
+	StartStandInChunks = FCapsaStandInServer::Get().GetNumChunks();
+	StartStandInBytes = FCapsaStandInServer::Get().GetNumChunkBytes();
+	StartStandInMetadataRequests = FCapsaStandInServer::Get().GetNumMetadataRequests();
+	LinesEmitted = 0;
+
+	BotLogIDs.Reset( Settings.NumBots );
+	for( int32 Bot = 0; Bot < Settings.NumBots; ++Bot )
+	{
+		BotLogIDs.Add( FGuid::NewGuid().ToString( EGuidFormats::DigitsWithHyphensLower ) );
+	}
+	BotRegistrations = 0;
+	bStopProducers = false;
+
+	for( int32 Index = 0; Index < Settings.NumThreads; ++Index )
+	{
+		TUniquePtr<FProducer>& Producer = Producers.Add_GetRef( MakeUnique<FProducer>( *this, Index ) );
+		Threads.Emplace( FRunnableThread::Create( Producer.Get(), *FString::Printf( TEXT( "CapsaLoadGen%d" ), Index ), 0, TPri_Normal ) );
+	}
+
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateRaw( this, &FCapsaLoadGenerator::Tick ), 0.5f );
+	return true;
+}
+
+void FCapsaLoadGenerator::Stop()
+{
+	if( IsRunning() == false )
+	{
+		return;
+	}
+
+	StopProducers();
+	Report();
+
+	FTSTicker::GetCoreTicker().RemoveTicker( TickerHandle );
+	TickerHandle.Reset();
+}
+
+bool FCapsaLoadGenerator::IsRunning() const
+{
+	return TickerHandle.IsValid() == true;
+}
+
+bool FCapsaLoadGenerator::ParseSize( const FString& Name, ECapsaLoadSize& OutSize )
+{
+	if( Name.Equals( TEXT( "small" ), ESearchCase::IgnoreCase ) == true )
+	{
+		OutSize = ECapsaLoadSize::Small;
+	} else if( Name.Equals( TEXT( "mixed" ), ESearchCase::IgnoreCase ) == true )
+	{
+		OutSize = ECapsaLoadSize::Mixed;
+	} else if( Name.Equals( TEXT( "large" ), ESearchCase::IgnoreCase ) == true )
+	{
+		OutSize = ECapsaLoadSize::Large;
+	} else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool FCapsaLoadGenerator::Tick( float DeltaTime )
+{
+	const FCapsaTelemetrySnapshot Snapshot = FCapsaTelemetry::Get().GetSnapshot();
+	PeakBufferedBytes = FMath::Max( PeakBufferedBytes, Snapshot.BufferedBytes );
+	PeakUploadQueueDepth = FMath::Max( PeakUploadQueueDepth, Snapshot.UploadQueueDepth );
+	PeakUsedPhysical = FMath::Max( PeakUsedPhysical, FPlatformMemory::GetStats().UsedPhysical );
+	CPUPercentSum += FPlatformTime::GetCPUTime().CPUTimePct;
+	++NumCPUSamples;
+
+	const double Now = FPlatformTime::Seconds();
+	TickBots( Now );
+
+	if( Threads.IsEmpty() == false && Now >= LoadEndTime )
+	{
+		StopProducers();
+		UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaLoadGenerator::Tick | Load finished, waiting %.0f s for the last uploads" ), Settings.DrainSeconds );
+	}
+
+	if( Now < LoadEndTime + Settings.DrainSeconds )
+	{
+		return true;
+	}
+
+	Report();
+	TickerHandle.Reset();
+	return false;
+}
+
+void FCapsaLoadGenerator::StopProducers()
+{
+	bStopProducers = true;
+	for( TUniquePtr<FRunnableThread>& Thread : Threads )
+	{
+		Thread->WaitForCompletion();
+	}
+	Threads.Empty();
+	Producers.Empty();
+	LoadEndTime = FMath::Min( LoadEndTime, FPlatformTime::Seconds() );
+}
+
+void FCapsaLoadGenerator::TickBots( double Now )
+{
+	UCapsaCoreSubsystem* CapsaCoreSubsystem = GEngine != nullptr ? GEngine->GetEngineSubsystem<UCapsaCoreSubsystem>() : nullptr;
+	if( BotLogIDs.IsEmpty() == true || CapsaCoreSubsystem == nullptr )
+	{
+		return;
+	}
+
+	// Every bot joins once per BotReconnectSeconds, in turn, until the load stops. A join gets a new Capsa Component,
+	// like the new Player Controller of a reconnecting player, and its client sends ServerRegisterLinkedCapsaLog.
+	const double BotSeconds = FMath::Min( Now, LoadEndTime ) - StartTime;
+	const uint64 NumDue = static_cast<uint64>( BotSeconds * BotLogIDs.Num() / Settings.BotReconnectSeconds ) + 1;
+	for( ; BotRegistrations < NumDue; ++BotRegistrations )
+	{
+		const FString& BotLogID = BotLogIDs[BotRegistrations % BotLogIDs.Num()];
+		UCapsaActorComponent* Component = NewObject<UCapsaActorComponent>( GetTransientPackage() );
+		Component->ServerRegisterLinkedCapsaLog_Implementation( FCapsaSharedData( BotLogID, FString::Printf( TEXT( "loadgen://%s" ), *BotLogID ), TEXT( "Player" ) ) );
+	}
+}
+
+void FCapsaLoadGenerator::Report()
+{
+	const double Elapsed = FPlatformTime::Seconds() - StartTime;
+	const double LoadSeconds = FMath::Max( LoadEndTime - StartTime, UE_SMALL_NUMBER );
+	const FCapsaTelemetryTotals Totals = FCapsaTelemetry::Get().GetTotals();
+	const FCapsaTelemetrySnapshot Snapshot = FCapsaTelemetry::Get().GetSnapshot();
+
+	// Every line logged by the process while the run was going counts, not only the generated ones
+	const uint64 Emitted = LinesEmitted.load();
+	const uint64 Captured = Totals.LinesCaptured - StartTotals.LinesCaptured;
+	const uint64 Delivered = Totals.LinesDelivered - StartTotals.LinesDelivered;
+	const uint64 Dropped = Totals.LinesDropped - StartTotals.LinesDropped;
+	const uint64 Filtered = Totals.LinesFiltered - StartTotals.LinesFiltered;
+	const double PipelineSeconds = ( Totals.FormatSeconds - StartTotals.FormatSeconds ) + ( Totals.CompressSeconds - StartTotals.CompressSeconds );
+
+	FCapsaBenchmarkContext Context;
+	FCapsaBenchmarkResult& Result = Context.AddResult( TEXT( "LoadGen" ) );
+	Result.AddMetric( TEXT( "TargetLinesPerSecond" ), Settings.LinesPerSecond );
+	Result.AddMetric( TEXT( "Threads" ), Settings.NumThreads );
+	Result.AddMetric( TEXT( "Seconds" ), Elapsed );
+	Result.AddMetric( TEXT( "LinesEmitted" ), Emitted );
+	Result.AddMetric( TEXT( "EmittedLinesPerSecond" ), Emitted / LoadSeconds );
+	Result.AddMetric( TEXT( "LinesCaptured" ), Captured );
+	Result.AddMetric( TEXT( "LinesFiltered" ), Filtered );
+	Result.AddMetric( TEXT( "LinesDropped" ), Dropped );
+	Result.AddMetric( TEXT( "LinesDelivered" ), Delivered );
+	Result.AddMetric( TEXT( "DropRatio" ), Captured > 0 ? static_cast<double>( Dropped ) / Captured : 0.0 );
+	Result.AddMetric( TEXT( "UndeliveredRatio" ), Captured > Delivered ? static_cast<double>( Captured - Delivered ) / Captured : 0.0 );
+	Result.AddMetric( TEXT( "DeliveryLatencyP50Milliseconds" ), Snapshot.DeliveryLatencyP50Milliseconds );
+	Result.AddMetric( TEXT( "DeliveryLatencyP95Milliseconds" ), Snapshot.DeliveryLatencyP95Milliseconds );
+	Result.AddMetric( TEXT( "DeliveryLatencyP99Milliseconds" ), Snapshot.DeliveryLatencyP99Milliseconds );
+	Result.AddMetric( TEXT( "Uploads" ), Totals.Uploads - StartTotals.Uploads );
+	Result.AddMetric( TEXT( "UploadFailures" ), Totals.UploadFailures - StartTotals.UploadFailures );
+	Result.AddMetric( TEXT( "PipelineCores" ), PipelineSeconds / Elapsed );
+	Result.AddMetric( TEXT( "ProcessCPUPercent" ), NumCPUSamples > 0 ? CPUPercentSum / NumCPUSamples : 0.0 );
+	Result.AddMetric( TEXT( "PeakBufferedBytes" ), PeakBufferedBytes );
+	Result.AddMetric( TEXT( "PeakUploadQueueDepth" ), PeakUploadQueueDepth );
+	Result.AddMetric( TEXT( "PeakUsedPhysicalGrowthBytes" ), static_cast<double>( PeakUsedPhysical ) - StartUsedPhysical );
+	if( FCapsaStandInServer::Get().IsRunning() == true )
+	{
+		Result.AddMetric( TEXT( "StandInChunks" ), FCapsaStandInServer::Get().GetNumChunks() - StartStandInChunks );
+		Result.AddMetric( TEXT( "StandInBytes" ), FCapsaStandInServer::Get().GetNumChunkBytes() - StartStandInBytes );
+	}
+	if( Settings.NumBots > 0 )
+	{
+		// BotRPCs are the ServerRegisterLinkedCapsaLog_Implementation calls, MetadataRequests the HTTP requests that were sent
+		const uint64 MetadataRequests = Totals.MetadataRequests - StartTotals.MetadataRequests;
+		Result.AddMetric( TEXT( "Bots" ), Settings.NumBots );
+		Result.AddMetric( TEXT( "BotRPCs" ), BotRegistrations );
+		Result.AddMetric( TEXT( "LinkedLogRegistrations" ), Totals.LinkedLogRegistrations - StartTotals.LinkedLogRegistrations );
+		Result.AddMetric( TEXT( "MetadataRequests" ), MetadataRequests );
+		Result.AddMetric( TEXT( "MetadataRequestsPerRPC" ), BotRegistrations > 0 ? static_cast<double>( MetadataRequests ) / BotRegistrations : 0.0 );
+		if( FCapsaStandInServer::Get().IsRunning() == true )
+		{
+			Result.AddMetric( TEXT( "StandInMetadataRequests" ), FCapsaStandInServer::Get().GetNumMetadataRequests() - StartStandInMetadataRequests );
+		}
+	}
+
+	UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaLoadGenerator::Report | %s" ), *Result.ToString() );
+
+	const FString OutputPath = FPaths::Combine( FPaths::ProjectSavedDir(), TEXT( "Capsa" ), TEXT( "LoadGen" ), FString::Printf( TEXT( "LoadGen-%s.json" ), *FDateTime::Now().ToString() ) );
+	if( FFileHelper::SaveStringToFile( Context.ToJson(), *OutputPath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM ) == true )
+	{
+		UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaLoadGenerator::Report | Written to %s" ), *FPaths::ConvertRelativePathToFull( OutputPath ) );
+	}
+}
+
+static void LoadGenCommand( const TArray<FString>& Args )
+{
+	if( Args.Num() > 0 && Args[0].Equals( TEXT( "stop" ), ESearchCase::IgnoreCase ) == true )
+	{
+		FCapsaLoadGenerator::Get().Stop();
+		return;
+	}
+
+	FCapsaLoadSettings Settings;
+	if( Args.Num() > 0 )
+	{
+		Settings.LinesPerSecond = FCString::Atod( *Args[0] );
+	}
+	if( Args.Num() > 1 )
+	{
+		Settings.NumThreads = FCString::Atoi( *Args[1] );
+	}
+	if( Args.Num() > 2 && FCapsaLoadGenerator::ParseSize( Args[2], Settings.Size ) == false )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "Capsa.LoadGen | Unknown size mix '%s', use small, mixed or large" ), *Args[2] );
+		return;
+	}
+	if( Args.Num() > 3 )
+	{
+		Settings.DurationSeconds = FCString::Atod( *Args[3] );
+	}
+	if( Args.Num() > 4 )
+	{
+		Settings.NumBots = FCString::Atoi( *Args[4] );
+	}
+	if( Args.Num() > 5 )
+	{
+		Settings.BotReconnectSeconds = FCString::Atod( *Args[5] );
+	}
+
+	FCapsaLoadGenerator::Get().Start( Settings );
+}
+
+static FAutoConsoleCommand CVarCapsaLoadGen(
+	TEXT( "Capsa.LoadGen" ),
+	TEXT( "Logs synthetic lines from several threads and reports delivery, drops and cost. " )
+	TEXT( "Usage: Capsa.LoadGen [LinesPerSecond=1000] [Threads=4] [small|mixed|large] [Seconds=60] [Bots=0] [BotReconnectSeconds=10], or Capsa.LoadGen stop" ),
+	FConsoleCommandWithArgsDelegate::CreateStatic( LoadGenCommand ),
+	ECVF_Default );
+
+static void StandInCommand( const TArray<FString>& Args )
+{
+	if( Args.Num() > 0 && Args[0].Equals( TEXT( "stop" ), ESearchCase::IgnoreCase ) == true )
+	{
+		FCapsaStandInServer::Get().Stop();
+		return;
+	}
+
+	const uint32 Port = Args.Num() > 0 ? FCString::Atoi( *Args[0] ) : FCapsaStandInServer::DefaultPort;
+	const double LatencySeconds = Args.Num() > 1 ? FCString::Atod( *Args[1] ) / 1000.0 : 0.0;
+	const float FailureRate = Args.Num() > 2 ? FCString::Atof( *Args[2] ) : 0.f;
+	FCapsaStandInServer::Get().Start( Port, LatencySeconds, FailureRate );
+}
+
+static FAutoConsoleCommand CVarCapsaStandIn(
+	TEXT( "Capsa.StandIn" ),
+	TEXT( "Starts a local stand-in for the Capsa Server, see FCapsaStandInServer. " )
+	TEXT( "Usage: Capsa.StandIn [Port=8787] [LatencyMs=0] [FailureRate=0], or Capsa.StandIn stop" ),
+	FConsoleCommandWithArgsDelegate::CreateStatic( StandInCommand ),
+	ECVF_Default );
+
+static void StandInPolicyCommand( const TArray<FString>& Args )
+{
+	if( Args.Num() == 0 || Args[0].Equals( TEXT( "clear" ), ESearchCase::IgnoreCase ) == true )
+	{
+		FCapsaStandInServer::Get().SetLogPolicy( FString() );
+		return;
+	}
+
+	// The console splits arguments on spaces, join them back into the JSON object
+	FCapsaStandInServer::Get().SetLogPolicy( FString::Join( Args, TEXT( " " ) ) );
+}
+
+static FAutoConsoleCommand CVarCapsaStandInPolicy(
+	TEXT( "Capsa.StandIn.Policy" ),
+	TEXT( "Sets the log policy the stand-in returns with every auth and metadata response, see FCapsaLogPolicy. " )
+	TEXT( "Usage: Capsa.StandIn.Policy {\"verbosity\":\"Log\"}, or Capsa.StandIn.Policy clear" ),
+	FConsoleCommandWithArgsDelegate::CreateStatic( StandInPolicyCommand ),
+	ECVF_Default );
@@ -0,0 +1,188 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#include "LoadGen/CapsaStandInServer.h"
+
+#include "CapsaCoreJson.h"
+#include "CapsaTools.h"
+#include "Settings/CapsaSettings.h"
+
+#include "Containers/Ticker.h"
+#include "HttpPath.h"
+#include "HttpServerModule.h"
+#include "HttpServerRequest.h"
+#include "HttpServerResponse.h"
+#include "IHttpRouter.h"
+
+
+FCapsaStandInServer& FCapsaStandInServer::Get()
+{
+	static FCapsaStandInServer Server;
+	return Server;
+}
+
+bool FCapsaStandInServer::Start( uint32 InPort, double InLatencySeconds, float InFailureRate )
+{
+	if( IsRunning() == true )
+	{
+		return true;
+	}
+
+	Port = InPort;
+	LatencySeconds = FMath::Max( InLatencySeconds, 0.0 );
+	FailureRate = FMath::Clamp( InFailureRate, 0.f, 1.f );
+
+	Router = FHttpServerModule::Get().GetHttpRouter( Port, true );
+	if( Router.IsValid() == false )
+	{
+		UE_LOG( LogCapsaTools, Error, TEXT( "FCapsaStandInServer::Start | Failed to listen on port %u" ), Port );
+		return false;
+	}
+
+	// The endpoints of UCapsaSettings
+	RouteHandles.Add( Router->BindRoute( FHttpPath( TEXT( "/v1/client/auth" ) ), EHttpServerRequestVerbs::VERB_POST,
+		FHttpRequestHandler::CreateLambda( [this]( const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete )
+			{
+				++NumSessions;
+				const FString LogID = FString::Printf( TEXT( "standin-%llu-%s" ), NumSessions, *FGuid::NewGuid().ToString( EGuidFormats::Digits ).ToLower() );
+				Respond( OnComplete, 200, FString::Printf( TEXT( "{\"token\":\"standin\",\"logId\":\"%s\",\"linkWeb\":\"http://%s/log/%s\",\"expiry\":\"%s\"%s}" ),
+					*LogID, *GetServerURL(), *LogID, *( FDateTime::UtcNow() + FTimespan::FromDays( 1.0 ) ).ToIso8601(), *GetLogPolicyMember( true ) ) );
+				return true;
+			} ) ) );
+
+	RouteHandles.Add( Router->BindRoute( FHttpPath( TEXT( "/v1/client/log/chunk" ) ), EHttpServerRequestVerbs::VERB_POST,
+		FHttpRequestHandler::CreateRaw( this, &FCapsaStandInServer::HandleChunk ) ) );
+
+	RouteHandles.Add( Router->BindRoute( FHttpPath( TEXT( "/v1/client/log/metadata" ) ), EHttpServerRequestVerbs::VERB_POST,
+		FHttpRequestHandler::CreateLambda( [this]( const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete )
+			{
+				++NumMetadataRequests;
+				Respond( OnComplete, 200, FString::Printf( TEXT( "{%s}" ), *GetLogPolicyMember( false ) ) );
+				return true;
+			} ) ) );
+
+	FHttpServerModule::Get().StartAllListeners();
+
+	UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaStandInServer::Start | Listening on %s, latency %.0f ms, failure rate %.2f" ), *GetServerURL(), LatencySeconds * 1000.0, FailureRate );
+
+	const FString CapsaServerURL = GetDefault<UCapsaSettings>()->GetCapsaServerURL();
+	if( CapsaServerURL.Equals( GetServerURL() ) == false )
+	{
+		UE_LOG( LogCapsaTools, Warning, TEXT( "FCapsaStandInServer::Start | CapsaServerURL is %s, logs are not sent to the stand-in. See FCapsaStandInServer." ), *CapsaServerURL );
+	}
+
+	return true;
+}
+
+void FCapsaStandInServer::Stop()
+{
+	if( IsRunning() == false )
+	{
+		return;
+	}
+
+	for( const FHttpRouteHandle& RouteHandle : RouteHandles )
+	{
+		Router->UnbindRoute( RouteHandle );
+	}
+	RouteHandles.Empty();
+	Router.Reset();
+
+	UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaStandInServer::Stop | Received %llu chunks, %llu bytes, failed %llu, %llu metadata requests" ), NumChunks, NumChunkBytes, NumFailedChunks, NumMetadataRequests );
+}
+
+bool FCapsaStandInServer::IsRunning() const
+{
+	return Router.IsValid() == true;
+}
+
+bool FCapsaStandInServer::SetLogPolicy( const FString& InLogPolicyJson )
+{
+	if( InLogPolicyJson.IsEmpty() == false )
+	{
+		// Read it the way the plugin will, so a typo does not silently leave the policy unapplied
+		const FTCHARToUTF8 Json( *FString::Printf( TEXT( "{\"policy\":%s}" ), *InLogPolicyJson ) );
+		TOptional<FCapsaLogPolicy> Policy;
+		if( UCapsaCoreJsonHelpers::ReadLogPolicy( TConstArrayView<uint8>( reinterpret_cast<const uint8*>( Json.Get() ), Json.Length() ), Policy ) == false || Policy.IsSet() == false )
+		{
+			UE_LOG( LogCapsaTools, Error, TEXT( "FCapsaStandInServer::SetLogPolicy | Invalid log policy: %s" ), *InLogPolicyJson );
+			return false;
+		}
+	}
+
+	LogPolicyJson = InLogPolicyJson;
+
+	UE_LOG( LogCapsaTools, Display, TEXT( "FCapsaStandInServer::SetLogPolicy | %s" ), LogPolicyJson.IsEmpty() == true ? TEXT( "Cleared the log policy" ) : *LogPolicyJson );
+	return true;
+}
+
+FString FCapsaStandInServer::GetLogPolicyMember( bool bAppend ) const
+{
+	if( LogPolicyJson.IsEmpty() == true )
+	{
+		return FString();
+	}
+
+	return FString::Printf( TEXT( "%s\"policy\":%s" ), bAppend == true ? TEXT( "," ) : TEXT( "" ), *LogPolicyJson );
+}
+
+FString FCapsaStandInServer::GetServerURL() const
+{
+	return FString::Printf( TEXT( "127.0.0.1:%u" ), Port );
+}
+
+uint64 FCapsaStandInServer::GetNumChunks() const
+{
+	return NumChunks;
+}
+
+uint64 FCapsaStandInServer::GetNumChunkBytes() const
+{
+	return NumChunkBytes;
+}
+
+uint64 FCapsaStandInServer::GetNumFailedChunks() const
+{
+	return NumFailedChunks;
+}
+
+uint64 FCapsaStandInServer::GetNumMetadataRequests() const
+{
+	return NumMetadataRequests;
+}
+
+bool FCapsaStandInServer::HandleChunk( const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete )
+{
+	if( FailureRate > 0.f && FMath::FRand() < FailureRate )
+	{
+		++NumFailedChunks;
+		Respond( OnComplete, 503, TEXT( "{\"error\":\"stand-in failure\"}" ) );
+		return true;
+	}
+
+	++NumChunks;
+	NumChunkBytes += Request.Body.Num();
+	Respond( OnComplete, 200, TEXT( "{}" ) );
+	return true;
+}
+
+void FCapsaStandInServer::Respond( const FHttpResultCallback& OnComplete, int32 ResponseCode, const FString& Body ) const
+{
+	auto SendResponse = [OnComplete, ResponseCode, Body]()
+		{
+			TUniquePtr<FHttpServerResponse> Response = FHttpServerResponse::Create( Body, TEXT( "application/json" ) );
+			Response->Code = static_cast<EHttpServerResponseCodes>( ResponseCode );
+			OnComplete( MoveTemp( Response ) );
+		};
+
+	if( LatencySeconds <= 0.0 )
+	{
+		SendResponse();
+		return;
+	}
+
+	FTSTicker::GetCoreTicker().AddTicker( FTickerDelegate::CreateLambda( [SendResponse]( float DeltaTime )
+		{
+			SendResponse();
+			return false;
+		} ), static_cast<float>( LatencySeconds ) );
+}
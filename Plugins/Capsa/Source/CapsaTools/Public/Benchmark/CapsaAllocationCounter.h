@@ -0,0 +1,41 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+* Counts heap allocations per thread, so benchmarks can report allocations per line or per chunk.
+*
+* The counting proxy wraps GMalloc, forwarding every call to the original allocator and counting Malloc and
+* Realloc calls of the calling thread. It is installed once when the CapsaTools module starts, with
+* -CapsaCountAllocations or when running the CapsaPerf commandlet, and stays installed for the rest of the
+* process, so the allocator never changes while a benchmark or any other thread is allocating.
+* Allocations that bypass GMalloc (for example an inlined allocator in monolithic builds) are not counted.
+*/
+class CAPSATOOLS_API FCapsaAllocationCounter
+{
+public:
+
+	/**
+	* Installs the counting proxy if the command line asks for it. Called by FCapsaToolsModule::StartupModule,
+	* before the benchmarks start any thread. Does nothing if it is already installed.
+	*/
+	static void						InstallAtStartup();
+
+	/**
+	* Returns whether the counting proxy is installed.
+	*
+	* @return bool True if allocations are being counted.
+	*/
+	static bool						IsInstalled();
+
+	/**
+	* Returns the number of allocations the calling thread made since the proxy was installed.
+	* Take the difference of two calls to count the allocations of a piece of code.
+	*
+	* @return uint64 The number of allocations of the calling thread.
+	*/
+	static uint64					GetThreadAllocations();
+};
@@ -0,0 +1,157 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+* The measurements of a single benchmark case.
+*/
+struct CAPSATOOLS_API FCapsaBenchmarkResult
+{
+	/**
+	* The name of the benchmark case, for example "TemplateMiner.Template".
+	*/
+	FString							Name;
+
+	/**
+	* The measured values, in the order they were added.
+	*/
+	TArray<TPair<FString, double>>	Metrics;
+
+	/**
+	* Adds a measured value.
+	*
+	* @param MetricName The name of the metric, including the unit, for example "CompressedBytes" or "Seconds".
+	* @param Value The measured value.
+	*/
+	void							AddMetric( const FString& MetricName, double Value );
+
+	/**
+	* Returns the result as a single line for printing/logging purposes.
+	*
+	* @return FString string representation of the result.
+	*/
+	FString							ToString() const;
+};
+
+/**
+* Passed to every benchmark, collects the results of a benchmark run.
+*/
+class CAPSATOOLS_API FCapsaBenchmarkContext
+{
+public:
+
+	/**
+	* @param InScale Multiplier for the amount of work done by each benchmark.
+	*/
+	explicit FCapsaBenchmarkContext( double InScale = 1.0 );
+
+	/**
+	* Starts a new result.
+	*
+	* @param Name The name of the benchmark case.
+	* @return FCapsaBenchmarkResult The result to add metrics to.
+	*/
+	FCapsaBenchmarkResult&			AddResult( const FString& Name );
+
+	/**
+	* Scales an amount of work by the context Scale.
+	*
+	* @param Count The unscaled amount.
+	* @return int32 The scaled amount, at least 1.
+	*/
+	int32							Scaled( int32 Count ) const;
+
+	/**
+	* Returns all results collected so far.
+	*
+	* @return TArray<FCapsaBenchmarkResult> The results.
+	*/
+	const TArray<FCapsaBenchmarkResult>& GetResults() const;
+
+	/**
+	* Sets the log file benchmarks use as recorded data, next to their synthetic data.
+	*
+	* @param InRecordedLogPath The path to a log file written by Unreal, empty to use the log file of this process.
+	*/
+	void							SetRecordedLogPath( const FString& InRecordedLogPath );
+
+	/**
+	* Returns the log file benchmarks use as recorded data.
+	*
+	* @return FString The path to the log file.
+	*/
+	FString							GetRecordedLogPath() const;
+
+	/**
+	* Returns the results as a JSON document, for CI to compare runs.
+	* {"Scale": 1.0, "Results": [{"Name": "...", "Metrics": {"Seconds": 1.0, ...}}, ...]}
+	*
+	* @return FString The JSON document.
+	*/
+	FString							ToJson() const;
+
+	/**
+	* Compares the results against a baseline written by ToJson in an earlier run, and logs every regression.
+	* Metrics ending in "PerSecond" or "Ratio" should go up, metrics ending in "Seconds", "PerLine" or
+	* "PerChunk" should go down, other metrics are informational.
+	*
+	* @param BaselinePath The path to the baseline results.
+	* @param MaxRegression The fraction a metric may get worse before it counts as a regression.
+	* @return int32 The number of regressed metrics, or -1 if the baseline could not be read.
+	*/
+	int32							CompareToBaseline( const FString& BaselinePath, double MaxRegression ) const;
+
+private:
+
+	TArray<FCapsaBenchmarkResult>	Results;
+	double							Scale;
+	FString							RecordedLogPath;
+};
+
+typedef TFunction<void( FCapsaBenchmarkContext& )> FCapsaBenchmarkFunction;
+
+/**
+* Registry of all Capsa benchmarks. Benchmarks register themselves at static initialization
+* through FCapsaBenchmarkRegistration and are run by the Capsa.Bench console command.
+*/
+class CAPSATOOLS_API FCapsaBenchmarkRegistry
+{
+public:
+
+	static FCapsaBenchmarkRegistry&	Get();
+
+	/**
+	* Registers a benchmark.
+	*
+	* @param Name The unique name of the benchmark.
+	* @param Function The function that runs the benchmark.
+	*/
+	void							Register( const FString& Name, FCapsaBenchmarkFunction Function );
+
+	/**
+	* Runs every benchmark whose name contains Filter, and logs the results.
+	*
+	* @param Filter Only benchmarks containing this string are run. Empty runs all benchmarks.
+	* @param Context Collects the results.
+	* @return int32 The number of benchmarks run.
+	*/
+	int32							Run( const FString& Filter, FCapsaBenchmarkContext& Context ) const;
+
+private:
+
+	TArray<TPair<FString, FCapsaBenchmarkFunction>> Benchmarks;
+};
+
+/**
+* Registers a benchmark with the FCapsaBenchmarkRegistry when constructed, use as a static.
+*/
+struct FCapsaBenchmarkRegistration
+{
+	FCapsaBenchmarkRegistration( const TCHAR* Name, FCapsaBenchmarkFunction Function )
+	{
+		FCapsaBenchmarkRegistry::Get().Register( Name, MoveTemp( Function ) );
+	}
+};
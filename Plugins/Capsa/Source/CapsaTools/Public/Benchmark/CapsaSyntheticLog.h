@@ -0,0 +1,45 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/OutputDevice.h"
+
+
+/**
+* Generates a deterministic, realistic looking mix of log lines for benchmarks.
+* Lines are drawn from a fixed set of message shapes across several categories and
+* verbosities, with variable parts (IDs, positions, durations, names) filled from a seeded stream.
+*/
+class CAPSATOOLS_API FCapsaSyntheticLog
+{
+public:
+
+	/**
+	* @param Seed The seed for the random stream, the same seed always generates the same lines.
+	*/
+	explicit FCapsaSyntheticLog( int32 Seed = 1337 );
+
+	/**
+	* Generates NumLines lines, spaced StepSeconds apart starting at StartTime.
+	*
+	* @param NumLines The number of lines to generate.
+	* @param OutLines The array to append the lines to.
+	* @param StartTime The Time of the first line, in unix seconds.
+	* @param StepSeconds The Time between two lines.
+	*/
+	void							Generate( int32 NumLines, TArray<FBufferedLine>& OutLines, double StartTime = 1700000000.0, double StepSeconds = 0.001 );
+
+	/**
+	* Generates the message of a single line.
+	*
+	* @param OutCategory Receives the category of the line.
+	* @param OutVerbosity Receives the verbosity of the line.
+	* @return FString The message.
+	*/
+	FString							MakeLine( FName& OutCategory, ELogVerbosity::Type& OutVerbosity );
+
+private:
+
+	FRandomStream					Stream;
+};
@@ -0,0 +1,21 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Modules/ModuleManager.h"
+
+DECLARE_LOG_CATEGORY_EXTERN( LogCapsaTools, Log, All );
+
+/**
+* Developer tools for the Capsa plugin: benchmarks and load generation.
+* Only loaded in builds with developer tools, never in Shipping.
+*/
+class FCapsaToolsModule : public IModuleInterface
+{
+public:
+
+	/** IModuleInterface implementation */
+	virtual void			StartupModule() override;
+	virtual void			ShutdownModule() override;
+};
@@ -0,0 +1,33 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "CapsaPerfCommandlet.generated.h"
+
+
+/**
+* Runs the Capsa benchmarks headless and writes the results as JSON, for CI.
+* Allocations are counted by FCapsaAllocationCounter, installed when the CapsaTools module starts.
+*
+* Usage: UnrealEditor-Cmd <Project> -run=CapsaPerf -nullrhi [-Filter=<Name>] [-Scale=<Scale>]
+*	[-Output=<File.json>] [-RecordedLog=<File.log>] [-Baseline=<File.json>] [-MaxRegression=<Fraction>]
+*
+* With -Baseline, every metric that is also in the baseline and has a known direction is compared,
+* and the commandlet fails if any of them got worse by more than MaxRegression (default 0.25).
+* See FCapsaBenchmarkContext::CompareToBaseline.
+*/
+UCLASS()
+class UCapsaPerfCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UCapsaPerfCommandlet();
+
+	// UCommandlet
+	virtual int32					Main( const FString& Params ) override;
+	// ~UCommandlet
+};
@@ -0,0 +1,38 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+
+#include "CapsaReplayCommandlet.generated.h"
+
+
+/**
+* Replays a Capsa log recording, written by Capsa.Record or -CapsaRecord, through the Log Pipeline and writes
+* the results as JSON. The same recording gives comparable results across plugin versions and settings.
+*
+* Usage: UnrealEditor-Cmd <Project> -run=CapsaReplay -nullrhi -File=<File.capsarec> [-Speed=<Factor>]
+*	[-Format=PlainText|Template|Columnar] [-Compress=true|false] [-MaxLinesPerSubChunk=<Lines>]
+*	[-Threads=<Count>] [-MaxChunksInFlight=<Count>] [-Output=<File.json>] [-Baseline=<File.json>] [-MaxRegression=<Fraction>]
+*
+* Lines are cut into chunks the way FCapsaOutputDevice flushes, using the recorded times and the flush settings of
+* UCapsaSettings. Speed 1 submits the chunks at the recorded pace, Speed 10 ten times faster, and Speed 0 (default)
+* as fast as the pipeline accepts them. Uploads complete immediately and nothing is written to disk, so only
+* formatting and compression are measured. Settings not given on the command line come from UCapsaSettings.
+*
+* The recording holds the lines after the category limiter and the Flight Recorder, these are not replayed.
+* With -Baseline the commandlet fails on regressions, see FCapsaBenchmarkContext::CompareToBaseline.
+*/
+UCLASS()
+class UCapsaReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UCapsaReplayCommandlet();
+
+	// UCommandlet
+	virtual int32					Main( const FString& Params ) override;
+	// ~UCommandlet
+};
@@ -0,0 +1,157 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Telemetry/CapsaTelemetry.h"
+
+#include <atomic>
+
+
+class FRunnableThread;
+
+/**
+* The line length mix the load generator produces.
+*/
+enum class ECapsaLoadSize : uint8
+{
+	/** Short lines only, as generated by FCapsaSyntheticLog. */
+	Small,
+	/** Mostly short lines, with some medium lines and rare multi-kilobyte lines, like a busy server. */
+	Mixed,
+	/** Every line carries a payload of up to a few kilobytes. */
+	Large,
+};
+
+/**
+* Settings of a single load generator run.
+*/
+struct FCapsaLoadSettings
+{
+	/**
+	* The number of lines per second, over all threads.
+	*/
+	double							LinesPerSecond = 1000.0;
+
+	/**
+	* The number of threads logging at the same time.
+	*/
+	int32							NumThreads = 4;
+
+	/**
+	* The line length mix.
+	*/
+	ECapsaLoadSize					Size = ECapsaLoadSize::Mixed;
+
+	/**
+	* How long to generate load for.
+	*/
+	double							DurationSeconds = 60.0;
+
+	/**
+	* How long to wait after the load stopped for the last lines to be uploaded, before reporting.
+	*/
+	double							DrainSeconds = 15.0;
+
+	/**
+	* The number of simulated players on the server. Every bot registers its log as a linked log, like the
+	* ServerRegisterLinkedCapsaLog RPC of a joining client does, and does so again on every reconnect.
+	*/
+	int32							NumBots = 0;
+
+	/**
+	* How often every bot reconnects. The bots join and reconnect spread out over this period.
+	*/
+	double							BotReconnectSeconds = 10.0;
+};
+
+/**
+* Soak test for the Capsa log path: logs a realistic mix of categories and verbosities through GLog from
+* several threads at a fixed rate, then reports how much of it reached the Capsa Server, how long that took,
+* and what it cost. Use together with FCapsaStandInServer to soak test without a real environment.
+*
+* Started with Capsa.LoadGen, runs on the game thread ticker. Only one run at a time.
+*/
+class CAPSATOOLS_API FCapsaLoadGenerator
+{
+public:
+
+	static FCapsaLoadGenerator&		Get();
+
+	/**
+	* Starts a run. Does nothing if a run is already in progress.
+	*
+	* @param InSettings The run settings.
+	* @return bool True if the run was started.
+	*/
+	bool							Start( const FCapsaLoadSettings& InSettings );
+
+	/**
+	* Stops generating load and reports the run.
+	*/
+	void							Stop();
+
+	bool							IsRunning() const;
+
+	/**
+	* Parses "small", "mixed" or "large".
+	*
+	* @param Name The name of the size mix.
+	* @param OutSize Receives the size mix.
+	* @return bool True if Name is a known size mix.
+	*/
+	static bool						ParseSize( const FString& Name, ECapsaLoadSize& OutSize );
+
+private:
+
+	class FProducer;
+
+	bool							Tick( float DeltaTime );
+
+	/**
+	* Stops the producer threads, if they are still running.
+	*/
+	void							StopProducers();
+
+	/**
+	* Registers the linked logs of the bots that joined or reconnected since the last tick.
+	*
+	* @param Now The current time.
+	*/
+	void							TickBots( double Now );
+
+	/**
+	* Logs the results of the run and writes them as JSON to Saved/Capsa/LoadGen.
+	*/
+	void							Report();
+
+	FCapsaLoadSettings				Settings;
+	FTSTicker::FDelegateHandle		TickerHandle;
+	TArray<TUniquePtr<FProducer>>	Producers;
+	TArray<TUniquePtr<FRunnableThread>> Threads;
+	std::atomic<uint64>				LinesEmitted{ 0 };
+	std::atomic<bool>				bStopProducers{ false };
+
+	/**
+	* Values at the start of the run, and the peaks sampled every tick.
+	*/
+	double							StartTime = 0.0;
+	double							LoadEndTime = 0.0;
+	FCapsaTelemetryTotals			StartTotals;
+	double							CPUPercentSum = 0.0;
+	int32							NumCPUSamples = 0;
+	uint64							StartUsedPhysical = 0;
+	uint64							PeakUsedPhysical = 0;
+	int64							PeakBufferedBytes = 0;
+	int32							PeakUploadQueueDepth = 0;
+	uint64							StartStandInChunks = 0;
+	uint64							StartStandInBytes = 0;
+	uint64							StartStandInMetadataRequests = 0;
+
+	/**
+	* The log of every bot, and the number of registrations made so far.
+	*/
+	TArray<FString>					BotLogIDs;
+	uint64							BotRegistrations = 0;
+};
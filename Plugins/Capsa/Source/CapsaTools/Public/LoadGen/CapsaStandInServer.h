@@ -0,0 +1,96 @@
+// Copyright Companion Group, Ltd. Made available under the MIT license
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HttpResultCallback.h"
+#include "HttpRouteHandle.h"
+
+
+class IHttpRouter;
+struct FHttpServerRequest;
+
+/**
+* Local stand-in for the Capsa Server, for soak tests that should not load a real environment.
+* Answers the auth, log chunk and metadata endpoints on the loopback interface, optionally with an
+* added response latency and a share of failed chunk uploads. Chunks are counted and discarded.
+* A log policy set with SetLogPolicy is returned with every auth and metadata response.
+*
+* Point Capsa at it with -ini:Engine:[/Script/CapsaCore.CapsaSettings]:Protocol=http
+* -ini:Engine:[/Script/CapsaCore.CapsaSettings]:CapsaServerURL=127.0.0.1:<Port>, and start it with
+* -CapsaStandIn[=<Port>] or the Capsa.StandIn console command. Only used on the game thread.
+*/
+class CAPSATOOLS_API FCapsaStandInServer
+{
+public:
+
+	static FCapsaStandInServer&		Get();
+
+	/**
+	* Starts listening. Does nothing if the server is already running.
+	*
+	* @param InPort The port to listen on.
+	* @param InLatencySeconds The time every response is delayed by.
+	* @param InFailureRate The share of chunk uploads, 0 to 1, that is answered with a 503.
+	* @return bool True if the server is running.
+	*/
+	bool							Start( uint32 InPort = DefaultPort, double InLatencySeconds = 0.0, float InFailureRate = 0.f );
+
+	/**
+	* Stops answering requests.
+	*/
+	void							Stop();
+
+	bool							IsRunning() const;
+
+	/**
+	* Sets the log policy returned in the "policy" member of the auth and metadata responses.
+	*
+	* @param InLogPolicyJson The policy JSON object, see FCapsaLogPolicy. Empty to return no policy.
+	* @return bool True if the policy was set, false if it is not a valid policy.
+	*/
+	bool							SetLogPolicy( const FString& InLogPolicyJson );
+
+	/**
+	* Returns the URL to use as CapsaServerURL, without protocol.
+	*
+	* @return FString The host and port, for example "127.0.0.1:8787".
+	*/
+	FString							GetServerURL() const;
+
+	uint64							GetNumChunks() const;
+	uint64							GetNumChunkBytes() const;
+	uint64							GetNumFailedChunks() const;
+	uint64							GetNumMetadataRequests() const;
+
+	static constexpr uint32			DefaultPort = 8787;
+
+private:
+
+	/**
+	* Handles a chunk upload. Returns true, the response is sent by Respond.
+	*/
+	bool							HandleChunk( const FHttpServerRequest& Request, const FHttpResultCallback& OnComplete );
+
+	/**
+	* Sends the response now, or after LatencySeconds.
+	*/
+	void							Respond( const FHttpResultCallback& OnComplete, int32 ResponseCode, const FString& Body ) const;
+
+	/**
+	* Returns the "policy" member to append to a response object, including the leading comma if bAppend is true.
+	*/
+	FString							GetLogPolicyMember( bool bAppend ) const;
+
+	TSharedPtr<IHttpRouter>			Router;
+	TArray<FHttpRouteHandle>		RouteHandles;
+	uint32							Port = DefaultPort;
+	double							LatencySeconds = 0.0;
+	float							FailureRate = 0.f;
+	FString							LogPolicyJson;
+	uint64							NumSessions = 0;
+	uint64							NumChunks = 0;
+	uint64							NumChunkBytes = 0;
+	uint64							NumFailedChunks = 0;
+	uint64							NumMetadataRequests = 0;
+};
@@ -28,5 +28,5 @@ void ACapsaDemoGameMode::PreLogin( const FString& Options, const FString& Addres
 		return;
 	}
 
-	CapsaCoreSubsystem->RegisterMetadataString( TEXT("JoinedPlayerAddress"), Address );
+	CapsaCoreSubsystem->SetMetadataString( TEXT("JoinedPlayerAddress"), Address );
 }